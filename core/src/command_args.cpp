@@ -16,9 +16,13 @@ void CommandArgsParser::defineAll() {
         define('a', "addr", "Server mode address", "0.0.0.0");
         define('h', "help", "Show help");
         define('p', "port", "Server mode port", 5259);
+        define('\0', "max-clients", "Server mode maximum number of clients", 8);
+        define('\0', "net-threads", "Server mode network threads, 0 for two threads per client", 2);
         define('r', "root", "Root directory, where all config files are stored", std::filesystem::absolute(root).string());
         define('s', "server", "Run in server mode");
         define('\0', "autostart", "Automatically start the SDR after loading");
+        define('\0', "bench-convert", "Benchmark the sample conversion kernels and exit");
+        define('\0', "bench-channelizer", "Check the fused channelizer against the VFO chain, benchmark both and exit");
 }
 
 int CommandArgsParser::parse(int argc, char* argv[]) {
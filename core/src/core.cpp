@@ -19,6 +19,9 @@
 #include <stb_image_resize2.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <dsp/fft/plan_cache.h>
+#include <dsp/bench/convert_benchmark.h>
+#include <dsp/bench/channelizer_benchmark.h>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -77,6 +80,34 @@ int sdrpp_main(int argc, char* argv[]) {
         return 0;
     }
 
+    // Check the sample conversion kernels against the generic ones, benchmark them against the loops they replaced and exit if requested
+    if (core::args["bench-convert"].b()) {
+        bool pass = true;
+        for (int arch = dsp::convert::ARCH_GENERIC; arch <= dsp::convert::ARCH_AVX2; arch++) {
+            if (!dsp::convert::setArch((dsp::convert::Arch)arch)) { continue; }
+            flog::info("Sample conversion kernels: {0}", dsp::convert::getArchName((dsp::convert::Arch)arch));
+            dsp::bench::ConvertBenchmark bench;
+            for (const auto& res : bench.run()) {
+                flog::info("    {0}: {1} MS/s -> {2} MS/s ({3}x), max error {4}, {5}", res.name, res.referenceRate / 1e6, res.kernelRate / 1e6,
+                           res.kernelRate / res.referenceRate, res.maxError, res.pass ? "OK" : "FAILED");
+                pass &= res.pass;
+            }
+        }
+        return pass ? 0 : -1;
+    }
+
+    // Check that the fused channelizer matches the chain it can replace, benchmark both and exit if requested
+    if (core::args["bench-channelizer"].b()) {
+        bool pass = true;
+        dsp::bench::ChannelizerBenchmark bench;
+        for (const auto& res : bench.run()) {
+            flog::info("{0}: {1} MS/s -> {2} MS/s ({3}x), passband error {4} dB, stopband {5} dB -> {6} dB, {7}", res.name, res.chainRate / 1e6, res.fusedRate / 1e6,
+                       res.fusedRate / res.chainRate, res.passbandError, res.chainStopband, res.fusedStopband, res.pass ? "OK" : "FAILED");
+            pass &= res.pass;
+        }
+        return pass ? 0 : -1;
+    }
+
     bool serverMode = (bool)core::args["server"];
 
 #ifdef _WIN32
@@ -123,6 +154,8 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["snrSmoothingSpeed"] = 20;
     defConfig["fastFFT"] = false;
     defConfig["fftHeight"] = 300;
+    defConfig["fftMode"] = 0;
+    defConfig["fftOverlap"] = 50;
     defConfig["fftRate"] = 20;
     defConfig["fftSize"] = 65536;
     defConfig["fftWindow"] = 2;
@@ -252,6 +285,7 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["decimation"] = 1;
     defConfig["iqCorrection"] = false;
     defConfig["invertIQ"] = false;
+    defConfig["sharedChannelizer"] = false;
 
     defConfig["streams"]["Radio"]["muted"] = false;
     defConfig["streams"]["Radio"]["sink"] = "Audio";
@@ -362,6 +396,9 @@ int sdrpp_main(int argc, char* argv[]) {
 
     core::configManager.release(true);
 
+    // Reuse the FFT plans measured in previous runs
+    dsp::fft::PlanCache::getInstance().loadWisdom(root + "/fftw_wisdom.txt");
+
     if (serverMode) { return server::main(); }
 
     core::configManager.acquire();
@@ -417,6 +454,7 @@ int sdrpp_main(int argc, char* argv[]) {
     backend::end();
 
     sigpath::iqFrontEnd.stop();
+    dsp::fft::PlanCache::getInstance().saveWisdom();
 
     core::configManager.disableAutoSave();
     core::configManager.save();
@@ -0,0 +1,138 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdlib.h>
+#include <math.h>
+#include "../buffer/buffer.h"
+#include "../channel/rx_vfo.h"
+#include "../math/phasor.h"
+
+// Largest passband gain difference in dB between the fused channelizer and the chain it replaces,
+// the resampler of the chain alone has about 0.5dB of ripple
+#define CHANNELIZER_BENCH_PASSBAND_TOLERANCE    1.0
+
+// The stopband of the fused channelizer can be up to this much higher than the one of the chain...
+#define CHANNELIZER_BENCH_STOPBAND_TOLERANCE    3.0
+
+// ...or anything under this level in dB
+#define CHANNELIZER_BENCH_STOPBAND_FLOOR        -60.0
+
+namespace dsp::bench {
+    struct ChannelizerBenchResult {
+        std::string name;
+        double chainRate;
+        double fusedRate;
+        double passbandError;   // Largest gain difference in the passband, in dB
+        double chainStopband;   // Highest gain in the stopband, in dB
+        double fusedStopband;
+        bool pass;
+    };
+
+    // Checks that the fused channelizer has the same response as the translate, resample and filter chain of
+    // the RxVFO within a tolerance, using test tones in and out of the channel, then compares their throughput.
+    // Rates are in input samples per second.
+    class ChannelizerBenchmark {
+    public:
+        ChannelizerBenchmark(int bufferSize = 65536, int durationMs = 200) {
+            _bufferSize = bufferSize;
+            _durationMs = durationMs;
+        }
+
+        std::vector<ChannelizerBenchResult> run() {
+            std::vector<ChannelizerBenchResult> results;
+            results.push_back(runConfig("NFM 2.4MS/s -> 48KS/s", 2400000.0, 48000.0, 12500.0, 312500.0));
+            results.push_back(runConfig("Pager 2.4MS/s -> 24KS/s", 2400000.0, 24000.0, 12500.0, -650000.0));
+            results.push_back(runConfig("SSB 10MS/s -> 12KS/s", 10000000.0, 12000.0, 3000.0, 1234000.0));
+            results.push_back(runConfig("WFM 10MS/s -> 250KS/s", 10000000.0, 250000.0, 150000.0, -2500000.0));
+            return results;
+        }
+
+    private:
+        ChannelizerBenchResult runConfig(std::string name, double inSamplerate, double outSamplerate, double bandwidth, double offset) {
+            ChannelizerBenchResult res;
+            res.name = name;
+
+            channel::RxVFO chain(NULL, inSamplerate, outSamplerate, bandwidth, offset);
+            channel::RxVFO fused(NULL, inSamplerate, outSamplerate, bandwidth, offset);
+            fused.setFused(true);
+            chain.setMaxInputSize(_bufferSize);
+            fused.setMaxInputSize(_bufferSize);
+            complex_t* in = buffer::alloc<complex_t>(_bufferSize);
+            complex_t* out = buffer::alloc<complex_t>(std::max<int>(chain.getOutputSize(_bufferSize), fused.getOutputSize(_bufferSize)));
+
+            // Passband, tones across most of the channel
+            res.passbandError = 0.0;
+            for (double pos = -0.4; pos <= 0.41; pos += 0.1) {
+                double freq = offset + (pos * bandwidth);
+                double chainGain = measureGain(chain, in, out, freq, inSamplerate);
+                double fusedGain = measureGain(fused, in, out, freq, inSamplerate);
+                res.passbandError = std::max<double>(res.passbandError, fabs(fusedGain - chainGain));
+            }
+
+            // Stopband, tones that would alias into the channel if not rejected
+            res.chainStopband = -INFINITY;
+            res.fusedStopband = -INFINITY;
+            double edge = std::max<double>(bandwidth, outSamplerate);
+            for (double dist : { 1.0, 1.5, 2.5, 4.0 }) {
+                for (double sign : { -1.0, 1.0 }) {
+                    double freq = offset + (sign * dist * edge);
+                    if (fabs(freq) >= inSamplerate / 2.0) { continue; }
+                    res.chainStopband = std::max<double>(res.chainStopband, measureGain(chain, in, out, freq, inSamplerate));
+                    res.fusedStopband = std::max<double>(res.fusedStopband, measureGain(fused, in, out, freq, inSamplerate));
+                }
+            }
+
+            res.pass = (res.passbandError <= CHANNELIZER_BENCH_PASSBAND_TOLERANCE) &&
+                       (res.fusedStopband <= std::max<double>(res.chainStopband + CHANNELIZER_BENCH_STOPBAND_TOLERANCE, CHANNELIZER_BENCH_STOPBAND_FLOOR));
+
+            // Throughput on noise
+            for (int i = 0; i < _bufferSize; i++) {
+                in[i].re = ((float)rand() / (float)RAND_MAX) - 0.5f;
+                in[i].im = ((float)rand() / (float)RAND_MAX) - 0.5f;
+            }
+            res.chainRate = measure([&]() { chain.process(_bufferSize, in, out); });
+            res.fusedRate = measure([&]() { fused.process(_bufferSize, in, out); });
+
+            buffer::free(in);
+            buffer::free(out);
+            return res;
+        }
+
+        // Gain in dB of a tone at the given baseband frequency, measured once the filters have settled
+        double measureGain(channel::RxVFO& vfo, complex_t* in, complex_t* out, double freq, double samplerate) {
+            vfo.reset();
+            double omega = 2.0 * FL_M_PI * freq / samplerate;
+            double power = 0.0;
+            int measured = 0;
+            int64_t n = 0;
+            for (int blk = 0; blk < 8; blk++) {
+                for (int i = 0; i < _bufferSize; i++) { in[i] = math::phasor(omega * (double)(n++)); }
+                int count = vfo.process(_bufferSize, in, out);
+                if (blk < 4) { continue; }
+                for (int i = 0; i < count; i++) { power += out[i].amplitude() * out[i].amplitude(); }
+                measured += count;
+            }
+            return 10.0 * log10(std::max<double>(power / (double)std::max<int>(measured, 1), 1e-20));
+        }
+
+        double measure(std::function<void()> func) {
+            // Warm up then count the buffers processed in the given time
+            func();
+            int64_t count = 0;
+            auto start = std::chrono::steady_clock::now();
+            auto end = start + std::chrono::milliseconds(_durationMs);
+            auto now = start;
+            while (now < end) {
+                func();
+                count++;
+                now = std::chrono::steady_clock::now();
+            }
+            return (double)(count * _bufferSize) / std::chrono::duration<double>(now - start).count();
+        }
+
+        int _bufferSize;
+        int _durationMs;
+    };
+}
\ No newline at end of file
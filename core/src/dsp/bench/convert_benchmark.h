@@ -0,0 +1,202 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <stdlib.h>
+#include <math.h>
+#include <volk/volk.h>
+#include "../buffer/buffer.h"
+#include "../convert/samples.h"
+
+// Largest difference allowed between a kernel and the generic one, FMA and the order of the operations
+// only change the last bits of the result
+#define CONVERT_BENCH_TOLERANCE     1e-5
+
+// Number of samples after the end of the output checked for writes past it
+#define CONVERT_BENCH_GUARD         16
+
+namespace dsp::bench {
+    struct ConvertBenchResult {
+        std::string name;
+        double referenceRate;
+        double kernelRate;
+        double maxError;    // Largest difference with the generic kernel, infinite if the kernel wrote past its output
+        bool pass;
+    };
+
+    // Checks that the sample conversion kernels in use give the same results as the generic ones, with and without
+    // correction, on odd lengths and misaligned buffers. Then compares them with the loops the sources used before,
+    // rates are in samples per second.
+    class ConvertBenchmark {
+    public:
+        ConvertBenchmark(int bufferSize = 65536, int durationMs = 200) {
+            _bufferSize = bufferSize;
+            _durationMs = durationMs;
+        }
+
+        std::vector<ConvertBenchResult> run() {
+            // Random input, big enough for any of the formats
+            uint8_t* in = buffer::alloc<uint8_t>(_bufferSize * 4);
+            for (int i = 0; i < _bufferSize * 4; i++) { in[i] = rand(); }
+            const int16_t* inPlanarQ = (const int16_t*)&in[_bufferSize * 2];
+            complex_t* out = buffer::alloc<complex_t>(_bufferSize);
+            int n = _bufferSize;
+            convert::IQCorrection corr = convert::IQCorrection::fromImbalance(0.01f, -0.02f, 1.05f, 0.03f);
+
+            std::vector<ConvertBenchResult> results;
+            results.push_back({
+                "u8 (rtl_sdr)",
+                measure([=]() {
+                    for (int i = 0; i < n; i++) {
+                        out[i].re = ((float)in[i * 2] - 127.4) / 128.0f;
+                        out[i].im = ((float)in[(i * 2) + 1] - 127.4) / 128.0f;
+                    }
+                }),
+                measure([=]() { convert::u8ToComplex(out, in, n, 127.4f, 1.0f / 128.0f); }),
+                check([=](complex_t* _out, int offset, int count, const convert::IQCorrection* _corr) {
+                    convert::u8ToComplex(_out, &in[offset], count, 127.4f, 1.0f / 128.0f, _corr);
+                }, &corr)
+            });
+            results.push_back({
+                "u8 (rtl_tcp)",
+                measure([=]() {
+                    for (int i = 0; i < n; i++) {
+                        out[i].re = ((double)in[i * 2] - 128.0) / 128.0;
+                        out[i].im = ((double)in[(i * 2) + 1] - 128.0) / 128.0;
+                    }
+                }),
+                measure([=]() { convert::u8ToComplex(out, in, n, 128.0f, 1.0f / 128.0f); }),
+                check([=](complex_t* _out, int offset, int count, const convert::IQCorrection* _corr) {
+                    convert::u8ToComplex(_out, &in[offset], count, 128.0f, 1.0f / 128.0f, _corr);
+                }, &corr)
+            });
+            results.push_back({
+                "i8",
+                measure([=]() { volk_8i_s32f_convert_32f((float*)out, (const int8_t*)in, 128.0f, n * 2); }),
+                measure([=]() { convert::i8ToComplex(out, (const int8_t*)in, n, 1.0f / 128.0f); }),
+                check([=](complex_t* _out, int offset, int count, const convert::IQCorrection* _corr) {
+                    convert::i8ToComplex(_out, (const int8_t*)&in[offset], count, 1.0f / 128.0f, _corr);
+                }, &corr)
+            });
+            results.push_back({
+                "i12 (sample stream decompressor)",
+                measure([=]() {
+                    const uint8_t* _in = in;
+                    float scale = 1.0f / 2047.0f;
+                    for (int i = 0; i < n; i++) {
+                        int re = (_in[0] | (_in[1] << 8)) & 0xFFF;
+                        int im = (_in[1] >> 4) | (_in[2] << 4);
+                        out[i].re = (float)((re ^ 0x800) - 0x800) * scale;
+                        out[i].im = (float)((im ^ 0x800) - 0x800) * scale;
+                        _in += 3;
+                    }
+                }),
+                measure([=]() { convert::i12ToComplex(out, in, n, 1.0f / 2047.0f); }),
+                check([=](complex_t* _out, int offset, int count, const convert::IQCorrection* _corr) {
+                    convert::i12ToComplex(_out, &in[offset], count, 1.0f / 2047.0f, _corr);
+                }, &corr)
+            });
+            results.push_back({
+                "i16",
+                measure([=]() { volk_16i_s32f_convert_32f((float*)out, (const int16_t*)in, 32768.0f, n * 2); }),
+                measure([=]() { convert::i16ToComplex(out, (const int16_t*)in, n, 1.0f / 32768.0f); }),
+                check([=](complex_t* _out, int offset, int count, const convert::IQCorrection* _corr) {
+                    convert::i16ToComplex(_out, &((const int16_t*)in)[offset], count, 1.0f / 32768.0f, _corr);
+                }, &corr)
+            });
+            results.push_back({
+                "i16 planar",
+                measure([=]() {
+                    for (int i = 0; i < n; i++) {
+                        out[i].re = (float)((const int16_t*)in)[i] / 32768.0f;
+                        out[i].im = (float)inPlanarQ[i] / 32768.0f;
+                    }
+                }),
+                measure([=]() { convert::i16PlanarToComplex(out, (const int16_t*)in, inPlanarQ, n, 1.0f / 32768.0f); }),
+                check([=](complex_t* _out, int offset, int count, const convert::IQCorrection* _corr) {
+                    convert::i16PlanarToComplex(_out, &((const int16_t*)in)[offset], &inPlanarQ[offset], count, 1.0f / 32768.0f, _corr);
+                }, &corr)
+            });
+
+            // Fused correction against converting then correcting in a second pass
+            results.push_back({
+                "i16 + IQ correction",
+                measure([=]() {
+                    volk_16i_s32f_convert_32f((float*)out, (const int16_t*)in, 32768.0f, n * 2);
+                    for (int i = 0; i < n; i++) {
+                        float re = (out[i].re - corr.dcI) * corr.gainI;
+                        out[i].im = ((out[i].im - corr.dcQ) * corr.gainQ) + (re * corr.cross);
+                        out[i].re = re;
+                    }
+                }),
+                measure([=]() { convert::i16ToComplex(out, (const int16_t*)in, n, 1.0f / 32768.0f, &corr); }),
+                check([=](complex_t* _out, int offset, int count, const convert::IQCorrection* _corr) {
+                    convert::i16ToComplex(_out, &((const int16_t*)in)[offset], count, 1.0f / 32768.0f, _corr);
+                }, &corr)
+            });
+
+            for (auto& res : results) { res.pass = (res.maxError <= CONVERT_BENCH_TOLERANCE); }
+            buffer::free(in);
+            buffer::free(out);
+            return results;
+        }
+
+    private:
+        // Largest difference between the kernel in use and the generic one, without and with the correction.
+        // The lengths leave every possible tail after the vector loops and the buffers are offset from their alignment.
+        double check(std::function<void(complex_t* out, int offset, int count, const convert::IQCorrection* corr)> func, const convert::IQCorrection* corr) {
+            const int maxCount = 4097;
+            const int maxOffset = 4;
+            complex_t* ref = buffer::alloc<complex_t>(maxCount);
+            complex_t* test = buffer::alloc<complex_t>(maxCount + maxOffset + CONVERT_BENCH_GUARD);
+            convert::Arch arch = convert::getArch();
+            double maxError = 0.0;
+
+            for (const convert::IQCorrection* c : { (const convert::IQCorrection*)NULL, corr }) {
+                for (int count : { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 65, 1023, maxCount }) {
+                    for (int offset = 0; offset < maxOffset; offset++) {
+                        convert::setArch(convert::ARCH_GENERIC);
+                        func(ref, offset, count, c);
+                        convert::setArch(arch);
+
+                        // The output is misaligned too, followed by values that must stay untouched
+                        complex_t* out = &test[offset];
+                        for (int i = 0; i < count + CONVERT_BENCH_GUARD; i++) { out[i] = { 1234.0f, -1234.0f }; }
+                        func(out, offset, count, c);
+                        for (int i = 0; i < count; i++) {
+                            double err = std::max<double>(fabs(out[i].re - ref[i].re), fabs(out[i].im - ref[i].im));
+                            maxError = (err > maxError || std::isnan(err)) ? err : maxError;
+                        }
+                        for (int i = count; i < count + CONVERT_BENCH_GUARD; i++) {
+                            if (out[i].re != 1234.0f || out[i].im != -1234.0f) { maxError = INFINITY; }
+                        }
+                    }
+                }
+            }
+
+            buffer::free(ref);
+            buffer::free(test);
+            return std::isnan(maxError) ? INFINITY : maxError;
+        }
+
+        double measure(std::function<void()> func) {
+            // Warm up then count the buffers converted in the given time
+            func();
+            int64_t count = 0;
+            auto start = std::chrono::steady_clock::now();
+            auto end = start + std::chrono::milliseconds(_durationMs);
+            auto now = start;
+            while (now < end) {
+                func();
+                count++;
+                now = std::chrono::steady_clock::now();
+            }
+            return (double)(count * _bufferSize) / std::chrono::duration<double>(now - start).count();
+        }
+
+        int _bufferSize;
+        int _durationMs;
+    };
+}
\ No newline at end of file
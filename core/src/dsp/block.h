@@ -7,15 +7,28 @@
 #include "types.h"
 
 namespace dsp {
+    class block;
+    class scheduler;
+
+    // Runs blocks on a shared set of threads instead of one thread per block
+    class block_scheduler {
+    public:
+        virtual ~block_scheduler() {}
+        virtual void schedule(block* blk) = 0;
+        virtual void unschedule(block* blk) = 0;
+    };
+
     class generic_block {
     public:
         virtual ~generic_block() {}
         virtual void start() {}
         virtual void stop() {}
         virtual int run() { return -1; }
+        virtual void setScheduler(block_scheduler* sched) {}
     };
 
     class block : public generic_block {
+        friend class scheduler;
     public:
         virtual ~block() {
             if (!_block_init) { return; }
@@ -61,6 +74,27 @@ namespace dsp {
             }
         }
 
+        // Run the block on a scheduler instead of its own thread, NULL to go back to a dedicated thread.
+        // Only applies to blocks that use the default doStart()/doStop() and only block in read() and swap().
+        virtual void setScheduler(block_scheduler* sched) {
+            assert(_block_init);
+            std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+            tempStop();
+            _scheduler = sched;
+            tempStart();
+        }
+
+        // Check if run() can be called without blocking
+        bool isRunnable() {
+            for (auto& in : inputs) {
+                if (!in->canRead()) { return false; }
+            }
+            for (auto& out : outputs) {
+                if (!out->canWrite()) { return false; }
+            }
+            return true;
+        }
+
         virtual int run() = 0;
 
     protected:
@@ -69,6 +103,10 @@ namespace dsp {
         }
 
         virtual void doStart() {
+            if (_scheduler) {
+                _scheduler->schedule(this);
+                return;
+            }
             workerThread = std::thread(&block::workerLoop, this);
         }
 
@@ -80,6 +118,11 @@ namespace dsp {
                 out->stopWriter();
             }
 
+            // Wait for the scheduler to be done with the block
+            if (_scheduler) {
+                _scheduler->unschedule(this);
+            }
+
             // TODO: Make sure this isn't needed, I don't know why it stops
             if (workerThread.joinable()) {
                 workerThread.join();
@@ -128,5 +171,6 @@ namespace dsp {
         bool tempStopped = false;
         int tempStopDepth = 0;
         std::thread workerThread;
+        block_scheduler* _scheduler = NULL;
     };
 }
\ No newline at end of file
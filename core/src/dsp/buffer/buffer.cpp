@@ -0,0 +1,22 @@
+#include "buffer.h"
+#include <atomic>
+
+namespace dsp::buffer {
+    std::atomic<int64_t> memoryUsage[_MEMORY_USE_COUNT];
+
+    void trackMemory(MemoryUse use, int64_t bytes) {
+        memoryUsage[use].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    int64_t getMemoryUsage(MemoryUse use) {
+        return memoryUsage[use].load(std::memory_order_relaxed);
+    }
+
+    int64_t getTotalMemoryUsage() {
+        int64_t total = 0;
+        for (int i = 0; i < _MEMORY_USE_COUNT; i++) {
+            total += memoryUsage[i].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <volk/volk.h>
 #include <string.h>
+#include <stdint.h>
 
 namespace dsp::buffer {
     template<class T>
@@ -16,4 +17,38 @@ namespace dsp::buffer {
     inline void free(void* buffer) {
         volk_free(buffer);
     }
+
+    // Memory held by the DSP, counted by whoever allocates the buffers
+    enum MemoryUse {
+        MEMORY_USE_STREAMS,
+        MEMORY_USE_WORK,
+        _MEMORY_USE_COUNT
+    };
+
+    void trackMemory(MemoryUse use, int64_t bytes);
+    int64_t getMemoryUsage(MemoryUse use);
+    int64_t getTotalMemoryUsage();
+
+    // Same as alloc() and free() but counted in the memory used by the work buffers of the blocks
+    template<class T>
+    inline T* allocWork(int count) {
+        trackMemory(MEMORY_USE_WORK, (int64_t)count * sizeof(T));
+        return alloc<T>(count);
+    }
+
+    template<class T>
+    inline void freeWork(T* buffer, int count) {
+        if (!buffer) { return; }
+        trackMemory(MEMORY_USE_WORK, -(int64_t)count * sizeof(T));
+        free(buffer);
+    }
+
+    // Reallocates a work buffer to a new size, keeping the first samples
+    template<class T>
+    inline T* resizeWork(T* buffer, int count, int newCount, int keep = 0) {
+        T* newBuffer = allocWork<T>(newCount);
+        if (buffer && keep) { memcpy(newBuffer, buffer, keep * sizeof(T)); }
+        freeWork(buffer, count);
+        return newBuffer;
+    }
 }
\ No newline at end of file
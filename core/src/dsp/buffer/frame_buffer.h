@@ -1,32 +1,44 @@
 #pragma once
 #include "../block.h"
-#define TEST_BUFFER_SIZE 32
+#include <chrono>
+#include <algorithm>
+#include <stdint.h>
 
-// IMPORTANT: THIS IS TRASH AND MUST BE REWRITTEN IN THE FUTURE
+// Amount of signal the buffer can hold unless configured otherwise
+#define SAMPLE_FRAME_BUFFER_DEFAULT_LATENCY_MS  500.0
+
+// Duration of the blocks released in target-latency mode
+#define SAMPLE_FRAME_BUFFER_PACED_BLOCK_MS      10.0
+
+// Maximum relative change of the release rate used to keep the fill level at the target
+#define SAMPLE_FRAME_BUFFER_MAX_RATE_CORRECTION 0.005
 
 namespace dsp::buffer {
+    // Jitter buffer between a source and the rest of the DSP. The samples are kept in a ring sized in milliseconds
+    // of signal at the current samplerate, blocks that don't fit are dropped and counted as overruns.
+    // By default, samples are released as soon as they come in. In target-latency mode, meant for network sources,
+    // the buffer first fills up to the target then releases the samples at the samplerate, slightly adjusted to
+    // keep the fill level around the target. If it runs empty, it's counted as an underrun and fills up again.
     template <class T>
     class SampleFrameBuffer : public block {
         using base_type = block;
     public:
         SampleFrameBuffer() {}
 
-        SampleFrameBuffer(stream<T>* in) { init(in); }
+        SampleFrameBuffer(stream<T>* in, double samplerate, double latency = SAMPLE_FRAME_BUFFER_DEFAULT_LATENCY_MS) { init(in, samplerate, latency); }
 
         ~SampleFrameBuffer() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            for (int i = 0; i < TEST_BUFFER_SIZE; i++) {
-                buffer::free(buffers[i]);
-            }
+            if (ring) { buffer::free(ring); }
         }
 
-        void init(stream<T>* in) {
+        void init(stream<T>* in, double samplerate, double latency = SAMPLE_FRAME_BUFFER_DEFAULT_LATENCY_MS) {
             _in = in;
+            _samplerate = samplerate;
+            _latency = latency;
 
-            for (int i = 0; i < TEST_BUFFER_SIZE; i++) {
-                buffers[i] = buffer::alloc<T>(STREAM_BUFFER_SIZE);
-            }
+            allocate();
 
             base_type::registerInput(in);
             base_type::registerOutput(&out);
@@ -43,9 +55,83 @@ namespace dsp::buffer {
             base_type::tempStart();
         }
 
+        void setSamplerate(double samplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (samplerate == _samplerate) { return; }
+            base_type::tempStop();
+            _samplerate = samplerate;
+            allocate();
+            base_type::tempStart();
+        }
+
+        // Maximum amount of buffered signal in milliseconds
+        void setLatency(double latency) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (latency == _latency) { return; }
+            base_type::tempStop();
+            _latency = latency;
+            allocate();
+            base_type::tempStart();
+        }
+
+        // Amount of buffered signal to keep in milliseconds, 0 to release the samples as soon as they come in.
+        // The ring is grown to twice the target if needed
+        void setTargetLatency(double targetLatency) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (targetLatency == _targetLatency) { return; }
+            base_type::tempStop();
+            _targetLatency = std::max<double>(targetLatency, 0.0);
+            allocate();
+            base_type::tempStart();
+        }
+
+        // Pass the blocks through without buffering them
+        void setBypass(bool bypass) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (bypass == _bypass) { return; }
+            base_type::tempStop();
+            _bypass = bypass;
+            readPos = 0;
+            fill = 0;
+            base_type::tempStart();
+        }
+
+        double getLatency() { return _latency; }
+        double getTargetLatency() { return _targetLatency; }
+        bool getBypass() { return _bypass; }
+
+        // Buffered signal in milliseconds
+        double getFillLevel() {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            return (double)fill * 1000.0 / _samplerate;
+        }
+
+        // Size of the ring in milliseconds
+        double getCapacity() {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            return (double)capacity * 1000.0 / _samplerate;
+        }
+
+        // Blocks dropped because the ring was full
+        uint64_t getOverruns() { return overruns; }
+
+        // Times the ring ran empty in target-latency mode
+        uint64_t getUnderruns() { return underruns; }
+
+        void resetCounters() {
+            overruns = 0;
+            underruns = 0;
+        }
+
         void flush() {
-            std::unique_lock lck(bufMtx);
-            readCur = writeCur;
+            std::lock_guard<std::mutex> lck(bufMtx);
+            readPos = 0;
+            fill = 0;
+            primed = false;
         }
 
         int run() {
@@ -53,20 +139,37 @@ namespace dsp::buffer {
             int count = _in->read();
             if (count < 0) { return -1; }
 
-            if (bypass) {
-                memcpy(out.writeBuf, _in->readBuf, count * sizeof(T));
+            if (_bypass) {
+                // Follow the block size declared by the source
+                int size = std::max<int>(_in->getBufferSize(), count);
+                if (out.getBufferSize() != size) { out.setBufferSize(size); }
+                T* buf = _in->exchangeReadBuf(out.writeBuf, size);
+                if (buf) {
+                    out.writeBuf = buf;
+                }
+                else {
+                    memcpy(out.writeBuf, _in->readBuf, count * sizeof(T));
+                }
                 _in->flush();
                 if (!out.swap(count)) { return -1; }
                 return count;
             }
 
-            // Push it on the ring buffer
+            // Copy into the ring, the block is dropped if it doesn't fit
             {
                 std::lock_guard<std::mutex> lck(bufMtx);
-                memcpy(buffers[writeCur], _in->readBuf, count * sizeof(T));
-                sizes[writeCur] = count;
-                writeCur++;
-                writeCur = ((writeCur) % TEST_BUFFER_SIZE);
+                inBlockSize = std::max<int>(_in->getBufferSize(), count);
+                if (count > capacity) { grow(count); }
+                if (fill + count <= capacity) {
+                    int writePos = (readPos + fill) % capacity;
+                    int first = std::min<int>(count, capacity - writePos);
+                    memcpy(&ring[writePos], _in->readBuf, first * sizeof(T));
+                    memcpy(ring, &_in->readBuf[first], (count - first) * sizeof(T));
+                    fill += count;
+                }
+                else {
+                    overruns++;
+                }
             }
             cnd.notify_all();
             _in->flush();
@@ -74,17 +177,57 @@ namespace dsp::buffer {
         }
 
         void worker() {
+            auto nextRelease = std::chrono::steady_clock::now();
             while (true) {
-                // Wait for data
-                std::unique_lock lck(bufMtx);
-                cnd.wait(lck, [this]() { return (((writeCur - readCur + TEST_BUFFER_SIZE) % TEST_BUFFER_SIZE) > 0) || stopWorker; });
-                if (stopWorker) { break; }
-
-                // Write one to output buffer and unlock in preparation to swap buffers
-                int count = sizes[readCur];
-                memcpy(out.writeBuf, buffers[readCur], count * sizeof(T));
-                readCur++;
-                readCur = ((readCur) % TEST_BUFFER_SIZE);
+                std::unique_lock<std::mutex> lck(bufMtx);
+                int count;
+                int outSize;
+                if (_targetLatency > 0.0) {
+                    int target = std::min<int>(_targetLatency * _samplerate / 1000.0, capacity);
+                    int blockSize = std::clamp<int>(SAMPLE_FRAME_BUFFER_PACED_BLOCK_MS * _samplerate / 1000.0, 1, STREAM_BUFFER_SIZE);
+
+                    // Fill up to the target before releasing anything
+                    if (!primed) {
+                        cnd.wait(lck, [this, target]() { return fill >= target || stopWorker; });
+                        if (stopWorker) { break; }
+                        primed = true;
+                        nextRelease = std::chrono::steady_clock::now();
+                    }
+
+                    // Wait for the time to release the next block
+                    cnd.wait_until(lck, nextRelease, [this]() { return stopWorker; });
+                    if (stopWorker) { break; }
+                    if (!primed) { continue; }
+                    if (fill < blockSize) {
+                        underruns++;
+                        primed = false;
+                        continue;
+                    }
+                    count = blockSize;
+                    outSize = blockSize;
+
+                    // Release slightly faster when above the target and slower when under it, so that the clock
+                    // drift between the source and this machine doesn't slowly empty or fill the ring
+                    double correction = std::clamp<double>((double)(fill - target) / (double)std::max<int>(target, 1) * 0.01,
+                                                           -SAMPLE_FRAME_BUFFER_MAX_RATE_CORRECTION, SAMPLE_FRAME_BUFFER_MAX_RATE_CORRECTION);
+                    double duration = (double)count / (_samplerate * (1.0 + correction));
+                    nextRelease += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(duration));
+                }
+                else {
+                    // Release everything available
+                    cnd.wait(lck, [this]() { return fill > 0 || stopWorker; });
+                    if (stopWorker) { break; }
+                    count = std::min<int>(fill, inBlockSize);
+                    outSize = inBlockSize;
+                }
+
+                // Copy out of the ring and unlock in preparation to swap buffers
+                if (out.getBufferSize() != outSize) { out.setBufferSize(outSize); }
+                int first = std::min<int>(count, capacity - readPos);
+                memcpy(out.writeBuf, &ring[readPos], first * sizeof(T));
+                memcpy(&out.writeBuf[first], ring, (count - first) * sizeof(T));
+                readPos = (readPos + count) % capacity;
+                fill -= count;
                 lck.unlock();
 
                 // Swap
@@ -94,21 +237,19 @@ namespace dsp::buffer {
 
         stream<T> out;
 
-        int writeCur = 0;
-        int readCur = 0;
-
-        bool bypass = false;
-
     private:
         void doStart() {
             base_type::workerThread = std::thread(&SampleFrameBuffer<T>::workerLoop, this);
-            readWorkerThread = std::thread(&SampleFrameBuffer<T>::worker, this);
+            if (!_bypass) { readWorkerThread = std::thread(&SampleFrameBuffer<T>::worker, this); }
         }
 
         void doStop() {
             _in->stopReader();
             out.stopWriter();
-            stopWorker = true;
+            {
+                std::lock_guard<std::mutex> lck(bufMtx);
+                stopWorker = true;
+            }
             cnd.notify_all();
 
             if (base_type::workerThread.joinable()) { base_type::workerThread.join(); }
@@ -119,13 +260,54 @@ namespace dsp::buffer {
             stopWorker = false;
         }
 
+        // Only called while stopped
+        void allocate() {
+            double duration = std::max<double>(_latency, _targetLatency * 2.0);
+            int size = std::clamp<double>(duration * _samplerate / 1000.0, 1.0, (double)INT32_MAX / 2);
+            if (ring) { buffer::free(ring); }
+            ring = buffer::alloc<T>(size);
+            capacity = size;
+            readPos = 0;
+            fill = 0;
+            primed = false;
+        }
+
+        // Blocks larger than the ring can never fit, so it's grown to hold two of them. Called with the lock held
+        void grow(int count) {
+            int size = count * 2;
+            T* newRing = buffer::alloc<T>(size);
+            int first = std::min<int>(fill, capacity - readPos);
+            memcpy(newRing, &ring[readPos], first * sizeof(T));
+            memcpy(&newRing[first], ring, (fill - first) * sizeof(T));
+            buffer::free(ring);
+            ring = newRing;
+            capacity = size;
+            readPos = 0;
+        }
+
         stream<T>* _in;
 
+        double _samplerate;
+        double _latency;
+        double _targetLatency = 0.0;
+        bool _bypass = false;
+
         std::thread readWorkerThread;
         std::mutex bufMtx;
         std::condition_variable cnd;
-        T* buffers[TEST_BUFFER_SIZE];
-        int sizes[TEST_BUFFER_SIZE];
+
+        // Ring of samples, the buffered ones start at readPos
+        T* ring = NULL;
+        int capacity = 0;
+        int readPos = 0;
+        int fill = 0;
+        bool primed = false;
+
+        // Block size declared by the source, used as the size of the released blocks
+        int inBlockSize = STREAM_BUFFER_SIZE;
+
+        std::atomic<uint64_t> overruns = 0;
+        std::atomic<uint64_t> underruns = 0;
 
         bool stopWorker = false;
     };
@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "buffer.h"
+
+namespace dsp::buffer {
+    template <class T>
+    class SharedBufferPool;
+
+    // Reference counted buffer handed out by a SharedBufferPool. It goes back to the pool
+    // as soon as the last holder calls unref(). Holders must treat the data as read-only.
+    template <class T>
+    class SharedBuffer {
+        friend class SharedBufferPool<T>;
+    public:
+        inline void ref() {
+            refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        inline void unref() {
+            if (refs.fetch_sub(1, std::memory_order_acq_rel) != 1) { return; }
+
+            // Keep the pool alive until the buffer is back in it
+            std::shared_ptr<SharedBufferPool<T>> p = std::move(pool);
+            p->recycle(this);
+        }
+
+        T* data;
+
+        // Number of samples data can hold
+        int capacity;
+
+    private:
+        std::atomic<int> refs;
+        std::shared_ptr<SharedBufferPool<T>> pool;
+    };
+
+    template <class T>
+    class SharedBufferPool : public std::enable_shared_from_this<SharedBufferPool<T>> {
+        friend class SharedBuffer<T>;
+    public:
+        SharedBufferPool(int bufferSize) {
+            _bufferSize = bufferSize;
+        }
+
+        ~SharedBufferPool() {
+            // All buffers are guaranteed to be back since each one holds a reference to the pool
+            for (auto& buf : freeBufs) {
+                trackMemory(MEMORY_USE_STREAMS, -(int64_t)buf->capacity * sizeof(T));
+                buffer::free(buf->data);
+                delete buf;
+            }
+        }
+
+        // Get a free buffer with a reference count of one, allocating a new one if needed. Buffers allocated
+        // before a size change are reallocated when they're acquired again
+        SharedBuffer<T>* acquire() {
+            SharedBuffer<T>* buf;
+            {
+                std::lock_guard<std::mutex> lck(poolMtx);
+                if (freeBufs.empty()) {
+                    buf = new SharedBuffer<T>;
+                    buf->data = buffer::alloc<T>(_bufferSize);
+                    buf->capacity = _bufferSize;
+                    trackMemory(MEMORY_USE_STREAMS, (int64_t)_bufferSize * sizeof(T));
+                    allocated++;
+                }
+                else {
+                    buf = freeBufs.back();
+                    freeBufs.pop_back();
+                }
+                if (buf->capacity != _bufferSize) {
+                    trackMemory(MEMORY_USE_STREAMS, ((int64_t)_bufferSize - buf->capacity) * sizeof(T));
+                    buffer::free(buf->data);
+                    buf->data = buffer::alloc<T>(_bufferSize);
+                    buf->capacity = _bufferSize;
+                }
+            }
+            buf->refs.store(1, std::memory_order_relaxed);
+            buf->pool = this->shared_from_this();
+            return buf;
+        }
+
+        // Size of the buffers acquired from now on, the ones in use keep theirs
+        void setBufferSize(int bufferSize) {
+            std::lock_guard<std::mutex> lck(poolMtx);
+            _bufferSize = bufferSize;
+        }
+
+        int getBufferSize() {
+            std::lock_guard<std::mutex> lck(poolMtx);
+            return _bufferSize;
+        }
+
+        int getAllocatedCount() {
+            std::lock_guard<std::mutex> lck(poolMtx);
+            return allocated;
+        }
+
+    private:
+        void recycle(SharedBuffer<T>* buf) {
+            std::lock_guard<std::mutex> lck(poolMtx);
+            freeBufs.push_back(buf);
+        }
+
+        int _bufferSize;
+        int allocated = 0;
+        std::mutex poolMtx;
+        std::vector<SharedBuffer<T>*> freeBufs;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+#include "rx_vfo.h"
+#include "fft_channelizer.h"
+
+namespace dsp::channel {
+    // RxVFO fed by a channel of a shared FFTChannelizer instead of the full baseband.
+    // Offsets and samplerates are given relative to the baseband like for a regular RxVFO,
+    // the channel is already centered so the VFO itself only resamples it.
+    class ChannelizedRxVFO : public RxVFO {
+        using base_type = RxVFO;
+    public:
+        ChannelizedRxVFO() {}
+
+        ChannelizedRxVFO(FFTChannelizer* chan, FFTChannelizer::Channel* ch, double outSamplerate, double bandwidth, double offset) { init(chan, ch, outSamplerate, bandwidth, offset); }
+
+        void init(FFTChannelizer* chan, FFTChannelizer::Channel* ch, double outSamplerate, double bandwidth, double offset) {
+            _chan = chan;
+            _ch = ch;
+            _fullOffset = offset;
+            _chan->setChannelOffset(_ch, offset);
+            base_type::init(&ch->out, _chan->getChannelSamplerate(_ch), outSamplerate, bandwidth, 0.0);
+        }
+
+        // The channelizer is expected to already be running at the new baseband samplerate
+        void setInSamplerate(double inSamplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            base_type::setInSamplerate(_chan->getChannelSamplerate(_ch));
+            _chan->setChannelOffset(_ch, _fullOffset);
+            base_type::tempStart();
+        }
+
+        void setOutSamplerate(double outSamplerate, double bandwidth) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            updateChannel(bandwidth);
+            base_type::setOutSamplerate(outSamplerate, bandwidth);
+            base_type::tempStart();
+        }
+
+        void setBandwidth(double bandwidth) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            updateChannel(bandwidth);
+            base_type::setBandwidth(bandwidth);
+        }
+
+        void setOffset(double offset) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            _fullOffset = offset;
+            _chan->setChannelOffset(_ch, _fullOffset);
+        }
+
+        FFTChannelizer::Channel* getChannel() {
+            return _ch;
+        }
+
+    protected:
+        void updateChannel(double bandwidth) {
+            // If the channel samplerate changed, the VFO has to follow
+            if (!_chan->setChannelBandwidth(_ch, bandwidth)) { return; }
+            base_type::tempStop();
+            base_type::setInSamplerate(_chan->getChannelSamplerate(_ch));
+            _chan->setChannelOffset(_ch, _fullOffset);
+            base_type::tempStart();
+        }
+
+        FFTChannelizer* _chan;
+        FFTChannelizer::Channel* _ch;
+        double _fullOffset;
+    };
+}
\ No newline at end of file
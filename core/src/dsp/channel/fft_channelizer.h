@@ -0,0 +1,345 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "../sink.h"
+#include "../taps/windowed_sinc.h"
+#include "../taps/estimate_tap_count.h"
+#include "../window/nuttall.h"
+#include "../math/phasor.h"
+#include "../fft/plan_cache.h"
+
+namespace dsp::channel {
+    // Fast convolution (overlap-save) filterbank. The input is transformed once per block and each channel
+    // only takes the slice of bins it needs, filters it in the frequency domain and brings it back to the
+    // time domain with a small inverse FFT. The cost of a channel doesn't depend on the input samplerate.
+    // Channels are centered on the nearest bin, the residual offset is then corrected at the decimated rate.
+    class FFTChannelizer : public Sink<complex_t> {
+        using base_type = Sink<complex_t>;
+    public:
+        class Channel {
+            friend FFTChannelizer;
+        public:
+            stream<complex_t> out;
+
+        private:
+            double offset;
+            double bandwidth;
+            int decim;
+            int bins;
+            int centerBin;
+            complex_t* response = NULL;
+            complex_t* ifftIn = NULL;
+            complex_t* ifftOut = NULL;
+            fft::Plan* plan = NULL;
+            lv_32fc_t blockPhase;
+            lv_32fc_t blockPhaseDelta;
+            lv_32fc_t residualPhase;
+            lv_32fc_t residualPhaseDelta;
+            int outCount = 0;
+        };
+
+        FFTChannelizer() {}
+
+        FFTChannelizer(stream<complex_t>* in, double samplerate, int fftSize = 0) { init(in, samplerate, fftSize); }
+
+        ~FFTChannelizer() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            for (auto& ch : channels) {
+                destroyChannel(ch);
+                delete ch;
+            }
+            channels.clear();
+            destroyBuffers();
+        }
+
+        void init(stream<complex_t>* in, double samplerate, int fftSize = 0) {
+            _samplerate = samplerate;
+            _fftSize = fftSize;
+            initBuffers();
+            base_type::init(in);
+        }
+
+        void setSamplerate(double samplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _samplerate = samplerate;
+            destroyBuffers();
+            initBuffers();
+            for (auto& ch : channels) {
+                configureChannel(ch, ch->bandwidth, std::max<int>(getDecimation(ch->bandwidth), 1));
+                tuneChannel(ch, ch->offset);
+            }
+            base_type::tempStart();
+        }
+
+        // Check if a channel of the given bandwidth can be extracted with a useful decimation
+        bool canChannelize(double bandwidth) {
+            return getDecimation(bandwidth) >= 4;
+        }
+
+        // Returns NULL if the channel is too wide to be worth channelizing
+        Channel* addChannel(double offset, double bandwidth) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (!canChannelize(bandwidth)) { return NULL; }
+
+            Channel* ch = new Channel;
+            configureChannel(ch, bandwidth, getDecimation(bandwidth));
+            tuneChannel(ch, offset);
+
+            base_type::tempStop();
+            base_type::registerOutput(&ch->out);
+            channels.push_back(ch);
+            base_type::tempStart();
+
+            return ch;
+        }
+
+        void removeChannel(Channel* ch) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            auto it = std::find(channels.begin(), channels.end(), ch);
+            if (it == channels.end()) {
+                throw std::runtime_error("[FFTChannelizer] Tried to remove a channel that doesn't exist");
+            }
+
+            base_type::tempStop();
+            channels.erase(it);
+            base_type::unregisterOutput(&ch->out);
+            base_type::tempStart();
+
+            destroyChannel(ch);
+            delete ch;
+        }
+
+        // Move a channel to the nearest bin and correct the rest, both take effect on the same block
+        void setChannelOffset(Channel* ch, double offset) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::mutex> lck(chanMtx);
+            tuneChannel(ch, offset);
+        }
+
+        // Change the bandwidth of a channel, returns true if its samplerate changed
+        bool setChannelBandwidth(Channel* ch, double bandwidth) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (bandwidth == ch->bandwidth) { return false; }
+            int decim = std::max<int>(getDecimation(bandwidth), 1);
+            if (decim == ch->decim) {
+                // Same bins, only the response has to follow the new cutoff. It's swapped in between two blocks
+                complex_t* response = genResponse(bandwidth, ch->bins);
+                {
+                    std::lock_guard<std::mutex> lck2(chanMtx);
+                    std::swap(ch->response, response);
+                    ch->bandwidth = bandwidth;
+                }
+                buffer::free(response);
+                return false;
+            }
+            base_type::tempStop();
+            configureChannel(ch, bandwidth, decim);
+            tuneChannel(ch, ch->offset);
+            base_type::tempStart();
+            return true;
+        }
+
+        double getChannelSamplerate(Channel* ch) {
+            return _samplerate / (double)ch->decim;
+        }
+
+        double getResidualOffset(Channel* ch) {
+            return ch->offset - ((double)ch->centerBin * _samplerate / (double)fftSize);
+        }
+
+        int getChannelCount() {
+            return channels.size();
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            {
+                std::lock_guard<std::mutex> lck(chanMtx);
+
+                // Run a block every time enough samples are available
+                const complex_t* data = base_type::_in->readBuf;
+                int consumed = 0;
+                while (consumed < count) {
+                    int toCopy = std::min<int>(count - consumed, fftSize - fill);
+                    memcpy(&fftIn[fill], &data[consumed], toCopy * sizeof(complex_t));
+                    fill += toCopy;
+                    consumed += toCopy;
+                    if (fill < fftSize) { break; }
+                    processBlock();
+                    memmove(fftIn, &fftIn[advance], overlap * sizeof(complex_t));
+                    fill = overlap;
+                }
+            }
+
+            base_type::_in->flush();
+
+            // Send out whatever each channel produced
+            for (auto& ch : channels) {
+                if (!ch->outCount) { continue; }
+                int outCount = ch->outCount;
+                ch->outCount = 0;
+                if (!ch->out.swap(outCount)) { return -1; }
+            }
+
+            return count;
+        }
+
+    protected:
+        void processBlock() {
+            fftwf_execute_dft(fwdPlan->get(), (fftwf_complex*)fftIn, (fftwf_complex*)fftOut);
+
+            float scale = 1.0f / (float)fftSize;
+            for (auto& ch : channels) {
+                // Take the bins of the channel and apply the filter
+                int half = ch->bins / 2;
+                for (int m = 0; m < ch->bins; m++) {
+                    int sm = (m < half) ? m : (m - ch->bins);
+                    int k = (ch->centerBin + sm) % fftSize;
+                    if (k < 0) { k += fftSize; }
+                    ch->ifftIn[m] = fftOut[k] * ch->response[m];
+                }
+
+                // Back to the time domain at the decimated rate
+                fftwf_execute_dft(ch->plan->get(), (fftwf_complex*)ch->ifftIn, (fftwf_complex*)ch->ifftOut);
+
+                // Keep only the valid part and correct the phase jump caused by the block advance
+                int skip = overlap / ch->decim;
+                int valid = ch->bins - skip;
+                lv_32fc_t gain = ch->blockPhase * scale;
+#if VOLK_VERSION >= 030100
+                volk_32fc_s32fc_multiply2_32fc((lv_32fc_t*)&ch->out.writeBuf[ch->outCount], (lv_32fc_t*)&ch->ifftOut[skip], &gain, valid);
+#else
+                volk_32fc_s32fc_multiply_32fc((lv_32fc_t*)&ch->out.writeBuf[ch->outCount], (lv_32fc_t*)&ch->ifftOut[skip], gain, valid);
+#endif
+#if VOLK_VERSION >= 030100
+                volk_32fc_s32fc_x2_rotator2_32fc((lv_32fc_t*)&ch->out.writeBuf[ch->outCount], (lv_32fc_t*)&ch->out.writeBuf[ch->outCount], &ch->residualPhaseDelta, &ch->residualPhase, valid);
+#else
+                volk_32fc_s32fc_x2_rotator_32fc((lv_32fc_t*)&ch->out.writeBuf[ch->outCount], (lv_32fc_t*)&ch->out.writeBuf[ch->outCount], ch->residualPhaseDelta, &ch->residualPhase, valid);
+#endif
+                ch->outCount += valid;
+                ch->blockPhase *= ch->blockPhaseDelta;
+                ch->blockPhase /= std::abs(ch->blockPhase);
+            }
+        }
+
+        // Transition width of the longest filter that fits in the overlap
+        double getTransitionWidth() {
+            return 3.8 * _samplerate / (double)(overlap + 1);
+        }
+
+        int getDecimation(double bandwidth) {
+            // The whole filter transition has to fit in the bins of the channel, on both sides, since the response
+            // is cut at the edges. The transition is about twice the estimated width once it reaches the stopband
+            double minSamplerate = bandwidth + (2.0 * getTransitionWidth());
+            int decim = 1;
+            while ((decim * 2) <= (fftSize / 8) && (_samplerate / (double)(decim * 2)) >= minSamplerate) {
+                decim *= 2;
+            }
+            return ((_samplerate / (double)decim) >= minSamplerate) ? decim : 0;
+        }
+
+        void configureChannel(Channel* ch, double bandwidth, int decim) {
+            destroyChannel(ch);
+            ch->bandwidth = bandwidth;
+            ch->decim = decim;
+            ch->bins = fftSize / decim;
+
+            ch->response = genResponse(bandwidth, ch->bins);
+
+            // Plan the inverse FFT
+            ch->ifftIn = (complex_t*)fftwf_malloc(ch->bins * sizeof(complex_t));
+            ch->ifftOut = (complex_t*)fftwf_malloc(ch->bins * sizeof(complex_t));
+            ch->plan = fft::PlanCache::getInstance().getDFT(ch->bins, FFTW_BACKWARD);
+        }
+
+        // Frequency response of the anti-aliasing filter for the bins used by a channel. The transition starts at the
+        // edge of the channel so that the response is down to nothing at the edges of the bins
+        complex_t* genResponse(double bandwidth, int bins) {
+            double cutoff = (bandwidth + getTransitionWidth()) / 2.0;
+            tap<float> ftaps = taps::windowedSinc<float>(overlap + 1, cutoff, _samplerate, window::nuttall);
+            complex_t* response = buffer::alloc<complex_t>(bins);
+            int half = bins / 2;
+            for (int m = 0; m < bins; m++) {
+                int sm = (m < half) ? m : (m - bins);
+                double omega = -2.0 * DB_M_PI * (double)sm / (double)fftSize;
+                complex_t acc = { 0.0f, 0.0f };
+                for (int p = 0; p < ftaps.size; p++) {
+                    acc += math::phasor(omega * (double)p) * ftaps.taps[p];
+                }
+                response[m] = acc;
+            }
+            taps::free(ftaps);
+            return response;
+        }
+
+        void tuneChannel(Channel* ch, double offset) {
+            ch->offset = offset;
+            ch->centerBin = round(offset * (double)fftSize / _samplerate);
+
+            // Shifting by whole bins rotates each block by the phase accumulated over the block advance
+            double delta = -2.0 * DB_M_PI * fmod((double)ch->centerBin * (double)advance, (double)fftSize) / (double)fftSize;
+            ch->blockPhaseDelta = lv_cmake(cos(delta), sin(delta));
+            ch->blockPhase = lv_cmake(1.0f, 0.0f);
+
+            // What's left is translated to 0Hz after decimation
+            double rdelta = -2.0 * DB_M_PI * getResidualOffset(ch) * (double)ch->decim / _samplerate;
+            ch->residualPhaseDelta = lv_cmake(cos(rdelta), sin(rdelta));
+            ch->residualPhase = lv_cmake(1.0f, 0.0f);
+        }
+
+        void destroyChannel(Channel* ch) {
+            if (ch->ifftIn) { fftwf_free(ch->ifftIn); }
+            if (ch->ifftOut) { fftwf_free(ch->ifftOut); }
+            if (ch->response) { buffer::free(ch->response); }
+            ch->plan = NULL;
+            ch->ifftIn = NULL;
+            ch->ifftOut = NULL;
+            ch->response = NULL;
+        }
+
+        void initBuffers() {
+            // Aim for bins of about 1KHz if no size was given
+            fftSize = _fftSize;
+            if (!fftSize) {
+                fftSize = 1 << std::clamp<int>(ceil(log2(_samplerate / 1000.0)), 10, 16);
+            }
+
+            // A quarter of each block overlaps with the previous one, this is also the max filter length
+            overlap = fftSize / 4;
+            advance = fftSize - overlap;
+
+            fftIn = (complex_t*)fftwf_malloc(fftSize * sizeof(complex_t));
+            fftOut = (complex_t*)fftwf_malloc(fftSize * sizeof(complex_t));
+            buffer::clear(fftIn, overlap);
+            fill = overlap;
+            fwdPlan = fft::PlanCache::getInstance().getDFT(fftSize, FFTW_FORWARD);
+        }
+
+        void destroyBuffers() {
+            fftwf_free(fftIn);
+            fftwf_free(fftOut);
+        }
+
+        double _samplerate;
+        int _fftSize;
+
+        int fftSize;
+        int overlap;
+        int advance;
+        int fill;
+        complex_t* fftIn;
+        complex_t* fftOut;
+        fft::Plan* fwdPlan;
+
+        std::mutex chanMtx;
+        std::vector<Channel*> channels;
+    };
+}
\ No newline at end of file
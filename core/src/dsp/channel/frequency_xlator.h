@@ -49,9 +49,12 @@ namespace dsp::channel {
             return count;
         }
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         virtual int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
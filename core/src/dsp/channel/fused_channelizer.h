@@ -0,0 +1,239 @@
+#pragma once
+#include <numeric>
+#include "../processor.h"
+#include "../multirate/polyphase_resampler.h"
+#include "../taps/low_pass.h"
+#include "../math/phasor.h"
+#include "../math/hz_to_rads.h"
+
+// Fraction of the room between the channel and its first alias given as transition width to the first stage
+#define FUSED_CHANNELIZER_TRANSITION_MARGIN 0.7
+
+namespace dsp::channel {
+    // Single pass channelizer doing the same job as FrequencyXlator -> RationalResampler -> FIR.
+    // The frequency translation is folded into the taps of a decimating filter so that taps are only
+    // applied to the samples that are kept, the result is then rotated back at the decimated rate.
+    // The channel filter is folded into the taps of the final polyphase resampler.
+    class FusedChannelizer : public Processor<complex_t, complex_t> {
+        using base_type = Processor<complex_t, complex_t>;
+    public:
+        FusedChannelizer() {}
+
+        FusedChannelizer(stream<complex_t>* in, double inSamplerate, double outSamplerate, double bandwidth, double offset) { init(in, inSamplerate, outSamplerate, bandwidth, offset); }
+
+        ~FusedChannelizer() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            taps::free(lpTaps);
+            taps::free(xlTaps);
+            taps::free(rtaps);
+            buffer::free(history);
+        }
+
+        void init(stream<complex_t>* in, double inSamplerate, double outSamplerate, double bandwidth, double offset) {
+            _inSamplerate = inSamplerate;
+            _outSamplerate = outSamplerate;
+            _bandwidth = bandwidth;
+            _offset = offset;
+
+            // Dummy initialization since only used for processing
+            rtaps = taps::lowPass(0.25, 0.1, 1.0);
+            resamp.init(NULL, 1, 1, rtaps);
+            resamp.out.free();
+
+            // Proper configuration
+            reconfigure();
+
+            base_type::init(in);
+        }
+
+        void setParameters(double inSamplerate, double outSamplerate, double bandwidth, double offset) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _inSamplerate = inSamplerate;
+            _outSamplerate = outSamplerate;
+            _bandwidth = bandwidth;
+            _offset = offset;
+            reconfigure();
+            base_type::tempStart();
+        }
+
+        void setInSamplerate(double inSamplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _inSamplerate = inSamplerate;
+            reconfigure();
+            base_type::tempStart();
+        }
+
+        void setOutSamplerate(double outSamplerate, double bandwidth) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _outSamplerate = outSamplerate;
+            _bandwidth = bandwidth;
+            reconfigure();
+            base_type::tempStart();
+        }
+
+        void setBandwidth(double bandwidth) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _bandwidth = bandwidth;
+            reconfigure();
+            base_type::tempStart();
+        }
+
+        // Done while running like FrequencyXlator::setOffset(), the taps are rotated in place and the phase
+        // of the output rotation is kept so that tuning doesn't cause dropouts
+        void setOffset(double offset) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            std::lock_guard<std::mutex> lck2(tapsMtx);
+            _offset = offset;
+            rotateTaps();
+        }
+
+        void reset() {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            buffer::clear(history, xlTaps.size - 1);
+            phase = lv_cmake(1.0f, 0.0f);
+            decimOffset = 0;
+            resamp.reset();
+            base_type::tempStart();
+        }
+
+        inline int process(int count, const complex_t* in, complex_t* out) {
+            std::lock_guard<std::mutex> lck(tapsMtx);
+            int outCount = 0;
+            int histLen = xlTaps.size - 1;
+
+            // Outputs that need samples from the previous buffer are computed from the history buffer,
+            // the input is appended to it only as much as needed to cover those
+            int headCount = std::min<int>(count, histLen);
+            memcpy(&history[histLen], in, headCount * sizeof(complex_t));
+            for (; decimOffset < headCount; decimOffset += _decim) {
+                volk_32fc_x2_dot_prod_32fc((lv_32fc_t*)&out[outCount++], (lv_32fc_t*)&history[decimOffset], (lv_32fc_t*)xlTaps.taps, xlTaps.size);
+            }
+
+            // All other outputs are computed directly from the input buffer
+            for (; decimOffset < count; decimOffset += _decim) {
+                volk_32fc_x2_dot_prod_32fc((lv_32fc_t*)&out[outCount++], (lv_32fc_t*)&in[decimOffset - histLen], (lv_32fc_t*)xlTaps.taps, xlTaps.size);
+            }
+            decimOffset -= count;
+
+            // Keep the last samples for the next buffer
+            if (count >= histLen) {
+                memcpy(history, &in[count - histLen], histLen * sizeof(complex_t));
+            }
+            else {
+                memmove(history, &history[count], histLen * sizeof(complex_t));
+            }
+
+            // Undo the rotation of the taps at the decimated rate
+#if VOLK_VERSION >= 030100
+            volk_32fc_s32fc_x2_rotator2_32fc((lv_32fc_t*)out, (lv_32fc_t*)out, &phaseDelta, &phase, outCount);
+#else
+            volk_32fc_s32fc_x2_rotator_32fc((lv_32fc_t*)out, (lv_32fc_t*)out, phaseDelta, &phase, outCount);
+#endif
+
+            // Resample and apply the channel filter in a single polyphase pass
+            return resamp.process(outCount, out, out);
+        }
+
+        // The decimated samples are written to the output before being resampled in place
+        int getOutputSize(int inputSize) {
+            int decimSize = (inputSize / _decim) + 2;
+            return std::max<int>(decimSize, resamp.getOutputSize(decimSize));
+        }
+
+        DEFAULT_MULTIRATE_PROC_RUN
+
+    protected:
+        void resizeBuffers(int inputSize) {
+            resamp.setMaxInputSize((inputSize / _decim) + 2);
+        }
+
+        void reconfigure() {
+            // The sizes depend on the ratios, the resampler's buffers are only valid once resized
+            base_type::invalidateSizes();
+
+            // Decimate as much as possible while keeping enough margin for a short filter
+            double minIntSamplerate = std::max<double>(4.0 * _bandwidth, _outSamplerate);
+            _decim = std::max<int>(floor(_inSamplerate / minIntSamplerate), 1);
+            double intSamplerate = _inSamplerate / (double)_decim;
+
+            // The first stage only has to protect the channel from aliasing, the rest is removed by the channel filter.
+            // Everything above intSamplerate - bandwidth/2 lands in the channel once decimated, the transition is centered
+            // between that and the channel edge. It's narrowed since the window only reaches its full attenuation past
+            // the transition width given to lowPass()
+            taps::free(lpTaps);
+            if (_decim > 1) {
+                lpTaps = taps::lowPass(intSamplerate / 2.0, (intSamplerate - _bandwidth) * FUSED_CHANNELIZER_TRANSITION_MARGIN, _inSamplerate);
+            }
+            else {
+                lpTaps = taps::alloc<float>(1);
+                lpTaps.taps[0] = 1.0f;
+            }
+
+            // Allocate the history buffer
+            buffer::free(history);
+            history = buffer::alloc<complex_t>(2 * lpTaps.size);
+            buffer::clear(history, lpTaps.size - 1);
+            decimOffset = 0;
+            taps::free(xlTaps);
+            xlTaps = taps::alloc<complex_t>(lpTaps.size);
+            rotateTaps();
+            phase = lv_cmake(1.0f, 0.0f);
+
+            // Calculate interpolation and decimation for the polyphase resampler
+            int IntSR = round(intSamplerate);
+            int OutSR = round(_outSamplerate);
+            int gcd = std::gcd(IntSR, OutSR);
+            int interp = OutSR / gcd;
+            int decim = IntSR / gcd;
+
+            // The resampler taps double as the channel filter
+            double tapSamplerate = intSamplerate * (double)interp;
+            double filterWidth = std::min<double>(_bandwidth, _outSamplerate) / 2.0;
+            taps::free(rtaps);
+            rtaps = taps::lowPass(filterWidth, filterWidth * 0.1, tapSamplerate);
+            for (int i = 0; i < rtaps.size; i++) { rtaps.taps[i] *= (float)interp; }
+            resamp.setRatio(interp, decim, rtaps);
+        }
+
+        void rotateTaps() {
+            // Taps are stored in reverse order, tap i is applied to the sample delayed by (size - 1 - i)
+            double omega = math::hzToRads(_offset, _inSamplerate);
+            for (int i = 0; i < lpTaps.size; i++) {
+                xlTaps.taps[i] = math::phasor(omega * (double)(lpTaps.size - 1 - i)) * lpTaps.taps[i];
+            }
+
+            // Rotation to apply to the decimated samples
+            double delta = fmod(-omega * (double)_decim, 2.0 * DB_M_PI);
+            phaseDelta = lv_cmake(cos(delta), sin(delta));
+        }
+
+        tap<float> lpTaps;
+        tap<complex_t> xlTaps;
+        std::mutex tapsMtx;
+        tap<float> rtaps;
+        multirate::PolyphaseResampler<complex_t> resamp;
+
+        complex_t* history = NULL;
+        int decimOffset = 0;
+        int _decim;
+        lv_32fc_t phase;
+        lv_32fc_t phaseDelta;
+
+        double _inSamplerate;
+        double _outSamplerate;
+        double _bandwidth;
+        double _offset;
+    };
+}
\ No newline at end of file
@@ -1,6 +1,11 @@
 #pragma once
 #include "frequency_xlator.h"
 #include "../multirate/rational_resampler.h"
+#include "fused_channelizer.h"
+#include "../filter/fft_fir.h"
+
+// Number of input samples translated at once before being resampled, so that the output only has to fit the resampled data
+#define RX_VFO_CHUNK_SIZE   16384
 
 namespace dsp::channel {
     class RxVFO : public Processor<complex_t, complex_t> {
@@ -14,6 +19,7 @@ namespace dsp::channel {
             if (!base_type::_block_init) { return; }
             base_type::stop();
             taps::free(ftaps);
+            buffer::freeWork(work, RX_VFO_CHUNK_SIZE);
         }
 
         void init(stream<complex_t>* in, double inSamplerate, double outSamplerate, double bandwidth, double offset) {
@@ -28,21 +34,31 @@ namespace dsp::channel {
             resamp.init(NULL, _inSamplerate, _outSamplerate);
             generateTaps();
             filter.init(NULL, ftaps);
+            fusedChan.init(NULL, _inSamplerate, _outSamplerate, _bandwidth, _offset);
+            work = buffer::allocWork<complex_t>(RX_VFO_CHUNK_SIZE);
+
+            // Only used for processing
+            xlator.out.free();
+            resamp.out.free();
+            filter.out.free();
+            fusedChan.out.free();
 
             base_type::init(in);
         }
 
-        void setInSamplerate(double inSamplerate) {
+        virtual void setInSamplerate(double inSamplerate) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             _inSamplerate = inSamplerate;
             xlator.setOffset(-_offset, _inSamplerate);
             resamp.setInSamplerate(_inSamplerate);
+            if (fused) { fusedChan.setInSamplerate(_inSamplerate); }
+            base_type::invalidateSizes();
             base_type::tempStart();
         }
 
-        void setOutSamplerate(double outSamplerate, double bandwidth) {
+        virtual void setOutSamplerate(double outSamplerate, double bandwidth) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
@@ -54,12 +70,30 @@ namespace dsp::channel {
                 generateTaps();
                 filter.setTaps(ftaps);
             }
+            if (fused) { fusedChan.setOutSamplerate(_outSamplerate, _bandwidth); }
+            base_type::invalidateSizes();
             base_type::tempStart();
         }
 
-        void setBandwidth(double bandwidth) {
+        virtual void setBandwidth(double bandwidth) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+
+            // The fused channelizer regenerates its taps, it can't be done while running
+            if (fused) {
+                base_type::tempStop();
+                _bandwidth = bandwidth;
+                filterNeeded = (_bandwidth != _outSamplerate);
+                if (filterNeeded) {
+                    generateTaps();
+                    filter.setTaps(ftaps);
+                }
+                fusedChan.setBandwidth(_bandwidth);
+                base_type::invalidateSizes();
+                base_type::tempStart();
+                return;
+            }
+
             std::lock_guard<std::mutex> lck2(filterMtx);
             _bandwidth = bandwidth;
             filterNeeded = (_bandwidth != _outSamplerate);
@@ -69,11 +103,35 @@ namespace dsp::channel {
             }
         }
 
-        void setOffset(double offset) {
+        virtual void setOffset(double offset) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             _offset = offset;
             xlator.setOffset(-_offset, _inSamplerate);
+            if (fused) { fusedChan.setOffset(_offset); }
+        }
+
+        // Select the single pass channelizer instead of the translate, resample and filter chain
+        void setFused(bool enabled) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (enabled == fused) { return; }
+            base_type::tempStop();
+            fused = enabled;
+            if (fused) {
+                fusedChan.setParameters(_inSamplerate, _outSamplerate, _bandwidth, _offset);
+            }
+            else {
+                xlator.reset();
+                resamp.reset();
+                filter.reset();
+            }
+            base_type::invalidateSizes();
+            base_type::tempStart();
+        }
+
+        bool getFused() {
+            return fused;
         }
 
         void reset() {
@@ -83,25 +141,38 @@ namespace dsp::channel {
             xlator.reset();
             resamp.reset();
             filter.reset();
+            fusedChan.reset();
             base_type::tempStart();
         }
 
         inline int process(int count, const complex_t* in, complex_t* out) {
-            xlator.process(count, in, out);
-            if (!filterNeeded) {
-                return resamp.process(count, out, out);
+            if (fused) {
+                return fusedChan.process(count, in, out);
             }
-            count = resamp.process(count, out, out);
-            {
+            int outCount = 0;
+            for (int i = 0; i < count; i += RX_VFO_CHUNK_SIZE) {
+                int n = std::min<int>(count - i, RX_VFO_CHUNK_SIZE);
+                xlator.process(n, &in[i], work);
+                outCount += resamp.process(n, work, &out[outCount]);
+            }
+            if (filterNeeded) {
                 std::lock_guard<std::mutex> lck(filterMtx);
-                filter.process(count, out, out);
+                filter.process(outCount, out, out);
             }
-            return count;
+            return outCount;
+        }
+
+        // Each chunk can write up to what the resampler outputs for a full chunk
+        int getOutputSize(int inputSize) {
+            if (fused) { return fusedChan.getOutputSize(inputSize); }
+            int chunks = (inputSize + RX_VFO_CHUNK_SIZE - 1) / RX_VFO_CHUNK_SIZE;
+            return chunks * resamp.getOutputSize(std::min<int>(inputSize, RX_VFO_CHUNK_SIZE));
         }
 
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             int outCount = process(count, base_type::_in->readBuf, out.writeBuf);
 
@@ -114,6 +185,16 @@ namespace dsp::channel {
         }
 
     protected:
+        void resizeBuffers(int inputSize) {
+            if (fused) {
+                fusedChan.setMaxInputSize(inputSize);
+                return;
+            }
+            resamp.setMaxInputSize(std::min<int>(inputSize, RX_VFO_CHUNK_SIZE));
+            std::lock_guard<std::mutex> lck(filterMtx);
+            filter.setMaxInputSize(getOutputSize(inputSize));
+        }
+
         void generateTaps() {
             taps::free(ftaps);
             double filterWidth = _bandwidth / 2.0;
@@ -122,9 +203,12 @@ namespace dsp::channel {
 
         FrequencyXlator xlator;
         multirate::RationalResampler<complex_t> resamp;
-        filter::FIR<complex_t, float> filter;
+        filter::FFTFIR<complex_t, float> filter;
         tap<float> ftaps;
         bool filterNeeded;
+        FusedChannelizer fusedChan;
+        bool fused = false;
+        complex_t* work = NULL;
 
         double _inSamplerate;
         double _outSamplerate;
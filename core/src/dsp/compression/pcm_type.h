@@ -1,9 +1,15 @@
 #pragma once
 
+// Number of complex samples sharing an exponent in the block floating point format
+#define SAMPLE_STREAM_BFP_BLOCK_SIZE    32
+
 namespace dsp::compression {
     enum PCMType {
         PCM_TYPE_I8,
         PCM_TYPE_I16,
-        PCM_TYPE_F32
+        PCM_TYPE_F32,
+        PCM_TYPE_BFP8,  // Lossy, int8 mantissas sharing an exponent per block of samples
+        PCM_TYPE_I12,   // 12-bit values scaled like I16, I and Q packed in 3 bytes
+        PCM_TYPE_BFP4   // Lossy, 4-bit mantissas sharing an exponent per block of samples, I and Q packed in a byte
     };
 }
\ No newline at end of file
@@ -44,13 +44,23 @@ namespace dsp::compression {
                 return 8 + (count * sizeof(complex_t));
             }
 
-            // Find maximum value
-            uint32_t maxIdx;
-            volk_32f_index_max_32u(&maxIdx, (float*)in, count * 2);
-            float maxVal = ((float*)in)[maxIdx];
+            // Each block is its exponent followed by the mantissas, so weak parts of the signal keep their precision.
+            // Blocks are scaled and packed right after their maximum is found, while still in cache.
+            if (pcmType == PCMType::PCM_TYPE_BFP8) {
+                *scaler = 0;
+                return 8 + encodeBFP(count, in, (uint8_t*)dataBuf);
+            }
+            else if (pcmType == PCMType::PCM_TYPE_BFP4) {
+                *scaler = 0;
+                return 8 + encodeBFP4(count, in, (uint8_t*)dataBuf);
+            }
+
+            // Scale by the largest magnitude, a silent buffer is all zeros whatever the scale
+            float maxVal = absMax((const float*)in, count * 2);
+            if (maxVal == 0.0f) { maxVal = 1.0f; }
             *scaler = maxVal;
 
-            // Convert to the right type and send it out (sign bit determines pcm type)
+            // Convert to the right type and send it out
             if (pcmType == PCMType::PCM_TYPE_I8) {
                 volk_32f_s32f_convert_8i((int8_t*)dataBuf, (float*)in, 128.0f / maxVal, count * 2);
                 return 8 + (count * sizeof(int8_t) * 2);
@@ -59,6 +69,10 @@ namespace dsp::compression {
                 volk_32f_s32f_convert_16i((int16_t*)dataBuf, (float*)in, 32768.0f / maxVal, count * 2);
                 return 8 + (count * sizeof(int16_t) * 2);
             }
+            else if (pcmType == PCMType::PCM_TYPE_I12) {
+                encodeI12(count, in, 2047.0f / maxVal, (uint8_t*)dataBuf);
+                return 8 + (count * 3);
+            }
 
             return count;
         }
@@ -78,6 +92,73 @@ namespace dsp::compression {
         }
 
     protected:
+        static float absMax(const float* in, int count) {
+            // With the sign bit cleared, floats compare like unsigned integers, which vectorizes without fast-math
+            const uint32_t* bits = (const uint32_t*)in;
+            uint32_t max = 0;
+            for (int i = 0; i < count; i++) {
+                max = std::max<uint32_t>(max, bits[i] & 0x7FFFFFFF);
+            }
+            float maxVal;
+            memcpy(&maxVal, &max, sizeof(float));
+            return maxVal;
+        }
+
+        static int blockExponent(const float* block, int len) {
+            // Exponent that puts the largest value of the block just under 1
+            int exp;
+            frexpf(absMax(block, len), &exp);
+            return std::clamp<int>(exp, -120, 127);
+        }
+
+        static int encodeBFP(int count, const complex_t* in, uint8_t* out) {
+            const float* fin = (const float*)in;
+            uint8_t* start = out;
+            for (int i = 0; i < count; i += SAMPLE_STREAM_BFP_BLOCK_SIZE) {
+                int len = std::min<int>(count - i, SAMPLE_STREAM_BFP_BLOCK_SIZE) * 2;
+                const float* block = &fin[i * 2];
+
+                // Put the largest value just under 128
+                int exp = blockExponent(block, len);
+                *(out++) = (uint8_t)(int8_t)exp;
+                volk_32f_s32f_convert_8i((int8_t*)out, block, ldexpf(1.0f, 7 - exp), len);
+                out += len;
+            }
+            return out - start;
+        }
+
+        static int encodeBFP4(int count, const complex_t* in, uint8_t* out) {
+            uint8_t* start = out;
+            for (int i = 0; i < count; i += SAMPLE_STREAM_BFP_BLOCK_SIZE) {
+                int len = std::min<int>(count - i, SAMPLE_STREAM_BFP_BLOCK_SIZE);
+                const complex_t* block = &in[i];
+
+                // Put the largest value just under 8, then pack the I and Q of each sample in a byte
+                int exp = blockExponent((const float*)block, len * 2);
+                float scale = ldexpf(1.0f, 3 - exp);
+                *(out++) = (uint8_t)(int8_t)exp;
+                for (int j = 0; j < len; j++) {
+                    int re = std::clamp<int>(lrintf(block[j].re * scale), -7, 7);
+                    int im = std::clamp<int>(lrintf(block[j].im * scale), -7, 7);
+                    out[j] = (re & 0xF) | ((im & 0xF) << 4);
+                }
+                out += len;
+            }
+            return out - start;
+        }
+
+        static void encodeI12(int count, const complex_t* in, float scale, uint8_t* out) {
+            // The scale keeps values within 12 bits, the I and Q of each sample go in 3 bytes
+            for (int i = 0; i < count; i++) {
+                int re = lrintf(in[i].re * scale) & 0xFFF;
+                int im = lrintf(in[i].im * scale) & 0xFFF;
+                out[0] = re;
+                out[1] = (re >> 8) | (im << 4);
+                out[2] = im >> 4;
+                out += 3;
+            }
+        }
+
         PCMType _pcmType;
     };
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include "../processor.h"
 #include "pcm_type.h"
+#include "../convert/samples.h"
 
 namespace dsp::compression {
     class SampleStreamDecompressor : public Processor<uint8_t, complex_t> {
@@ -21,18 +22,62 @@ namespace dsp::compression {
             }
             else if (sampleType == PCMType::PCM_TYPE_I16) {
                 int outCount = (count - 8) / (sizeof(int16_t) * 2);
-                volk_16i_s32f_convert_32f((float*)out, (int16_t*)dataBuf, 32768.0f / scaler, outCount * 2);
+                convert::i16ToComplex(out, (int16_t*)dataBuf, outCount, scaler / 32768.0f);
                 return outCount;
             }
             else if (sampleType == PCMType::PCM_TYPE_I8) {
                 int outCount = (count - 8) / (sizeof(int8_t) * 2);
-                volk_8i_s32f_convert_32f((float*)out, (int8_t*)dataBuf, 128.0f / scaler, outCount * 2);
+                convert::i8ToComplex(out, (int8_t*)dataBuf, outCount, scaler / 128.0f);
                 return outCount;
             }
+            else if (sampleType == PCMType::PCM_TYPE_I12) {
+                int outCount = (count - 8) / 3;
+                convert::i12ToComplex(out, (const uint8_t*)dataBuf, outCount, scaler / 2047.0f);
+                return outCount;
+            }
+            else if (sampleType == PCMType::PCM_TYPE_BFP8) {
+                return decodeBFP(count - 8, (const uint8_t*)dataBuf, out);
+            }
+            else if (sampleType == PCMType::PCM_TYPE_BFP4) {
+                return decodeBFP4(count - 8, (const uint8_t*)dataBuf, out);
+            }
             
             return 0;
         }
 
+        static int decodeBFP(int size, const uint8_t* in, complex_t* out) {
+            // Blocks are an exponent followed by the mantissas of up to SAMPLE_STREAM_BFP_BLOCK_SIZE samples
+            float* fout = (float*)out;
+            int outCount = 0;
+            while (size > 1) {
+                int exp = (int8_t)*(in++);
+                int len = std::min<int>((size - 1) / 2, SAMPLE_STREAM_BFP_BLOCK_SIZE) * 2;
+                volk_8i_s32f_convert_32f(&fout[outCount * 2], (const int8_t*)in, ldexpf(1.0f, 7 - exp), len);
+                in += len;
+                size -= len + 1;
+                outCount += len / 2;
+            }
+            return outCount;
+        }
+
+        static int decodeBFP4(int size, const uint8_t* in, complex_t* out) {
+            // Blocks are an exponent followed by a byte per sample, I in the low nibble and Q in the high one
+            int outCount = 0;
+            while (size > 1) {
+                int exp = (int8_t)*(in++);
+                int len = std::min<int>(size - 1, SAMPLE_STREAM_BFP_BLOCK_SIZE);
+                float scale = ldexpf(1.0f, exp - 3);
+                for (int i = 0; i < len; i++) {
+                    out[outCount + i].re = (float)((int8_t)(in[i] << 4) >> 4) * scale;
+                    out[outCount + i].im = (float)((int8_t)in[i] >> 4) * scale;
+                }
+                in += len;
+                size -= len + 1;
+                outCount += len;
+            }
+            return outCount;
+        }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
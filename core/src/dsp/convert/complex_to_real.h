@@ -16,9 +16,12 @@ namespace dsp::convert {
             return count;
         }
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
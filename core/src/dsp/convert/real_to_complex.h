@@ -12,12 +12,13 @@ namespace dsp::convert {
         ~RealToComplex() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            buffer::free(nullBuf);
+            buffer::freeWork(nullBuf, nullSize);
         }
 
         void init(stream<float>* in) {
-            nullBuf = buffer::alloc<float>(STREAM_BUFFER_SIZE);
-            buffer::clear(nullBuf, STREAM_BUFFER_SIZE);
+            nullBuf = buffer::allocWork<float>(STREAM_BUFFER_SIZE);
+            nullSize = STREAM_BUFFER_SIZE;
+            buffer::clear(nullBuf, nullSize);
             base_type::init(in);
         }
 
@@ -26,9 +27,12 @@ namespace dsp::convert {
             return count;
         }
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -38,7 +42,14 @@ namespace dsp::convert {
         }
 
     private:
+        void resizeBuffers(int inputSize) {
+            nullBuf = buffer::resizeWork(nullBuf, nullSize, inputSize);
+            nullSize = inputSize;
+            buffer::clear(nullBuf, nullSize);
+        }
+
         float* nullBuf;
+        int nullSize = 0;
 
     };
 }
\ No newline at end of file
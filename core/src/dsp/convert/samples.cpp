@@ -0,0 +1,374 @@
+#include "samples.h"
+#include <math.h>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+// MSVC allows any intrinsic without changing the target of the whole file
+#include <intrin.h>
+#define CONVERT_AVX2
+#else
+#define CONVERT_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+namespace dsp::convert {
+    // Affine map applied to the raw values, with the offset, scale and correction folded in
+    struct Coefs {
+        float ai;
+        float bi;
+        float aq;
+        float bq;
+        float cross;
+    };
+
+    struct Kernels {
+        void (*u8)(complex_t* out, const uint8_t* in, int count, const Coefs& c);
+        void (*i8)(complex_t* out, const int8_t* in, int count, const Coefs& c);
+        void (*i12)(complex_t* out, const uint8_t* in, int count, const Coefs& c);
+        void (*i16)(complex_t* out, const int16_t* in, int count, const Coefs& c);
+        void (*i16Planar)(complex_t* out, const int16_t* re, const int16_t* im, int count, const Coefs& c);
+    };
+
+    IQCorrection IQCorrection::fromImbalance(float dcI, float dcQ, float gainRatio, float phaseError) {
+        // The received Q is gainRatio * (Q * cos(phaseError) + I * sin(phaseError))
+        IQCorrection corr;
+        corr.dcI = dcI;
+        corr.dcQ = dcQ;
+        corr.gainQ = 1.0f / (gainRatio * cosf(phaseError));
+        corr.cross = -tanf(phaseError);
+        return corr;
+    }
+
+    static Coefs makeCoefs(float offset, float scale, const IQCorrection* corr) {
+        IQCorrection none;
+        if (!corr) { corr = &none; }
+        Coefs c;
+        c.ai = scale * corr->gainI;
+        c.bi = -((offset * scale) + corr->dcI) * corr->gainI;
+        c.aq = scale * corr->gainQ;
+        c.bq = -((offset * scale) + corr->dcQ) * corr->gainQ;
+        c.cross = corr->cross;
+        return c;
+    }
+
+    // ======== Generic ========
+
+    static inline void genericStore(complex_t* out, float i, float q, const Coefs& c) {
+        float re = (i * c.ai) + c.bi;
+        out->re = re;
+        out->im = (q * c.aq) + c.bq + (re * c.cross);
+    }
+
+    template <class T>
+    static void genericInterleaved(complex_t* out, const T* in, int count, const Coefs& c) {
+        for (int i = 0; i < count; i++) {
+            genericStore(&out[i], (float)in[2 * i], (float)in[(2 * i) + 1], c);
+        }
+    }
+
+    static void genericI12(complex_t* out, const uint8_t* in, int count, const Coefs& c) {
+        for (int i = 0; i < count; i++) {
+            int re = (in[0] | (in[1] << 8)) & 0xFFF;
+            int im = (in[1] >> 4) | (in[2] << 4);
+            genericStore(&out[i], (float)((re ^ 0x800) - 0x800), (float)((im ^ 0x800) - 0x800), c);
+            in += 3;
+        }
+    }
+
+    static void genericPlanar(complex_t* out, const int16_t* re, const int16_t* im, int count, const Coefs& c) {
+        for (int i = 0; i < count; i++) {
+            genericStore(&out[i], (float)re[i], (float)im[i], c);
+        }
+    }
+
+    static const Kernels genericKernels = {
+        genericInterleaved<uint8_t>,
+        genericInterleaved<int8_t>,
+        genericI12,
+        genericInterleaved<int16_t>,
+        genericPlanar
+    };
+
+#ifdef CONVERT_X86
+    // ======== SSE2 ========
+
+    // Converts 4 values (2 samples) and applies the map. The cross term adds the corrected I to the Q next to it,
+    // the check is taken out of the loops by the compiler
+    static inline void sse2Store(float* out, __m128i v, __m128 a, __m128 b, __m128 x, bool cross) {
+        __m128 y = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), a), b);
+        if (cross) { y = _mm_add_ps(y, _mm_mul_ps(_mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 2, 0, 0)), x)); }
+        _mm_storeu_ps(out, y);
+    }
+
+    static inline __m128i sse2Lo16To32(__m128i v) { return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); }
+    static inline __m128i sse2Hi16To32(__m128i v) { return _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16); }
+
+#define SSE2_COEFS                                              \
+    __m128 a = _mm_setr_ps(c.ai, c.aq, c.ai, c.aq);             \
+    __m128 b = _mm_setr_ps(c.bi, c.bq, c.bi, c.bq);             \
+    __m128 x = _mm_setr_ps(0.0f, c.cross, 0.0f, c.cross);       \
+    bool cross = (c.cross != 0.0f);                             \
+    float* fout = (float*)out;
+
+    static void sse2U8(complex_t* out, const uint8_t* in, int count, const Coefs& c) {
+        SSE2_COEFS
+        __m128i zero = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&in[i * 2]);
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            sse2Store(&fout[i * 2], _mm_unpacklo_epi16(lo, zero), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 4], _mm_unpackhi_epi16(lo, zero), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 8], _mm_unpacklo_epi16(hi, zero), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 12], _mm_unpackhi_epi16(hi, zero), a, b, x, cross);
+        }
+        genericInterleaved(&out[i], &in[i * 2], count - i, c);
+    }
+
+    static void sse2I8(complex_t* out, const int8_t* in, int count, const Coefs& c) {
+        SSE2_COEFS
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            // Sign extend by putting the byte in the high half and shifting it back
+            __m128i v = _mm_loadu_si128((const __m128i*)&in[i * 2]);
+            __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+            __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+            sse2Store(&fout[i * 2], sse2Lo16To32(lo), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 4], sse2Hi16To32(lo), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 8], sse2Lo16To32(hi), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 12], sse2Hi16To32(hi), a, b, x, cross);
+        }
+        genericInterleaved(&out[i], &in[i * 2], count - i, c);
+    }
+
+    static void sse2I16(complex_t* out, const int16_t* in, int count, const Coefs& c) {
+        SSE2_COEFS
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&in[i * 2]);
+            sse2Store(&fout[i * 2], sse2Lo16To32(v), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 4], sse2Hi16To32(v), a, b, x, cross);
+        }
+        genericInterleaved(&out[i], &in[i * 2], count - i, c);
+    }
+
+    static void sse2Planar(complex_t* out, const int16_t* re, const int16_t* im, int count, const Coefs& c) {
+        SSE2_COEFS
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i vre = _mm_loadu_si128((const __m128i*)&re[i]);
+            __m128i vim = _mm_loadu_si128((const __m128i*)&im[i]);
+            __m128i lo = _mm_unpacklo_epi16(vre, vim);
+            __m128i hi = _mm_unpackhi_epi16(vre, vim);
+            sse2Store(&fout[i * 2], sse2Lo16To32(lo), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 4], sse2Hi16To32(lo), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 8], sse2Lo16To32(hi), a, b, x, cross);
+            sse2Store(&fout[(i * 2) + 12], sse2Hi16To32(hi), a, b, x, cross);
+        }
+        genericPlanar(&out[i], &re[i], &im[i], count - i, c);
+    }
+
+    static const Kernels sse2Kernels = {
+        sse2U8,
+        sse2I8,
+        genericI12,
+        sse2I16,
+        sse2Planar
+    };
+
+    // ======== AVX2 ========
+
+    // Converts 8 values (4 samples) and applies the map
+    CONVERT_AVX2 static inline void avx2Store(float* out, __m256i v, __m256 a, __m256 b, __m256 x, bool cross) {
+        __m256 y = _mm256_fmadd_ps(_mm256_cvtepi32_ps(v), a, b);
+        if (cross) { y = _mm256_fmadd_ps(_mm256_moveldup_ps(y), x, y); }
+        _mm256_storeu_ps(out, y);
+    }
+
+    // Unpacks 4 samples of 12 bits, reads 16 bytes
+    CONVERT_AVX2 static inline __m256i avx2Unpack12(const uint8_t* in, __m128i shuf) {
+        // Put the two bytes holding each value in a 16-bit lane, I is in the low 12 bits and Q in the high ones
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), shuf);
+        __m128i re = _mm_srai_epi16(_mm_slli_epi16(v, 4), 4);
+        __m128i im = _mm_srai_epi16(v, 4);
+        return _mm256_cvtepi16_epi32(_mm_blend_epi16(re, im, 0xAA));
+    }
+
+#define AVX2_COEFS                                                                                  \
+    __m256 a = _mm256_setr_ps(c.ai, c.aq, c.ai, c.aq, c.ai, c.aq, c.ai, c.aq);                      \
+    __m256 b = _mm256_setr_ps(c.bi, c.bq, c.bi, c.bq, c.bi, c.bq, c.bi, c.bq);                      \
+    __m256 x = _mm256_setr_ps(0.0f, c.cross, 0.0f, c.cross, 0.0f, c.cross, 0.0f, c.cross);          \
+    bool cross = (c.cross != 0.0f);                                                                 \
+    float* fout = (float*)out;
+
+    CONVERT_AVX2 static void avx2U8(complex_t* out, const uint8_t* in, int count, const Coefs& c) {
+        AVX2_COEFS
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&in[i * 2]);
+            avx2Store(&fout[i * 2], _mm256_cvtepu8_epi32(v), a, b, x, cross);
+            avx2Store(&fout[(i * 2) + 8], _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)), a, b, x, cross);
+        }
+        genericInterleaved(&out[i], &in[i * 2], count - i, c);
+    }
+
+    CONVERT_AVX2 static void avx2I8(complex_t* out, const int8_t* in, int count, const Coefs& c) {
+        AVX2_COEFS
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&in[i * 2]);
+            avx2Store(&fout[i * 2], _mm256_cvtepi8_epi32(v), a, b, x, cross);
+            avx2Store(&fout[(i * 2) + 8], _mm256_cvtepi8_epi32(_mm_srli_si128(v, 8)), a, b, x, cross);
+        }
+        genericInterleaved(&out[i], &in[i * 2], count - i, c);
+    }
+
+    CONVERT_AVX2 static void avx2I12(complex_t* out, const uint8_t* in, int count, const Coefs& c) {
+        AVX2_COEFS
+        __m128i shuf = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+        int i = 0;
+
+        // Each group of 4 samples is 12 bytes but 16 are read, so stop early enough not to read past the end
+        for (; i + 10 <= count; i += 8) {
+            avx2Store(&fout[i * 2], avx2Unpack12(&in[i * 3], shuf), a, b, x, cross);
+            avx2Store(&fout[(i * 2) + 8], avx2Unpack12(&in[(i * 3) + 12], shuf), a, b, x, cross);
+        }
+        genericI12(&out[i], &in[i * 3], count - i, c);
+    }
+
+    CONVERT_AVX2 static void avx2I16(complex_t* out, const int16_t* in, int count, const Coefs& c) {
+        AVX2_COEFS
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)&in[i * 2]);
+            __m128i v1 = _mm_loadu_si128((const __m128i*)&in[(i * 2) + 8]);
+            avx2Store(&fout[i * 2], _mm256_cvtepi16_epi32(v0), a, b, x, cross);
+            avx2Store(&fout[(i * 2) + 8], _mm256_cvtepi16_epi32(v1), a, b, x, cross);
+        }
+        genericInterleaved(&out[i], &in[i * 2], count - i, c);
+    }
+
+    CONVERT_AVX2 static void avx2Planar(complex_t* out, const int16_t* re, const int16_t* im, int count, const Coefs& c) {
+        AVX2_COEFS
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i vre = _mm_loadu_si128((const __m128i*)&re[i]);
+            __m128i vim = _mm_loadu_si128((const __m128i*)&im[i]);
+            avx2Store(&fout[i * 2], _mm256_cvtepi16_epi32(_mm_unpacklo_epi16(vre, vim)), a, b, x, cross);
+            avx2Store(&fout[(i * 2) + 8], _mm256_cvtepi16_epi32(_mm_unpackhi_epi16(vre, vim)), a, b, x, cross);
+        }
+        genericPlanar(&out[i], &re[i], &im[i], count - i, c);
+    }
+
+    static const Kernels avx2Kernels = {
+        avx2U8,
+        avx2I8,
+        avx2I12,
+        avx2I16,
+        avx2Planar
+    };
+#endif
+
+    // ======== Dispatch ========
+
+    static bool supported(Arch arch) {
+        switch (arch) {
+        case ARCH_GENERIC:
+            return true;
+#ifdef CONVERT_X86
+        case ARCH_SSE2:
+            // Part of x86_64
+            return true;
+        case ARCH_AVX2:
+        {
+#ifdef _MSC_VER
+            // AVX2 and FMA support, and the OS saving the AVX registers
+            int info[4];
+            __cpuid(info, 1);
+            bool fma = info[2] & (1 << 12);
+            bool osxsave = info[2] & (1 << 27);
+            __cpuidex(info, 7, 0);
+            bool avx2 = info[1] & (1 << 5);
+            return avx2 && fma && osxsave && ((_xgetbv(0) & 6) == 6);
+#else
+            // Needed since this can run before the constructors
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    static const Kernels* kernelsFor(Arch arch) {
+        switch (arch) {
+#ifdef CONVERT_X86
+        case ARCH_SSE2:
+            return &sse2Kernels;
+        case ARCH_AVX2:
+            return &avx2Kernels;
+#endif
+        default:
+            return &genericKernels;
+        }
+    }
+
+    static Arch bestArch() {
+        Arch arch = ARCH_AVX2;
+        while (!supported(arch)) { arch = (Arch)(arch - 1); }
+        return arch;
+    }
+
+    static std::atomic<Arch> currentArch = bestArch();
+    static std::atomic<const Kernels*> kernels = kernelsFor(currentArch);
+
+    void u8ToComplex(complex_t* out, const uint8_t* in, int count, float offset, float scale, const IQCorrection* corr) {
+        kernels.load(std::memory_order_relaxed)->u8(out, in, count, makeCoefs(offset, scale, corr));
+    }
+
+    void i8ToComplex(complex_t* out, const int8_t* in, int count, float scale, const IQCorrection* corr) {
+        kernels.load(std::memory_order_relaxed)->i8(out, in, count, makeCoefs(0.0f, scale, corr));
+    }
+
+    void i12ToComplex(complex_t* out, const uint8_t* in, int count, float scale, const IQCorrection* corr) {
+        kernels.load(std::memory_order_relaxed)->i12(out, in, count, makeCoefs(0.0f, scale, corr));
+    }
+
+    void i16ToComplex(complex_t* out, const int16_t* in, int count, float scale, const IQCorrection* corr) {
+        kernels.load(std::memory_order_relaxed)->i16(out, in, count, makeCoefs(0.0f, scale, corr));
+    }
+
+    void i16PlanarToComplex(complex_t* out, const int16_t* re, const int16_t* im, int count, float scale, const IQCorrection* corr) {
+        kernels.load(std::memory_order_relaxed)->i16Planar(out, re, im, count, makeCoefs(0.0f, scale, corr));
+    }
+
+    Arch getArch() {
+        return currentArch;
+    }
+
+    bool setArch(Arch arch) {
+        if (!supported(arch)) { return false; }
+        currentArch = arch;
+        kernels = kernelsFor(arch);
+        return true;
+    }
+
+    const char* getArchName(Arch arch) {
+        switch (arch) {
+        case ARCH_GENERIC:
+            return "Generic";
+        case ARCH_SSE2:
+            return "SSE2";
+        case ARCH_AVX2:
+            return "AVX2";
+        default:
+            return "Unknown";
+        }
+    }
+}
\ No newline at end of file
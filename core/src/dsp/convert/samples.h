@@ -0,0 +1,44 @@
+#pragma once
+#include "../types.h"
+#include <stdint.h>
+
+namespace dsp::convert {
+    enum Arch {
+        ARCH_GENERIC,
+        ARCH_SSE2,
+        ARCH_AVX2
+    };
+
+    // Correction applied while converting, on the already scaled samples:
+    // re = (i - dcI) * gainI
+    // im = (q - dcQ) * gainQ + re * cross
+    struct IQCorrection {
+        float dcI = 0.0f;
+        float dcQ = 0.0f;
+        float gainI = 1.0f;
+        float gainQ = 1.0f;
+        float cross = 0.0f;
+
+        // From the DC offset, the amplitude of Q relative to I and the phase error of Q in radians
+        static IQCorrection fromImbalance(float dcI, float dcQ, float gainRatio, float phaseError);
+    };
+
+    // Conversion of raw interleaved IQ samples to complex, using the fastest kernels supported by the CPU.
+    // Each value is converted as (value - offset) * scale, followed by the correction if one is given.
+
+    void u8ToComplex(complex_t* out, const uint8_t* in, int count, float offset, float scale, const IQCorrection* corr = NULL);
+    void i8ToComplex(complex_t* out, const int8_t* in, int count, float scale, const IQCorrection* corr = NULL);
+
+    // Two 12-bit values in 3 bytes: I in the low 12 bits of the first two bytes, Q in the remaining 12 bits
+    void i12ToComplex(complex_t* out, const uint8_t* in, int count, float scale, const IQCorrection* corr = NULL);
+
+    void i16ToComplex(complex_t* out, const int16_t* in, int count, float scale, const IQCorrection* corr = NULL);
+
+    // I and Q in separate buffers
+    void i16PlanarToComplex(complex_t* out, const int16_t* re, const int16_t* im, int count, float scale, const IQCorrection* corr = NULL);
+
+    // Kernels in use, can be forced to a lower level. Returns false if the CPU doesn't support it
+    Arch getArch();
+    bool setArch(Arch arch);
+    const char* getArchName(Arch arch);
+}
\ No newline at end of file
@@ -132,9 +132,12 @@ namespace dsp::demod {
             return count;
         }
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -144,6 +147,16 @@ namespace dsp::demod {
         }
 
     protected:
+        // The output of the AGCs is used as scratch space
+        void resizeBuffers(int inputSize) {
+            carrierAgc.out.setBufferSize(inputSize);
+            if constexpr (std::is_same_v<T, stereo_t>) {
+                audioAgc.out.setBufferSize(inputSize);
+            }
+            std::lock_guard<std::mutex> lck(lpfMtx);
+            lpf.setMaxInputSize(inputSize);
+        }
+
         AGCMode _agcMode;
 
         double _samplerate;
@@ -102,9 +102,12 @@ namespace dsp::demod {
             return count;
         }
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -114,6 +117,14 @@ namespace dsp::demod {
         }
 
     private:
+        void resizeBuffers(int inputSize) {
+            if constexpr (std::is_same_v<T, stereo_t>) {
+                demod.out.setBufferSize(inputSize);
+            }
+            std::lock_guard<std::mutex> lck(filterMtx);
+            fir.setMaxInputSize(inputSize);
+        }
+
         void updateFilter(bool lowPass, bool highPass) {
             std::lock_guard<std::mutex> lck(filterMtx);
 
@@ -4,7 +4,13 @@
 #include "../math/hz_to_rads.h"
 #include "../math/normalize_phase.h"
 
+// Number of samples discriminated at once, the phase differences are kept in a small buffer that stays in cache
+#define QUADRATURE_CHUNK_SIZE   1024
+
 namespace dsp::demod {
+    // The phase difference between two samples is the phase of one times the conjugate of the other,
+    // so the whole buffer goes through a conjugate multiply and an atan2 kernel instead of one atan2 per sample
+    // followed by a phase wrap. Safe to use with out == in.
     class Quadrature : public Processor<complex_t, float> {
         using base_type = Processor<complex_t, float>;
     public:
@@ -16,7 +22,7 @@ namespace dsp::demod {
 
         
         virtual void init(stream<complex_t>* in, double deviation) {
-            _invDeviation = 1.0 / deviation;
+            _deviation = deviation;
             base_type::init(in);
         }
 
@@ -27,20 +33,26 @@ namespace dsp::demod {
         void setDeviation(double deviation) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            _invDeviation = 1.0 / deviation;
+            _deviation = deviation;
         }
 
         void setDeviation(double deviation, double samplerate) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            _invDeviation = 1.0 / math::hzToRads(deviation, samplerate);
+            _deviation = math::hzToRads(deviation, samplerate);
         }
 
         inline int process(int count, complex_t* in, float* out) {
-            for (int i = 0; i < count; i++) {
-                float cphase = in[i].phase();
-                out[i] = math::normalizePhase(cphase - phase) * _invDeviation;
-                phase = cphase;
+            for (int i = 0; i < count; i += QUADRATURE_CHUNK_SIZE) {
+                int len = std::min<int>(count - i, QUADRATURE_CHUNK_SIZE);
+
+                // Multiply each sample by the conjugate of the previous one
+                diffs[0] = in[i] * lastSample.conj();
+                volk_32fc_x2_multiply_conjugate_32fc((lv_32fc_t*)&diffs[1], (lv_32fc_t*)&in[i + 1], (lv_32fc_t*)&in[i], len - 1);
+                lastSample = in[i + len - 1];
+
+                // The output only overlaps input samples that were already used
+                volk_32fc_s32f_atan2_32f(&out[i], (lv_32fc_t*)diffs, _deviation, len);
             }
             return count;
         }
@@ -48,12 +60,15 @@ namespace dsp::demod {
         void reset() {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            phase = 0.0f;
+            lastSample = { 1.0f, 0.0f };
         }
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -63,7 +78,8 @@ namespace dsp::demod {
         }
 
     protected:
-        float _invDeviation;
-        float phase = 0.0f;
+        float _deviation;
+        complex_t lastSample = { 1.0f, 0.0f };
+        complex_t diffs[QUADRATURE_CHUNK_SIZE];
     };
 }
\ No newline at end of file
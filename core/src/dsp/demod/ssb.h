@@ -91,9 +91,12 @@ namespace dsp::demod {
             return count;
         }
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -103,6 +106,14 @@ namespace dsp::demod {
         }
 
     protected:
+        // The output of the xlator and AGC is used as scratch space
+        void resizeBuffers(int inputSize) {
+            xlator.out.setBufferSize(inputSize);
+            if constexpr (std::is_same_v<T, stereo_t>) {
+                agc.out.setBufferSize(inputSize);
+            }
+        }
+
         double getTranslation() {
             if (_mode == Mode::USB) {
                 return _bandwidth / 2.0;
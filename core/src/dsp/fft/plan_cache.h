@@ -0,0 +1,263 @@
+#pragma once
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <fftw3.h>
+
+// Longest time in seconds the background planner may hold the planner mutex while measuring a plan
+#define PLAN_CACHE_MAX_MEASURE_TIME 0.05
+
+namespace dsp::fft {
+    enum PlanType {
+        PLAN_C2C,
+        PLAN_R2C,
+        PLAN_C2R
+    };
+
+    // Handle to a cached plan. It has to be executed with the new-array functions (fftwf_execute_dft, etc)
+    // on buffers with the alignment it was requested for (fftwf_alignment_of, 0 for fftwf_malloc or buffer::alloc),
+    // and fetched again with get() every time since the plan is swapped for a measured one once it's ready.
+    // Handles are valid until the cache is destroyed.
+    class Plan {
+        friend class PlanCache;
+    public:
+        inline fftwf_plan get() { return plan.load(std::memory_order_acquire); }
+
+        // Check if the plan is final (found in wisdom or measured)
+        inline bool isFinal() { return final.load(std::memory_order_acquire); }
+
+    private:
+        std::atomic<fftwf_plan> plan = NULL;
+        std::atomic<bool> final = false;
+
+        // A thread may still be executing the first plan after the swap, it's only destroyed with the cache
+        fftwf_plan estimated = NULL;
+
+        PlanType type;
+        int n;
+        int direction;
+        bool inPlace;
+        int howmany;
+        int dist;
+        int alignment;
+    };
+
+    // Process wide cache of FFTW plans. A plan is planned once per layout: from wisdom if there is some,
+    // otherwise estimated right away and measured by a background thread. FFTW's planner isn't thread safe
+    // so every plan made or destroyed outside of the cache has to hold getPlannerMutex(). Getting a plan that
+    // is already cached never waits on the planner.
+    class PlanCache {
+    public:
+        ~PlanCache() {
+            // Stop the background planner
+            {
+                std::lock_guard<std::mutex> lck(queueMtx);
+                stopWorker = true;
+            }
+            queueCnd.notify_all();
+            if (workerThread.joinable()) { workerThread.join(); }
+
+            // Destroy all plans
+            std::lock_guard<std::mutex> lck(plannerMtx);
+            std::lock_guard<std::mutex> lck2(plansMtx);
+            for (auto& [key, p] : plans) {
+                if (p->estimated) { fftwf_destroy_plan(p->estimated); }
+                if (p->get() != p->estimated) { fftwf_destroy_plan(p->get()); }
+                delete p;
+            }
+            plans.clear();
+        }
+
+        static PlanCache& getInstance() {
+            static PlanCache instance;
+            return instance;
+        }
+
+        // Import the wisdom saved by a previous run, it's saved back there by saveWisdom()
+        void loadWisdom(const std::string& path) {
+            std::lock_guard<std::mutex> lck(plannerMtx);
+            wisdomPath = path;
+            fftwf_import_wisdom_from_filename(wisdomPath.c_str());
+        }
+
+        void saveWisdom() {
+            std::lock_guard<std::mutex> lck(plannerMtx);
+            if (wisdomPath.empty()) { return; }
+            fftwf_export_wisdom_to_filename(wisdomPath.c_str());
+        }
+
+        // FFTW_MEASURE, FFTW_PATIENT or FFTW_EXHAUSTIVE, and max time spent measuring a single plan. Other threads
+        // planning at the same time wait on the measurement so the limit is capped to PLAN_CACHE_MAX_MEASURE_TIME
+        void setBackgroundPlanning(unsigned int flags, double timeLimit = PLAN_CACHE_MAX_MEASURE_TIME) {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            bgFlags = flags;
+            bgTimeLimit = std::min<double>(timeLimit, PLAN_CACHE_MAX_MEASURE_TIME);
+        }
+
+        // Complex transform of howmany signals of n samples spaced by dist samples (n if 0)
+        Plan* getDFT(int n, int direction, bool inPlace = false, int howmany = 1, int dist = 0, int alignment = 0) {
+            return getPlan(PLAN_C2C, n, direction, inPlace, howmany, dist ? dist : n, alignment);
+        }
+
+        // Real to complex transform giving (n / 2) + 1 bins
+        Plan* getR2C(int n, bool inPlace = false, int alignment = 0) {
+            return getPlan(PLAN_R2C, n, FFTW_FORWARD, inPlace, 1, n, alignment);
+        }
+
+        // Complex to real transform, the input is overwritten
+        Plan* getC2R(int n, bool inPlace = false, int alignment = 0) {
+            return getPlan(PLAN_C2R, n, FFTW_BACKWARD, inPlace, 1, n, alignment);
+        }
+
+        std::mutex& getPlannerMutex() {
+            return plannerMtx;
+        }
+
+    private:
+        using Key = std::tuple<int, int, int, bool, int, int, int>;
+
+        PlanCache() {}
+
+        Plan* findPlan(const Key& key) {
+            std::lock_guard<std::mutex> lck(plansMtx);
+            auto it = plans.find(key);
+            return (it != plans.end()) ? it->second : NULL;
+        }
+
+        Plan* getPlan(PlanType type, int n, int direction, bool inPlace, int howmany, int dist, int alignment) {
+            Key key = { type, n, direction, inPlace, howmany, dist, alignment };
+            Plan* p = findPlan(key);
+            if (p) { return p; }
+            {
+                // Check again once owning the planner in case another thread was making the same plan
+                std::lock_guard<std::mutex> lck(plannerMtx);
+                p = findPlan(key);
+                if (p) { return p; }
+
+                p = new Plan;
+                p->type = type;
+                p->n = n;
+                p->direction = direction;
+                p->inPlace = inPlace;
+                p->howmany = howmany;
+                p->dist = dist;
+                p->alignment = alignment;
+
+                // Use wisdom if there is some, otherwise estimate for now
+                fftwf_plan wise = makePlan(p, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+                if (wise) {
+                    p->plan = wise;
+                    p->final = true;
+                }
+                else {
+                    p->estimated = makePlan(p, FFTW_ESTIMATE);
+                    p->plan = p->estimated;
+                }
+                {
+                    std::lock_guard<std::mutex> lck2(plansMtx);
+                    plans[key] = p;
+                }
+                if (p->isFinal()) { return p; }
+            }
+
+            // Have it measured in the background
+            {
+                std::lock_guard<std::mutex> lck(queueMtx);
+                queue.push_back(p);
+                if (!workerThread.joinable()) { workerThread = std::thread(&PlanCache::worker, this); }
+            }
+            queueCnd.notify_all();
+            return p;
+        }
+
+        // Must be called with the planner mutex held
+        fftwf_plan makePlan(Plan* p, unsigned int flags) {
+            // Plan on scratch buffers with the same alignment and placement as the user's
+            int bins = (p->type == PLAN_C2C) ? p->n : ((p->n / 2) + 1);
+            int inSize = (p->type == PLAN_R2C) ? p->n : (2 * bins);
+            int outSize = (p->type == PLAN_C2R) ? p->n : (2 * bins);
+            int span = (p->howmany - 1) * p->dist;
+            int shift = p->alignment / sizeof(float);
+            float* inBuf = fftwf_alloc_real(std::max<int>(inSize, outSize) + (2 * span) + shift);
+            float* outBuf = p->inPlace ? inBuf : fftwf_alloc_real(outSize + (2 * span) + shift);
+            float* in = &inBuf[shift];
+            float* out = &outBuf[shift];
+
+            fftwf_plan plan = NULL;
+            if (p->type == PLAN_C2C) {
+                plan = fftwf_plan_many_dft(1, &p->n, p->howmany, (fftwf_complex*)in, NULL, 1, p->dist, (fftwf_complex*)out, NULL, 1, p->dist, p->direction, flags);
+            }
+            else if (p->type == PLAN_R2C) {
+                plan = fftwf_plan_dft_r2c_1d(p->n, in, (fftwf_complex*)out, flags);
+            }
+            else {
+                plan = fftwf_plan_dft_c2r_1d(p->n, (fftwf_complex*)in, out, flags);
+            }
+
+            fftwf_free(inBuf);
+            if (!p->inPlace) { fftwf_free(outBuf); }
+            return plan;
+        }
+
+        void worker() {
+            while (true) {
+                // Get the next plan to measure
+                Plan* p;
+                unsigned int flags;
+                double timeLimit;
+                {
+                    std::unique_lock<std::mutex> lck(queueMtx);
+                    queueCnd.wait(lck, [this] { return !queue.empty() || stopWorker; });
+                    if (stopWorker) { return; }
+                    p = queue.front();
+                    queue.pop_front();
+                    flags = bgFlags;
+                    timeLimit = bgTimeLimit;
+                }
+
+                // Measure it, the time limit bounds how long threads making a new plan wait on the planner
+                fftwf_plan measured;
+                {
+                    std::lock_guard<std::mutex> lck(plannerMtx);
+                    fftwf_set_timelimit(timeLimit);
+                    measured = makePlan(p, flags);
+                    fftwf_set_timelimit(FFTW_NO_TIMELIMIT);
+                }
+
+                // Swap it in
+                if (measured) {
+                    p->plan.store(measured, std::memory_order_release);
+                }
+                p->final = true;
+
+                // Save the wisdom once everything was measured
+                bool empty;
+                {
+                    std::lock_guard<std::mutex> lck(queueMtx);
+                    empty = queue.empty();
+                }
+                if (empty) { saveWisdom(); }
+            }
+        }
+
+        std::mutex plannerMtx;
+        std::mutex plansMtx;
+        std::map<Key, Plan*> plans;
+        std::string wisdomPath;
+
+        // Background planning
+        std::mutex queueMtx;
+        std::condition_variable queueCnd;
+        std::deque<Plan*> queue;
+        std::thread workerThread;
+        bool stopWorker = false;
+        unsigned int bgFlags = FFTW_MEASURE;
+        double bgTimeLimit = PLAN_CACHE_MAX_MEASURE_TIME;
+    };
+}
\ No newline at end of file
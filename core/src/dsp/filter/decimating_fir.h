@@ -2,6 +2,8 @@
 #include "fir.h"
 
 namespace dsp::filter {
+    // Only computes the outputs that are kept. The input is read in place, only the samples needed to
+    // bridge with the previous buffer are copied, which also makes it safe to use with out == in.
     template <class D, class T>
     class DecimatingFIR : public FIR<D, T> {
         using base_type = FIR<D, T>;
@@ -10,9 +12,16 @@ namespace dsp::filter {
 
         DecimatingFIR(stream<D>* in, tap<T>& taps, int decimation) { init(in, taps, decimation); }
 
+        ~DecimatingFIR() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(tail);
+        }
+
         void init(stream<D>* in, tap<T>& taps, int decimation) {
             _decimation = decimation;
             base_type::init(in, taps);
+            tail = buffer::alloc<D>(base_type::_taps.size);
         }
 
         void setTaps(tap<T>& taps) {
@@ -21,6 +30,8 @@ namespace dsp::filter {
             base_type::tempStop();
             offset = 0;
             base_type::setTaps(taps);
+            buffer::free(tail);
+            tail = buffer::alloc<D>(base_type::_taps.size);
             base_type::tempStart();
         }
 
@@ -43,26 +54,45 @@ namespace dsp::filter {
         }
 
         inline int process(int count, const D* in, D* out) {
-            // Copy data to work buffer
-            memcpy(base_type::bufStart, in, count * sizeof(D));
-
-            // Do convolution
+            int histLen = base_type::_taps.size - 1;
             int outCount = 0;
+
+            // Find how many samples must go through the work buffer. Past those, an output is always written
+            // behind the oldest sample still needed ((j - 1) * (decim - 1) > histLen - offset - decim) so the
+            // rest can be read straight from the input even when processing in place.
+            int headCount = count;
+            if (_decimation > 1) {
+                int margin = std::max<int>(histLen - offset - _decimation, 0);
+                int minOutputs = (margin / (_decimation - 1)) + 2;
+                headCount = std::min<int>(std::max<int>(offset + (minOutputs * _decimation), histLen), count);
+            }
+
+            // Copy the head to the work buffer and save the tail for the next call before anything is overwritten
+            base_type::reserve(headCount);
+            memcpy(base_type::bufStart, in, headCount * sizeof(D));
+            bool useTail = (count > headCount);
+            if (useTail) {
+                memcpy(tail, &in[count - histLen], histLen * sizeof(D));
+            }
+
+            // Outputs that need samples from the previous buffer
+            for (; offset < headCount; offset += _decimation) {
+                dotProduct(&out[outCount++], &base_type::buffer[offset]);
+            }
+
+            // Outputs computed directly from the input
             for (; offset < count; offset += _decimation) {
-                if constexpr (std::is_same_v<D, float> && std::is_same_v<T, float>) {
-                    volk_32f_x2_dot_prod_32f(&out[outCount++], &base_type::buffer[offset], base_type::_taps.taps, base_type::_taps.size);
-                }
-                if constexpr ((std::is_same_v<D, complex_t> || std::is_same_v<D, stereo_t>) && std::is_same_v<T, float>) {
-                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&out[outCount++], (lv_32fc_t*)&base_type::buffer[offset], base_type::_taps.taps, base_type::_taps.size);
-                }
-                if constexpr ((std::is_same_v<D, complex_t> || std::is_same_v<D, stereo_t>) && std::is_same_v<T, complex_t>) {
-                    volk_32fc_x2_dot_prod_32fc((lv_32fc_t*)&out[outCount++], (lv_32fc_t*)&base_type::buffer[offset], (lv_32fc_t*)base_type::_taps.taps, base_type::_taps.size);
-                }
+                dotProduct(&out[outCount++], &in[offset - histLen]);
             }
             offset -= count;
 
-            // Move unused data
-            memmove(base_type::buffer, &base_type::buffer[count], (base_type::_taps.size - 1) * sizeof(D));
+            // Keep the last samples for the next call
+            if (useTail) {
+                memcpy(base_type::buffer, tail, histLen * sizeof(D));
+            }
+            else {
+                memmove(base_type::buffer, &base_type::buffer[count], histLen * sizeof(D));
+            }
 
             return outCount;
         }
@@ -82,7 +112,20 @@ namespace dsp::filter {
         }
 
     protected:
+        inline void dotProduct(D* out, const D* in) {
+            if constexpr (std::is_same_v<D, float> && std::is_same_v<T, float>) {
+                volk_32f_x2_dot_prod_32f(out, in, base_type::_taps.taps, base_type::_taps.size);
+            }
+            if constexpr ((std::is_same_v<D, complex_t> || std::is_same_v<D, stereo_t>) && std::is_same_v<T, float>) {
+                volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)out, (lv_32fc_t*)in, base_type::_taps.taps, base_type::_taps.size);
+            }
+            if constexpr ((std::is_same_v<D, complex_t> || std::is_same_v<D, stereo_t>) && std::is_same_v<T, complex_t>) {
+                volk_32fc_x2_dot_prod_32fc((lv_32fc_t*)out, (lv_32fc_t*)in, (lv_32fc_t*)base_type::_taps.taps, base_type::_taps.size);
+            }
+        }
+
         int _decimation;
         int offset = 0;
+        D* tail = NULL;
     };
 }
\ No newline at end of file
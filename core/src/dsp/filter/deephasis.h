@@ -78,9 +78,12 @@ namespace dsp::filter {
 
         //DEFAULT_PROC_RUN();
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
@@ -0,0 +1,289 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include "fir.h"
+#include "../fft/plan_cache.h"
+
+namespace dsp::filter {
+    // Drop-in replacement for FIR doing the convolution by overlap-save through FFTW when it's cheaper.
+    // Both paths share the same history so the choice is made again for every buffer depending on its
+    // size, using costs measured once per process by a short benchmark. The output is identical to FIR
+    // (no added delay), a partial FFT block is used for the tail of each buffer.
+    template <class D, class T>
+    class FFTFIR : public FIR<D, T> {
+        using base_type = FIR<D, T>;
+        static constexpr bool realPath = std::is_same_v<D, float>;
+    public:
+        enum Mode {
+            MODE_AUTO,
+            MODE_DIRECT,
+            MODE_FFT
+        };
+
+        FFTFIR() {}
+
+        FFTFIR(stream<D>* in, tap<T>& taps, Mode mode = MODE_AUTO) { init(in, taps, mode); }
+
+        ~FFTFIR() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            destroyFFT();
+        }
+
+        void init(stream<D>* in, tap<T>& taps, Mode mode) {
+            _mode = mode;
+            base_type::init(in, taps);
+            initFFT();
+        }
+
+        void init(stream<D>* in, tap<T>& taps) {
+            init(in, taps, MODE_AUTO);
+        }
+
+        void setTaps(tap<T>& taps) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            base_type::setTaps(taps);
+            destroyFFT();
+            initFFT();
+            base_type::tempStart();
+        }
+
+        void setMode(Mode mode) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _mode = mode;
+            base_type::tempStart();
+        }
+
+        // Check which path would be used for a buffer of the given size
+        bool usesFFT(int count) {
+            if (_mode != MODE_AUTO) { return _mode == MODE_FFT; }
+            const Costs& c = getCosts();
+            double directCost = (double)count * (double)base_type::_taps.size * c.macNs;
+            double fftCost = (double)((count + chunk - 1) / chunk) * blockCost(fftSize);
+            return fftCost < directCost;
+        }
+
+        // Smallest tap count from which the FFT path wins for a buffer of the given size
+        static int getCrossover(int count = STREAM_BUFFER_SIZE / 16) {
+            const Costs& c = getCosts();
+            for (int tc = 2; tc < 64000; tc *= 2) {
+                int n = pickFFTSize(tc);
+                int l = n - tc + 1;
+                double fftCost = (double)((count + l - 1) / l) * blockCost(n);
+                if (fftCost < (double)count * (double)tc * c.macNs) { return tc; }
+            }
+            return 64000;
+        }
+
+        inline int process(int count, const D* in, D* out) {
+            if (!usesFFT(count)) {
+                return base_type::process(count, in, out);
+            }
+
+            // Copy data to work buffer
+            int histLen = base_type::_taps.size - 1;
+            base_type::reserve(count);
+            memcpy(base_type::bufStart, in, count * sizeof(D));
+
+            // Each block gives the outputs for the samples that follow the history it starts with
+            for (int i = 0; i < count; i += chunk) {
+                int len = std::min<int>(chunk, count - i);
+                memcpy(fftIn, &base_type::buffer[i], (histLen + len) * sizeof(D));
+                if (len < chunk) {
+                    buffer::clear<D>(fftIn, chunk - len, histLen + len);
+                }
+                transform(fwdPlan, invPlan, fftIn, fftFreq, response, fftOut, freqBins);
+                memcpy(&out[i], &fftOut[histLen], len * sizeof(D));
+            }
+
+            // Move unused data
+            memmove(base_type::buffer, &base_type::buffer[count], histLen * sizeof(D));
+
+            return count;
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+            base_type::updateSizes(count);
+
+            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+
+            base_type::_in->flush();
+            if (!base_type::out.swap(count)) { return -1; }
+            return count;
+        }
+
+    protected:
+        struct Costs {
+            double macNs;       // Direct path, per tap and per sample
+            double butterflyNs; // FFT path, per N*log2(N) for a forward and inverse transform plus the product
+        };
+
+        // Forward transform, product with the response and inverse transform of a block
+        static inline void transform(fft::Plan* fwd, fft::Plan* inv, D* in, complex_t* freq, const complex_t* resp, D* out, int bins) {
+            if constexpr (realPath) {
+                fftwf_execute_dft_r2c(fwd->get(), in, (fftwf_complex*)freq);
+            }
+            else {
+                fftwf_execute_dft(fwd->get(), (fftwf_complex*)in, (fftwf_complex*)freq);
+            }
+            volk_32fc_x2_multiply_32fc((lv_32fc_t*)freq, (lv_32fc_t*)freq, (lv_32fc_t*)resp, bins);
+            if constexpr (realPath) {
+                fftwf_execute_dft_c2r(inv->get(), (fftwf_complex*)freq, out);
+            }
+            else {
+                fftwf_execute_dft(inv->get(), (fftwf_complex*)freq, (fftwf_complex*)out);
+            }
+        }
+
+        static double blockCost(int n) {
+            return getCosts().butterflyNs * (double)n * log2((double)n);
+        }
+
+        static int pickFFTSize(int tapCount) {
+            // Usually best between 4 and 8 times the filter length, pick the lowest cost per output sample
+            int best = 0;
+            double bestCost = INFINITY;
+            int n = 1;
+            while (n < 2 * tapCount) { n <<= 1; }
+            for (int i = 0; i < 3; i++, n <<= 1) {
+                double cost = (double)n * log2((double)n) / (double)(n - tapCount + 1);
+                if (cost < bestCost) {
+                    best = n;
+                    bestCost = cost;
+                }
+            }
+            return best;
+        }
+
+        static const Costs& getCosts() {
+            static Costs costs;
+            static std::once_flag flag;
+            std::call_once(flag, [] { costs = benchmark(); });
+            return costs;
+        }
+
+        static Costs benchmark() {
+            const int tapCount = 128;
+            const int count = 2048;
+            const int n = 1024;
+            const int runs = 8;
+            Costs c;
+
+            // Time the direct path
+            {
+                tap<T> t = taps::alloc<T>(tapCount);
+                buffer::clear(t.taps, tapCount);
+                D* in = buffer::alloc<D>(count);
+                D* out = buffer::alloc<D>(count);
+                buffer::clear(in, count);
+                FIR<D, T> fir;
+                fir.init(NULL, t);
+                fir.out.free();
+                fir.process(count, in, out);
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < runs; i++) { fir.process(count, in, out); }
+                auto end = std::chrono::steady_clock::now();
+                c.macNs = std::chrono::duration<double, std::nano>(end - start).count() / ((double)runs * count * tapCount);
+                buffer::free(in);
+                buffer::free(out);
+                taps::free(t);
+            }
+
+            // Time one block of the FFT path
+            {
+                int bins = realPath ? (n / 2 + 1) : n;
+                D* in = (D*)fftwf_malloc(n * sizeof(D));
+                D* out = (D*)fftwf_malloc(n * sizeof(D));
+                complex_t* freq = (complex_t*)fftwf_malloc(bins * sizeof(complex_t));
+                complex_t* resp = buffer::alloc<complex_t>(bins);
+                buffer::clear(in, n);
+                buffer::clear(resp, bins);
+                fft::Plan* fwd;
+                fft::Plan* inv;
+                getPlans(n, fwd, inv);
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < runs * 4; i++) {
+                    transform(fwd, inv, in, freq, resp, out, bins);
+                }
+                auto end = std::chrono::steady_clock::now();
+                c.butterflyNs = std::chrono::duration<double, std::nano>(end - start).count() / ((double)runs * 4.0 * n * log2((double)n));
+                fftwf_free(in);
+                fftwf_free(out);
+                fftwf_free(freq);
+                buffer::free(resp);
+            }
+
+            return c;
+        }
+
+        void initFFT() {
+            int tapCount = base_type::_taps.size;
+            fftSize = pickFFTSize(tapCount);
+            chunk = fftSize - tapCount + 1;
+            freqBins = realPath ? (fftSize / 2 + 1) : fftSize;
+
+            fftIn = (D*)fftwf_malloc(fftSize * sizeof(D));
+            fftOut = (D*)fftwf_malloc(fftSize * sizeof(D));
+            fftFreq = (complex_t*)fftwf_malloc(freqBins * sizeof(complex_t));
+            response = buffer::alloc<complex_t>(freqBins);
+
+            // Taps are stored reversed, tap i is applied to the sample delayed by (size - 1 - i)
+            complex_t* impulse = (complex_t*)fftwf_malloc(fftSize * sizeof(complex_t));
+            complex_t* impulseFreq = (complex_t*)fftwf_malloc(fftSize * sizeof(complex_t));
+            buffer::clear(impulse, fftSize);
+            float scale = 1.0f / (float)fftSize;
+            for (int i = 0; i < tapCount; i++) {
+                if constexpr (std::is_same_v<T, float>) {
+                    impulse[tapCount - 1 - i] = { base_type::_taps.taps[i] * scale, 0.0f };
+                }
+                else {
+                    impulse[tapCount - 1 - i] = base_type::_taps.taps[i] * scale;
+                }
+            }
+            fft::Plan* p = fft::PlanCache::getInstance().getDFT(fftSize, FFTW_FORWARD);
+            fftwf_execute_dft(p->get(), (fftwf_complex*)impulse, (fftwf_complex*)impulseFreq);
+            memcpy(response, impulseFreq, freqBins * sizeof(complex_t));
+            fftwf_free(impulse);
+            fftwf_free(impulseFreq);
+
+            getPlans(fftSize, fwdPlan, invPlan);
+        }
+
+        // Complex and stereo data both go through a complex transform, like the dot products of the direct path
+        static void getPlans(int n, fft::Plan*& fwd, fft::Plan*& inv) {
+            fft::PlanCache& cache = fft::PlanCache::getInstance();
+            if constexpr (realPath) {
+                fwd = cache.getR2C(n);
+                inv = cache.getC2R(n);
+            }
+            else {
+                fwd = cache.getDFT(n, FFTW_FORWARD);
+                inv = cache.getDFT(n, FFTW_BACKWARD);
+            }
+        }
+
+        void destroyFFT() {
+            fftwf_free(fftIn);
+            fftwf_free(fftOut);
+            fftwf_free(fftFreq);
+            buffer::free(response);
+        }
+
+        Mode _mode = MODE_AUTO;
+        int fftSize;
+        int chunk;
+        int freqBins;
+        D* fftIn;
+        D* fftOut;
+        complex_t* fftFreq;
+        complex_t* response;
+        fft::Plan* fwdPlan;
+        fft::Plan* invPlan;
+    };
+}
\ No newline at end of file
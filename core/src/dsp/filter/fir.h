@@ -14,14 +14,15 @@ namespace dsp::filter {
         ~FIR() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            buffer::free(buffer);
+            buffer::freeWork(buffer, bufferSize);
         }
 
         virtual void init(stream<D>* in, tap<T>& taps) {
             _taps = taps;
 
-            // Allocate and clear buffer
-            buffer = buffer::alloc<D>(STREAM_BUFFER_SIZE + 64000);
+            // Allocate and clear the history, room for the input is made once its size is known
+            bufferSize = _taps.size;
+            buffer = buffer::allocWork<D>(bufferSize);
             bufStart = &buffer[_taps.size - 1];
             buffer::clear<D>(buffer, _taps.size - 1);
 
@@ -36,6 +37,13 @@ namespace dsp::filter {
             int oldTC = _taps.size;
             _taps = taps;
 
+            // Make room for the new taps, keeping the history
+            int maxInput = bufferSize - oldTC;
+            if (bufferSize < maxInput + _taps.size) {
+                buffer = buffer::resizeWork<D>(buffer, bufferSize, maxInput + _taps.size, oldTC - 1);
+                bufferSize = maxInput + _taps.size;
+            }
+
             // Update start of buffer
             bufStart = &buffer[_taps.size - 1];
 
@@ -61,6 +69,7 @@ namespace dsp::filter {
 
         inline int process(int count, const D* in, D* out) {
             // Copy data to work buffer
+            reserve(count);
             memcpy(bufStart, in, count * sizeof(D));
             
             // Do convolution
@@ -82,9 +91,12 @@ namespace dsp::filter {
             return count;
         }
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         virtual int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -94,8 +106,21 @@ namespace dsp::filter {
         }
 
     protected:
+        void resizeBuffers(int inputSize) {
+            buffer = buffer::resizeWork<D>(buffer, bufferSize, inputSize + _taps.size, _taps.size - 1);
+            bufferSize = inputSize + _taps.size;
+            bufStart = &buffer[_taps.size - 1];
+        }
+
+        // Grows the buffer if a block larger than the known input size comes in, for users of process() that
+        // don't call setMaxInputSize()
+        inline void reserve(int count) {
+            if (count + _taps.size > bufferSize) { resizeBuffers(count); }
+        }
+
         tap<T> _taps;
         D* buffer;
         D* bufStart;
+        int bufferSize;
     };
 }
\ No newline at end of file
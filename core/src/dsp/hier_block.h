@@ -50,6 +50,15 @@ namespace dsp {
             }
         }
 
+        // Run all sub-blocks on the given scheduler
+        virtual void setScheduler(block_scheduler* sched) {
+            assert(_block_init);
+            std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+            for (auto& block : blocks) {
+                block->setScheduler(sched);
+            }
+        }
+
     private:
         virtual void doStart() {
             for (auto& block : blocks) {
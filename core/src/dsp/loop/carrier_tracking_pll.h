@@ -12,9 +12,13 @@ namespace dsp::loop {
         }
 
         inline int process(int count, complex_t* in, complex_t* out) {
-            for (int i = 0; i < count; i++) {
-                out[i] = in[i] * math::phasor(-pcl.phase);
-                pcl.advance(math::normalizePhase(in[i].phase() - pcl.phase));
+            for (int i = 0; i < count; i += PLL_CHUNK_SIZE) {
+                int len = std::min<int>(count - i, PLL_CHUNK_SIZE);
+                computePhases(len, &in[i]);
+                for (int j = 0; j < len; j++) {
+                    out[i + j] = in[i + j] * math::phasor(-pcl.phase);
+                    pcl.advance(math::normalizePhase(phases[j] - pcl.phase));
+                }
             }
             return count;
         }
@@ -4,6 +4,9 @@
 #include "../math/phasor.h"
 #include "phase_control_loop.h"
 
+// Number of samples for which the input phase is computed at once
+#define PLL_CHUNK_SIZE  1024
+
 namespace dsp::loop {
     class PLL : public Processor<complex_t, complex_t> {
         using base_type = Processor<complex_t, complex_t>;
@@ -62,9 +65,13 @@ namespace dsp::loop {
         }
 
         virtual inline int process(int count, complex_t* in, complex_t* out) {
-            for (int i = 0; i < count; i++) {
-                out[i] = math::phasor(pcl.phase);
-                pcl.advance(math::normalizePhase(in[i].phase() - pcl.phase));
+            for (int i = 0; i < count; i += PLL_CHUNK_SIZE) {
+                int len = std::min<int>(count - i, PLL_CHUNK_SIZE);
+                computePhases(len, &in[i]);
+                for (int j = 0; j < len; j++) {
+                    out[i + j] = math::phasor(pcl.phase);
+                    pcl.advance(math::normalizePhase(phases[j] - pcl.phase));
+                }
             }
             return count;
         }
@@ -81,10 +88,16 @@ namespace dsp::loop {
         }
 
     protected:
+        // Phase of a chunk of input samples, computed before any output of the chunk is written
+        inline void computePhases(int count, const complex_t* in) {
+            volk_32fc_s32f_atan2_32f(phases, (lv_32fc_t*)in, 1.0f, count);
+        }
+
         PhaseControlLoop<float> pcl;
         float _initPhase;
         float _initFreq;
         complex_t lastVCO = { 1.0f, 0.0f };
+        float phases[PLL_CHUNK_SIZE];
 
     };
 }
\ No newline at end of file
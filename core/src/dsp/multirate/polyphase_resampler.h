@@ -15,7 +15,7 @@ namespace dsp::multirate {
         ~PolyphaseResampler() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            buffer::free(buffer);
+            buffer::freeWork(buffer, bufferSize);
             freePolyphaseBank(phases);
         }
 
@@ -28,7 +28,8 @@ namespace dsp::multirate {
             phases = buildPolyphaseBank(_interp, _taps);
 
             // Allocate delay buffer
-            buffer = buffer::alloc<T>(STREAM_BUFFER_SIZE + 64000);
+            bufferSize = STREAM_BUFFER_SIZE + std::max<int>(phases.tapsPerPhase, 64000);
+            buffer = buffer::allocWork<T>(bufferSize);
             bufStart = &buffer[phases.tapsPerPhase - 1];
             buffer::clear<T>(buffer, phases.tapsPerPhase - 1);
 
@@ -49,6 +50,15 @@ namespace dsp::multirate {
             freePolyphaseBank(phases);
             phases = buildPolyphaseBank(_interp, _taps);
 
+            // Make room for the new history
+            int maxInput = (base_type::_inputSize > 0) ? base_type::_inputSize : STREAM_BUFFER_SIZE;
+            if (bufferSize < maxInput + phases.tapsPerPhase) {
+                buffer::freeWork(buffer, bufferSize);
+                bufferSize = maxInput + phases.tapsPerPhase;
+                buffer = buffer::allocWork<T>(bufferSize);
+            }
+            base_type::invalidateSizes();
+
             // Reset buffer
             bufStart = &buffer[phases.tapsPerPhase - 1];
             reset();
@@ -98,9 +108,15 @@ namespace dsp::multirate {
             return outCount;
         }
 
+        // The phase left from the previous block can give one more output
+        int getOutputSize(int inputSize) {
+            return (int)((((int64_t)inputSize + 1) * _interp) / _decim) + 2;
+        }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -113,6 +129,12 @@ namespace dsp::multirate {
         }
 
     protected:
+        void resizeBuffers(int inputSize) {
+            buffer = buffer::resizeWork<T>(buffer, bufferSize, inputSize + phases.tapsPerPhase, phases.tapsPerPhase - 1);
+            bufferSize = inputSize + phases.tapsPerPhase;
+            bufStart = &buffer[phases.tapsPerPhase - 1];
+        }
+
         int _interp;
         int _decim;
         tap<float> _taps;
@@ -121,6 +143,7 @@ namespace dsp::multirate {
         int offset = 0;
         T* buffer;
         T* bufStart;
+        int bufferSize;
 
     };
 }
\ No newline at end of file
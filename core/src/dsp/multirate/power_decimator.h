@@ -3,6 +3,9 @@
 #include "../taps/from_array.h"
 #include "decim/plans.h"
 
+// Number of input samples run through the whole cascade at once, small enough for the intermediate data to stay in cache
+#define POWER_DECIMATOR_CHUNK_SIZE  8192
+
 namespace dsp::multirate {
     template<class T>
     class PowerDecimator : public Processor<T, T> {
@@ -16,11 +19,13 @@ namespace dsp::multirate {
             if (!base_type::_block_init) { return; }
             base_type::stop();
             freeFirs();
+            buffer::free(work);
         }
 
         void init(stream<T>* in, unsigned int ratio) {
             assert(checkRatio(ratio));
             _ratio = ratio;
+            work = buffer::alloc<T>(POWER_DECIMATOR_CHUNK_SIZE);
             reconfigure();
             base_type::init(in);
         }
@@ -35,6 +40,7 @@ namespace dsp::multirate {
             base_type::tempStop();
             _ratio = ratio;
             reconfigure();
+            base_type::invalidateSizes();
             base_type::tempStart();
         }
 
@@ -55,20 +61,30 @@ namespace dsp::multirate {
                 return count;
             }
             
-            // Process data through each stage
-            const T* data = in;
+            // Run all stages on one chunk before moving to the next. The first stage reads the input directly,
+            // the intermediate stages run in place in the work buffer and the last one writes to the output.
             int last = stageCount - 1;
-            for (int i = 0; i < stageCount; i++) {
-                auto fir = decimFirs[i];
-                count = fir->process(count, data, out);
-                data = out;
+            int outCount = 0;
+            for (int i = 0; i < count; i += POWER_DECIMATOR_CHUNK_SIZE) {
+                int n = std::min<int>(count - i, POWER_DECIMATOR_CHUNK_SIZE);
+                for (int j = 0; j < stageCount; j++) {
+                    n = decimFirs[j]->process(n, j ? work : &in[i], (j == last) ? &out[outCount] : work);
+                }
+                outCount += n;
             }
-            return count;
+            return outCount;
+        }
+
+        // Each chunk can give one more output than the ratio alone
+        int getOutputSize(int inputSize) {
+            if (_ratio == 1) { return inputSize; }
+            return (inputSize / _ratio) + (inputSize / POWER_DECIMATOR_CHUNK_SIZE) + 2;
         }
 
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -101,6 +117,7 @@ namespace dsp::multirate {
                     tap<float> taps = taps::fromArray<float>(plan.stages[i].tapcount, plan.stages[i].taps);
                     auto fir = new filter::DecimatingFIR<T, float>(NULL, taps, plan.stages[i].decimation);
                     fir->out.free();
+                    fir->setMaxInputSize(POWER_DECIMATOR_CHUNK_SIZE);
                     decimTaps.push_back(taps);
                     decimFirs.push_back(fir);
                 }
@@ -114,6 +131,7 @@ namespace dsp::multirate {
 
         std::vector<filter::DecimatingFIR<T, float>*> decimFirs;
         std::vector<tap<float>> decimTaps;
+        T* work = NULL;
         unsigned int _ratio;
         int stageCount;
     };
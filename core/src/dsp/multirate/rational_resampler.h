@@ -96,9 +96,24 @@ namespace dsp::multirate {
             return count;
         }
 
+        // When both are used, the decimated samples are written to the output before being resampled in place
+        int getOutputSize(int inputSize) {
+            switch(mode) {
+                case Mode::BOTH:
+                    return std::max<int>(decim.getOutputSize(inputSize), resamp.getOutputSize(decim.getOutputSize(inputSize)));
+                case Mode::DECIM_ONLY:
+                    return decim.getOutputSize(inputSize);
+                case Mode::RESAMP_ONLY:
+                    return resamp.getOutputSize(inputSize);
+                default:
+                    return inputSize;
+            }
+        }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -118,7 +133,14 @@ namespace dsp::multirate {
             NONE
         };
 
+        void resizeBuffers(int inputSize) {
+            resamp.setMaxInputSize((mode == Mode::BOTH) ? decim.getOutputSize(inputSize) : inputSize);
+        }
+
         void reconfigure() {
+            // The sizes depend on the ratios, the resampler's buffers are only valid once resized
+            base_type::invalidateSizes();
+
             // Calculate highest power-of-two decimation for the power decimator 
             int predecPower = std::min<int>(floor(log2(_inSamplerate / _outSamplerate)), PowerDecimator<T>::getMaxRatio());
             int predecRatio = std::min<int>(1 << predecPower, PowerDecimator<T>::getMaxRatio());
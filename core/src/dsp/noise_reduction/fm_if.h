@@ -1,9 +1,17 @@
 #pragma once
 #include "../processor.h"
-#include "../window/nuttall.h"
-#include <fftw3.h>
+#include "../fft/plan_cache.h"
+
+// Number of samples after which the sliding DFT is recomputed from scratch to cancel rounding drift
+#define FMIF_RESYNC_INTERVAL    4096
 
 namespace dsp::noise_reduction {
+    // Keeps only the strongest bin of a Nuttall windowed DFT of the last samples, taken at the middle of the window.
+    // The bins are updated for every sample by a sliding DFT and the window is applied in the frequency domain,
+    // so only one output value is computed instead of a forward and inverse FFT per sample.
+    // The window is the periodic Nuttall window, the symmetric one (N - 1 in the denominator) isn't made of
+    // harmonics of the bins so it can't be applied as a convolution. It's centered on the middle sample,
+    // which puts it half a sample off the bin grid for an odd number of bins.
     class FMIF : public Processor<complex_t, complex_t> {
         using base_type = Processor<complex_t, complex_t>;
     public:
@@ -37,48 +45,65 @@ namespace dsp::noise_reduction {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
-            buffer::clear(buffer, _bins - 1);
-            buffer::clear(backFFTIn, _bins);
+            buffer::clear(buffer, _bins);
+            buffer::clear(dft, _bins + 6);
+            sinceResync = 0;
             base_type::tempStart();
         }
 
         int process(int count, const complex_t* in, complex_t* out) {
-            // Write new input data to buffer buffer
+            // Write new input data after the previous window
             memcpy(bufferStart, in, count * sizeof(complex_t));
-            
-            // Iterate the FFT
-            for (int i = 0; i < count; i++) {
-                // Apply windows
-                volk_32fc_32f_multiply_32fc((lv_32fc_t*)forwFFTIn, (lv_32fc_t*)&buffer[i], fftWin, _bins);
-
-                // Do forward FFT
-                fftwf_execute(forwardPlan);
-
-                // Process bins here
-                uint32_t idx;
-                volk_32fc_magnitude_32f(ampBuf, (lv_32fc_t*)forwFFTOut, _bins);
-                volk_32f_index_max_32u(&idx, ampBuf, _bins);
-
-                // Keep only the bin of highest amplitude
-                backFFTIn[idx] = forwFFTOut[idx];
 
-                // Do reverse FFT and get first element
-                fftwf_execute(backwardPlan);
-                out[i] = backFFTOut[_bins / 2];
-
-                // Reset the input buffer
-                backFFTIn[idx] = { 0, 0 };
+            complex_t* bins = &dft[3];
+            for (int i = 0; i < count; i++) {
+                // Slide the DFT by one sample, or recompute it once in a while
+                if (++sinceResync >= FMIF_RESYNC_INTERVAL) {
+                    resync(&buffer[i + 1]);
+                }
+                else {
+                    complex_t diff = buffer[i + _bins] - buffer[i];
+                    for (int k = 0; k < _bins; k++) {
+                        bins[k] = (bins[k] + diff) * twiddles[k];
+                    }
+                }
+
+                // Bins that wrap around are needed on both sides by the window
+                for (int k = 1; k <= 3; k++) {
+                    bins[-k] = bins[(_bins - (k % _bins)) % _bins];
+                    bins[_bins - 1 + k] = bins[(k - 1) % _bins];
+                }
+
+                // Apply the window and find the strongest bin
+                for (int k = 0; k < _bins; k++) {
+                    complex_t acc = bins[k] * winCenter;
+                    for (int m = 1; m <= 3; m++) {
+                        complex_t sum = bins[k + m] + bins[k - m];
+                        complex_t diff = bins[k + m] - bins[k - m];
+                        acc.re += (sum.re * winCos[m - 1]) - (diff.im * winSin[m - 1]);
+                        acc.im += (sum.im * winCos[m - 1]) + (diff.re * winSin[m - 1]);
+                    }
+                    windowed[k] = acc;
+                }
+                uint32_t best;
+                volk_32fc_index_max_32u(&best, (lv_32fc_t*)windowed, _bins);
+
+                // Same as the middle sample of the inverse transform of that bin alone
+                out[i] = windowed[best] * outRotations[best];
             }
 
-            // Move buffer buffer
-            memmove(buffer, &buffer[count], (_bins - 1) * sizeof(complex_t));
+            // Keep the last window
+            memmove(buffer, &buffer[count], _bins * sizeof(complex_t));
 
             return count;
         }
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
@@ -89,61 +114,90 @@ namespace dsp::noise_reduction {
         }
 
     protected:
-        void initBuffers() {
-            // Allocate FFT buffers
-            forwFFTIn = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
-            forwFFTOut = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
-            backFFTIn = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
-            backFFTOut = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
-
-            // Allocate and clear delay buffer
-            buffer = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + 64000);
-            bufferStart = &buffer[_bins - 1];
-            buffer::clear(buffer, _bins - 1);
-
-            // Clear backward FFT input since only one value is changed and reset at a time
-            buffer::clear(backFFTIn, _bins);
-
-            // Allocate amplitude buffer
-            ampBuf = buffer::alloc<float>(_bins);
-
-            // Allocate and generate Window
-            fftWin = buffer::alloc<float>(_bins);
-            for (int i = 0; i < _bins; i++) { fftWin[i] = window::nuttall(i, _bins - 1); }
-
-            // Plan FFTs
-            forwardPlan = fftwf_plan_dft_1d(_bins, (fftwf_complex*)forwFFTIn, (fftwf_complex*)forwFFTOut, FFTW_FORWARD, FFTW_ESTIMATE);
-            backwardPlan = fftwf_plan_dft_1d(_bins, (fftwf_complex*)backFFTIn, (fftwf_complex*)backFFTOut, FFTW_BACKWARD, FFTW_ESTIMATE);
+        void resizeBuffers(int inputSize) {
+            buffer = buffer::resizeWork(buffer, bufferSize, inputSize + _bins, _bins);
+            bufferSize = inputSize + _bins;
+            bufferStart = &buffer[_bins];
         }
 
-        void destroyBuffers() {
-            fftwf_destroy_plan(forwardPlan);
-            fftwf_destroy_plan(backwardPlan);
-            fftwf_free(forwFFTIn);
-            fftwf_free(forwFFTOut);
-            fftwf_free(backFFTIn);
-            fftwf_free(backFFTOut);
-            buffer::free(buffer);
-            buffer::free(ampBuf);
-            buffer::free(fftWin);
+        void resync(const complex_t* window) {
+            memcpy(fftIn, window, _bins * sizeof(complex_t));
+            fftwf_execute_dft(plan->get(), (fftwf_complex*)fftIn, (fftwf_complex*)fftOut);
+            memcpy(&dft[3], fftOut, _bins * sizeof(complex_t));
+            sinceResync = 0;
         }
 
-        complex_t* forwFFTIn;
-        complex_t* forwFFTOut;
-        complex_t* backFFTIn;
-        complex_t* backFFTOut;
+        void initBuffers() {
+            // Allocate and clear the delay buffer, it holds the last window followed by the new samples
+            bufferSize = ((base_type::_inputSize > 0) ? base_type::_inputSize : STREAM_BUFFER_SIZE) + _bins;
+            buffer = buffer::allocWork<complex_t>(bufferSize);
+            bufferStart = &buffer[_bins];
+            buffer::clear(buffer, _bins);
+
+            // Allocate the bins with room for the ones that wrap around on each side, the window is all zeros
+            dft = buffer::alloc<complex_t>(_bins + 6);
+            buffer::clear(dft, _bins + 6);
+            windowed = buffer::alloc<complex_t>(_bins);
+            sinceResync = 0;
+
+            // Sliding the window by one sample rotates bin k by 2*pi*k/N, and the middle sample of the inverse transform
+            // of bin k alone is that bin rotated by 2*pi*k*floor(N/2)/N
+            twiddles = buffer::alloc<complex_t>(_bins);
+            outRotations = buffer::alloc<complex_t>(_bins);
+            for (int k = 0; k < _bins; k++) {
+                double phase = 2.0 * DB_M_PI * (double)k / (double)_bins;
+                twiddles[k] = { (float)cos(phase), (float)sin(phase) };
+                double outPhase = fmod(phase * (double)(_bins / 2), 2.0 * DB_M_PI);
+                outRotations[k] = { (float)cos(outPhase), (float)sin(outPhase) };
+            }
+
+            // The Nuttall window is a sum of cosines, applying it is a convolution with the bins on each side.
+            // Delaying it by shift samples rotates the bins below and above by opposite phases, which is applied
+            // as a real part on their sum and an imaginary part on their difference
+            const double coefs[] = { 0.355768, 0.487396, 0.144232, 0.012604 };
+            double shift = (double)(_bins / 2) - ((double)_bins / 2.0);
+            winCenter = coefs[0];
+            for (int m = 1; m <= 3; m++) {
+                double amp = ((m & 1) ? -coefs[m] : coefs[m]) / 2.0;
+                double phase = 2.0 * DB_M_PI * (double)m * shift / (double)_bins;
+                winCos[m - 1] = amp * cos(phase);
+                winSin[m - 1] = amp * sin(phase);
+            }
 
-        fftwf_plan forwardPlan;
-        fftwf_plan backwardPlan;
+            // Plan used to recompute the bins
+            fftIn = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
+            fftOut = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
+            plan = fft::PlanCache::getInstance().getDFT(_bins, FFTW_FORWARD);
+        }
+
+        void destroyBuffers() {
+            buffer::freeWork(buffer, bufferSize);
+            buffer::free(windowed);
+            buffer::free(twiddles);
+            buffer::free(outRotations);
+            buffer::free(dft);
+            fftwf_free(fftIn);
+            fftwf_free(fftOut);
+        }
 
         complex_t* buffer;
         complex_t* bufferStart;
+        int bufferSize;
 
-        float* fftWin;
+        complex_t* dft;
+        complex_t* windowed;
+        complex_t* twiddles;
+        complex_t* outRotations;
+        float winCenter;
+        float winCos[3];
+        float winSin[3];
+        int sinceResync;
 
-        float* ampBuf;
+        complex_t* fftIn;
+        complex_t* fftOut;
+        fft::Plan* plan;
 
         int _bins;
 
-    }; 
+    };
 }
\ No newline at end of file
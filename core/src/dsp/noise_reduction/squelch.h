@@ -13,13 +13,14 @@ namespace dsp::noise_reduction {
         ~Squelch() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            buffer::free(normBuffer);
+            buffer::freeWork(normBuffer, normSize);
         }
 
         void init(stream<complex_t>* in, double level) {
             _level = level;
 
-            normBuffer = buffer::alloc<float>(STREAM_BUFFER_SIZE);
+            normBuffer = buffer::allocWork<float>(STREAM_BUFFER_SIZE);
+            normSize = STREAM_BUFFER_SIZE;
 
             base_type::init(in);
         }
@@ -48,9 +49,12 @@ namespace dsp::noise_reduction {
 
         //DEFAULT_PROC_RUN();
 
+        int getOutputSize(int inputSize) { return inputSize; }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            base_type::updateSizes(count);
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
@@ -58,7 +62,13 @@ namespace dsp::noise_reduction {
         }
 
     private:
+        void resizeBuffers(int inputSize) {
+            normBuffer = buffer::resizeWork(normBuffer, normSize, inputSize);
+            normSize = inputSize;
+        }
+
         float* normBuffer;
+        int normSize = 0;
         float _level = -50.0f;
                 
     };
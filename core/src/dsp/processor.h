@@ -10,6 +10,7 @@
         if (count < 0) {\
             return -1;\
         }\
+        base_type::updateSizes(count);\
         \
         exp;\
         \
@@ -24,6 +25,7 @@
         if (count < 0) {\
             return -1;\
         }\
+        base_type::updateSizes(count);\
         \
         int outCount = exp;\
         \
@@ -64,11 +66,46 @@ namespace dsp {
             tempStart();
         }
 
+        // Largest block output for input blocks of up to inputSize samples. Processors that don't know it keep
+        // full size output buffers
+        virtual int getOutputSize(int inputSize) { return STREAM_BUFFER_SIZE; }
+
+        // For processors only used through process() by another block, sizes the work buffers for blocks of up to
+        // size samples. The output stream isn't touched since it may be used as scratch space.
+        void setMaxInputSize(int size) {
+            if (size == _inputSize) { return; }
+            _inputSize = size;
+            resizeBuffers(size);
+        }
+
         virtual int run() = 0;
 
         stream<O> out;
 
     protected:
+        // Sizes the output and work buffers from the capacity of the input. Called right after read() by the
+        // processors that override getOutputSize(). The producer resizes its output before writing larger blocks
+        // into it, so the sizes propagate down the graph along with the data.
+        inline void updateSizes(int count) {
+            // The block just read may be larger than the capacity if the producer shrank its output since
+            int inputSize = _in->getBufferSize();
+            if (inputSize <= 0) { inputSize = STREAM_BUFFER_SIZE; }
+            inputSize = std::max<int>(inputSize, count);
+            if (inputSize == _inputSize) { return; }
+            _inputSize = inputSize;
+            resizeBuffers(inputSize);
+            out.setBufferSize(getOutputSize(inputSize));
+        }
+
+        // Called with the block stopped by setters that change getOutputSize(), the buffers are resized on the next run()
+        inline void invalidateSizes() {
+            _inputSize = -1;
+        }
+
+        // Resizes the work buffers to process blocks of up to inputSize samples
+        virtual void resizeBuffers(int inputSize) {}
+
         stream<I>* _in;
+        int _inputSize = -1;
     };
 }
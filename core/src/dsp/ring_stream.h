@@ -0,0 +1,219 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "stream.h"
+
+// Number of slots of a ring stream if not specified
+#define RING_STREAM_DEFAULT_SLOTS   4
+
+// Number of times a ring stream polls before going to sleep
+#define RING_STREAM_SPIN_COUNT      64
+
+namespace dsp {
+    // Drop-in replacement for stream<T> backed by a lock-free single-producer/single-consumer
+    // ring of pre-allocated slots. The writer can run up to (slots - 1) buffers ahead of the
+    // reader and only takes a lock when it actually has to sleep because the ring is full (or empty
+    // for the reader). writeBuf and readBuf always point to the slot currently owned by each side.
+    template <class T>
+    class ring_stream : public stream<T> {
+    public:
+        ring_stream(int slots = RING_STREAM_DEFAULT_SLOTS, int bufferSize = STREAM_BUFFER_SIZE) : stream<T>(false) {
+            // At least two slots are needed for the writer and reader to work at the same time
+            slotCount = std::max<int>(slots, 2);
+            stream<T>::bufferSize = bufferSize;
+            allocSlots();
+        }
+
+        virtual ~ring_stream() {
+            freeSlots();
+        }
+
+        // Same rules as stream<T>: only called by the writer or while it's stopped. Slots are only reallocated
+        // while the writer owns them, the current one right away and the others when the writer moves on to them,
+        // so the reader never loses a slot it holds or one that was published before the change.
+        virtual void setBufferSize(int samples) {
+            if (samples == stream<T>::bufferSize) { return; }
+            stream<T>::bufferSize = samples;
+            unsigned int h = head.load(std::memory_order_relaxed);
+            resizeSlot(h % slotCount);
+            stream<T>::writeBuf = slots[h % slotCount];
+        }
+
+        // The read buffer is a slot of the ring, it can't be given away
+        virtual T* exchangeReadBuf(T* buf, int size) {
+            return NULL;
+        }
+
+        virtual inline bool swap(int size) {
+            // Wait until the slot after the current one is not owned by the reader
+            unsigned int h = head.load(std::memory_order_relaxed);
+            if (!waitFor(writerMtx, writerCV, writerWaiting, [this, h] { return (h + 1 - tail.load()) < (unsigned int)slotCount; }, writerStop)) {
+                return false;
+            }
+
+            // Publish the current slot and move on to the next one, resized if the size changed since it was last used
+            sizes[h % slotCount] = size;
+            resizeSlot((h + 1) % slotCount);
+            stream<T>::writeBuf = slots[(h + 1) % slotCount];
+            head.store(h + 1, std::memory_order_seq_cst);
+
+            // Wake up the reader only if it is sleeping
+            if (readerWaiting.load(std::memory_order_seq_cst)) { notify(readerMtx, readerCV); }
+            untyped_stream::notifyObserver();
+
+            return true;
+        }
+
+        virtual inline int read() {
+            // Wait for a slot to be published
+            unsigned int t = tail.load(std::memory_order_relaxed);
+            if (!waitFor(readerMtx, readerCV, readerWaiting, [this, t] { return head.load() != t; }, readerStop)) {
+                return -1;
+            }
+
+            stream<T>::readBuf = slots[t % slotCount];
+            return sizes[t % slotCount];
+        }
+
+        virtual inline void flush() {
+            // Give the slot back to the writer, if one was acquired
+            unsigned int t = tail.load(std::memory_order_relaxed);
+            if (head.load(std::memory_order_acquire) == t) { return; }
+            tail.store(t + 1, std::memory_order_seq_cst);
+
+            // Wake up the writer only if it is sleeping
+            if (writerWaiting.load(std::memory_order_seq_cst)) { notify(writerMtx, writerCV); }
+            untyped_stream::notifyObserver();
+        }
+
+        virtual void stopWriter() {
+            {
+                std::lock_guard<std::mutex> lck(writerMtx);
+                writerStop = true;
+            }
+            writerCV.notify_all();
+            untyped_stream::notifyObserver();
+        }
+
+        virtual void clearWriteStop() {
+            writerStop = false;
+        }
+
+        virtual void stopReader() {
+            {
+                std::lock_guard<std::mutex> lck(readerMtx);
+                readerStop = true;
+            }
+            readerCV.notify_all();
+            untyped_stream::notifyObserver();
+        }
+
+        virtual void clearReadStop() {
+            readerStop = false;
+        }
+
+        virtual bool canRead() {
+            return (head.load() != tail.load(std::memory_order_relaxed)) || readerStop;
+        }
+
+        virtual bool canWrite() {
+            unsigned int h = head.load(std::memory_order_relaxed);
+            return ((h + 1 - tail.load()) < (unsigned int)slotCount) || writerStop;
+        }
+
+        // Number of published buffers that the reader hasn't flushed yet
+        int available() {
+            return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+        }
+
+        int getSlotCount() {
+            return slotCount;
+        }
+
+    private:
+        template <class Pred>
+        inline bool waitFor(std::mutex& mtx, std::condition_variable& cv, std::atomic<bool>& waiting, Pred pred, std::atomic<bool>& stop) {
+            // Fast path, poll for a little while without taking any lock
+            for (int i = 0; i < RING_STREAM_SPIN_COUNT; i++) {
+                if (stop) { return false; }
+                if (pred()) { return true; }
+                std::this_thread::yield();
+            }
+
+            // Slow path, declare that we're waiting so the other side knows to notify
+            std::unique_lock<std::mutex> lck(mtx);
+            waiting.store(true, std::memory_order_seq_cst);
+            cv.wait(lck, [&] { return pred() || stop; });
+            waiting.store(false, std::memory_order_relaxed);
+
+            return !stop;
+        }
+
+        inline void notify(std::mutex& mtx, std::condition_variable& cv) {
+            // Taking the lock guarantees the waiter is either before its check or already sleeping
+            { std::lock_guard<std::mutex> lck(mtx); }
+            cv.notify_all();
+        }
+
+        void allocSlots() {
+            slots = new T*[slotCount];
+            sizes = new int[slotCount];
+            capacities = new int[slotCount];
+            for (int i = 0; i < slotCount; i++) {
+                slots[i] = stream<T>::allocBuffer(stream<T>::bufferSize);
+                sizes[i] = 0;
+                capacities[i] = stream<T>::bufferSize;
+            }
+            head = 0;
+            tail = 0;
+            stream<T>::writeBuf = slots[0];
+            stream<T>::readBuf = slots[0];
+        }
+
+        void freeSlots() {
+            if (!slots) { return; }
+            for (int i = 0; i < slotCount; i++) {
+                stream<T>::freeBuffer(slots[i], capacities[i]);
+            }
+            delete[] slots;
+            delete[] sizes;
+            delete[] capacities;
+            slots = NULL;
+            sizes = NULL;
+            capacities = NULL;
+
+            // Make sure the base class doesn't free the slots a second time
+            stream<T>::writeBuf = NULL;
+            stream<T>::readBuf = NULL;
+        }
+
+        // Only called by the writer on a slot it owns
+        inline void resizeSlot(int id) {
+            int size = stream<T>::bufferSize;
+            if (capacities[id] == size) { return; }
+            stream<T>::freeBuffer(slots[id], capacities[id]);
+            slots[id] = stream<T>::allocBuffer(size);
+            capacities[id] = size;
+        }
+
+        T** slots = NULL;
+        int* sizes = NULL;
+        int* capacities = NULL;
+        int slotCount;
+
+        // Written only by the writer and the reader respectively
+        alignas(64) std::atomic<unsigned int> head = 0;
+        alignas(64) std::atomic<unsigned int> tail = 0;
+
+        std::mutex writerMtx;
+        std::condition_variable writerCV;
+        std::atomic<bool> writerWaiting = false;
+        std::atomic<bool> writerStop = false;
+
+        std::mutex readerMtx;
+        std::condition_variable readerCV;
+        std::atomic<bool> readerWaiting = false;
+        std::atomic<bool> readerStop = false;
+    };
+}
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
+#include <memory>
 #include "../sink.h"
+#include "../shared_stream.h"
 
 namespace dsp::routing {
     template <class T>
@@ -15,14 +17,21 @@ namespace dsp::routing {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             
             // Check that the stream isn't already bound
-            if (std::find(streams.begin(), streams.end(), stream) != streams.end()) {
+            if (isBound(stream)) {
                 throw std::runtime_error("[Splitter] Tried to bind stream to that is already bound");
             }
 
-            // Add to the list
+            // Add to the list, shared streams get a reference to a pooled buffer instead of a copy
             base_type::tempStop();
             base_type::registerOutput(stream);
-            streams.push_back(stream);
+            shared_stream<T>* sstream = dynamic_cast<shared_stream<T>*>(stream);
+            if (sstream) {
+                if (!pool) { pool = std::make_shared<buffer::SharedBufferPool<T>>(getInputSize(0)); }
+                sharedStreams.push_back(sstream);
+            }
+            else {
+                streams.push_back(stream);
+            }
             base_type::tempStart();
         }
 
@@ -31,14 +40,14 @@ namespace dsp::routing {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             
             // Check that the stream is bound
-            auto sit = std::find(streams.begin(), streams.end(), stream);
-            if (sit == streams.end()) {
+            if (!isBound(stream)) {
                 throw std::runtime_error("[Splitter] Tried to unbind stream to that isn't bound");
             }
 
-            // Add to the list
+            // Remove from the list
             base_type::tempStop();
-            streams.erase(sit);
+            streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
+            sharedStreams.erase(std::remove(sharedStreams.begin(), sharedStreams.end(), stream), sharedStreams.end());
             base_type::unregisterOutput(stream);
             base_type::tempStart();
         }
@@ -47,7 +56,27 @@ namespace dsp::routing {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
 
+            // Copy once into a pooled buffer referenced by all shared streams, sized like the input
+            if (!sharedStreams.empty()) {
+                int size = getInputSize(count);
+                if (size != pool->getBufferSize()) { pool->setBufferSize(size); }
+                buffer::SharedBuffer<T>* buf = pool->acquire();
+                assert(count <= buf->capacity);
+                memcpy(buf->data, base_type::_in->readBuf, count * sizeof(T));
+                for (const auto& sstream : sharedStreams) {
+                    buf->ref();
+                    if (!sstream->swapBuffer(buf, count)) {
+                        buf->unref();
+                        base_type::_in->flush();
+                        return -1;
+                    }
+                }
+                buf->unref();
+            }
+
+            // Copy into every regular stream, grown first if the block doesn't fit
             for (const auto& stream : streams) {
+                if (stream->getBufferSize() < count) { stream->setBufferSize(getInputSize(count)); }
                 memcpy(stream->writeBuf, base_type::_in->readBuf, count * sizeof(T));
                 if (!stream->swap(count)) {
                     base_type::_in->flush();
@@ -61,7 +90,20 @@ namespace dsp::routing {
         }
 
     protected:
+        int getInputSize(int count) {
+            int size = base_type::_in->getBufferSize();
+            if (size <= 0) { size = STREAM_BUFFER_SIZE; }
+            return std::max<int>(size, count);
+        }
+
+        bool isBound(stream<T>* stream) {
+            return std::find(streams.begin(), streams.end(), stream) != streams.end() ||
+                   std::find(sharedStreams.begin(), sharedStreams.end(), stream) != sharedStreams.end();
+        }
+
         std::vector<stream<T>*> streams;
+        std::vector<shared_stream<T>*> sharedStreams;
+        std::shared_ptr<buffer::SharedBufferPool<T>> pool;
 
     };
 }
\ No newline at end of file
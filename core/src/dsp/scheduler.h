@@ -0,0 +1,228 @@
+#pragma once
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "block.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace dsp {
+    // Fixed pool of worker threads running any scheduled block whose inputs have data and whose outputs have room.
+    // Blocks opt in with block::setScheduler(). The scheduler must outlive the blocks and streams it runs.
+    // When a stream changes, only the blocks attached to it are checked and the runnable ones are queued, one
+    // worker is woken up per queued block.
+    class scheduler : public block_scheduler, public stream_observer {
+    public:
+        struct BlockStats {
+            uint64_t runs;
+            double cpuTime; // CPU time of the worker thread spent in run(), in seconds
+        };
+
+        scheduler(int workerCount = 0) {
+            if (workerCount <= 0) {
+                workerCount = std::max<int>(std::thread::hardware_concurrency(), 1);
+            }
+            for (int i = 0; i < workerCount; i++) {
+                workers.push_back(std::thread(&scheduler::worker, this));
+            }
+        }
+
+        ~scheduler() {
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                stopWorkers = true;
+            }
+            cnd.notify_all();
+            for (auto& w : workers) {
+                if (w.joinable()) { w.join(); }
+            }
+            for (auto& [blk, e] : entries) {
+                releaseStreams(blk);
+                delete e;
+            }
+        }
+
+        void schedule(block* blk) {
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                if (entries.find(blk) != entries.end()) { return; }
+
+                // Keep the stats of a block across stops and starts
+                auto sit = stats.find(blk);
+                Entry* e = new Entry;
+                e->busy = false;
+                e->done = false;
+                e->queued = false;
+                e->stats = (sit != stats.end()) ? sit->second : BlockStats{ 0, 0.0 };
+                entries[blk] = e;
+                acquireStreams(blk);
+                enqueueIfRunnable(blk, e);
+            }
+        }
+
+        void unschedule(block* blk) {
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                auto it = entries.find(blk);
+                if (it == entries.end()) { return; }
+
+                // Wait for the block to return from run(). The streams were stopped by the caller so this won't last.
+                Entry* e = it->second;
+                idleCnd.wait(lck, [e] { return !e->busy; });
+
+                stats[blk] = e->stats;
+                releaseStreams(blk);
+                if (e->queued) { readyQueue.erase(std::find(readyQueue.begin(), readyQueue.end(), blk)); }
+                entries.erase(blk);
+                delete e;
+            }
+        }
+
+        void streamChanged(untyped_stream* s) {
+            std::lock_guard<std::mutex> lck(mtx);
+            auto it = streamBlocks.find(s);
+            if (it == streamBlocks.end()) { return; }
+            for (auto& blk : it->second) {
+                enqueueIfRunnable(blk, entries[blk]);
+            }
+        }
+
+        BlockStats getStats(block* blk) {
+            std::lock_guard<std::mutex> lck(mtx);
+            auto it = entries.find(blk);
+            if (it != entries.end()) { return it->second->stats; }
+            auto sit = stats.find(blk);
+            if (sit != stats.end()) { return sit->second; }
+            return BlockStats{ 0, 0.0 };
+        }
+
+        int getWorkerCount() {
+            return workers.size();
+        }
+
+        // Pin the workers to the given cores (round robin), only supported on Linux
+        bool setAffinity(const std::vector<int>& cores) {
+#ifdef __linux__
+            if (cores.empty()) { return false; }
+            bool success = true;
+            for (int i = 0; i < workers.size(); i++) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cores[i % cores.size()], &set);
+                success &= !pthread_setaffinity_np(workers[i].native_handle(), sizeof(cpu_set_t), &set);
+            }
+            return success;
+#else
+            return false;
+#endif
+        }
+
+    private:
+        struct Entry {
+            bool busy;
+            bool done;
+            bool queued;
+            BlockStats stats;
+        };
+
+        void worker() {
+            std::unique_lock<std::mutex> lck(mtx);
+            while (true) {
+                // Wait for a block that can run without blocking
+                cnd.wait(lck, [this] { return !readyQueue.empty() || stopWorkers; });
+                if (stopWorkers) { break; }
+                block* blk = readyQueue.front();
+                readyQueue.pop_front();
+                Entry* e = entries[blk];
+                e->queued = false;
+
+                // Run it once outside of the lock
+                e->busy = true;
+                lck.unlock();
+                double start = threadCpuTime();
+                int ret = blk->run();
+                double end = threadCpuTime();
+                lck.lock();
+
+                // A negative return means the streams were stopped, the block is waiting to be unscheduled.
+                // Changes of its streams were ignored while it was busy, so it's checked again
+                e->busy = false;
+                e->done = (ret < 0);
+                e->stats.runs++;
+                e->stats.cpuTime += end - start;
+                idleCnd.notify_all();
+                enqueueIfRunnable(blk, e);
+            }
+        }
+
+        // Called with the lock held
+        void enqueueIfRunnable(block* blk, Entry* e) {
+            if (e->busy || e->done || e->queued || !blk->isRunnable()) { return; }
+            e->queued = true;
+            readyQueue.push_back(blk);
+            cnd.notify_one();
+        }
+
+        static double threadCpuTime() {
+#ifdef _WIN32
+            FILETIME creation, exit, kernel, user;
+            GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+            uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+            uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+            return (double)(k + u) * 100e-9;
+#else
+            timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+#endif
+        }
+
+        void acquireStreams(block* blk) {
+            for (auto& s : blk->inputs) { acquireStream(s, blk); }
+            for (auto& s : blk->outputs) { acquireStream(s, blk); }
+        }
+
+        void releaseStreams(block* blk) {
+            for (auto& s : blk->inputs) { releaseStream(s, blk); }
+            for (auto& s : blk->outputs) { releaseStream(s, blk); }
+        }
+
+        void acquireStream(untyped_stream* s, block* blk) {
+            auto& blocks = streamBlocks[s];
+            if (blocks.empty()) { s->setObserver(this); }
+            blocks.push_back(blk);
+        }
+
+        void releaseStream(untyped_stream* s, block* blk) {
+            auto& blocks = streamBlocks[s];
+            blocks.erase(std::find(blocks.begin(), blocks.end(), blk));
+            if (!blocks.empty()) { return; }
+            streamBlocks.erase(s);
+            if (s->getObserver() == this) { s->setObserver(NULL); }
+        }
+
+        std::mutex mtx;
+        std::condition_variable cnd;
+        std::condition_variable idleCnd;
+        bool stopWorkers = false;
+
+        std::vector<std::thread> workers;
+        std::map<block*, Entry*> entries;
+        std::map<block*, BlockStats> stats;
+        std::deque<block*> readyQueue;
+
+        // Scheduled blocks each stream is an input or output of
+        std::map<untyped_stream*, std::vector<block*>> streamBlocks;
+    };
+}
\ No newline at end of file
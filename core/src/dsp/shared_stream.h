@@ -0,0 +1,147 @@
+#pragma once
+#include "stream.h"
+#include "buffer/shared_buffer.h"
+
+namespace dsp {
+    // Stream whose read buffer is a reference to a pooled buffer shared with other readers instead
+    // of a private copy. It can only be fed with swapBuffer() (see routing::Splitter), readers see
+    // it as a regular stream<T> but must not modify readBuf. The reference is dropped on flush().
+    template <class T>
+    class shared_stream : public stream<T> {
+    public:
+        shared_stream() : stream<T>(false) {}
+
+        virtual ~shared_stream() {
+            if (current) { current->unref(); }
+
+            // The read buffer belongs to the pool, make sure the base class doesn't free it
+            stream<T>::readBuf = NULL;
+        }
+
+        // The buffers come from the pool of the writer, getBufferSize() gives the capacity of the last one
+        virtual void setBufferSize(int samples) {}
+
+        // The read buffer belongs to the pool
+        virtual T* exchangeReadBuf(T* buf, int size) {
+            return NULL;
+        }
+
+        // Shared streams have no write buffer, a regular swap is always refused
+        virtual inline bool swap(int size) {
+            return false;
+        }
+
+        // Hand a buffer to the reader, takes over one reference of the buffer even on failure
+        inline bool swapBuffer(buffer::SharedBuffer<T>* buf, int size) {
+            {
+                // Wait to either swap or stop
+                std::unique_lock<std::mutex> lck(swapMtx);
+                swapCV.wait(lck, [this] { return (canSwap || writerStop); });
+
+                // If writer was stopped, abandon operation
+                if (writerStop) {
+                    buf->unref();
+                    return false;
+                }
+
+                // Take the buffer
+                current = buf;
+                dataSize = size;
+                stream<T>::bufferSize = buf->capacity;
+                canSwap = false;
+            }
+
+            // Notify reader that some data is ready
+            {
+                std::lock_guard<std::mutex> lck(rdyMtx);
+                dataReady = true;
+            }
+            rdyCV.notify_all();
+            untyped_stream::notifyObserver();
+
+            return true;
+        }
+
+        virtual inline int read() {
+            // Wait for data to be ready or to be stopped
+            std::unique_lock<std::mutex> lck(rdyMtx);
+            rdyCV.wait(lck, [this] { return (dataReady || readerStop); });
+            if (readerStop) { return -1; }
+
+            stream<T>::readBuf = current->data;
+            return dataSize;
+        }
+
+        virtual inline void flush() {
+            // Clear data ready
+            {
+                std::lock_guard<std::mutex> lck(rdyMtx);
+                dataReady = false;
+            }
+
+            // Give the buffer back and notify writer that a new one can be swapped in
+            {
+                std::lock_guard<std::mutex> lck(swapMtx);
+                if (current) {
+                    current->unref();
+                    current = NULL;
+                }
+                canSwap = true;
+            }
+
+            swapCV.notify_all();
+            untyped_stream::notifyObserver();
+        }
+
+        virtual void stopWriter() {
+            {
+                std::lock_guard<std::mutex> lck(swapMtx);
+                writerStop = true;
+            }
+            swapCV.notify_all();
+            untyped_stream::notifyObserver();
+        }
+
+        virtual void clearWriteStop() {
+            writerStop = false;
+        }
+
+        virtual void stopReader() {
+            {
+                std::lock_guard<std::mutex> lck(rdyMtx);
+                readerStop = true;
+            }
+            rdyCV.notify_all();
+            untyped_stream::notifyObserver();
+        }
+
+        virtual void clearReadStop() {
+            readerStop = false;
+        }
+
+        virtual bool canRead() {
+            std::lock_guard<std::mutex> lck(rdyMtx);
+            return (dataReady || readerStop);
+        }
+
+        virtual bool canWrite() {
+            std::lock_guard<std::mutex> lck(swapMtx);
+            return (canSwap || writerStop);
+        }
+
+    private:
+        std::mutex swapMtx;
+        std::condition_variable swapCV;
+        bool canSwap = true;
+
+        std::mutex rdyMtx;
+        std::condition_variable rdyCV;
+        bool dataReady = false;
+
+        bool readerStop = false;
+        bool writerStop = false;
+
+        buffer::SharedBuffer<T>* current = NULL;
+        int dataSize = 0;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,499 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include "../sink.h"
+#include "../fft/plan_cache.h"
+
+// Max number of samples transformed in a single batch
+#define SPECTRUM_MAX_BATCH_SAMPLES  (1 << 20)
+
+namespace dsp::sink {
+    // Computes power spectra of the input and hands them out at a fixed rate, in dB.
+    // Frames are transformed in batches with a single plan_many plan and batches are split between
+    // worker threads. All the frames that fall between two outputs can be combined (average, peak or min hold).
+    // The input is buffered separately so that a slow transform drops input instead of stalling the writer.
+    class Spectrum : public Sink<complex_t> {
+        using base_type = Sink<complex_t>;
+    public:
+        enum Mode {
+            MODE_NORMAL,    // One frame per output
+            MODE_AVERAGE,   // Welch average of all frames between two outputs
+            MODE_PEAK_HOLD, // Max of all frames between two outputs
+            MODE_MIN_HOLD   // Min of all frames between two outputs
+        };
+
+        Spectrum() {}
+
+        Spectrum(stream<complex_t>* in, double samplerate, int fftSize, double rate, const float* window, float* (*acquireBuffer)(void* ctx), void (*releaseBuffer)(void* ctx), void* ctx, int threads = 0) {
+            init(in, samplerate, fftSize, rate, window, acquireBuffer, releaseBuffer, ctx, threads);
+        }
+
+        ~Spectrum() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            destroyBuffers();
+            buffer::free(window);
+        }
+
+        void init(stream<complex_t>* in, double samplerate, int fftSize, double rate, const float* window, float* (*acquireBuffer)(void* ctx), void (*releaseBuffer)(void* ctx), void* ctx, int threads = 0) {
+            _samplerate = samplerate;
+            _fftSize = fftSize;
+            _rate = rate;
+            _acquireBuffer = acquireBuffer;
+            _releaseBuffer = releaseBuffer;
+            _ctx = ctx;
+            _threads = threads > 0 ? threads : std::clamp<int>(std::thread::hardware_concurrency() / 2, 1, 4);
+            initBuffers(window);
+            base_type::init(in);
+        }
+
+        void setSamplerate(double samplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _samplerate = samplerate;
+            reconfigure();
+            base_type::tempStart();
+        }
+
+        // The window is expected to be fftSize long
+        void setFFTParams(int fftSize, double rate, const float* window) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _fftSize = fftSize;
+            _rate = rate;
+            reconfigure(window);
+            base_type::tempStart();
+        }
+
+        // Fraction of a frame shared with the previous one when combining frames, from 0 to 0.95
+        void setOverlap(double overlap) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _overlap = std::clamp<double>(overlap, 0.0, 0.95);
+            reconfigure();
+            base_type::tempStart();
+        }
+
+        void setMode(Mode mode) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _mode = mode;
+            reconfigure();
+            base_type::tempStart();
+        }
+
+        void setThreadCount(int threads) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _threads = std::max<int>(threads, 1);
+            reconfigure();
+            base_type::tempStart();
+        }
+
+        // Number of input buffers dropped because the transforms couldn't keep up
+        uint64_t getDroppedCount() {
+            std::lock_guard<std::mutex> lck(fifoMtx);
+            return dropped;
+        }
+
+        // Buffers the input, never blocks
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            {
+                std::lock_guard<std::mutex> lck(fifoMtx);
+                if (count <= fifoSize - fifoFill) {
+                    int start = (fifoStart + fifoFill) % fifoSize;
+                    int first = std::min<int>(count, fifoSize - start);
+                    memcpy(&fifo[start], base_type::_in->readBuf, first * sizeof(complex_t));
+                    memcpy(fifo, &base_type::_in->readBuf[first], (count - first) * sizeof(complex_t));
+                    fifoFill += count;
+                }
+                else {
+                    // Drop everything so that frames are never made of discontinuous samples
+                    fifoStart = 0;
+                    fifoFill = 0;
+                    fifoGap = true;
+                    dropped++;
+                }
+            }
+            fifoCnd.notify_all();
+
+            base_type::_in->flush();
+            return count;
+        }
+
+    protected:
+        void doStart() {
+            base_type::doStart();
+            processThread = std::thread(&Spectrum::processWorker, this);
+            for (int i = 1; i < _threads; i++) {
+                helperThreads.push_back(std::thread(&Spectrum::helperWorker, this, i));
+            }
+        }
+
+        void doStop() {
+            // Stop the processing side
+            {
+                std::lock_guard<std::mutex> lck(fifoMtx);
+                fifoStop = true;
+            }
+            fifoCnd.notify_all();
+            {
+                std::lock_guard<std::mutex> lck(jobMtx);
+                jobStop = true;
+            }
+            jobCnd.notify_all();
+            jobDoneCnd.notify_all();
+            if (processThread.joinable()) { processThread.join(); }
+            for (auto& t : helperThreads) {
+                if (t.joinable()) { t.join(); }
+            }
+            helperThreads.clear();
+
+            // Stop the input side
+            base_type::doStop();
+
+            // Start again from a clean state
+            fifoStop = false;
+            jobStop = false;
+            fifoStart = 0;
+            fifoFill = 0;
+            fifoGap = false;
+            kept = 0;
+            framesDone = 0;
+            jobId = 0;
+            accCounts.assign(_threads, 0);
+        }
+
+    private:
+        void processWorker() {
+            while (true) {
+                // Gather the frames of the next batch
+                int frames = std::min<int>(batchSize, framesPerOutput - framesDone);
+                int ret = gatherFrames(frames);
+                if (ret < 0) { break; }
+                if (!ret) {
+                    // A gap in the input, start over
+                    framesDone = 0;
+                    accCounts.assign(_threads, 0);
+                    continue;
+                }
+
+                // Transform and combine on all threads
+                if (!runJob(frames)) { break; }
+                framesDone += frames;
+
+                // Keep the start of the next frame if they overlap
+                if (hop < _fftSize) {
+                    kept = _fftSize - hop;
+                    memmove(frameBuf, &frameBuf[frames * hop], kept * sizeof(complex_t));
+                }
+                if (framesDone < framesPerOutput) { continue; }
+                framesDone = 0;
+
+                // Send out the result
+                float* buf = _acquireBuffer(_ctx);
+                if (buf) { writeOutput(buf); }
+                _releaseBuffer(_ctx);
+            }
+        }
+
+        void helperWorker(int id) {
+            uint64_t lastJob = 0;
+            while (true) {
+                int frames;
+                {
+                    std::unique_lock<std::mutex> lck(jobMtx);
+                    jobCnd.wait(lck, [&] { return (jobId != lastJob) || jobStop; });
+                    if (jobStop) { return; }
+                    lastJob = jobId;
+                    frames = jobFrames;
+                }
+
+                processFrames(id, frames);
+
+                {
+                    std::lock_guard<std::mutex> lck(jobMtx);
+                    jobsDone++;
+                }
+                jobDoneCnd.notify_all();
+            }
+        }
+
+        // Returns false if stopped before the helpers were done
+        bool runJob(int frames) {
+            // Hand the other slices to the helpers and do the first one on this thread
+            bool parallel = (frames > sliceSize);
+            if (parallel) {
+                {
+                    std::lock_guard<std::mutex> lck(jobMtx);
+                    jobFrames = frames;
+                    jobsDone = 0;
+                    jobId++;
+                }
+                jobCnd.notify_all();
+            }
+            processFrames(0, frames);
+            if (!parallel) { return true; }
+            std::unique_lock<std::mutex> lck(jobMtx);
+            jobDoneCnd.wait(lck, [this] { return (jobsDone == _threads - 1) || jobStop; });
+            return !jobStop;
+        }
+
+        void processFrames(int id, int frames) {
+            // Find the slice of the batch handled by this thread
+            int first = std::min<int>(id * sliceSize, frames);
+            int last = std::min<int>(first + sliceSize, frames);
+            int count = last - first;
+            if (!count) { return; }
+
+            // Apply the window while copying to the FFT input
+            for (int i = first; i < last; i++) {
+                volk_32fc_32f_multiply_32fc((lv_32fc_t*)&fftIn[i * stride], (lv_32fc_t*)framePtrs[i], window, _fftSize);
+            }
+
+            // Transform the whole slice at once if possible
+            if (count == sliceSize) {
+                fftwf_execute_dft(slicePlan->get(), (fftwf_complex*)&fftIn[first * stride], (fftwf_complex*)&fftOut[first * stride]);
+            }
+            else {
+                for (int i = first; i < last; i++) {
+                    fftwf_execute_dft(framePlan->get(), (fftwf_complex*)&fftIn[i * stride], (fftwf_complex*)&fftOut[i * stride]);
+                }
+            }
+
+            // In normal mode, the only frame is converted to dB directly when outputting
+            if (_mode == MODE_NORMAL) { return; }
+
+            // Combine the frames of the slice in the accumulator of this thread
+            float* acc = &accs[id * _fftSize];
+            float* power = &powers[id * _fftSize];
+            for (int i = first; i < last; i++) {
+                if (!accCounts[id]) {
+                    volk_32fc_magnitude_squared_32f(acc, (lv_32fc_t*)&fftOut[i * stride], _fftSize);
+                    accCounts[id]++;
+                    continue;
+                }
+                volk_32fc_magnitude_squared_32f(power, (lv_32fc_t*)&fftOut[i * stride], _fftSize);
+                combine(acc, power);
+                accCounts[id]++;
+            }
+        }
+
+        inline void combine(float* acc, const float* power) {
+            if (_mode == MODE_AVERAGE) {
+                volk_32f_x2_add_32f(acc, acc, power, _fftSize);
+            }
+            else if (_mode == MODE_PEAK_HOLD) {
+                volk_32f_x2_max_32f(acc, acc, power, _fftSize);
+            }
+            else if (_mode == MODE_MIN_HOLD) {
+                volk_32f_x2_min_32f(acc, acc, power, _fftSize);
+            }
+        }
+
+        int gatherFrames(int frames) {
+            if (hop < _fftSize) {
+                // Frames overlap, read the whole span at once after the samples kept from the last batch
+                int span = ((frames - 1) * hop) + _fftSize;
+                int ret = readFifo(&frameBuf[kept], span - kept);
+                if (ret <= 0) {
+                    kept = 0;
+                    return ret;
+                }
+                for (int i = 0; i < frames; i++) { framePtrs[i] = &frameBuf[i * hop]; }
+                return 1;
+            }
+
+            // Frames are separated by samples that are never used
+            for (int i = 0; i < frames; i++) {
+                int ret = readFifo(&frameBuf[i * _fftSize], _fftSize);
+                if (ret > 0) { ret = skipFifo(hop - _fftSize); }
+                if (ret <= 0) { return ret; }
+                framePtrs[i] = &frameBuf[i * _fftSize];
+            }
+            return 1;
+        }
+
+        // Returns -1 if stopped, 0 if input was dropped while waiting and 1 on success
+        int readFifo(complex_t* data, int count) {
+            std::unique_lock<std::mutex> lck(fifoMtx);
+            fifoCnd.wait(lck, [&] { return fifoFill >= count || fifoGap || fifoStop; });
+            if (fifoStop) { return -1; }
+            if (fifoGap) {
+                fifoGap = false;
+                return 0;
+            }
+            int first = std::min<int>(count, fifoSize - fifoStart);
+            memcpy(data, &fifo[fifoStart], first * sizeof(complex_t));
+            memcpy(&data[first], fifo, (count - first) * sizeof(complex_t));
+            fifoStart = (fifoStart + count) % fifoSize;
+            fifoFill -= count;
+            return 1;
+        }
+
+        int skipFifo(int count) {
+            std::unique_lock<std::mutex> lck(fifoMtx);
+            while (count) {
+                fifoCnd.wait(lck, [&] { return fifoFill || fifoGap || fifoStop; });
+                if (fifoStop) { return -1; }
+                if (fifoGap) {
+                    fifoGap = false;
+                    return 0;
+                }
+                int toSkip = std::min<int>(count, fifoFill);
+                fifoStart = (fifoStart + toSkip) % fifoSize;
+                fifoFill -= toSkip;
+                count -= toSkip;
+            }
+            return 1;
+        }
+
+        void writeOutput(float* buf) {
+            if (_mode == MODE_NORMAL) {
+                volk_32fc_s32f_power_spectrum_32f(buf, (lv_32fc_t*)fftOut, _fftSize, _fftSize);
+                return;
+            }
+
+            // Merge the accumulators of all threads into the first one that was used
+            float* result = NULL;
+            int total = 0;
+            for (int i = 0; i < _threads; i++) {
+                if (!accCounts[i]) { continue; }
+                float* acc = &accs[i * _fftSize];
+                if (result) { combine(result, acc); }
+                else { result = acc; }
+                total += accCounts[i];
+                accCounts[i] = 0;
+            }
+            if (!result) { return; }
+
+            // Convert to dB with the same normalization as in normal mode, the average is done at the same time
+            double offset = -20.0 * log10((double)_fftSize);
+            if (_mode == MODE_AVERAGE) { offset -= 10.0 * log10((double)total); }
+            volk_32f_log2_32f(buf, result, _fftSize);
+            volk_32f_s32f_multiply_32f(buf, buf, 10.0f * log10f(2.0f), _fftSize);
+            volk_32f_s32f_add_32f(buf, buf, offset, _fftSize);
+        }
+
+        void reconfigure(const float* newWindow = NULL) {
+            destroyBuffers();
+            if (newWindow) {
+                buffer::free(window);
+                window = buffer::alloc<float>(_fftSize);
+                memcpy(window, newWindow, _fftSize * sizeof(float));
+            }
+            initBuffers();
+        }
+
+        void initBuffers(const float* newWindow) {
+            window = buffer::alloc<float>(_fftSize);
+            memcpy(window, newWindow, _fftSize * sizeof(float));
+            initBuffers();
+        }
+
+        void initBuffers() {
+            // Work out the framing, in normal mode there is only one frame per output
+            double interval = std::max<double>(_samplerate / _rate, 1.0);
+            if (_mode == MODE_NORMAL) {
+                framesPerOutput = 1;
+            }
+            else {
+                double desiredHop = std::max<double>((double)_fftSize * (1.0 - _overlap), 1.0);
+                framesPerOutput = std::max<int>(round(interval / desiredHop), 1);
+            }
+            hop = std::max<int>(round(interval / (double)framesPerOutput), 1);
+            batchSize = std::clamp<int>(framesPerOutput, 1, std::max<int>(SPECTRUM_MAX_BATCH_SAMPLES / _fftSize, 1));
+            sliceSize = (batchSize + _threads - 1) / _threads;
+
+            // Keep every frame aligned the same way so that the plans can be used on any of them
+            stride = (_fftSize + 15) & ~15;
+            int span = (hop < _fftSize) ? (((batchSize - 1) * hop) + _fftSize) : (batchSize * _fftSize);
+            frameBuf = buffer::alloc<complex_t>(span);
+            framePtrs.resize(batchSize);
+            fifoSize = span + STREAM_BUFFER_SIZE;
+            fifo = buffer::alloc<complex_t>(fifoSize);
+            fftIn = (complex_t*)fftwf_malloc(batchSize * stride * sizeof(complex_t));
+            fftOut = (complex_t*)fftwf_malloc(batchSize * stride * sizeof(complex_t));
+            accs = buffer::alloc<float>(_threads * _fftSize);
+            powers = buffer::alloc<float>(_threads * _fftSize);
+            accCounts.assign(_threads, 0);
+
+            // Get the plans, they're owned by the cache so switching back to a previous size is instant
+            fft::PlanCache& cache = fft::PlanCache::getInstance();
+            slicePlan = cache.getDFT(_fftSize, FFTW_FORWARD, false, sliceSize, stride);
+            framePlan = cache.getDFT(_fftSize, FFTW_FORWARD, false, 1, stride);
+        }
+
+        void destroyBuffers() {
+            fftwf_free(fftIn);
+            fftwf_free(fftOut);
+            buffer::free(frameBuf);
+            buffer::free(fifo);
+            buffer::free(accs);
+            buffer::free(powers);
+        }
+
+        double _samplerate;
+        int _fftSize;
+        double _rate;
+        double _overlap = 0.5;
+        Mode _mode = MODE_NORMAL;
+        int _threads;
+        float* (*_acquireBuffer)(void* ctx);
+        void (*_releaseBuffer)(void* ctx);
+        void* _ctx;
+
+        // Framing
+        int framesPerOutput;
+        int framesDone = 0;
+        int hop;
+        int batchSize;
+        int sliceSize;
+        int stride;
+        int kept = 0;
+        complex_t* frameBuf;
+        std::vector<complex_t*> framePtrs;
+
+        // Transforms
+        float* window = NULL;
+        complex_t* fftIn;
+        complex_t* fftOut;
+        fft::Plan* slicePlan;
+        fft::Plan* framePlan;
+        float* accs;
+        float* powers;
+        std::vector<int> accCounts;
+
+        // Input buffering
+        std::mutex fifoMtx;
+        std::condition_variable fifoCnd;
+        complex_t* fifo;
+        int fifoSize;
+        int fifoStart = 0;
+        int fifoFill = 0;
+        bool fifoGap = false;
+        bool fifoStop = false;
+        uint64_t dropped = 0;
+
+        // Threads
+        std::thread processThread;
+        std::vector<std::thread> helperThreads;
+        std::mutex jobMtx;
+        std::condition_variable jobCnd;
+        std::condition_variable jobDoneCnd;
+        uint64_t jobId = 0;
+        int jobFrames;
+        int jobsDone;
+        bool jobStop = false;
+    };
+}
\ No newline at end of file
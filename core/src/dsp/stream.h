@@ -1,7 +1,9 @@
 #pragma once
 #include <string.h>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <utility>
 #include <volk/volk.h>
 #include "buffer/buffer.h"
 
@@ -9,6 +11,15 @@
 #define STREAM_BUFFER_SIZE 1000000
 
 namespace dsp {
+    class untyped_stream;
+
+    // Notified every time a stream changes state (data ready, flushed or stopped)
+    class stream_observer {
+    public:
+        virtual ~stream_observer() {}
+        virtual void streamChanged(untyped_stream* s) = 0;
+    };
+
     class untyped_stream {
     public:
         virtual ~untyped_stream() {}
@@ -19,25 +30,78 @@ namespace dsp {
         virtual void clearWriteStop() {}
         virtual void stopReader() {}
         virtual void clearReadStop() {}
+
+        // Non-blocking checks of whether read() and swap() would return immediately
+        virtual bool canRead() { return true; }
+        virtual bool canWrite() { return true; }
+
+        void setObserver(stream_observer* obs) { observer = obs; }
+        stream_observer* getObserver() { return observer; }
+
+    protected:
+        inline void notifyObserver() {
+            stream_observer* obs = observer.load(std::memory_order_acquire);
+            if (obs) { obs->streamChanged(this); }
+        }
+
+    private:
+        std::atomic<stream_observer*> observer = NULL;
     };
 
     template <class T>
     class stream : public untyped_stream {
     public:
         stream() {
-            writeBuf = buffer::alloc<T>(STREAM_BUFFER_SIZE);
-            readBuf = buffer::alloc<T>(STREAM_BUFFER_SIZE);
+            writeBuf = allocBuffer(STREAM_BUFFER_SIZE);
+            readBuf = allocBuffer(STREAM_BUFFER_SIZE);
         }
 
         virtual ~stream() {
             free();
         }
 
+        // Changes the capacity of the buffers. Must only be called by the writer or while it's stopped, the reader
+        // can keep running: if it's busy with the read buffer, the latter is only replaced on the next swap.
         virtual void setBufferSize(int samples) {
-            buffer::free(writeBuf);
-            buffer::free(readBuf);
-            writeBuf = buffer::alloc<T>(samples);
-            readBuf = buffer::alloc<T>(samples);
+            if (samples == bufferSize && !pendingReadSize) { return; }
+
+            // The writer isn't using its buffer
+            if (writeBuf) { freeBuffer(writeBuf, writeSize); }
+            writeBuf = allocBuffer(samples);
+            writeSize = samples;
+            bufferSize = samples;
+
+            // Replace the read buffer now only if the reader doesn't hold it
+            std::lock_guard<std::mutex> lck(rdyMtx);
+            if (dataReady) {
+                pendingReadSize = samples;
+                return;
+            }
+            if (readBuf) { freeBuffer(readBuf, readSize); }
+            readBuf = allocBuffer(samples);
+            readSize = samples;
+            pendingReadSize = 0;
+        }
+
+        // Capacity of the write and read buffers in samples
+        virtual int getBufferSize() {
+            return bufferSize;
+        }
+
+        // End of the write buffer, lent to the writer so it can receive raw data straight into it and convert it
+        // in place to the start of the buffer. The converted samples must end before the raw data does start.
+        inline void* rawWriteBuf(int bytes) {
+            return &((uint8_t*)writeBuf)[((size_t)getBufferSize() * sizeof(T)) - bytes];
+        }
+
+        // Gives the reader the current read buffer in exchange for one of the same size, so it can keep the data
+        // without copying it. Must be called between read() and flush(). Returns NULL if the stream can't do it,
+        // in which case the caller keeps its buffer.
+        virtual T* exchangeReadBuf(T* buf, int size) {
+            if (!readBuf || size != bufferSize || pendingReadSize) { return NULL; }
+            T* old = readBuf;
+            readBuf = buf;
+            return old;
         }
 
         virtual inline bool swap(int size) {
@@ -49,11 +113,20 @@ namespace dsp {
                 // If writer was stopped, abandon operation
                 if (writerStop) { return false; }
 
+                // The reader is done with its buffer, it can be resized if it was busy when the size changed
+                if (pendingReadSize) {
+                    freeBuffer(readBuf, readSize);
+                    readBuf = allocBuffer(pendingReadSize);
+                    readSize = pendingReadSize;
+                    pendingReadSize = 0;
+                }
+
                 // Swap buffers
                 dataSize = size;
                 T* temp = writeBuf;
                 writeBuf = readBuf;
                 readBuf = temp;
+                std::swap(writeSize, readSize);
                 canSwap = false;
             }
 
@@ -63,6 +136,7 @@ namespace dsp {
                 dataReady = true;
             }
             rdyCV.notify_all();
+            untyped_stream::notifyObserver();
 
             return true;
         }
@@ -89,6 +163,7 @@ namespace dsp {
             }
 
             swapCV.notify_all();
+            untyped_stream::notifyObserver();
         }
 
         virtual void stopWriter() {
@@ -97,6 +172,7 @@ namespace dsp {
                 writerStop = true;
             }
             swapCV.notify_all();
+            untyped_stream::notifyObserver();
         }
 
         virtual void clearWriteStop() {
@@ -109,15 +185,26 @@ namespace dsp {
                 readerStop = true;
             }
             rdyCV.notify_all();
+            untyped_stream::notifyObserver();
         }
 
         virtual void clearReadStop() {
             readerStop = false;
         }
 
+        virtual bool canRead() {
+            std::lock_guard<std::mutex> lck(rdyMtx);
+            return (dataReady || readerStop);
+        }
+
+        virtual bool canWrite() {
+            std::lock_guard<std::mutex> lck(swapMtx);
+            return (canSwap || writerStop);
+        }
+
         void free() {
-            if (writeBuf) { buffer::free(writeBuf); }
-            if (readBuf) { buffer::free(readBuf); }
+            if (writeBuf) { freeBuffer(writeBuf, writeSize); }
+            if (readBuf) { freeBuffer(readBuf, readSize); }
             writeBuf = NULL;
             readBuf = NULL;
         }
@@ -125,6 +212,27 @@ namespace dsp {
         T* writeBuf;
         T* readBuf;
 
+    protected:
+        // Used by derived streams that manage their own buffers
+        stream(bool allocBuffers) {
+            writeBuf = allocBuffers ? allocBuffer(STREAM_BUFFER_SIZE) : NULL;
+            readBuf = allocBuffers ? allocBuffer(STREAM_BUFFER_SIZE) : NULL;
+        }
+
+        // Allocation counted in the memory used by the streams
+        static T* allocBuffer(int samples) {
+            buffer::trackMemory(buffer::MEMORY_USE_STREAMS, (int64_t)samples * sizeof(T));
+            return buffer::alloc<T>(samples);
+        }
+
+        static void freeBuffer(T* buf, int samples) {
+            buffer::trackMemory(buffer::MEMORY_USE_STREAMS, -(int64_t)samples * sizeof(T));
+            buffer::free(buf);
+        }
+
+        // Capacity seen by the writer, the buffers only match it once a pending resize of the read buffer is done
+        std::atomic<int> bufferSize = STREAM_BUFFER_SIZE;
+
     private:
         std::mutex swapMtx;
         std::condition_variable swapCV;
@@ -138,5 +246,9 @@ namespace dsp {
         bool writerStop = false;
 
         int dataSize = 0;
+
+        int writeSize = STREAM_BUFFER_SIZE;
+        int readSize = STREAM_BUFFER_SIZE;
+        int pendingReadSize = 0;
     };
 }
\ No newline at end of file
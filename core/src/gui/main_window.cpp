@@ -86,10 +86,6 @@ void MainWindow::init() {
     gui::waterfall.setBandwidth(8000000);
     gui::waterfall.setViewBandwidth(8000000);
 
-    fft_in = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
-    fft_out = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
-    fftwPlan = fftwf_plan_dft_1d(fftSize, fft_in, fft_out, FFTW_FORWARD, FFTW_ESTIMATE);
-
     sigpath::iqFrontEnd.init(&dummyStream, 8000000, true, 1, false, 1024, 20.0, IQFrontEnd::FFTWindow::NUTTALL,
                              acquireFFTBuffer, releaseFFTBuffer, this);
     sigpath::iqFrontEnd.start();
@@ -579,9 +575,16 @@ void MainWindow::draw() {
         ImGui::Checkbox("Show demo window", &demoWindow);
         ImGui::Text("ImGui version: %s", ImGui::GetVersion());
 
-        // ImGui::Checkbox("Bypass buffering", &sigpath::iqFrontEnd.inputBuffer.bypass);
+        if (sigpath::iqFrontEnd.isBuffering()) {
+            ImGui::Text("Input buffer: %.1f / %.1f ms", sigpath::iqFrontEnd.getBufferFillLevel(), sigpath::iqFrontEnd.getBufferCapacity());
+            ImGui::Text("Input overruns: %d, underruns: %d", (int)sigpath::iqFrontEnd.getBufferOverruns(), (int)sigpath::iqFrontEnd.getBufferUnderruns());
+        }
+        else {
+            ImGui::TextUnformatted("Input buffer: bypassed");
+        }
 
-        // ImGui::Text("Buffering: %d", (sigpath::iqFrontEnd.inputBuffer.writeCur - sigpath::iqFrontEnd.inputBuffer.readCur + 32) % 32);
+        ImGui::Text("DSP memory: %.1f MB (streams: %.1f MB, work: %.1f MB)", (double)dsp::buffer::getTotalMemoryUsage() / 1e6,
+                    (double)dsp::buffer::getMemoryUsage(dsp::buffer::MEMORY_USE_STREAMS) / 1e6, (double)dsp::buffer::getMemoryUsage(dsp::buffer::MEMORY_USE_WORK) / 1e6);
 
         if (ImGui::Button("Test Bug")) {
             flog::error("Will this make the software crash?");
@@ -46,8 +46,6 @@ private:
     // FFT Variables
     int fftSize = 8192 * 8;
     std::mutex fft_mtx;
-    fftwf_complex *fft_in, *fft_out;
-    fftwf_plan fftwPlan;
 
     // GUI Variables
     bool firstMenuRender = true;
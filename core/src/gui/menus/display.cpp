@@ -18,6 +18,8 @@ namespace displaymenu {
     std::string colorMapNamesTxt = "";
     std::string colorMapAuthor = "";
     int selectedWindow = 0;
+    int selectedMode = 0;
+    int fftOverlap = 50;
     int fftRate = 20;
     int fftSizeId = 0;
     int uiScaleId = 0;
@@ -38,6 +40,13 @@ namespace displaymenu {
         IQFrontEnd::FFTWindow::NUTTALL
     };
 
+    const dsp::sink::Spectrum::Mode fftModeList[] = {
+        dsp::sink::Spectrum::MODE_NORMAL,
+        dsp::sink::Spectrum::MODE_AVERAGE,
+        dsp::sink::Spectrum::MODE_PEAK_HOLD,
+        dsp::sink::Spectrum::MODE_MIN_HOLD
+    };
+
     void updateFFTSpeeds() {
         gui::waterfall.setFFTHoldSpeed((float)fftHoldSpeed / ((float)fftRate * 10.0f));
         gui::waterfall.setFFTSmoothingSpeed(std::min<float>((float)fftSmoothingSpeed / (float)(fftRate * 10.0f), 1.0f));
@@ -92,6 +101,12 @@ namespace displaymenu {
         selectedWindow = std::clamp<int>((int)core::configManager.conf["fftWindow"], 0, (sizeof(fftWindowList) / sizeof(IQFrontEnd::FFTWindow)) - 1);
         sigpath::iqFrontEnd.setFFTWindow(fftWindowList[selectedWindow]);
 
+        selectedMode = std::clamp<int>((int)core::configManager.conf["fftMode"], 0, (sizeof(fftModeList) / sizeof(dsp::sink::Spectrum::Mode)) - 1);
+        sigpath::iqFrontEnd.setFFTMode(fftModeList[selectedMode]);
+
+        fftOverlap = std::clamp<int>((int)core::configManager.conf["fftOverlap"], 0, 95);
+        sigpath::iqFrontEnd.setFFTOverlap((double)fftOverlap / 100.0);
+
         gui::menu.locked = core::configManager.conf["lockMenuOrder"];
 
         fftHold = core::configManager.conf["fftHold"];
@@ -237,6 +252,24 @@ namespace displaymenu {
             core::configManager.release(true);
         }
 
+        ImGui::LeftLabel("FFT Mode");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::Combo("##sdrpp_fft_mode", &selectedMode, "Normal\0Average\0Peak Hold\0Min Hold\0")) {
+            sigpath::iqFrontEnd.setFFTMode(fftModeList[selectedMode]);
+            core::configManager.acquire();
+            core::configManager.conf["fftMode"] = selectedMode;
+            core::configManager.release(true);
+        }
+
+        ImGui::LeftLabel("FFT Overlap");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::SliderInt("##sdrpp_fft_overlap", &fftOverlap, 0, 95, "%d%%")) {
+            sigpath::iqFrontEnd.setFFTOverlap((double)fftOverlap / 100.0);
+            core::configManager.acquire();
+            core::configManager.conf["fftOverlap"] = fftOverlap;
+            core::configManager.release(true);
+        }
+
         if (colorMapNames.size() > 0) {
             ImGui::LeftLabel("Color Map");
             ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
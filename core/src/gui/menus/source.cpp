@@ -20,6 +20,7 @@ namespace sourcemenu {
 
     bool iqCorrection = false;
     bool invertIQ = false;
+    bool sharedChannelizer = false;
 
     int offsetId = 0;
     double manualOffset = 0.0;
@@ -183,6 +184,7 @@ namespace sourcemenu {
         std::string selectedOffset = core::configManager.conf["selectedOffset"];
         iqCorrection = core::configManager.conf["iqCorrection"];
         invertIQ = core::configManager.conf["invertIQ"];
+        sharedChannelizer = core::configManager.conf["sharedChannelizer"];
         int decimation = core::configManager.conf["decimation"];
         if (decimations.keyExists(decimation)) {
             decimId = decimations.keyId(decimation);
@@ -198,6 +200,7 @@ namespace sourcemenu {
         // Update frontend settings
         sigpath::iqFrontEnd.setDCBlocking(iqCorrection);
         sigpath::iqFrontEnd.setInvertIQ(invertIQ);
+        sigpath::iqFrontEnd.setChannelizer(sharedChannelizer);
         sigpath::iqFrontEnd.setDecimation(decimations.value(decimId));
         selectOffsetByName(selectedOffset);
 
@@ -322,6 +325,14 @@ namespace sourcemenu {
             core::configManager.release(true);
         }
 
+        // Only applies to VFOs created after the change
+        if (ImGui::Checkbox("Shared Channelizer##_sdrpp_shared_chan", &sharedChannelizer)) {
+            sigpath::iqFrontEnd.setChannelizer(sharedChannelizer);
+            core::configManager.acquire();
+            core::configManager.conf["sharedChannelizer"] = sharedChannelizer;
+            core::configManager.release(true);
+        }
+
         ImGui::LeftLabel("Offset mode");
         ImGui::SetNextItemWidth(itemWidth - ImGui::GetCursorPosX() - 2.0f*(lineHeight + 1.5f*spacing));
         if (ImGui::Combo("##_sdrpp_offset", &offsetId, offsets.txt)) {
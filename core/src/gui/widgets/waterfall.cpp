@@ -62,31 +62,18 @@ inline void printAndScale(double freq, char* buf) {
     }
 }
 
-inline void doZoom(int offset, int width, int inSize, int outSize, float* in, float* out) {
-    // NOTE: REMOVE THAT SHIT, IT'S JUST A HACKY FIX
-    if (offset < 0) {
-        offset = 0;
-    }
-    if (width > 524288) {
-        width = 524288;
-    }
-
-    float factor = (float)width / (float)outSize;
-    float sFactor = ceilf(factor);
-    float uFactor;
-    float id = offset;
-    float maxVal;
-    int sId;
-    for (int i = 0; i < outSize; i++) {
-        maxVal = -INFINITY;
-        sId = (int)id;
-        uFactor = (sId + sFactor > inSize) ? sFactor - ((sId + sFactor) - inSize) : sFactor;
-        for (int j = 0; j < uFactor; j++) {
-            if (in[sId + j] > maxVal) { maxVal = in[sId + j]; }
-        }
-        out[i] = maxVal;
-        id += factor;
-    }
+inline float maxOf(const float* in, int count) {
+    if (count <= 0) { return -INFINITY; }
+    if (count < 8) {
+        float maxVal = in[0];
+        for (int i = 1; i < count; i++) {
+            if (in[i] > maxVal) { maxVal = in[i]; }
+        }
+        return maxVal;
+    }
+    uint32_t id;
+    volk_32f_index_max_32u(&id, in, count);
+    return in[id];
 }
 
 namespace ImGui {
@@ -106,6 +93,10 @@ namespace ImGui {
         latestFFT = new float[dataWidth];
         latestFFTHold = new float[dataWidth];
         waterfallFb = new uint32_t[1];
+        zoomStarts.resize(dataWidth);
+        zoomCounts.resize(dataWidth);
+        zoomBuf.resize(dataWidth);
+        pixelIds.resize(dataWidth);
 
         viewBandwidth = 1.0;
         wholeBandwidth = 1.0;
@@ -618,34 +609,68 @@ namespace ImGui {
             return;
         }
         double offsetRatio = viewOffset / (wholeBandwidth / 2.0);
-        int drawDataSize;
-        int drawDataStart;
-        // TODO: Maybe put on the stack for faster alloc?
-        float* tempData = new float[dataWidth];
-        float pixel;
-        float dataRange = waterfallMax - waterfallMin;
+        int drawDataSize = (viewBandwidth / wholeBandwidth) * rawFFTSize;
+        int drawDataStart = (((double)rawFFTSize / 2.0) * (offsetRatio + 1)) - (drawDataSize / 2);
         int count = std::min<float>(waterfallHeight, fftLines);
-        if (rawFFTs != NULL && fftLines >= 0) {
+        if (fftLines >= 0) {
+            // When zoomed out enough, work from the coarse lines to read a fraction of the memory.
+            // The max is then taken over whole groups of bins which widens each pixel by less than a quarter.
+            bool coarse = (drawDataSize >= dataWidth * WATERFALL_COARSE_DECIM * 4);
+            updateZoomMap(drawDataStart, drawDataSize, rawFFTSize, coarse ? WATERFALL_COARSE_DECIM : 1);
             for (int i = 0; i < count; i++) {
-                drawDataSize = (viewBandwidth / wholeBandwidth) * rawFFTSize;
-                drawDataStart = (((double)rawFFTSize / 2.0) * (offsetRatio + 1)) - (drawDataSize / 2);
-                doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, &rawFFTs[((i + currentFFTLine) % waterfallHeight) * rawFFTSize], tempData);
-                for (int j = 0; j < dataWidth; j++) {
-                    pixel = (std::clamp<float>(tempData[j], waterfallMin, waterfallMax) - waterfallMin) / dataRange;
-                    waterfallFb[(i * dataWidth) + j] = waterfallPallet[(int)(pixel * (WATERFALL_RESOLUTION - 1))];
-                }
+                int line = (i + currentFFTLine) % waterfallHeight;
+                zoomLine(coarse ? &coarseFFTs[line * coarseFFTSize] : &rawFFTs[line * rawFFTSize], zoomBuf.data());
+                lineToPixels(zoomBuf.data(), &waterfallFb[i * dataWidth]);
             }
 
-            for (int i = count; i < waterfallHeight; i++) {
-                for (int j = 0; j < dataWidth; j++) {
-                    waterfallFb[(i * dataWidth) + j] = (uint32_t)255 << 24;
-                }
-            }
+            std::fill(&waterfallFb[count * dataWidth], &waterfallFb[waterfallHeight * dataWidth], (uint32_t)255 << 24);
         }
-        delete[] tempData;
         waterfallUpdate = true;
     }
 
+    void WaterFall::updateZoomMap(int offset, int width, int inSize, int decim) {
+        // Each pixel is the max of the bins starting at its position, rounded outwards to whole groups if decimated
+        double factor = (double)width / (double)dataWidth;
+        int sFactor = ceil(factor);
+        for (int i = 0; i < dataWidth; i++) {
+            int start = floor((double)offset + ((double)i * factor));
+            int end = std::min<int>(start + sFactor, inSize);
+            start = std::max<int>(start, 0);
+            zoomStarts[i] = start / decim;
+            zoomCounts[i] = ((end + decim - 1) / decim) - zoomStarts[i];
+        }
+    }
+
+    void WaterFall::zoomLine(const float* in, float* out) {
+        for (int i = 0; i < dataWidth; i++) {
+            out[i] = maxOf(&in[zoomStarts[i]], zoomCounts[i]);
+        }
+    }
+
+    void WaterFall::lineToPixels(const float* in, uint32_t* out) {
+        // Scale to palette indexes, the contrast stretches the range past the max
+        float dataRange = std::max<float>((waterfallMax - waterfallMin) + 160 - getContrast(), 1e-3f);
+        float scale = (float)(WATERFALL_RESOLUTION - 1) / dataRange;
+        int maxId = std::clamp<int>((waterfallMax - waterfallMin) * scale, 0, WATERFALL_RESOLUTION - 1);
+        volk_32f_s32f_add_32f(zoomBuf.data(), in, -waterfallMin, dataWidth);
+        volk_32f_s32f_convert_32i(pixelIds.data(), zoomBuf.data(), scale, dataWidth);
+
+        // Look up the colors
+        for (int i = 0; i < dataWidth; i++) {
+            int id = std::clamp<int>(pixelIds[i], 0, maxId);
+            out[i] = waterfallPallet[id];
+        }
+    }
+
+    void WaterFall::updateCoarseLine(int line) {
+        float* raw = &rawFFTs[line * rawFFTSize];
+        float* coarse = &coarseFFTs[line * coarseFFTSize];
+        for (int i = 0; i < coarseFFTSize; i++) {
+            int start = i * WATERFALL_COARSE_DECIM;
+            coarse[i] = maxOf(&raw[start], std::min<int>(WATERFALL_COARSE_DECIM, rawFFTSize - start));
+        }
+    }
+
     void WaterFall::drawBandPlan() {
         int count = bandplan->bands.size();
         double horizScale = (double)dataWidth / viewBandwidth;
@@ -755,19 +780,18 @@ namespace ImGui {
             // Raw FFT resize
             fftLines = std::min<int>(fftLines, waterfallHeight) - 1;
             if (rawFFTs != NULL) {
+                // Move the latest line to the top
                 if (currentFFTLine != 0) {
-                    float* tempWF = new float[currentFFTLine * rawFFTSize];
-                    int moveCount = lastWaterfallHeight - currentFFTLine;
-                    memcpy(tempWF, rawFFTs, currentFFTLine * rawFFTSize * sizeof(float));
-                    memmove(rawFFTs, &rawFFTs[currentFFTLine * rawFFTSize], moveCount * rawFFTSize * sizeof(float));
-                    memcpy(&rawFFTs[moveCount * rawFFTSize], tempWF, currentFFTLine * rawFFTSize * sizeof(float));
-                    delete[] tempWF;
+                    std::rotate(rawFFTs, &rawFFTs[currentFFTLine * rawFFTSize], &rawFFTs[lastWaterfallHeight * rawFFTSize]);
+                    std::rotate(coarseFFTs, &coarseFFTs[currentFFTLine * coarseFFTSize], &coarseFFTs[lastWaterfallHeight * coarseFFTSize]);
                 }
                 currentFFTLine = 0;
                 rawFFTs = (float*)realloc(rawFFTs, waterfallHeight * rawFFTSize * sizeof(float));
+                coarseFFTs = (float*)realloc(coarseFFTs, waterfallHeight * coarseFFTSize * sizeof(float));
             }
             else {
                 rawFFTs = (float*)malloc(waterfallHeight * rawFFTSize * sizeof(float));
+                coarseFFTs = (float*)malloc(waterfallHeight * coarseFFTSize * sizeof(float));
             }
             // ==============
         }
@@ -784,6 +808,12 @@ namespace ImGui {
         }
         latestFFTHold = new float[dataWidth];
 
+        // Resize the zoom scratch buffers
+        zoomStarts.resize(dataWidth);
+        zoomCounts.resize(dataWidth);
+        zoomBuf.resize(dataWidth);
+        pixelIds.resize(dataWidth);
+
         // Reallocate smoothing buffer
         if (fftSmoothing) {
             if (smoothingBuf) { delete[] smoothingBuf; }
@@ -913,22 +943,16 @@ namespace ImGui {
         int drawDataSize = (viewBandwidth / wholeBandwidth) * rawFFTSize;
         int drawDataStart = (((double)rawFFTSize / 2.0) * (offsetRatio + 1)) - (drawDataSize / 2);
 
+        updateZoomMap(drawDataStart, drawDataSize, rawFFTSize, 1);
         if (waterfallVisible) {
-            doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, &rawFFTs[currentFFTLine * rawFFTSize], latestFFT);
+            zoomLine(&rawFFTs[currentFFTLine * rawFFTSize], latestFFT);
+            updateCoarseLine(currentFFTLine);
             memmove(&waterfallFb[dataWidth], waterfallFb, dataWidth * (waterfallHeight - 1) * sizeof(uint32_t));
-            float pixel;
-            float dataRange = (waterfallMax - waterfallMin) + 160 - getContrast();
-            for (int j = 0; j < dataWidth; j++) {
-                pixel = (std::clamp<float>(latestFFT[j], waterfallMin, waterfallMax) - waterfallMin) / dataRange;
-                int id = (int)(pixel * (WATERFALL_RESOLUTION - 1));
-                id = id < 0 ? 0 : id;
-                id = id >= WATERFALL_RESOLUTION ? WATERFALL_RESOLUTION - 1 : id;
-                waterfallFb[j] = waterfallPallet[id];
-            }
+            lineToPixels(latestFFT, waterfallFb);
             waterfallUpdate = true;
         }
         else {
-            doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, rawFFTs, latestFFT);
+            zoomLine(rawFFTs, latestFFT);
             fftLines = 1;
         }
 
@@ -1165,18 +1189,26 @@ namespace ImGui {
     void WaterFall::setRawFFTSize(int size) {
         std::lock_guard<std::recursive_mutex> lck(buf_mtx);
         rawFFTSize = size;
+        coarseFFTSize = (rawFFTSize + WATERFALL_COARSE_DECIM - 1) / WATERFALL_COARSE_DECIM;
         int wfSize = std::max<int>(1, waterfallHeight);
         if (rawFFTs != NULL) {
             rawFFTs = (float*)realloc(rawFFTs, rawFFTSize * wfSize * sizeof(float));
+            coarseFFTs = (float*)realloc(coarseFFTs, coarseFFTSize * wfSize * sizeof(float));
         }
         else {
             rawFFTs = (float*)malloc(rawFFTSize * wfSize * sizeof(float));
+            coarseFFTs = (float*)malloc(coarseFFTSize * wfSize * sizeof(float));
         }
         fftLines = 0;
         memset(rawFFTs, 0, rawFFTSize * waterfallHeight * sizeof(float));
+        memset(coarseFFTs, 0, coarseFFTSize * waterfallHeight * sizeof(float));
         updateWaterfallFb();
     }
 
+    int WaterFall::getRawFFTSize() {
+        return rawFFTSize;
+    }
+
     void WaterFall::setBandPlanPos(int pos) {
         bandPlanPos = pos;
     }
@@ -1421,6 +1453,7 @@ namespace ImGui {
         waterfallVisible = true;
         onResize();
         memset(rawFFTs, 0, waterfallHeight * rawFFTSize * sizeof(float));
+        memset(coarseFFTs, 0, waterfallHeight * coarseFFTSize * sizeof(float));
         updateWaterfallFb();
         buf_mtx.unlock();
     }
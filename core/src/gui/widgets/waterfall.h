@@ -10,6 +10,9 @@
 
 #define WATERFALL_RESOLUTION 1000000
 
+// Bins per sample of the coarse copy of each waterfall line used when zoomed out
+#define WATERFALL_COARSE_DECIM 16
+
 namespace ImGui {
     class WaterfallVFO {
     public:
@@ -137,6 +140,7 @@ namespace ImGui {
         int getFFTHeight();
 
         void setRawFFTSize(int size);
+        int getRawFFTSize();
 
         void setFullWaterfallUpdate(bool fullUpdate);
 
@@ -239,6 +243,10 @@ namespace ImGui {
         void onPositionChange();
         void onResize();
         void updateWaterfallFb();
+        void updateZoomMap(int offset, int width, int inSize, int decim);
+        void zoomLine(const float* in, float* out);
+        void lineToPixels(const float* in, uint32_t* out);
+        void updateCoarseLine(int line);
         void updateWaterfallTexture();
         void updateAllVFOs(bool checkRedrawRequired = false);
         bool calculateVFOSignalInfo(float* fftLine, WaterfallVFO* vfo, float& strength, float& snr);
@@ -301,9 +309,17 @@ namespace ImGui {
         float* latestFFT = NULL;
         float* latestFFTHold = NULL;
         float* smoothingBuf = NULL;
+        float* coarseFFTs = NULL;
+        int coarseFFTSize = 0;
         int currentFFTLine = 0;
         int fftLines = 0;
 
+        // Zoom and colormap scratch, sized to the data width
+        std::vector<int> zoomStarts;
+        std::vector<int> zoomCounts;
+        std::vector<float> zoomBuf;
+        std::vector<int32_t> pixelIds;
+
         uint32_t* waterfallFb;
 
         bool draggingFW = false;
@@ -4,77 +4,57 @@
 #include <version.h>
 #include <config.h>
 #include <filesystem>
+#include <set>
 #include <dsp/types.h>
 #include <signal_path/signal_path.h>
 #include <gui/smgui.h>
 #include <utils/optionlist.h>
-#include "dsp/compression/sample_stream_compressor.h"
+#include <utils/reactor.h>
 #include "dsp/sink/handler_sink.h"
-#include <zstd.h>
 
 namespace server {
     dsp::stream<dsp::complex_t> dummyInput;
-    dsp::compression::SampleStreamCompressor comp;
-    dsp::sink::Handler<uint8_t> hnd;
-    net::Conn client;
-    uint8_t* rbuf = NULL;
-    uint8_t* sbuf = NULL;
-    uint8_t* bbuf = NULL;
-
-    PacketHeader* r_pkt_hdr = NULL;
-    uint8_t* r_pkt_data = NULL;
-    CommandHeader* r_cmd_hdr = NULL;
-    uint8_t* r_cmd_data = NULL;
-
-    PacketHeader* s_pkt_hdr = NULL;
-    uint8_t* s_pkt_data = NULL;
-    CommandHeader* s_cmd_hdr = NULL;
-    uint8_t* s_cmd_data = NULL;
-
-    PacketHeader* bb_pkt_hdr = NULL;
-    uint8_t* bb_pkt_data = NULL;
+    dsp::stream<dsp::complex_t> basebandIn;
+    dsp::sink::Handler<dsp::complex_t> hnd;
 
     SmGui::DrawListElem dummyElem;
 
-    ZSTD_CCtx* cctx;
-
+    net::Reactor* reactor = NULL;
     net::Listener listener;
 
+    // Connected clients
+    std::vector<ClientSession*> sessions;
+    std::mutex sessionsMtx;
+    int maxClients = 8;
+
+    // Rejected connections, closed once their disconnect command had time to go out
+    std::vector<std::pair<net::Conn, std::chrono::steady_clock::time_point>> rejected;
+    std::mutex rejectedMtx;
+
+    // Held while a command is handled, the source and the UI are shared by all clients
+    std::mutex cmdMtx;
+    int streamingClients = 0;
+
     OptionList<std::string, std::string> sourceList;
     int sourceId = 0;
     bool running = false;
-    bool compression = false;
     double sampleRate = 1000000.0;
 
+    // Decoders run on the server without any client
+    ConfigManager farmConfig;
+
     int main() {
         flog::info("=====| SERVER MODE |=====");
 
-        // Init DSP
-        comp.init(&dummyInput, dsp::compression::PCM_TYPE_I8);
-        hnd.init(&comp.out, _testServerHandler, NULL);
-        rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        sbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        bbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        comp.start();
+        // Init DSP, the source goes through the IQ frontend so that VFOs and FFTs can be computed for the clients.
+        // Its own FFT has nowhere to go so it's disabled, and nothing is done to the samples before the full baseband is sent.
+        sigpath::iqFrontEnd.init(&dummyInput, sampleRate, false, 1, false, 1024, 1.0, IQFrontEnd::FFTWindow::NUTTALL, _acquireFFTBuffer, _releaseFFTBuffer, NULL);
+        sigpath::iqFrontEnd.setFFTEnabled(false);
+        sigpath::iqFrontEnd.bindIQStream(&basebandIn);
+        hnd.init(&basebandIn, _basebandHandler, NULL);
+        sigpath::iqFrontEnd.start();
         hnd.start();
 
-        // Initialize headers
-        r_pkt_hdr = (PacketHeader*)rbuf;
-        r_pkt_data = &rbuf[sizeof(PacketHeader)];
-        r_cmd_hdr = (CommandHeader*)r_pkt_data;
-        r_cmd_data = &rbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
-
-        s_pkt_hdr = (PacketHeader*)sbuf;
-        s_pkt_data = &sbuf[sizeof(PacketHeader)];
-        s_cmd_hdr = (CommandHeader*)s_pkt_data;
-        s_cmd_data = &sbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
-
-        bb_pkt_hdr = (PacketHeader*)bbuf;
-        bb_pkt_data = &bbuf[sizeof(PacketHeader)];
-
-        // Initialize compressor
-        cctx = ZSTD_createCCtx();
-
         // Load config
         core::configManager.acquire();
         std::string modulesDir = core::configManager.conf["modulesDirectory"];
@@ -87,6 +67,27 @@ namespace server {
         // Initialize SmGui in server mode
         SmGui::init(true);
 
+        // Load the decoder farm config, the modules providing its decoders are loaded along with the sources
+        json farmDef = json({});
+        farmDef["enabled"] = false;
+        farmDef["centerFrequency"] = 100000000.0;
+        farmDef["workers"] = 0;
+        farmDef["statsInterval"] = 10.0;
+        farmDef["output"]["file"] = core::args["root"].s() + "/decoder_farm.jsonl";
+        farmDef["output"]["host"] = "0.0.0.0";
+        farmDef["output"]["port"] = 0;
+        farmDef["modules"] = json::array({ "pager_decoder", "radio" });
+        farmDef["channels"] = json::array();
+        farmConfig.setPath(core::args["root"].s() + "/decoder_farm_config.json");
+        farmConfig.load(farmDef);
+        farmConfig.acquire();
+        bool farmEnabled = farmConfig.conf["enabled"];
+        std::set<std::string> farmModules;
+        if (farmEnabled) {
+            for (auto const& mod : farmConfig.conf["modules"]) { farmModules.insert((std::string)mod); }
+        }
+        farmConfig.release();
+
         flog::info("Loading modules");
         // Load modules and check type to only load sources ( TODO: Have a proper type parameter int the info )
         // TODO LATER: Add whitelist/blacklist stuff
@@ -98,7 +99,7 @@ namespace server {
                     continue;
                 }
                 if (!file.is_regular_file()) { continue; }
-                if (fn.find("source") == std::string::npos) { continue; }
+                if (fn.find("source") == std::string::npos && !farmModules.count(file.path().stem().string())) { continue; }
 
                 flog::info("Loading {0}", path);
                 core::moduleManager.loadModule(path);
@@ -118,7 +119,7 @@ namespace server {
                 continue;
             }
             if (!std::filesystem::is_regular_file(file)) { continue; }
-            if (fn.find("source") == std::string::npos) { continue; }
+            if (fn.find("source") == std::string::npos && !farmModules.count(file.stem().string())) { continue; }
 
             flog::info("Loading {0}", path);
             core::moduleManager.loadModule(path);
@@ -129,6 +130,10 @@ namespace server {
             std::string mod = _module["module"];
             bool enabled = _module["enabled"];
             if (core::moduleManager.modules.find(mod) == core::moduleManager.modules.end()) { continue; }
+
+            // Decoder modules are only loaded for the farm, their instances need the GUI
+            if (farmModules.count(mod)) { continue; }
+
             flog::info("Initializing {0} ({1})", name, mod);
             core::moduleManager.createInstance(name, mod);
             if (!enabled) { core::moduleManager.disableInstance(name); }
@@ -148,22 +153,57 @@ namespace server {
         if (sourceList.keyExists(sourceName)) { sourceId = sourceList.keyId(sourceName); }
         sigpath::sourceManager.selectSource(sourceList[sourceId]);
 
+        // Start the decoder farm, the source then keeps running even without any client
+        if (farmEnabled) {
+            farmConfig.acquire();
+            json farmConf = farmConfig.conf;
+            farmConfig.release();
+            sigpath::sourceManager.tune(farmConf["centerFrequency"]);
+            if (sigpath::decoderFarm.start(farmConf)) {
+                std::lock_guard<std::mutex> lck(cmdMtx);
+                if (!streamingClients++) {
+                    sigpath::sourceManager.start();
+                    running = true;
+                }
+            }
+        }
+
         // TODO: Use command line option
         std::string host = (std::string)core::args["addr"];
         int port = (int)core::args["port"];
-        listener = net::listen(host, port);
+        maxClients = std::max<int>((int)core::args["max-clients"], 1);
+
+        // Handle the network for all clients on a few threads if possible
+        int netThreads = (int)core::args["net-threads"];
+        if (netThreads > 0) {
+            try {
+                reactor = new net::Reactor(netThreads);
+            }
+            catch (const std::exception& e) {
+                flog::warn("Could not start network threads, using two threads per client: {0}", e.what());
+            }
+        }
+        listener = net::listen(host, port, reactor);
         listener->acceptAsync(_clientHandler, NULL);
 
         flog::info("Ready, listening on {0}:{1}", host, port);
-        while(1) { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }
+        while(1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            removeClosedSessions();
+        }
 
         return 0;
     }
 
     void _clientHandler(net::Conn conn, void* ctx) {
-        // Reject if someone else is already connected
-        if (client && client->isOpen()) {
-            flog::info("REJECTED Connection from {0}:{1}, another client is already connected.", "TODO", "TODO");
+        // Reject if the server is full
+        int clientCount;
+        {
+            std::lock_guard<std::mutex> lck(sessionsMtx);
+            clientCount = sessions.size();
+        }
+        if (clientCount >= maxClients) {
+            flog::info("REJECTED Connection from {0}:{1}, too many clients are already connected.", "TODO", "TODO");
             
             // Issue a disconnect command to the client
             uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader)];
@@ -172,83 +212,154 @@ namespace server {
             tmp_phdr->size = sizeof(PacketHeader) + sizeof(CommandHeader);
             tmp_phdr->type = PACKET_TYPE_COMMAND;
             tmp_chdr->cmd = COMMAND_DISCONNECT;
-            conn->write(tmp_phdr->size, buf);
+            conn->writeAsync(tmp_phdr->size, buf);
 
-            // TODO: Find something cleaner
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            // Leave it to the cleanup loop to close it so that the accepting thread doesn't wait
+            {
+                std::lock_guard<std::mutex> lck(rejectedMtx);
+                rejected.push_back({ std::move(conn), std::chrono::steady_clock::now() + std::chrono::milliseconds(100) });
+            }
 
-            conn->close();
-            
             // Start another async accept
             listener->acceptAsync(_clientHandler, NULL);
             return;
         }
 
         flog::info("Connection from {0}:{1}", "TODO", "TODO");
-        client = std::move(conn);
-        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
-
-        // Perform settings reset
-        sigpath::sourceManager.stop();
-        comp.setPCMType(dsp::compression::PCM_TYPE_I16);
-        compression = false;
 
-        sendSampleRate(sampleRate);
-
-        // TODO: Wait otherwise someone else could connect
+        // Create a session with the default settings, the source keeps running for the other clients
+        ClientSession* session = new ClientSession(std::move(conn));
+        session->setPCMType(dsp::compression::PCM_TYPE_I16);
+        session->setCompression(COMPRESSION_NONE);
+        session->setInputSampleRate(sampleRate);
+        {
+            std::lock_guard<std::mutex> lck(sessionsMtx);
+            sessions.push_back(session);
+        }
+        session->start(_packetHandler);
 
         listener->acceptAsync(_clientHandler, NULL);
     }
 
     void _packetHandler(int count, uint8_t* buf, void* ctx) {
+        ClientSession* session = (ClientSession*)ctx;
         PacketHeader* hdr = (PacketHeader*)buf;
 
-        // Read the rest of the data (TODO: CHECK SIZE OR SHIT WILL BE FUCKED + ADD TIMEOUT)
-        int len = 0;
-        int read = 0;
+        // Drop the client if the packet can't fit in the buffer (TODO: ADD TIMEOUT)
+        if (hdr->size < sizeof(PacketHeader) || hdr->size > SERVER_MAX_PACKET_SIZE) {
+            flog::error("Invalid packet size from client: {0}", hdr->size);
+            session->sendError(ERROR_INVALID_PACKET);
+            session->markForRemoval();
+            return;
+        }
+
+        // Have the rest of the packet read without blocking the network thread
         int goal = hdr->size - sizeof(PacketHeader);
-        while (len < goal) {
-            read = client->read(goal - len, &buf[sizeof(PacketHeader) + len]);
-            if (read < 0) { return; };
-            len += read;
+        if (goal) {
+            session->conn->readAsync(goal, &buf[sizeof(PacketHeader)], _packetBodyHandler, session);
+            return;
         }
+        _packetBodyHandler(0, &buf[sizeof(PacketHeader)], session);
+    }
+
+    void _packetBodyHandler(int count, uint8_t* buf, void* ctx) {
+        // The body follows the header in the session's read buffer
+        ClientSession* session = (ClientSession*)ctx;
+        buf = session->rbuf;
+        PacketHeader* hdr = (PacketHeader*)buf;
 
         // Parse and process
         if (hdr->type == PACKET_TYPE_COMMAND && hdr->size >= sizeof(PacketHeader) + sizeof(CommandHeader)) {
             CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
-            commandHandler((Command)chdr->cmd, &buf[sizeof(PacketHeader) + sizeof(CommandHeader)], hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
+            commandHandler(session, (Command)chdr->cmd, &buf[sizeof(PacketHeader) + sizeof(CommandHeader)], hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
         }
         else {
-            sendError(ERROR_INVALID_PACKET);
+            session->sendError(ERROR_INVALID_PACKET);
         }
 
         // Start another async read
-        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
+        session->readNextPacket();
     }
 
-    void _testServerHandler(uint8_t* data, int count, void* ctx) {
-        // Compress data if needed and fill out header fields
-        if (compression) {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND_COMPRESSED;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + (uint32_t)ZSTD_compressCCtx(cctx, &bbuf[sizeof(PacketHeader)], SERVER_MAX_PACKET_SIZE-sizeof(PacketHeader), data, count, 1);
+    void _basebandHandler(dsp::complex_t* data, int count, void* ctx) {
+        // Hand the samples to every client that started streaming, none of them can block the source
+        std::lock_guard<std::mutex> lck(sessionsMtx);
+        for (auto& session : sessions) {
+            if (session->streaming && session->basebandEnabled) { session->pushBaseband(data, count); }
         }
-        else {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + count;
-            memcpy(&bbuf[sizeof(PacketHeader)], data, count);
+    }
+
+    void removeClosedSessions() {
+        // Close the rejected connections that are due
+        {
+            std::lock_guard<std::mutex> lck(rejectedMtx);
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = rejected.begin(); it != rejected.end();) {
+                if (now < it->second) { it++; continue; }
+                it->first->close();
+                it = rejected.erase(it);
+            }
+        }
+
+        std::vector<ClientSession*> closed;
+        {
+            std::lock_guard<std::mutex> cmdLck(cmdMtx);
+
+            // Take the closed sessions out of the list
+            {
+                std::lock_guard<std::mutex> lck(sessionsMtx);
+                for (auto it = sessions.begin(); it != sessions.end();) {
+                    if ((*it)->isOpen()) { it++; continue; }
+                    closed.push_back(*it);
+                    it = sessions.erase(it);
+                }
+            }
+
+            // Remove their streams and stop the source if nobody else was using it
+            for (auto& session : closed) {
+                session->removed = true;
+                session->removeStreams();
+                if (session->streaming) { setStreaming(session, false); }
+            }
+        }
+
+        // Destroy them once no command can be waiting on them
+        for (auto& session : closed) {
+            flog::info("Client disconnected, {0} buffers were dropped", session->getDroppedBuffers());
+            delete session;
         }
+    }
+
+    // Must be called with the command mutex held
+    void setStreaming(ClientSession* session, bool streaming) {
+        if (session->streaming == streaming) { return; }
+        session->streaming = streaming;
+        if (streaming && !streamingClients++) {
+            sigpath::sourceManager.start();
+            running = true;
+        }
+        else if (!streaming && !--streamingClients) {
+            sigpath::sourceManager.stop();
+            running = false;
+        }
+    }
 
-        // Write to network
-        if (client && client->isOpen()) { client->write(bb_pkt_hdr->size, bbuf); }
+    float* _acquireFFTBuffer(void* ctx) {
+        return NULL;
     }
 
+    void _releaseFFTBuffer(void* ctx) {}
+
     void setInput(dsp::stream<dsp::complex_t>* stream) {
-        comp.setInput(stream);
+        sigpath::iqFrontEnd.setInput(stream);
     }
 
-    void commandHandler(Command cmd, uint8_t* data, int len) {
+    void commandHandler(ClientSession* session, Command cmd, uint8_t* data, int len) {
+        std::lock_guard<std::mutex> lck(cmdMtx);
+        if (session->removed) { return; }
+
         if (cmd == COMMAND_GET_UI) {
-            sendUI(COMMAND_GET_UI, "", dummyElem);
+            sendUI(session, COMMAND_GET_UI, "", dummyElem);
         }
         else if (cmd == COMMAND_UI_ACTION && len >= 3) {
             // Check if sending back data is needed
@@ -259,48 +370,73 @@ namespace server {
             // Load id
             SmGui::DrawListElem diffId;
             int count = SmGui::DrawList::loadItem(diffId, &data[i], len);
-            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
-            if (diffId.type != SmGui::DRAW_LIST_ELEM_TYPE_STRING) { sendError(ERROR_INVALID_ARGUMENT); return; } 
+            if (count < 0) { session->sendError(ERROR_INVALID_ARGUMENT); return; }
+            if (diffId.type != SmGui::DRAW_LIST_ELEM_TYPE_STRING) { session->sendError(ERROR_INVALID_ARGUMENT); return; } 
             i += count;
             len -= count;
 
             // Load value
             SmGui::DrawListElem diffValue;
             count = SmGui::DrawList::loadItem(diffValue, &data[i], len);
-            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
+            if (count < 0) { session->sendError(ERROR_INVALID_ARGUMENT); return; }
             i += count;
             len -= count;
 
             // Render and send back
             if (sendback) {
-                sendUI(COMMAND_UI_ACTION, diffId.str, diffValue);
+                sendUI(session, COMMAND_UI_ACTION, diffId.str, diffValue);
             }
             else {
                 renderUI(NULL, diffId.str, diffValue);
             }
         }
         else if (cmd == COMMAND_START) {
-            sigpath::sourceManager.start();
-            running = true;
+            setStreaming(session, true);
         }
         else if (cmd == COMMAND_STOP) {
-            sigpath::sourceManager.stop();
-            running = false;
+            setStreaming(session, false);
         }
         else if (cmd == COMMAND_SET_FREQUENCY && len == 8) {
             sigpath::sourceManager.tune(*(double*)data);
-            sendCommandAck(COMMAND_SET_FREQUENCY, 0);
+            session->sendCommandAck(COMMAND_SET_FREQUENCY, 0);
         }
         else if (cmd == COMMAND_SET_SAMPLE_TYPE && len == 1) {
             dsp::compression::PCMType type = (dsp::compression::PCMType)*(uint8_t*)data;
-            comp.setPCMType(type);
+            if (type > dsp::compression::PCM_TYPE_BFP4) { session->sendError(ERROR_INVALID_ARGUMENT); return; }
+            session->setPCMType(type);
         }
-        else if (cmd == COMMAND_SET_COMPRESSION && len == 1) {
-            compression = *(uint8_t*)data;
+        else if (cmd == COMMAND_SET_COMPRESSION && (len == 1 || len == 2)) {
+            // The optional second byte is the zstd level, automatic if not given
+            CompressionMode mode = (CompressionMode)data[0];
+            if (mode > COMPRESSION_STREAM) { session->sendError(ERROR_INVALID_ARGUMENT); return; }
+            session->setCompression(mode, (len == 2) ? data[1] : 0);
+        }
+        else if (cmd == COMMAND_ADD_VFO && len == sizeof(VFOParams)) {
+            VFOParams params;
+            memcpy(&params, data, sizeof(VFOParams));
+            if (!session->setVFO(params)) { session->sendError(ERROR_INVALID_ARGUMENT); return; }
+            session->sendCommandAck(COMMAND_ADD_VFO, 0);
+        }
+        else if (cmd == COMMAND_REMOVE_VFO && len == sizeof(uint32_t)) {
+            uint32_t id;
+            memcpy(&id, data, sizeof(uint32_t));
+            if (!session->removeVFO(id)) { session->sendError(ERROR_INVALID_ARGUMENT); return; }
+            session->sendCommandAck(COMMAND_REMOVE_VFO, 0);
+        }
+        else if (cmd == COMMAND_SET_FFT && len == sizeof(FFTParams)) {
+            FFTParams params;
+            memcpy(&params, data, sizeof(FFTParams));
+            if (!session->setFFT(params.size, params.rate)) { session->sendError(ERROR_INVALID_ARGUMENT); return; }
+            session->sendCommandAck(COMMAND_SET_FFT, 0);
+        }
+        else if (cmd == COMMAND_SET_BASEBAND && len == 1) {
+            // Clients that only use VFOs or the FFT can stop the full baseband
+            session->basebandEnabled = data[0];
+            session->sendCommandAck(COMMAND_SET_BASEBAND, 0);
         }
         else {
             flog::error("Invalid Command: {0} (len = {1})", (int)cmd, len);
-            sendError(ERROR_INVALID_COMMAND);
+            session->sendError(ERROR_INVALID_COMMAND);
         }
     }
 
@@ -339,49 +475,27 @@ namespace server {
         }
     }
 
-    void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue) {
+    void sendUI(ClientSession* session, Command originCmd, std::string diffId, SmGui::DrawListElem diffValue) {
         // Render UI
         SmGui::DrawList dl;
         renderUI(&dl, diffId, diffValue);
 
         // Create response
         int size = dl.getSize();
-        dl.store(s_cmd_data, size);
+        dl.store(session->s_cmd_data, size);
 
         // Send to network
-        sendCommandAck(originCmd, size);
-    }
-
-    void sendError(Error err) {
-        PacketHeader* hdr = (PacketHeader*)sbuf;
-        s_pkt_data[0] = err;
-        sendPacket(PACKET_TYPE_ERROR, 1);
-    }
-
-    void sendSampleRate(double sampleRate) {
-        *(double*)s_cmd_data = sampleRate;
-        sendCommand(COMMAND_SET_SAMPLERATE, sizeof(double));
+        session->sendCommandAck(originCmd, size);
     }
 
     void setInputSampleRate(double samplerate) {
         sampleRate = samplerate;
-        if (!client || !client->isOpen()) { return; }
-        sendSampleRate(sampleRate);
-    }
+        sigpath::iqFrontEnd.setSampleRate(sampleRate);
 
-    void sendPacket(PacketType type, int len) {
-        s_pkt_hdr->type = type;
-        s_pkt_hdr->size = sizeof(PacketHeader) + len;
-        client->write(s_pkt_hdr->size, sbuf);
-    }
-
-    void sendCommand(Command cmd, int len) {
-        s_cmd_hdr->cmd = cmd;
-        sendPacket(PACKET_TYPE_COMMAND, sizeof(CommandHeader) + len);
-    }
-
-    void sendCommandAck(Command cmd, int len) {
-        s_cmd_hdr->cmd = cmd;
-        sendPacket(PACKET_TYPE_COMMAND_ACK, sizeof(CommandHeader) + len);
+        // Sent by each client's own thread so that a stalled client doesn't block the caller
+        std::lock_guard<std::mutex> lck(sessionsMtx);
+        for (auto& session : sessions) {
+            session->setInputSampleRate(sampleRate);
+        }
     }
 }
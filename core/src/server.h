@@ -3,6 +3,7 @@
 #include <dsp/stream.h>
 #include <dsp/types.h>
 #include <server_protocol.h>
+#include "server_session.h"
 
 namespace server {
     void setInput(dsp::stream<dsp::complex_t>* stream);
@@ -10,18 +11,18 @@ namespace server {
 
     void _clientHandler(net::Conn conn, void* ctx);
     void _packetHandler(int count, uint8_t* buf, void* ctx);
-    void _testServerHandler(uint8_t* data, int count, void* ctx);
+    void _packetBodyHandler(int count, uint8_t* buf, void* ctx);
+    void _basebandHandler(dsp::complex_t* data, int count, void* ctx);
+    float* _acquireFFTBuffer(void* ctx);
+    void _releaseFFTBuffer(void* ctx);
+
+    void removeClosedSessions();
+    void setStreaming(ClientSession* session, bool streaming);
 
     void drawMenu();
 
-    void commandHandler(Command cmd, uint8_t* data, int len);
+    void commandHandler(ClientSession* session, Command cmd, uint8_t* data, int len);
     void renderUI(SmGui::DrawList* dl, std::string diffId, SmGui::DrawListElem diffValue);
-    void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
-    void sendError(Error err);
-    void sendSampleRate(double sampleRate);
+    void sendUI(ClientSession* session, Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
     void setInputSampleRate(double samplerate);
-
-    void sendPacket(PacketType type, int len);
-    void sendCommand(Command cmd, int len);
-    void sendCommandAck(Command cmd, int len);
 }
@@ -0,0 +1,127 @@
+#include "server_compressor.h"
+#include <algorithm>
+#include <chrono>
+#include <utils/flog.h>
+
+namespace server {
+    BasebandCompressor::BasebandCompressor() {
+        bufferCtx = ZSTD_createCCtx();
+        streamCtx = ZSTD_createCCtx();
+    }
+
+    BasebandCompressor::~BasebandCompressor() {
+        ZSTD_freeCCtx(bufferCtx);
+        ZSTD_freeCCtx(streamCtx);
+    }
+
+    void BasebandCompressor::setMode(CompressionMode mode, int level) {
+        std::lock_guard<std::mutex> lck(paramMtx);
+        newMode = mode;
+        newLevel = level;
+        changed = true;
+    }
+
+    int BasebandCompressor::compress(const void* in, int count, void* out, int maxSize) {
+        applyMode();
+        auto start = std::chrono::steady_clock::now();
+
+        size_t len;
+        if (mode == COMPRESSION_STREAM) {
+            // The level can only change between zstd frames, so end the current one first
+            bool changeLevel = (level != streamLevel);
+            ZSTD_inBuffer input = { in, (size_t)count, 0 };
+            ZSTD_outBuffer output = { out, (size_t)maxSize, 0 };
+            size_t remaining;
+            do {
+                remaining = ZSTD_compressStream2(streamCtx, &output, &input, changeLevel ? ZSTD_e_end : ZSTD_e_flush);
+                if (ZSTD_isError(remaining)) {
+                    flog::error("Baseband compression failed: {0}", ZSTD_getErrorName(remaining));
+                    resetStream();
+                    return -1;
+                }
+                if (remaining && output.pos == output.size) {
+                    flog::error("Baseband compression output buffer too small");
+                    resetStream();
+                    return -1;
+                }
+            } while (remaining);
+            if (changeLevel) {
+                ZSTD_CCtx_setParameter(streamCtx, ZSTD_c_compressionLevel, level);
+                streamLevel = level;
+            }
+            len = output.pos;
+        }
+        else {
+            len = ZSTD_compressCCtx(bufferCtx, out, maxSize, in, count, level);
+            if (ZSTD_isError(len)) {
+                flog::error("Baseband compression failed: {0}", ZSTD_getErrorName(len));
+                return -1;
+            }
+        }
+
+        lastCompressTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return len;
+    }
+
+    void BasebandCompressor::report(double sendTime, double duration) {
+        if (!autoLevel || mode == COMPRESSION_NONE || duration <= 0.0) { return; }
+
+        // Smooth the share of real time spent on each side
+        cpuLoad += 0.1 * ((lastCompressTime / duration) - cpuLoad);
+        linkLoad += 0.1 * ((sendTime / duration) - linkLoad);
+        if (++sinceTune < SERVER_COMPRESSOR_TUNE_INTERVAL) { return; }
+        sinceTune = 0;
+
+        // Compress harder when the link is the bottleneck and the CPU has headroom, back off when compressing
+        // can't keep up or when the link doesn't need it
+        int oldLevel = level;
+        if (cpuLoad > 0.6) {
+            level--;
+        }
+        else if (linkLoad > 0.6 && cpuLoad < 0.3) {
+            level++;
+        }
+        else if (linkLoad < 0.2 && cpuLoad > 0.3) {
+            level--;
+        }
+        level = std::clamp<int>(level, SERVER_COMPRESSOR_MIN_AUTO_LEVEL, SERVER_COMPRESSOR_MAX_AUTO_LEVEL);
+        if (level != oldLevel) {
+            flog::debug("Baseband compression level: {0} (cpu: {1}, link: {2})", level, cpuLoad, linkLoad);
+        }
+    }
+
+    CompressionMode BasebandCompressor::getMode() {
+        applyMode();
+        return mode;
+    }
+
+    int BasebandCompressor::getLevel() {
+        return level;
+    }
+
+    void BasebandCompressor::applyMode() {
+        std::lock_guard<std::mutex> lck(paramMtx);
+        if (!changed) { return; }
+        changed = false;
+
+        // Start from the lowest level when tuning it
+        autoLevel = (newLevel <= 0);
+        level = autoLevel ? SERVER_COMPRESSOR_MIN_AUTO_LEVEL : std::clamp<int>(newLevel, 1, ZSTD_maxCLevel());
+        cpuLoad = 0.0;
+        linkLoad = 0.0;
+        sinceTune = 0;
+
+        // The client starts decompressing a new stream whenever it changes the mode
+        mode = newMode;
+        if (mode == COMPRESSION_STREAM) { resetStream(); }
+    }
+
+    void BasebandCompressor::resetStream() {
+        ZSTD_CCtx_reset(streamCtx, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(streamCtx, ZSTD_c_compressionLevel, level);
+        streamLevel = level;
+
+        // Fails if zstd was built without threading, it then just compresses on the calling thread
+        ZSTD_CCtx_setParameter(streamCtx, ZSTD_c_nbWorkers, SERVER_COMPRESSOR_WORKERS);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+#include <server_protocol.h>
+#include <mutex>
+#include <zstd.h>
+
+// Range of levels used when the level is tuned automatically, higher ones are too slow for IQ data
+#define SERVER_COMPRESSOR_MIN_AUTO_LEVEL    1
+#define SERVER_COMPRESSOR_MAX_AUTO_LEVEL    9
+
+// Number of buffers between two changes of the automatic level
+#define SERVER_COMPRESSOR_TUNE_INTERVAL     16
+
+// Number of zstd worker threads used in stream mode
+#define SERVER_COMPRESSOR_WORKERS           2
+
+namespace server {
+    // zstd compression of the baseband sent to a client. In stream mode a single zstd stream is kept for the whole
+    // connection and flushed after each buffer, so that buffers reference the data before them, and zstd's worker
+    // threads are used. An automatic level is tuned from the share of the real time of each buffer that was spent
+    // compressing it and waiting for the link to take it: a busy link raises the level, a busy CPU lowers it.
+    class BasebandCompressor {
+    public:
+        BasebandCompressor();
+        ~BasebandCompressor();
+
+        // Can be called from any thread, the change applies to the next buffer. A level of 0 is automatic.
+        void setMode(CompressionMode mode, int level);
+
+        // Returns the compressed size or -1 on error, in which case the stream starts over
+        int compress(const void* in, int count, void* out, int maxSize);
+
+        // Give the time the last compressed buffer waited for room in the send queue and the duration of its samples
+        void report(double sendTime, double duration);
+
+        CompressionMode getMode();
+        int getLevel();
+
+    private:
+        void applyMode();
+        void resetStream();
+
+        // Requested settings
+        std::mutex paramMtx;
+        bool changed = false;
+        CompressionMode newMode = COMPRESSION_NONE;
+        int newLevel = 0;
+
+        // Current settings, only used by the sending thread
+        CompressionMode mode = COMPRESSION_NONE;
+        bool autoLevel = true;
+        int level = SERVER_COMPRESSOR_MIN_AUTO_LEVEL;
+        int streamLevel = SERVER_COMPRESSOR_MIN_AUTO_LEVEL;
+
+        // Tuning
+        double lastCompressTime = 0.0;
+        double cpuLoad = 0.0;
+        double linkLoad = 0.0;
+        int sinceTune = 0;
+
+        ZSTD_CCtx* bufferCtx;
+        ZSTD_CCtx* streamCtx;
+    };
+}
\ No newline at end of file
@@ -12,8 +12,8 @@ namespace server {
         PACKET_TYPE_COMMAND_ACK,
         PACKET_TYPE_BASEBAND,
         PACKET_TYPE_BASEBAND_COMPRESSED,
-        PACKET_TYPE_VFO,
-        PACKET_TYPE_FFT,
+        PACKET_TYPE_VFO,    // VFOHeader followed by the samples
+        PACKET_TYPE_FFT,    // Power spectrum in dB with DC in the middle
         PACKET_TYPE_ERROR
     };
 
@@ -27,12 +27,23 @@ namespace server {
         COMMAND_GET_SAMPLERATE,
         COMMAND_SET_SAMPLE_TYPE,
         COMMAND_SET_COMPRESSION,
+        COMMAND_ADD_VFO,
+        COMMAND_REMOVE_VFO,
+        COMMAND_SET_FFT,
+        COMMAND_SET_BASEBAND,
 
         // Server to client
         COMMAND_SET_SAMPLERATE = 0x80,
         COMMAND_DISCONNECT
     };
 
+    // Argument of COMMAND_SET_COMPRESSION, optionally followed by the zstd level (0 to tune it automatically)
+    enum CompressionMode {
+        COMPRESSION_NONE,
+        COMPRESSION_BUFFER, // Each buffer is compressed on its own
+        COMPRESSION_STREAM  // One zstd stream for the connection, each buffer needs the previous ones to be decompressed
+    };
+
     enum Error {
         ERROR_NONE = 0x00,
         ERROR_INVALID_PACKET,
@@ -49,5 +60,25 @@ namespace server {
     struct CommandHeader {
         uint32_t cmd;
     };
+
+    // Argument of COMMAND_ADD_VFO, also used to change the parameters of an existing VFO
+    struct VFOParams {
+        uint32_t id;
+        double sampleRate;
+        double bandwidth;
+        double offset;
+    };
+
+    // Argument of COMMAND_SET_FFT, a size of 0 disables the FFT
+    struct FFTParams {
+        uint32_t size;
+        double rate;
+    };
+
+    // Start of a PACKET_TYPE_VFO packet, followed by the samples encoded like the baseband
+    struct VFOHeader {
+        uint32_t id;
+        uint32_t compressed;
+    };
 #pragma pack(pop)
 }
\ No newline at end of file
@@ -0,0 +1,415 @@
+#include "server_session.h"
+#include <dsp/compression/sample_stream_compressor.h>
+#include <dsp/window/nuttall.h>
+#include <chrono>
+#include <signal_path/signal_path.h>
+
+namespace server {
+    ClientSession::ClientSession(net::Conn conn) {
+        this->conn = std::move(conn);
+
+        // Allocate buffers
+        rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        sbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        pcmBuf = new uint8_t[STREAM_BUFFER_SIZE * sizeof(dsp::complex_t) + 8];
+
+        // Initialize headers
+        s_pkt_hdr = (PacketHeader*)sbuf;
+        s_pkt_data = &sbuf[sizeof(PacketHeader)];
+        s_cmd_hdr = (CommandHeader*)s_pkt_data;
+        s_cmd_data = &sbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
+
+        // Initialize the VFO compressor, the baseband has its own
+        vfoCtx = ZSTD_createCCtx();
+
+        // Give the streams of this client unique names on the IQ frontend
+        static std::atomic<int> sessionCount = 0;
+        namePrefix = "server_session_" + std::to_string(sessionCount++) + "_";
+
+        workerThread = std::thread(&ClientSession::worker, this);
+    }
+
+    ClientSession::~ClientSession() {
+        close();
+        removeStreams();
+
+        // Stop the sending thread
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            stopWorker = true;
+        }
+        queueCnd.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
+
+        for (auto& frame : queue) { delete frame; }
+        for (auto& frame : replies) { delete frame; }
+        for (auto& frame : freeFrames) { delete frame; }
+
+        ZSTD_freeCCtx(vfoCtx);
+        delete[] rbuf;
+        delete[] sbuf;
+        delete[] pcmBuf;
+    }
+
+    void ClientSession::start(void (*packetHandler)(int count, uint8_t* buf, void* ctx)) {
+        _packetHandler = packetHandler;
+        readNextPacket();
+    }
+
+    void ClientSession::readNextPacket() {
+        conn->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, this);
+    }
+
+    void ClientSession::close() {
+        conn->close();
+    }
+
+    bool ClientSession::isOpen() {
+        return !removalRequested && conn->isOpen();
+    }
+
+    void ClientSession::markForRemoval() {
+        removalRequested = true;
+    }
+
+    void ClientSession::pushBaseband(const dsp::complex_t* data, int count) {
+        pushFrame(FRAME_BASEBAND, 0, data, count * sizeof(dsp::complex_t));
+    }
+
+    void ClientSession::notifySampleRate(double sampleRate) {
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            pendingSampleRate = sampleRate;
+            sampleRatePending = true;
+        }
+        queueCnd.notify_all();
+    }
+
+    void ClientSession::setPCMType(dsp::compression::PCMType type) {
+        pcmType = type;
+    }
+
+    void ClientSession::setCompression(CompressionMode mode, int level) {
+        compressor.setMode(mode, level);
+    }
+
+    bool ClientSession::setVFO(const VFOParams& params) {
+        // Check that the VFO fits in the baseband
+        double sr = sigpath::iqFrontEnd.getEffectiveSamplerate();
+        if (params.sampleRate <= 0.0 || params.sampleRate > sr) { return false; }
+        if (params.bandwidth <= 0.0 || params.bandwidth > params.sampleRate) { return false; }
+        if (fabs(params.offset) > sr / 2.0) { return false; }
+
+        // Update the VFO if it already exists
+        auto it = vfos.find(params.id);
+        if (it != vfos.end()) {
+            it->second->vfo->setOutSamplerate(params.sampleRate, params.bandwidth);
+            it->second->vfo->setOffset(params.offset);
+            return true;
+        }
+        if (vfos.size() >= SERVER_SESSION_MAX_VFOS) { return false; }
+
+        // Create the VFO on the frontend and forward its output to the client
+        SessionVFO* svfo = new SessionVFO;
+        svfo->session = this;
+        svfo->id = params.id;
+        svfo->name = namePrefix + std::to_string(params.id);
+        svfo->vfo = sigpath::iqFrontEnd.addVFO(svfo->name, params.sampleRate, params.bandwidth, params.offset);
+        if (!svfo->vfo) {
+            delete svfo;
+            return false;
+        }
+        svfo->sink.init(&svfo->vfo->out, vfoHandler, svfo);
+        svfo->sink.start();
+        vfos[params.id] = svfo;
+        return true;
+    }
+
+    bool ClientSession::removeVFO(uint32_t id) {
+        auto it = vfos.find(id);
+        if (it == vfos.end()) { return false; }
+        SessionVFO* svfo = it->second;
+        svfo->sink.stop();
+        sigpath::iqFrontEnd.removeVFO(svfo->name);
+        vfos.erase(it);
+        delete svfo;
+        return true;
+    }
+
+    bool ClientSession::setFFT(int size, double rate) {
+        if (size && (size < 64 || size > 65536 || rate <= 0.0 || rate > 200.0)) { return false; }
+        std::lock_guard<std::mutex> lck(streamMtx);
+
+        // Remove the previous FFT
+        if (spectrum) {
+            spectrum->stop();
+            sigpath::iqFrontEnd.unbindIQStream(&fftIn);
+            delete spectrum;
+            spectrum = NULL;
+        }
+        if (!size) { return true; }
+
+        // Nuttall window, the sign is flipped every other sample to center the spectrum
+        float* window = dsp::buffer::alloc<float>(size);
+        for (int i = 0; i < size; i++) { window[i] = dsp::window::nuttall(i, size) * ((i % 2) ? -1.0f : 1.0f); }
+
+        // Compute it from the frontend's output, a single thread per client is enough at these rates
+        fftBuf.resize(size);
+        spectrum = new dsp::sink::Spectrum(&fftIn, inputSampleRate, size, rate, window, acquireFFTBuffer, releaseFFTBuffer, this, 1);
+        dsp::buffer::free(window);
+        sigpath::iqFrontEnd.bindIQStream(&fftIn);
+        spectrum->start();
+        return true;
+    }
+
+    void ClientSession::setInputSampleRate(double sampleRate) {
+        {
+            std::lock_guard<std::mutex> lck(streamMtx);
+            inputSampleRate = sampleRate;
+            if (spectrum) { spectrum->setSamplerate(sampleRate); }
+        }
+        notifySampleRate(sampleRate);
+    }
+
+    void ClientSession::removeStreams() {
+        while (!vfos.empty()) { removeVFO(vfos.begin()->first); }
+        setFFT(0, 0.0);
+    }
+
+    uint64_t ClientSession::getDroppedBuffers() {
+        std::lock_guard<std::mutex> lck(queueMtx);
+        return dropped;
+    }
+
+    void ClientSession::sendPacket(PacketType type, int len) {
+        s_pkt_hdr->type = type;
+        s_pkt_hdr->size = sizeof(PacketHeader) + len;
+
+        // Hand a copy to the worker
+        Frame* frame;
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            frame = takeFrame();
+        }
+        frame->type = FRAME_PACKET;
+        frame->id = 0;
+        frame->size = s_pkt_hdr->size;
+        if ((int)frame->data.size() < frame->size) { frame->data.resize(frame->size); }
+        memcpy(frame->data.data(), sbuf, frame->size);
+
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            replies.push_back(frame);
+            replyBytes += frame->size;
+            if (replyBytes > SERVER_SESSION_QUEUE_SIZE) { markForRemoval(); }
+        }
+        queueCnd.notify_all();
+    }
+
+    void ClientSession::sendCommand(Command cmd, int len) {
+        s_cmd_hdr->cmd = cmd;
+        sendPacket(PACKET_TYPE_COMMAND, sizeof(CommandHeader) + len);
+    }
+
+    void ClientSession::sendCommandAck(Command cmd, int len) {
+        s_cmd_hdr->cmd = cmd;
+        sendPacket(PACKET_TYPE_COMMAND_ACK, sizeof(CommandHeader) + len);
+    }
+
+    void ClientSession::sendError(Error err) {
+        s_pkt_data[0] = err;
+        sendPacket(PACKET_TYPE_ERROR, 1);
+    }
+
+    void ClientSession::pushFrame(FrameType type, uint32_t id, const void* data, int size) {
+        // Several DSP threads can push at once, they take turns so that buffers are queued in the order they were counted
+        std::lock_guard<std::mutex> pushLck(pushMtx);
+
+        // Drop the data if the client is too slow, a buffer is always accepted into an empty queue
+        Frame* frame;
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            if (queuedBytes && queuedBytes + size > SERVER_SESSION_QUEUE_SIZE) {
+                dropped++;
+                return;
+            }
+            queuedBytes += size;
+            frame = takeFrame();
+        }
+
+        // The worker doesn't see that buffer until it's queued
+        frame->type = type;
+        frame->id = id;
+        frame->size = size;
+        if ((int)frame->data.size() < size) { frame->data.resize(size); }
+        memcpy(frame->data.data(), data, size);
+
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            queue.push_back(frame);
+        }
+        queueCnd.notify_all();
+    }
+
+    ClientSession::Frame* ClientSession::takeFrame() {
+        // Must be called with the queue mutex held, buffers are reused to avoid reallocating their data
+        if (freeFrames.empty()) { return new Frame; }
+        Frame* frame = freeFrames.back();
+        freeFrames.pop_back();
+        return frame;
+    }
+
+    void ClientSession::worker() {
+        while (true) {
+            // Wait for something to send, replies go first
+            Frame* frame = NULL;
+            bool sendRate;
+            double rate;
+            {
+                std::unique_lock<std::mutex> lck(queueMtx);
+                queueCnd.wait(lck, [this]() { return !replies.empty() || !queue.empty() || sampleRatePending || stopWorker; });
+                if (stopWorker) { return; }
+                sendRate = sampleRatePending;
+                rate = pendingSampleRate;
+                sampleRatePending = false;
+                if (!replies.empty()) {
+                    frame = replies.front();
+                    replies.pop_front();
+                }
+                else if (!queue.empty()) {
+                    frame = queue.front();
+                    queue.pop_front();
+                }
+            }
+
+            // The samplerate is sent before the samples that follow the change
+            if (sendRate) {
+                sendSampleRate(rate);
+                basebandSampleRate = rate;
+            }
+            if (!frame) { continue; }
+
+            // Hand the oldest buffer to the connection and release it, it counts against the queue size until then
+            if (frame->type == FRAME_PACKET) {
+                if (isOpen()) { conn->writeAsync(frame->size, frame->data.data()); }
+            }
+            else if (frame->type == FRAME_FFT) {
+                sendFFT(*frame);
+            }
+            else {
+                sendSamples(*frame);
+            }
+            std::lock_guard<std::mutex> lck(queueMtx);
+            if (frame->type == FRAME_PACKET) {
+                replyBytes -= frame->size;
+            }
+            else {
+                queuedBytes -= frame->size;
+            }
+            freeFrames.push_back(frame);
+        }
+    }
+
+    void ClientSession::sendSamples(const Frame& frame) {
+        const dsp::complex_t* data = (const dsp::complex_t*)frame.data.data();
+        int count = frame.size / sizeof(dsp::complex_t);
+        bool compress = (compressor.getMode() != COMPRESSION_NONE);
+        dsp::compression::PCMType type = pcmType;
+
+        // Encode straight into a buffer of the connection's write pool, sized for the worst case. All of them being
+        // queued means the link is behind, so the time spent waiting for one tells how busy it is.
+        int hdrSize = sizeof(PacketHeader) + ((frame.type == FRAME_VFO) ? sizeof(VFOHeader) : 0);
+        int maxSize = 8 + frame.size;
+        if (compress) { maxSize = ZSTD_compressBound(maxSize); }
+        auto start = std::chrono::steady_clock::now();
+        net::ConnWriteBuffer* wbuf = conn->acquireWriteBuffer(hdrSize + maxSize);
+        if (!wbuf) { return; }
+        double sendTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        PacketHeader* hdr = (PacketHeader*)wbuf->buf;
+        uint8_t* pktData = &wbuf->buf[sizeof(PacketHeader)];
+
+        // VFO samples are prefixed with the ID of their VFO
+        if (frame.type == FRAME_VFO) {
+            VFOHeader* vhdr = (VFOHeader*)pktData;
+            vhdr->id = frame.id;
+            vhdr->compressed = compress;
+            pktData += sizeof(VFOHeader);
+        }
+
+        // Encode the samples and compress them if needed. VFO buffers are always compressed on their own
+        // so that the baseband stream doesn't depend on them.
+        int len;
+        if (compress) {
+            int pcmCount = dsp::compression::SampleStreamCompressor::process(count, type, data, pcmBuf);
+            if (frame.type == FRAME_VFO) {
+                size_t ret = ZSTD_compressCCtx(vfoCtx, pktData, maxSize, pcmBuf, pcmCount, compressor.getLevel());
+                len = ZSTD_isError(ret) ? -1 : ret;
+            }
+            else {
+                len = compressor.compress(pcmBuf, pcmCount, pktData, maxSize);
+            }
+            if (len < 0) {
+                conn->releaseWriteBuffer(wbuf);
+                return;
+            }
+        }
+        else {
+            len = dsp::compression::SampleStreamCompressor::process(count, type, data, pktData);
+        }
+
+        // Fill out the header
+        if (frame.type == FRAME_VFO) {
+            hdr->type = PACKET_TYPE_VFO;
+        }
+        else {
+            hdr->type = compress ? PACKET_TYPE_BASEBAND_COMPRESSED : PACKET_TYPE_BASEBAND;
+        }
+        hdr->size = hdrSize + len;
+
+        // Have the reactor send it
+        wbuf->count = hdr->size;
+        conn->writeAsync(wbuf);
+        if (compress && frame.type == FRAME_BASEBAND) {
+            compressor.report(sendTime, (double)count / basebandSampleRate);
+        }
+    }
+
+    void ClientSession::sendFFT(const Frame& frame) {
+        // Spectra are small, they're sent as is
+        net::ConnWriteBuffer* wbuf = conn->acquireWriteBuffer(sizeof(PacketHeader) + frame.size);
+        if (!wbuf) { return; }
+        PacketHeader* hdr = (PacketHeader*)wbuf->buf;
+        hdr->type = PACKET_TYPE_FFT;
+        hdr->size = sizeof(PacketHeader) + frame.size;
+        memcpy(&wbuf->buf[sizeof(PacketHeader)], frame.data.data(), frame.size);
+        wbuf->count = hdr->size;
+        conn->writeAsync(wbuf);
+    }
+
+    void ClientSession::sendSampleRate(double sampleRate) {
+        // Uses its own buffer since the packet thread may be using the send buffer
+        uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader) + sizeof(double)];
+        PacketHeader* hdr = (PacketHeader*)buf;
+        CommandHeader* cmdHdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+        hdr->type = PACKET_TYPE_COMMAND;
+        hdr->size = sizeof(buf);
+        cmdHdr->cmd = COMMAND_SET_SAMPLERATE;
+        memcpy(&buf[sizeof(PacketHeader) + sizeof(CommandHeader)], &sampleRate, sizeof(double));
+        if (isOpen()) { conn->writeAsync(hdr->size, buf); }
+    }
+
+    void ClientSession::vfoHandler(dsp::complex_t* data, int count, void* ctx) {
+        SessionVFO* svfo = (SessionVFO*)ctx;
+        svfo->session->pushFrame(FRAME_VFO, svfo->id, data, count * sizeof(dsp::complex_t));
+    }
+
+    float* ClientSession::acquireFFTBuffer(void* ctx) {
+        ClientSession* _this = (ClientSession*)ctx;
+        return _this->fftBuf.data();
+    }
+
+    void ClientSession::releaseFFTBuffer(void* ctx) {
+        ClientSession* _this = (ClientSession*)ctx;
+        _this->pushFrame(FRAME_FFT, 0, _this->fftBuf.data(), _this->fftBuf.size() * sizeof(float));
+    }
+}
\ No newline at end of file
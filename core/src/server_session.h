@@ -0,0 +1,159 @@
+#pragma once
+#include <utils/networking.h>
+#include <dsp/stream.h>
+#include <dsp/types.h>
+#include <dsp/compression/pcm_type.h>
+#include <dsp/channel/rx_vfo.h>
+#include <dsp/sink/handler_sink.h>
+#include <dsp/sink/spectrum.h>
+#include <server_protocol.h>
+#include "server_compressor.h"
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <deque>
+#include <map>
+#include <zstd.h>
+
+// Number of bytes of samples and FFTs a client can have waiting to be sent before new ones are dropped
+#define SERVER_SESSION_QUEUE_SIZE   (16 * 1024 * 1024)
+
+// Max number of VFOs a single client can open on the server
+#define SERVER_SESSION_MAX_VFOS     8
+
+namespace server {
+    class ClientSession;
+
+    // VFO instantiated on the server's IQ frontend for a client
+    struct SessionVFO {
+        ClientSession* session;
+        uint32_t id;
+        std::string name;
+        dsp::channel::RxVFO* vfo;
+        dsp::sink::Handler<dsp::complex_t> sink;
+    };
+
+    // State of a connected client. The baseband, the client's VFOs and its FFT are pushed by the DSP threads, encoded by
+    // the session's own thread in the PCM type and compression the client asked for, then queued on the connection
+    // for the network threads to send. A client that can't keep up has its buffers dropped instead of stalling the
+    // source or the other clients. Replies to commands go through the same thread, so handling a command never
+    // waits on the network.
+    class ClientSession {
+    public:
+        ClientSession(net::Conn conn);
+        ~ClientSession();
+
+        // Start reading packets, the handler is called with the session as context
+        void start(void (*packetHandler)(int count, uint8_t* buf, void* ctx));
+        void readNextPacket();
+
+        void close();
+        bool isOpen();
+
+        // Have the session closed by the server, can be called from the packet handler unlike close()
+        void markForRemoval();
+
+        // Called from the source thread, never waits on the network
+        void pushBaseband(const dsp::complex_t* data, int count);
+        void notifySampleRate(double sampleRate);
+
+        void setPCMType(dsp::compression::PCMType type);
+        void setCompression(CompressionMode mode, int level = 0);
+
+        // Streams computed on the server, must be called with the server's command mutex held.
+        // setInputSampleRate() can also be called from the source.
+        bool setVFO(const VFOParams& params);
+        bool removeVFO(uint32_t id);
+        bool setFFT(int size, double rate);
+        void setInputSampleRate(double sampleRate);
+        void removeStreams();
+
+        uint64_t getDroppedBuffers();
+
+        // Only used by the thread handling the packets of this client, the packet is copied and queued
+        void sendPacket(PacketType type, int len);
+        void sendCommand(Command cmd, int len);
+        void sendCommandAck(Command cmd, int len);
+        void sendError(Error err);
+
+        net::Conn conn;
+
+        uint8_t* rbuf = NULL;
+        uint8_t* sbuf = NULL;
+
+        uint8_t* s_pkt_data = NULL;
+        uint8_t* s_cmd_data = NULL;
+
+        // Changed with the server's command mutex held, also read by the source thread
+        std::atomic<bool> streaming = false;
+        std::atomic<bool> basebandEnabled = true;
+        bool removed = false;
+
+    private:
+        enum FrameType {
+            FRAME_BASEBAND,
+            FRAME_VFO,
+            FRAME_FFT,
+            FRAME_PACKET
+        };
+
+        struct Frame {
+            FrameType type;
+            uint32_t id;
+            int size;
+            std::vector<uint8_t> data;
+        };
+
+        void pushFrame(FrameType type, uint32_t id, const void* data, int size);
+        Frame* takeFrame();
+        void worker();
+        void sendSamples(const Frame& frame);
+        void sendFFT(const Frame& frame);
+        void sendSampleRate(double sampleRate);
+
+        static void vfoHandler(dsp::complex_t* data, int count, void* ctx);
+        static float* acquireFFTBuffer(void* ctx);
+        static void releaseFFTBuffer(void* ctx);
+
+        void (*_packetHandler)(int count, uint8_t* buf, void* ctx) = NULL;
+        std::atomic<bool> removalRequested = false;
+
+        PacketHeader* s_pkt_hdr = NULL;
+        CommandHeader* s_cmd_hdr = NULL;
+
+        // Outgoing queues, the samples are written by the DSP threads and the replies by the packet thread. Replies
+        // are never dropped and go first, a client letting them pile up isn't reading anything and gets removed.
+        std::deque<Frame*> queue;
+        std::deque<Frame*> replies;
+        std::vector<Frame*> freeFrames;
+        int64_t queuedBytes = 0;
+        int64_t replyBytes = 0;
+        uint64_t dropped = 0;
+        bool sampleRatePending = false;
+        double pendingSampleRate = 0.0;
+        bool stopWorker = false;
+        std::mutex queueMtx;
+        std::mutex pushMtx;
+        std::condition_variable queueCnd;
+        std::thread workerThread;
+
+        // Server side streams
+        std::string namePrefix;
+        std::map<uint32_t, SessionVFO*> vfos;
+        dsp::stream<dsp::complex_t> fftIn;
+        dsp::sink::Spectrum* spectrum = NULL;
+        std::vector<float> fftBuf;
+        double inputSampleRate = 1000000.0;
+        std::mutex streamMtx;
+
+        // Encoding, the PCM type is set by the packet thread and read once per buffer by the worker
+        std::atomic<dsp::compression::PCMType> pcmType = dsp::compression::PCM_TYPE_I16;
+        BasebandCompressor compressor;
+        double basebandSampleRate = 1000000.0;
+        uint8_t* pcmBuf = NULL;
+        ZSTD_CCtx* vfoCtx = NULL;
+    };
+}
\ No newline at end of file
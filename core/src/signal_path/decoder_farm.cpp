@@ -0,0 +1,390 @@
+#include <signal_path/decoder_farm.h>
+#include <signal_path/signal_path.h>
+#include <dsp/buffer/buffer.h>
+#include <utils/flog.h>
+#include <utils/net.h>
+#include <chrono>
+#include <math.h>
+
+struct DecoderFarm::NetOutput {
+    // Accepted sockets are non-blocking, what a client didn't take yet is kept in its backlog
+    struct Client {
+        std::shared_ptr<net::Socket> sock;
+        std::string backlog;
+    };
+
+    std::shared_ptr<net::Listener> listener;
+    std::vector<Client> clients;
+    std::mutex clientsMtx;
+};
+
+DecoderFarm::DecoderFarm() {}
+
+DecoderFarm::~DecoderFarm() {
+    stop();
+}
+
+void DecoderFarm::registerDecoder(std::string name, DecoderProvider provider) {
+    std::lock_guard<std::mutex> lck(providerMtx);
+    if (providers.find(name) != providers.end()) {
+        flog::error("[DecoderFarm] Tried to register new decoder with existing name: {0}", name);
+        return;
+    }
+    providers[name] = provider;
+}
+
+void DecoderFarm::unregisterDecoder(std::string name) {
+    std::lock_guard<std::mutex> lck(providerMtx);
+    if (providers.find(name) == providers.end()) {
+        flog::error("[DecoderFarm] Tried to unregister non existent decoder: {0}", name);
+        return;
+    }
+    providers.erase(name);
+}
+
+std::vector<std::string> DecoderFarm::getDecoderNames() {
+    std::lock_guard<std::mutex> lck(providerMtx);
+    std::vector<std::string> names;
+    for (auto const& [name, prov] : providers) { names.push_back(name); }
+    return names;
+}
+
+bool DecoderFarm::start(const json& config) {
+    std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+    if (running) { return true; }
+
+    // Open the outputs
+    json output = config.contains("output") ? config["output"] : json::object();
+    std::string path = output.value("file", std::string(""));
+    int port = output.value("port", 0);
+    if (path.empty() && port <= 0) {
+        flog::error("[DecoderFarm] No output file or port configured");
+        return false;
+    }
+    if (!path.empty()) {
+        outFile = fopen(path.c_str(), "a");
+        if (!outFile) {
+            flog::error("[DecoderFarm] Could not open '{0}'", path);
+            return false;
+        }
+    }
+    if (port > 0) {
+        std::string host = output.value("host", std::string("0.0.0.0"));
+        netOut = std::make_unique<NetOutput>();
+        try {
+            netOut->listener = net::listen(host, port);
+        }
+        catch (const std::exception& e) {
+            flog::error("[DecoderFarm] Could not listen on {0}:{1}: {2}", host, port, e.what());
+            netOut.reset();
+            if (outFile) { fclose(outFile); }
+            outFile = NULL;
+            return false;
+        }
+        listenWorkerThread = std::thread(&DecoderFarm::listenWorker, this);
+    }
+    statsInterval = config.value("statsInterval", 10.0);
+    writerThread = std::thread(&DecoderFarm::writer, this);
+
+    // Create the channels, narrow ones all come from the shared channelizer
+    pool = std::make_unique<dsp::scheduler>(config.value("workers", 0));
+    double centerFreq = config.value("centerFrequency", 0.0);
+    bool chanEnabled = sigpath::iqFrontEnd.isChannelizerEnabled();
+    sigpath::iqFrontEnd.setChannelizer(true);
+    if (config.contains("channels") && config["channels"].is_array()) {
+        for (auto const& conf : config["channels"]) {
+            addChannel(conf, centerFreq);
+        }
+    }
+    sigpath::iqFrontEnd.setChannelizer(chanEnabled);
+
+    flog::info("[DecoderFarm] Decoding {0} channels on {1} workers", (int)channels.size(), pool->getWorkerCount());
+    running = true;
+    return true;
+}
+
+void DecoderFarm::stop() {
+    std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+    if (!running) { return; }
+
+    // Stop decoding, the last messages are still written
+    removeChannels();
+
+    // Stop accepting clients
+    if (netOut) { netOut->listener->stop(); }
+    if (listenWorkerThread.joinable()) { listenWorkerThread.join(); }
+
+    // Write what's left and close the outputs
+    {
+        std::lock_guard<std::mutex> lck2(queueMtx);
+        stopWriter = true;
+    }
+    queueCnd.notify_all();
+    if (writerThread.joinable()) { writerThread.join(); }
+    stopWriter = false;
+    if (netOut) {
+        for (auto& client : netOut->clients) { client.sock->close(); }
+        netOut.reset();
+    }
+    if (outFile) { fclose(outFile); }
+    outFile = NULL;
+
+    pool.reset();
+    running = false;
+}
+
+bool DecoderFarm::isRunning() {
+    std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+    return running;
+}
+
+std::vector<DecoderFarm::ChannelStats> DecoderFarm::getStats() {
+    std::lock_guard<std::mutex> lck(chanMtx);
+    std::vector<ChannelStats> stats;
+    for (auto& ch : channels) {
+        stats.push_back({ ch->name, ch->decoder, ch->frequency, ch->messages, ch->dec->symbols, getCpuTime(ch) });
+    }
+    return stats;
+}
+
+uint64_t DecoderFarm::getDroppedLines() {
+    return droppedLines;
+}
+
+uint64_t DecoderFarm::getClientDroppedLines() {
+    return clientDroppedLines;
+}
+
+bool DecoderFarm::addChannel(const json& conf, double centerFreq) {
+    // Check the config of the channel
+    if (!conf.contains("name") || !conf.contains("frequency") || !conf.contains("decoder")) {
+        flog::error("[DecoderFarm] A channel is missing its name, frequency or decoder");
+        return false;
+    }
+    std::string name = conf["name"];
+    double frequency = conf["frequency"];
+    std::string decoder = conf["decoder"];
+    json params = conf.contains("params") ? conf["params"] : json::object();
+
+    // Find the decoder
+    DecoderProvider provider;
+    {
+        std::lock_guard<std::mutex> lck(providerMtx);
+        auto it = providers.find(decoder);
+        if (it == providers.end()) {
+            flog::error("[DecoderFarm] Unknown decoder '{0}' for channel '{1}', is its module loaded?", decoder, name);
+            return false;
+        }
+        provider = it->second;
+    }
+
+    // The channel has to be within the baseband
+    double samplerate, bandwidth;
+    provider.getChannelParams(params, samplerate, bandwidth, provider.ctx);
+    double offset = frequency - centerFreq;
+    if (fabs(offset) + (bandwidth / 2.0) > sigpath::iqFrontEnd.getEffectiveSamplerate() / 2.0) {
+        flog::error("[DecoderFarm] Channel '{0}' is outside of the baseband", name);
+        return false;
+    }
+
+    // Create the VFO then the decoder
+    Channel* ch = new Channel;
+    ch->name = name;
+    ch->decoder = decoder;
+    ch->vfoName = "Decoder Farm: " + name;
+    ch->frequency = frequency;
+    ch->vfo = sigpath::iqFrontEnd.addVFO(ch->vfoName, samplerate, bandwidth, offset);
+    if (!ch->vfo) {
+        flog::error("[DecoderFarm] Could not create the VFO of channel '{0}'", name);
+        delete ch;
+        return false;
+    }
+    ch->dec = provider.create(&ch->vfo->out, params, provider.ctx);
+    if (!ch->dec) {
+        flog::error("[DecoderFarm] Could not create the decoder of channel '{0}'", name);
+        sigpath::iqFrontEnd.removeVFO(ch->vfoName);
+        delete ch;
+        return false;
+    }
+
+    // Run everything on the worker pool
+    ch->vfo->setScheduler(pool.get());
+    for (auto& blk : ch->dec->getBlocks()) { blk->setScheduler(pool.get()); }
+    ch->dec->onMessage.bind([this, ch](const json& fields) { messageHandler(ch, fields); });
+    ch->dec->start();
+
+    std::lock_guard<std::mutex> lck(chanMtx);
+    channels.push_back(ch);
+    return true;
+}
+
+void DecoderFarm::removeChannels() {
+    std::lock_guard<std::mutex> lck(chanMtx);
+    for (auto& ch : channels) {
+        // Stop the decoder first so that the VFO isn't left waiting on it
+        ch->dec->stop();
+        sigpath::iqFrontEnd.removeVFO(ch->vfoName);
+        delete ch->dec;
+        delete ch;
+    }
+    channels.clear();
+}
+
+double DecoderFarm::getCpuTime(Channel* ch) {
+    double cpuTime = pool->getStats(ch->vfo).cpuTime;
+    for (auto& blk : ch->dec->getBlocks()) { cpuTime += pool->getStats(blk).cpuTime; }
+    return cpuTime;
+}
+
+static double unixTime() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void DecoderFarm::messageHandler(Channel* ch, const json& fields) {
+    ch->messages++;
+    json line;
+    line["type"] = "message";
+    line["time"] = unixTime();
+    line["channel"] = ch->name;
+    line["frequency"] = ch->frequency;
+    line["decoder"] = ch->decoder;
+    line["data"] = fields;
+    push(line);
+}
+
+void DecoderFarm::push(const json& line) {
+    // Decoded text isn't always valid UTF-8
+    std::string str = line.dump(-1, ' ', false, json::error_handler_t::replace) + "\n";
+    {
+        std::lock_guard<std::mutex> lck(queueMtx);
+        if (queue.size() >= DECODER_FARM_MAX_QUEUED_LINES) {
+            droppedLines++;
+            return;
+        }
+        queue.push_back(std::move(str));
+    }
+    queueCnd.notify_one();
+}
+
+void DecoderFarm::writeStats(double interval) {
+    std::lock_guard<std::mutex> lck(chanMtx);
+    double now = unixTime();
+    for (auto& ch : channels) {
+        uint64_t symbols = ch->dec->symbols;
+        double cpuTime = getCpuTime(ch);
+        json line;
+        line["type"] = "stats";
+        line["time"] = now;
+        line["channel"] = ch->name;
+        line["frequency"] = ch->frequency;
+        line["decoder"] = ch->decoder;
+        line["messages"] = (uint64_t)ch->messages;
+        line["symbols"] = symbols;
+        line["symbolRate"] = (double)(symbols - ch->lastSymbols) / interval;
+        line["cpuLoad"] = (cpuTime - ch->lastCpuTime) / interval;
+        ch->lastSymbols = symbols;
+        ch->lastCpuTime = cpuTime;
+        push(line);
+    }
+
+    // State of the whole farm
+    json line;
+    line["type"] = "summary";
+    line["time"] = now;
+    line["channels"] = channels.size();
+    line["workers"] = pool->getWorkerCount();
+    line["droppedLines"] = (uint64_t)droppedLines;
+    line["clientDroppedLines"] = (uint64_t)clientDroppedLines;
+    line["dspMemory"] = dsp::buffer::getTotalMemoryUsage();
+    push(line);
+}
+
+void DecoderFarm::writer() {
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(statsInterval));
+    auto nextStats = std::chrono::steady_clock::now() + interval;
+    bool backlog = false;
+    std::unique_lock<std::mutex> lck(queueMtx);
+    while (true) {
+        // Wait for lines, for the time to write the stats or to retry the clients that are behind
+        auto ready = [this]() { return !queue.empty() || stopWriter; };
+        if (backlog) {
+            auto retry = std::chrono::steady_clock::now() + std::chrono::milliseconds(DECODER_FARM_RETRY_INTERVAL_MS);
+            queueCnd.wait_until(lck, (statsInterval > 0.0) ? std::min(nextStats, retry) : retry, ready);
+        }
+        else if (statsInterval > 0.0) {
+            queueCnd.wait_until(lck, nextStats, ready);
+        }
+        else {
+            queueCnd.wait(lck, ready);
+        }
+
+        // The stats go through the queue like the messages
+        if (statsInterval > 0.0 && std::chrono::steady_clock::now() >= nextStats) {
+            lck.unlock();
+            writeStats(statsInterval);
+            lck.lock();
+            nextStats += interval;
+        }
+
+        // Whatever is left in the backlogs when stopping is dropped
+        if (queue.empty()) {
+            if (stopWriter) { break; }
+            if (!backlog) { continue; }
+        }
+
+        // Write the lines without holding the lock
+        std::deque<std::string> lines;
+        lines.swap(queue);
+        lck.unlock();
+        if (outFile && !lines.empty()) {
+            for (auto const& str : lines) { fwrite(str.data(), 1, str.size(), outFile); }
+            fflush(outFile);
+        }
+        if (netOut) { backlog = sendLines(lines); }
+        lck.lock();
+    }
+}
+
+bool DecoderFarm::sendLines(const std::deque<std::string>& lines) {
+    std::lock_guard<std::mutex> lck(netOut->clientsMtx);
+    bool pending = false;
+    auto& clients = netOut->clients;
+    for (auto it = clients.begin(); it != clients.end();) {
+        // Only whole lines are queued so that a slow client misses lines instead of receiving partial ones
+        for (auto const& str : lines) {
+            if (it->backlog.size() + str.size() > DECODER_FARM_MAX_CLIENT_BACKLOG) {
+                clientDroppedLines++;
+                continue;
+            }
+            it->backlog += str;
+        }
+
+        // Send what the socket takes without waiting
+        while (!it->backlog.empty()) {
+            int sent = it->sock->send((const uint8_t*)it->backlog.data(), it->backlog.size());
+            if (sent <= 0) { break; }
+            it->backlog.erase(0, sent);
+        }
+
+        // The socket closes itself on errors other than would block
+        if (!it->sock->isOpen()) {
+            flog::info("[DecoderFarm] Client disconnected");
+            it = clients.erase(it);
+            continue;
+        }
+        if (!it->backlog.empty()) { pending = true; }
+        it++;
+    }
+    return pending;
+}
+
+void DecoderFarm::listenWorker() {
+    while (netOut->listener->listening()) {
+        // Accept with a timeout to notice when the listener is stopped
+        auto client = netOut->listener->accept(NULL, 100);
+        if (!client) { continue; }
+        flog::info("[DecoderFarm] Client connected");
+        std::lock_guard<std::mutex> lck(netOut->clientsMtx);
+        netOut->clients.push_back({ client, "" });
+    }
+}
\ No newline at end of file
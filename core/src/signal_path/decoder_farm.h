@@ -0,0 +1,143 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include <stdio.h>
+#include <json.hpp>
+#include <dsp/stream.h>
+#include <dsp/types.h>
+#include <dsp/block.h>
+#include <dsp/scheduler.h>
+#include <dsp/channel/rx_vfo.h>
+#include <utils/new_event.h>
+
+using nlohmann::json;
+
+// Maximum number of lines waiting to be written, decoders never wait for the output
+#define DECODER_FARM_MAX_QUEUED_LINES   10000
+
+// Maximum number of bytes waiting to be sent to a client, lines that don't fit are dropped for that client
+#define DECODER_FARM_MAX_CLIENT_BACKLOG 4000000
+
+// Interval at which the backlog of slow clients is retried
+#define DECODER_FARM_RETRY_INTERVAL_MS  50
+
+// Runs many decoding chains off the baseband without the GUI. The channels and the output are taken from a config,
+// the decoders are provided by the modules. Each channel gets a VFO from the IQ front end, narrow ones are taken from
+// the shared channelizer, and the VFOs and decoders all run on one worker pool. Decoded messages and periodic
+// per-channel stats are written as one JSON object per line to a file and/or to the clients of a TCP port.
+// The cpuLoad of the stats is the CPU time the worker threads spent in the blocks of the channel per second.
+class DecoderFarm {
+public:
+    // Decoding chain of one channel, must not use the GUI
+    class ChannelDecoder {
+    public:
+        virtual ~ChannelDecoder() {}
+        virtual void start() = 0;
+        virtual void stop() = 0;
+
+        // Blocks of the chain, they're run on the worker pool of the farm
+        virtual std::vector<dsp::block*> getBlocks() = 0;
+
+        // Called with the decoder specific fields of each decoded message
+        NewEvent<const json&> onMessage;
+
+        // Decoded symbols, used for the throughput stats
+        std::atomic<uint64_t> symbols = 0;
+    };
+
+    struct DecoderProvider {
+        // Samplerate and bandwidth of the channel a decoder with the given parameters needs
+        void (*getChannelParams)(const json& params, double& samplerate, double& bandwidth, void* ctx);
+        ChannelDecoder* (*create)(dsp::stream<dsp::complex_t>* in, const json& params, void* ctx);
+        void* ctx;
+    };
+
+    struct ChannelStats {
+        std::string name;
+        std::string decoder;
+        double frequency;
+        uint64_t messages;
+        uint64_t symbols;
+        double cpuTime; // CPU time of the worker threads in seconds, VFO included
+    };
+
+    DecoderFarm();
+    ~DecoderFarm();
+
+    void registerDecoder(std::string name, DecoderProvider provider);
+    void unregisterDecoder(std::string name);
+    std::vector<std::string> getDecoderNames();
+
+    // Create the channels listed in the config, open the output and start decoding. The source has to be tuned
+    // to the center frequency given in the config. Channels that can't be created are skipped with an error.
+    bool start(const json& config);
+    void stop();
+    bool isRunning();
+
+    std::vector<ChannelStats> getStats();
+
+    // Lines dropped because the output couldn't keep up
+    uint64_t getDroppedLines();
+
+    // Lines dropped for a client because its backlog was full, counted once per client
+    uint64_t getClientDroppedLines();
+
+private:
+    struct Channel {
+        std::string name;
+        std::string decoder;
+        std::string vfoName;
+        double frequency;
+        dsp::channel::RxVFO* vfo;
+        ChannelDecoder* dec;
+        std::atomic<uint64_t> messages = 0;
+
+        // Values when the last stats were written
+        uint64_t lastSymbols = 0;
+        double lastCpuTime = 0.0;
+    };
+
+    bool addChannel(const json& conf, double centerFreq);
+    void removeChannels();
+    double getCpuTime(Channel* ch);
+
+    void messageHandler(Channel* ch, const json& fields);
+    void push(const json& line);
+    void writeStats(double interval);
+
+    void writer();
+    bool sendLines(const std::deque<std::string>& lines);
+    void listenWorker();
+
+    std::recursive_mutex ctrlMtx;
+    bool running = false;
+
+    std::mutex providerMtx;
+    std::map<std::string, DecoderProvider> providers;
+
+    std::unique_ptr<dsp::scheduler> pool;
+    std::mutex chanMtx;
+    std::vector<Channel*> channels;
+
+    // Output, the sockets are kept out of the header since the core has two networking libraries
+    struct NetOutput;
+    double statsInterval = 0.0;
+    FILE* outFile = NULL;
+    std::unique_ptr<NetOutput> netOut;
+    std::thread listenWorkerThread;
+
+    std::thread writerThread;
+    std::mutex queueMtx;
+    std::condition_variable queueCnd;
+    std::deque<std::string> queue;
+    bool stopWriter = false;
+    std::atomic<uint64_t> droppedLines = 0;
+    std::atomic<uint64_t> clientDroppedLines = 0;
+};
\ No newline at end of file
@@ -9,9 +9,6 @@ IQFrontEnd::~IQFrontEnd() {
     if (!_init) { return; }
     stop();
     dsp::buffer::free(fftWindowBuf);
-    fftwf_destroy_plan(fftwPlan);
-    fftwf_free(fftInBuf);
-    fftwf_free(fftOutBuf);
 }
 
 void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool buffering, int decimRatio, bool dcBlocking, int fftSize, double fftRate, FFTWindow fftWindow, float* (*acquireFFTBuffer)(void* ctx), void (*releaseFFTBuffer)(void* ctx), void* fftCtx) {
@@ -26,8 +23,8 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
 
     effectiveSr = _sampleRate / _decimRatio;
 
-    inBuf.init(in);
-    inBuf.bypass = !buffering;
+    inBuf.init(in, _sampleRate);
+    inBuf.setBypass(!buffering);
 
     decim.init(NULL, _decimRatio);
     dcBlock.init(NULL, genDCBlockRate(effectiveSr));
@@ -40,29 +37,11 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
 
     split.init(preproc.out);
 
-    // TODO: Do something to avoid basically repeating this code twice
-    int skip;
-    genReshapeParams(effectiveSr, _fftSize, _fftRate, skip, _nzFFTSize);
-    reshape.init(&fftIn, fftSize, skip);
-    fftSink.init(&reshape.out, handler, this);
+    // Only bound to the splitter once a VFO uses it
+    chan.init(&chanIn, effectiveSr);
 
-    fftWindowBuf = dsp::buffer::alloc<float>(_nzFFTSize);
-    if (_fftWindow == FFTWindow::RECTANGULAR) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = 0; }
-    }
-    else if (_fftWindow == FFTWindow::BLACKMAN) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::blackman(i, _nzFFTSize); }
-    }
-    else if (_fftWindow == FFTWindow::NUTTALL) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::nuttall(i, _nzFFTSize); }
-    }
-
-    fftInBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftOutBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftwPlan = fftwf_plan_dft_1d(_fftSize, fftInBuf, fftOutBuf, FFTW_FORWARD, FFTW_ESTIMATE);
-
-    // Clear the rest of the FFT input buffer
-    dsp::buffer::clear(fftInBuf, _fftSize - _nzFFTSize, _nzFFTSize);
+    generateFFTWindow();
+    spectrum.init(&fftIn, effectiveSr, _fftSize, _fftRate, fftWindowBuf, _acquireFFTBuffer, _releaseFFTBuffer, _fftCtx);
 
     split.bindStream(&fftIn);
 
@@ -80,17 +59,17 @@ void IQFrontEnd::setSampleRate(double sampleRate) {
         vfo->tempStop();
     }
 
-    // Update the samplerate
+    // Update the samplerate, the input buffer is resized to hold the same duration
     _sampleRate = sampleRate;
+    inBuf.setSamplerate(_sampleRate);
     effectiveSr = _sampleRate / _decimRatio;
     dcBlock.setRate(genDCBlockRate(effectiveSr));
+    chan.setSamplerate(effectiveSr);
+    spectrum.setSamplerate(effectiveSr);
     for (auto& [name, vfo] : vfos) {
         vfo->setInSamplerate(effectiveSr);
     }
 
-    // Reconfigure the FFT
-    updateFFTPath();
-
     // Restart blocks
     dcBlock.tempStart();
     for (auto& [name, vfo] : vfos) {
@@ -99,7 +78,15 @@ void IQFrontEnd::setSampleRate(double sampleRate) {
 }
 
 void IQFrontEnd::setBuffering(bool enabled) {
-    inBuf.bypass = !enabled;
+    inBuf.setBypass(!enabled);
+}
+
+void IQFrontEnd::setBufferLatency(double latency) {
+    inBuf.setLatency(latency);
+}
+
+void IQFrontEnd::setBufferTargetLatency(double targetLatency) {
+    inBuf.setTargetLatency(targetLatency);
 }
 
 void IQFrontEnd::setDecimation(int ratio) {
@@ -129,6 +116,11 @@ void IQFrontEnd::setInvertIQ(bool enabled) {
     preproc.setBlockEnabled(&conjugate, enabled, [=](dsp::stream<dsp::complex_t>* out){ split.setInput(out); });
 }
 
+void IQFrontEnd::setChannelizer(bool enabled) {
+    // Only applies to VFOs created from now on
+    channelizerEnabled = enabled;
+}
+
 void IQFrontEnd::bindIQStream(dsp::stream<dsp::complex_t>* stream) {
     split.bindStream(stream);
 }
@@ -144,8 +136,24 @@ dsp::channel::RxVFO* IQFrontEnd::addVFO(std::string name, double sampleRate, dou
         return NULL;
     }
 
-    // Create VFO and its input stream
-    dsp::stream<dsp::complex_t>* vfoIn = new dsp::stream<dsp::complex_t>;
+    // Narrow VFOs get their channel from the shared channelizer if enabled
+    if (channelizerEnabled && chan.canChannelize(bandwidth)) {
+        dsp::channel::FFTChannelizer::Channel* ch = chan.addChannel(offset, bandwidth);
+        dsp::channel::RxVFO* vfo = new dsp::channel::ChannelizedRxVFO(&chan, ch, sampleRate, bandwidth, offset);
+
+        // Register them, the channelizer is fed as soon as it has a channel
+        vfoChannels[name] = ch;
+        vfos[name] = vfo;
+        if (chan.getChannelCount() == 1) { bindIQStream(&chanIn); }
+
+        // Start VFO
+        vfo->start();
+
+        return vfo;
+    }
+
+    // Create VFO and its input stream (shared with the other VFOs to avoid a copy per VFO)
+    dsp::stream<dsp::complex_t>* vfoIn = new dsp::shared_stream<dsp::complex_t>;
     dsp::channel::RxVFO* vfo = new dsp::channel::RxVFO(vfoIn, effectiveSr, sampleRate, bandwidth, offset);
 
     // Register them
@@ -166,6 +174,23 @@ void IQFrontEnd::removeVFO(std::string name) {
         return;
     }
 
+    // Channelized VFOs give their channel back instead of having their own stream
+    if (vfoChannels.find(name) != vfoChannels.end()) {
+        dsp::channel::FFTChannelizer::Channel* ch = vfoChannels[name];
+        dsp::channel::RxVFO* vfo = vfos[name];
+
+        // Stop the VFO
+        vfo->stop();
+
+        // Stop feeding the channelizer once it has no channel left
+        vfoChannels.erase(name);
+        vfos.erase(name);
+        delete vfo;
+        chan.removeChannel(ch);
+        if (!chan.getChannelCount()) { unbindIQStream(&chanIn); }
+        return;
+    }
+
     // Remove the VFO and stream from registry
     dsp::stream<dsp::complex_t>* vfoIn = vfoStreams[name];
     dsp::channel::RxVFO* vfo = vfos[name];
@@ -197,6 +222,27 @@ void IQFrontEnd::setFFTWindow(FFTWindow fftWindow) {
     updateFFTPath();
 }
 
+void IQFrontEnd::setFFTMode(dsp::sink::Spectrum::Mode mode) {
+    spectrum.setMode(mode);
+}
+
+void IQFrontEnd::setFFTOverlap(double overlap) {
+    spectrum.setOverlap(overlap);
+}
+
+void IQFrontEnd::setFFTEnabled(bool enabled) {
+    if (enabled == fftEnabled) { return; }
+    fftEnabled = enabled;
+    if (fftEnabled) {
+        split.bindStream(&fftIn);
+        spectrum.start();
+    }
+    else {
+        spectrum.stop();
+        split.unbindStream(&fftIn);
+    }
+}
+
 void IQFrontEnd::flushInputBuffer() {
     inBuf.flush();
 }
@@ -211,14 +257,16 @@ void IQFrontEnd::start() {
     // Start IQ splitter
     split.start();
 
+    // Start the shared channelizer
+    chan.start();
+
     // Start all VFOs
     for (auto& [name, vfo] : vfos) {
         vfo->start();
     }
 
-    // Start FFT chain
-    reshape.start();
-    fftSink.start();
+    // Start FFT
+    if (fftEnabled) { spectrum.start(); }
 }
 
 void IQFrontEnd::stop() {
@@ -231,79 +279,42 @@ void IQFrontEnd::stop() {
     // Stop IQ splitter
     split.stop();
 
+    // Stop the shared channelizer
+    chan.stop();
+
     // Stop all VFOs
     for (auto& [name, vfo] : vfos) {
         vfo->stop();
     }
 
-    // Stop FFT chain
-    reshape.stop();
-    fftSink.stop();
+    // Stop FFT
+    spectrum.stop();
 }
 
 double IQFrontEnd::getEffectiveSamplerate() {
     return effectiveSr;
 }
 
-void IQFrontEnd::handler(dsp::complex_t* data, int count, void* ctx) {
-    IQFrontEnd* _this = (IQFrontEnd*)ctx;
-
-    // Apply window
-    volk_32fc_32f_multiply_32fc((lv_32fc_t*)_this->fftInBuf, (lv_32fc_t*)data, _this->fftWindowBuf, _this->_nzFFTSize);
-
-    // Execute FFT
-    fftwf_execute(_this->fftwPlan);
-
-    // Aquire buffer
-    float* fftBuf = _this->_acquireFFTBuffer(_this->_fftCtx);
-
-    // Convert the complex output of the FFT to dB amplitude
-    if (fftBuf) {
-        volk_32fc_s32f_power_spectrum_32f(fftBuf, (lv_32fc_t*)_this->fftOutBuf, _this->_fftSize, _this->_fftSize);
-    }
-
-    // Release buffer
-    _this->_releaseFFTBuffer(_this->_fftCtx);
-}
-
 void IQFrontEnd::updateFFTPath(bool updateWaterfall) {
-    // Temp stop branch
-    reshape.tempStop();
-    fftSink.tempStop();
+    // Update the window and the spectrum engine
+    generateFFTWindow();
+    spectrum.setFFTParams(_fftSize, _fftRate, fftWindowBuf);
 
-    // Update reshaper settings
-    int skip;
-    genReshapeParams(effectiveSr, _fftSize, _fftRate, skip, _nzFFTSize);
-    reshape.setKeep(_nzFFTSize);
-    reshape.setSkip(skip);
+    // Update waterfall (TODO: This is annoying, it makes this module non testable and will constantly clear the waterfall for any reason)
+    if (updateWaterfall) { gui::waterfall.setRawFFTSize(_fftSize); }
+}
 
-    // Update window
+void IQFrontEnd::generateFFTWindow() {
+    // The sign is flipped every other sample to center the spectrum
     dsp::buffer::free(fftWindowBuf);
-    fftWindowBuf = dsp::buffer::alloc<float>(_nzFFTSize);
+    fftWindowBuf = dsp::buffer::alloc<float>(_fftSize);
     if (_fftWindow == FFTWindow::RECTANGULAR) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = 1.0f * ((i % 2) ? -1.0f : 1.0f); }
+        for (int i = 0; i < _fftSize; i++) { fftWindowBuf[i] = 1.0f * ((i % 2) ? -1.0f : 1.0f); }
     }
     else if (_fftWindow == FFTWindow::BLACKMAN) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::blackman(i, _nzFFTSize) * ((i % 2) ? -1.0f : 1.0f); }
+        for (int i = 0; i < _fftSize; i++) { fftWindowBuf[i] = dsp::window::blackman(i, _fftSize) * ((i % 2) ? -1.0f : 1.0f); }
     }
     else if (_fftWindow == FFTWindow::NUTTALL) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::nuttall(i, _nzFFTSize) * ((i % 2) ? -1.0f : 1.0f); }
+        for (int i = 0; i < _fftSize; i++) { fftWindowBuf[i] = dsp::window::nuttall(i, _fftSize) * ((i % 2) ? -1.0f : 1.0f); }
     }
-
-    // Update FFT plan
-    fftwf_free(fftInBuf);
-    fftwf_free(fftOutBuf);
-    fftInBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftOutBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftwPlan = fftwf_plan_dft_1d(_fftSize, fftInBuf, fftOutBuf, FFTW_FORWARD, FFTW_ESTIMATE);
-
-    // Clear the rest of the FFT input buffer
-    dsp::buffer::clear(fftInBuf, _fftSize - _nzFFTSize, _nzFFTSize);
-
-    // Update waterfall (TODO: This is annoying, it makes this module non testable and will constantly clear the waterfall for any reason)
-    if (updateWaterfall) { gui::waterfall.setRawFFTSize(_fftSize); }
-
-    // Restart branch
-    reshape.tempStart();
-    fftSink.tempStart();
 }
\ No newline at end of file
@@ -1,12 +1,13 @@
 #pragma once
 #include "../dsp/buffer/frame_buffer.h"
-#include "../dsp/buffer/reshaper.h"
 #include "../dsp/multirate/power_decimator.h"
 #include "../dsp/correction/dc_blocker.h"
 #include "../dsp/chain.h"
 #include "../dsp/routing/splitter.h"
+#include "../dsp/shared_stream.h"
 #include "../dsp/channel/rx_vfo.h"
-#include "../dsp/sink/handler_sink.h"
+#include "../dsp/channel/channelized_rx_vfo.h"
+#include "../dsp/sink/spectrum.h"
 #include "../dsp/math/conjugate.h"
 #include <fftw3.h>
 
@@ -27,9 +28,13 @@ public:
     inline double getSampleRate() { return _sampleRate / _decimRatio; }
 
     void setBuffering(bool enabled);
+    void setBufferLatency(double latency);
+    void setBufferTargetLatency(double targetLatency);
     void setDecimation(int ratio);
     void setInvertIQ(bool enabled);
     void setDCBlocking(bool enabled);
+    void setChannelizer(bool enabled);
+    inline bool isChannelizerEnabled() { return channelizerEnabled; }
 
     void bindIQStream(dsp::stream<dsp::complex_t>* stream);
     void unbindIQStream(dsp::stream<dsp::complex_t>* stream);
@@ -40,28 +45,36 @@ public:
     void setFFTSize(int size);
     void setFFTRate(double rate);
     void setFFTWindow(FFTWindow fftWindow);
+    void setFFTMode(dsp::sink::Spectrum::Mode mode);
+    void setFFTOverlap(double overlap);
+    inline int getFFTSize() { return _fftSize; }
+    inline double getFFTRate() { return _fftRate; }
+
+    // The FFT is enabled by default, disabling it unbinds it from the splitter so that nothing is computed
+    void setFFTEnabled(bool enabled);
 
     void flushInputBuffer();
 
+    // Input buffer state, durations are in milliseconds
+    inline double getBufferFillLevel() { return inBuf.getFillLevel(); }
+    inline double getBufferCapacity() { return inBuf.getCapacity(); }
+    inline uint64_t getBufferOverruns() { return inBuf.getOverruns(); }
+    inline uint64_t getBufferUnderruns() { return inBuf.getUnderruns(); }
+    inline bool isBuffering() { return !inBuf.getBypass(); }
+
     void start();
     void stop();
 
     double getEffectiveSamplerate();
 
 protected:
-    static void handler(dsp::complex_t* data, int count, void* ctx);
     void updateFFTPath(bool updateWaterfall = false);
+    void generateFFTWindow();
 
     static inline double genDCBlockRate(double sampleRate) {
         return 50.0 / sampleRate;
     }
 
-    static inline void genReshapeParams(double sampleRate, int size, double rate, int& skip, int& nzSampCount) {
-        int fftInterval = round(sampleRate / rate);
-        nzSampCount = std::min<int>(fftInterval, size);
-        skip = fftInterval - nzSampCount;
-    }
-
     // Input buffer
     dsp::buffer::SampleFrameBuffer<dsp::complex_t> inBuf;
 
@@ -75,12 +88,18 @@ protected:
     dsp::routing::Splitter<dsp::complex_t> split;
 
     // FFT
-    dsp::stream<dsp::complex_t> fftIn;
-    dsp::buffer::Reshaper<dsp::complex_t> reshape;
-    dsp::sink::Handler<dsp::complex_t> fftSink;
+    dsp::shared_stream<dsp::complex_t> fftIn;
+    dsp::sink::Spectrum spectrum;
+    bool fftEnabled = true;
+
+    // Shared channelizer
+    dsp::shared_stream<dsp::complex_t> chanIn;
+    dsp::channel::FFTChannelizer chan;
+    bool channelizerEnabled = false;
 
     // VFOs
     std::map<std::string, dsp::stream<dsp::complex_t>*> vfoStreams;
+    std::map<std::string, dsp::channel::FFTChannelizer::Channel*> vfoChannels;
     std::map<std::string, dsp::channel::RxVFO*> vfos;
 
     // Parameters
@@ -94,11 +113,7 @@ protected:
     void* _fftCtx;
 
     // Processing data
-    int _nzFFTSize;
-    float* fftWindowBuf;
-    fftwf_complex *fftInBuf, *fftOutBuf;
-    fftwf_plan fftwPlan;
-    float* fftDbOut;
+    float* fftWindowBuf = NULL;
 
     double effectiveSr;
 
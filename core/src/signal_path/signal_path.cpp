@@ -5,4 +5,5 @@ namespace sigpath {
     VFOManager vfoManager;
     SourceManager sourceManager;
     SinkManager sinkManager;
+    DecoderFarm decoderFarm;
 };
\ No newline at end of file
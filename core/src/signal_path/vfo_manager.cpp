@@ -67,6 +67,10 @@ void VFOManager::VFO::setBandwidthLimits(double minBandwidth, double maxBandwidt
     wtfVFO->bandwidthLocked = bandwidthLocked;
 }
 
+void VFOManager::VFO::setFused(bool enabled) {
+    dspVFO->setFused(enabled);
+}
+
 bool VFOManager::VFO::getBandwidthChanged(bool erase) {
     bool val = wtfVFO->bandwidthChanged;
     if (erase) { wtfVFO->bandwidthChanged = false; }
@@ -168,6 +172,13 @@ void VFOManager::setBandwidthLimits(std::string name, double minBandwidth, doubl
     vfos[name]->setBandwidthLimits(minBandwidth, maxBandwidth, bandwidthLocked);
 }
 
+void VFOManager::setFused(std::string name, bool enabled) {
+    if (vfos.find(name) == vfos.end()) {
+        return;
+    }
+    vfos[name]->setFused(enabled);
+}
+
 bool VFOManager::getBandwidthChanged(std::string name, bool erase) {
     if (vfos.find(name) == vfos.end()) {
         return false;
@@ -20,6 +20,7 @@ public:
         void setReference(int ref);
         void setSnapInterval(double interval);
         void setBandwidthLimits(double minBandwidth, double maxBandwidth, bool bandwidthLocked);
+        void setFused(bool enabled);
         bool getBandwidthChanged(bool erase = true);
         double getBandwidth();
         int getReference();
@@ -49,6 +50,7 @@ public:
     void setSampleRate(std::string name, double sampleRate, double bandwidth);
     void setReference(std::string name, int ref);
     void setBandwidthLimits(std::string name, double minBandwidth, double maxBandwidth, bool bandwidthLocked);
+    void setFused(std::string name, bool enabled);
     bool getBandwidthChanged(std::string name, bool erase = true);
     double getBandwidth(std::string name);
     void setColor(std::string name, ImU32 color);
@@ -0,0 +1,266 @@
+#include <utils/async_file.h>
+#include <utils/flog.h>
+#include <volk/volk.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+namespace utils {
+    AsyncFile::~AsyncFile() {
+        close();
+    }
+
+    bool AsyncFile::open(std::string path, const AsyncFileOptions& options) {
+        if (opened) { close(); }
+        this->path = path;
+        opts = options;
+
+        // Open the file, direct I/O is only a request since many file systems don't support it
+        direct = false;
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+        if (opts.direct) {
+            fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+            direct = (fd >= 0);
+            if (!direct) { flog::warn("Direct I/O not supported for '{0}', using buffered writes", path); }
+        }
+#endif
+        if (fd < 0) { fd = ::open(path.c_str(), flags, 0644); }
+#ifdef __APPLE__
+        // Closest equivalent to O_DIRECT
+        if (fd >= 0 && opts.direct) { fcntl(fd, F_NOCACHE, 1); }
+#endif
+#endif
+        if (fd < 0) { return false; }
+
+        // Allocate the buffers, their size must be a multiple of the alignment for direct I/O
+        bufferSize = std::max<int>(opts.bufferSize, ASYNC_FILE_ALIGNMENT);
+        bufferSize = ((bufferSize + ASYNC_FILE_ALIGNMENT - 1) / ASYNC_FILE_ALIGNMENT) * ASYNC_FILE_ALIGNMENT;
+        int count = std::max<int>(opts.bufferCount, 2);
+        for (int i = 0; i < count; i++) {
+            buffers.push_back((uint8_t*)volk_malloc(bufferSize, ASYNC_FILE_ALIGNMENT));
+        }
+
+        // Reset the state
+        fill = 0;
+        head = 0;
+        tail = 0;
+        position = 0;
+        allocatedUntil = 0;
+        patches.clear();
+        overruns = 0;
+        droppedBytes = 0;
+        failed = false;
+        stopWorker = false;
+
+        // Start the I/O thread
+        opened = true;
+        workerThread = std::thread(&AsyncFile::worker, this);
+        return true;
+    }
+
+    bool AsyncFile::isOpen() {
+        return opened;
+    }
+
+    void AsyncFile::close() {
+        if (!opened) { return; }
+
+        // Let the I/O thread write all the full buffers
+        stopWorker = true;
+        workerCnd.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
+
+        // Write the rest and the patches
+        finish();
+        freeBuffers();
+        opened = false;
+    }
+
+    bool AsyncFile::write(const void* data, size_t len) {
+        if (!opened) { return false; }
+        if (failed) {
+            droppedBytes += len;
+            return false;
+        }
+
+        // Space left in the current buffer plus the free buffers, it can only grow while copying
+        size_t count = buffers.size();
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t queued = h - tail.load(std::memory_order_acquire);
+        size_t avail = (queued < count) ? (bufferSize - fill) + (count - 1 - queued) * bufferSize : 0;
+        if (len > avail) {
+            overruns++;
+            droppedBytes += len;
+            return false;
+        }
+
+        // Copy into the buffers and hand them to the I/O thread as they get full
+        const uint8_t* in = (const uint8_t*)data;
+        while (len) {
+            size_t toCopy = std::min<size_t>(len, bufferSize - fill);
+            memcpy(&buffers[h % count][fill], in, toCopy);
+            fill += toCopy;
+            in += toCopy;
+            len -= toCopy;
+            position += toCopy;
+            if (fill == bufferSize) {
+                head.store(++h, std::memory_order_release);
+                fill = 0;
+                workerCnd.notify_one();
+            }
+        }
+        return true;
+    }
+
+    void AsyncFile::writeAt(uint64_t offset, const void* data, size_t len) {
+        if (!opened) { return; }
+        Patch patch;
+        patch.offset = offset;
+        patch.data.assign((const uint8_t*)data, (const uint8_t*)data + len);
+        patches.push_back(std::move(patch));
+    }
+
+    uint64_t AsyncFile::tell() {
+        return position;
+    }
+
+    uint64_t AsyncFile::getOverruns() {
+        return overruns;
+    }
+
+    uint64_t AsyncFile::getDroppedBytes() {
+        return droppedBytes;
+    }
+
+    float AsyncFile::getBufferUsage() {
+        if (!opened) { return 0.0f; }
+        return (float)(head - tail) / (float)buffers.size();
+    }
+
+    bool AsyncFile::hasFailed() {
+        return failed;
+    }
+
+    void AsyncFile::worker() {
+        size_t count = buffers.size();
+        while (true) {
+            // Wait for a full buffer. The writer never takes the mutex, so a missed notification only delays it
+            uint64_t t = tail.load(std::memory_order_relaxed);
+            if (t == head.load(std::memory_order_acquire)) {
+                if (stopWorker) { return; }
+                std::unique_lock<std::mutex> lck(workerMtx);
+                workerCnd.wait_for(lck, std::chrono::milliseconds(10));
+                continue;
+            }
+
+            // Buffers are always written full, so their place in the file is given by their index
+            uint64_t offset = t * bufferSize;
+            if (opts.preallocate) { preallocate(offset + count * bufferSize); }
+            if (!failed && !writeBuffer(fd, buffers[t % count], bufferSize, offset)) {
+                flog::error("Could not write to '{0}', the rest of the data will be dropped", path);
+                failed = true;
+            }
+            if (failed) { droppedBytes += bufferSize; }
+            tail.store(t + 1, std::memory_order_release);
+        }
+    }
+
+    bool AsyncFile::writeBuffer(int fd, const uint8_t* data, size_t len, uint64_t offset) {
+#ifdef _WIN32
+        if (_lseeki64(fd, offset, SEEK_SET) < 0) { return false; }
+        while (len) {
+            int ret = _write(fd, data, (unsigned int)std::min<size_t>(len, 1 << 30));
+            if (ret <= 0) { return false; }
+            data += ret;
+            len -= ret;
+        }
+#else
+        while (len) {
+            ssize_t ret = pwrite(fd, data, len, offset);
+            if (ret < 0 && errno == EINTR) { continue; }
+            if (ret <= 0) { return false; }
+            data += ret;
+            len -= ret;
+            offset += ret;
+        }
+#endif
+        return true;
+    }
+
+    void AsyncFile::preallocate(uint64_t until) {
+#ifdef __linux__
+        if (until <= allocatedUntil) { return; }
+
+        // Reserve the space without changing the size of the file, so that what's not used is freed when closing
+        uint64_t len = std::max<uint64_t>(ASYNC_FILE_PREALLOC_STEP, until - allocatedUntil);
+        if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocatedUntil, len) < 0) {
+            flog::warn("Could not preallocate space for '{0}'", path);
+            opts.preallocate = false;
+            return;
+        }
+        allocatedUntil += len;
+#endif
+    }
+
+    void AsyncFile::finish() {
+        // Direct I/O can only write whole aligned blocks, so the end and the patches go through a normal descriptor
+#ifndef _WIN32
+        if (direct) {
+            ::close(fd);
+            fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+            if (fd < 0) {
+                flog::error("Could not reopen '{0}' to finish it", path);
+                return;
+            }
+        }
+#endif
+
+        // Write the partially filled buffer, the I/O thread has written everything before it
+        uint64_t h = head;
+        if (fill && (failed || !writeBuffer(fd, buffers[h % buffers.size()], fill, h * bufferSize))) {
+            if (!failed) { flog::error("Could not write to '{0}'", path); }
+            failed = true;
+            droppedBytes += fill;
+        }
+
+        // Apply the patches
+        for (const auto& patch : patches) {
+            if (!writeBuffer(fd, patch.data.data(), patch.data.size(), patch.offset)) {
+                flog::error("Could not write to '{0}'", path);
+            }
+        }
+        patches.clear();
+
+#ifdef _WIN32
+        _close(fd);
+#else
+        // Free the preallocated space that wasn't used
+        if (allocatedUntil > position && ftruncate(fd, position) < 0) {
+            flog::warn("Could not free the space preallocated for '{0}'", path);
+        }
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+
+    void AsyncFile::freeBuffers() {
+        for (auto& buf : buffers) {
+            volk_free(buf);
+        }
+        buffers.clear();
+    }
+}
\ No newline at end of file
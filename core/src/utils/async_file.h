@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+// Default size and number of the buffers between the writer and the I/O thread
+#define ASYNC_FILE_DEFAULT_BUFFER_SIZE  (4 * 1024 * 1024)
+#define ASYNC_FILE_DEFAULT_BUFFER_COUNT 8
+
+// Alignment of the buffers and of their size, required by direct I/O
+#define ASYNC_FILE_ALIGNMENT            4096
+
+// Amount of disk space reserved at once ahead of the data when preallocating
+#define ASYNC_FILE_PREALLOC_STEP        (256ULL * 1024 * 1024)
+
+namespace utils {
+    struct AsyncFileOptions {
+        // Bypass the page cache (O_DIRECT), falls back to normal writes if the file system doesn't support it
+        bool direct = false;
+
+        // Reserve disk space ahead of the data so that the file doesn't get fragmented (Linux only)
+        bool preallocate = false;
+
+        int bufferSize = ASYNC_FILE_DEFAULT_BUFFER_SIZE;
+        int bufferCount = ASYNC_FILE_DEFAULT_BUFFER_COUNT;
+    };
+
+    // File written sequentially by a dedicated I/O thread. Writes are copied into a ring of large aligned buffers and
+    // only full buffers are handed to the I/O thread, without any lock on either side. A write never waits for the
+    // disk: if it doesn't fit in the free buffers it's dropped as a whole and counted as an overrun. Once writing to
+    // the file has failed, everything is dropped.
+    // Only one thread may write at a time. Data written at an earlier offset (eg. header sizes) is kept and applied
+    // once the file is closed.
+    class AsyncFile {
+    public:
+        AsyncFile() {}
+        ~AsyncFile();
+
+        bool open(std::string path, const AsyncFileOptions& options = AsyncFileOptions());
+        bool isOpen();
+
+        // Waits for all the data to be on disk
+        void close();
+
+        // Returns false if the data was dropped, which is always the case once the file has failed
+        bool write(const void* data, size_t len);
+
+        // Applied when closing the file
+        void writeAt(uint64_t offset, const void* data, size_t len);
+
+        // Number of bytes written so far, including those still buffered
+        uint64_t tell();
+
+        // Can be called from any thread. Dropped bytes include those lost to a write error.
+        uint64_t getOverruns();
+        uint64_t getDroppedBytes();
+        float getBufferUsage();
+        bool hasFailed();
+
+    private:
+        struct Patch {
+            uint64_t offset;
+            std::vector<uint8_t> data;
+        };
+
+        void worker();
+        bool writeBuffer(int fd, const uint8_t* data, size_t len, uint64_t offset);
+        void preallocate(uint64_t until);
+        void finish();
+        void freeBuffers();
+
+        std::string path;
+        AsyncFileOptions opts;
+        int fd = -1;
+        bool direct = false;
+        bool opened = false;
+
+        // Ring of buffers, the writer fills the one at head while the I/O thread writes from tail to head
+        std::vector<uint8_t*> buffers;
+        size_t bufferSize = 0;
+        size_t fill = 0;
+        std::atomic<uint64_t> head = 0;
+        std::atomic<uint64_t> tail = 0;
+        uint64_t position = 0;
+        uint64_t allocatedUntil = 0;
+
+        std::vector<Patch> patches;
+
+        std::thread workerThread;
+        std::mutex workerMtx;
+        std::condition_variable workerCnd;
+        std::atomic<bool> stopWorker = false;
+
+        std::atomic<uint64_t> overruns = 0;
+        std::atomic<uint64_t> droppedBytes = 0;
+        std::atomic<bool> failed = false;
+    };
+}
\ No newline at end of file
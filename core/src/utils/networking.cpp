@@ -1,7 +1,9 @@
 #include <utils/networking.h>
+#include <utils/reactor.h>
 #include <assert.h>
 #include <utils/flog.h>
 #include <stdexcept>
+#include <string.h>
 
 namespace net {
 
@@ -9,17 +11,55 @@ namespace net {
     extern bool winsock_init = false;
 #endif
 
-    ConnClass::ConnClass(Socket sock, struct sockaddr_in raddr, bool udp) {
+    // Sockets are only non-blocking when handled by a reactor
+    static void setNonBlocking(Socket sock) {
+#ifndef _WIN32
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    }
+
+    static bool wouldBlock() {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+    }
+
+    static bool waitForSocket(Socket sock, bool write) {
+#ifdef _WIN32
+        WSAPOLLFD pfd = { sock, (SHORT)(write ? POLLOUT : POLLIN), 0 };
+        return WSAPoll(&pfd, 1, -1) > 0;
+#else
+        struct pollfd pfd = { sock, (short)(write ? POLLOUT : POLLIN), 0 };
+        int ret;
+        do {
+            ret = poll(&pfd, 1, -1);
+        } while (ret < 0 && errno == EINTR);
+        return ret > 0;
+#endif
+    }
+
+    ConnClass::ConnClass(Socket sock, struct sockaddr_in raddr, bool udp, Reactor* reactor) {
         _sock = sock;
         _udp = udp;
+        _reactor = reactor;
         remoteAddr = raddr;
         connectionOpen = true;
+
+        // Either let the reactor call us when the socket is ready or start our own workers
+        if (_reactor) {
+            setNonBlocking(_sock);
+            reactorId = _reactor->add(_sock, reactorHandler, this);
+            return;
+        }
         readWorkerThread = std::thread(&ConnClass::readWorker, this);
         writeWorkerThread = std::thread(&ConnClass::writeWorker, this);
     }
 
     ConnClass::~ConnClass() {
         ConnClass::close();
+        clearWritePool();
     }
 
     void ConnClass::close() {
@@ -34,6 +74,18 @@ namespace net {
         // Notify the workers of the change
         readQueueCnd.notify_all();
         writeQueueCnd.notify_all();
+        writePoolCnd.notify_all();
+
+        // Wake up a handler waiting on the socket, wait for it to return and give back the queued buffers
+        if (reactorId >= 0) {
+#ifndef _WIN32
+            ::shutdown(_sock, SHUT_RDWR);
+#endif
+            _reactor->remove(reactorId);
+            reactorId = -1;
+            std::lock_guard wlck(writeMtx);
+            stopWriter();
+        }
 
         if (connectionOpen) {
 #ifdef _WIN32
@@ -71,7 +123,9 @@ namespace net {
 
         if (_udp) {
             socklen_t fromLen = sizeof(remoteAddr);
-            ret = recvfrom(_sock, (char*)buf, count, 0, (struct sockaddr*)&remoteAddr, &fromLen);
+            do {
+                ret = recvfrom(_sock, (char*)buf, count, 0, (struct sockaddr*)&remoteAddr, &fromLen);
+            } while (ret < 0 && _reactor && wouldBlock() && waitForSocket(_sock, false));
             if (ret <= 0) {
                 {
                     std::lock_guard lck(connectionOpenMtx);
@@ -86,6 +140,7 @@ namespace net {
         int beenRead = 0;
         while (beenRead < count) {
             ret = recv(_sock, (char*)&buf[beenRead], count - beenRead, 0);
+            if (ret < 0 && _reactor && wouldBlock() && waitForSocket(_sock, false)) { continue; }
 
             if (ret <= 0) {
                 {
@@ -109,8 +164,17 @@ namespace net {
         std::lock_guard lck(writeMtx);
         int ret;
 
+        // Finish sending the buffer the reactor started so that packets don't get mixed up
+        if (_reactor) {
+            if (writeProgress && sendQueued(true) < 0) { return false; }
+            std::lock_guard qlck(writeQueueMtx);
+            if (!writeQueue.empty()) { _reactor->arm(reactorId, REACTOR_EVENT_WRITE); }
+        }
+
         if (_udp) {
-            ret = sendto(_sock, (char*)buf, count, 0, (struct sockaddr*)&remoteAddr, sizeof(remoteAddr));
+            do {
+                ret = sendto(_sock, (char*)buf, count, 0, (struct sockaddr*)&remoteAddr, sizeof(remoteAddr));
+            } while (ret < 0 && _reactor && wouldBlock() && waitForSocket(_sock, true));
             if (ret <= 0) {
                 {
                     std::lock_guard lck(connectionOpenMtx);
@@ -123,7 +187,8 @@ namespace net {
 
         int beenWritten = 0;
         while (beenWritten < count) {
-            ret = send(_sock, (char*)buf, count, 0);
+            ret = send(_sock, (char*)&buf[beenWritten], count - beenWritten, 0);
+            if (ret < 0 && _reactor && wouldBlock() && waitForSocket(_sock, true)) { continue; }
             if (ret <= 0) {
                 {
                     std::lock_guard lck(connectionOpenMtx);
@@ -154,25 +219,182 @@ namespace net {
             readQueue.push_back(entry);
         }
 
-        // Notify read worker
+        // Notify read worker or have the reactor read once data is available
+        if (_reactor) {
+            _reactor->arm(reactorId, REACTOR_EVENT_READ);
+            return;
+        }
         readQueueCnd.notify_all();
     }
 
-    void ConnClass::writeAsync(int count, uint8_t* buf) {
-        if (!connectionOpen) { return; }
-        // Create entry
-        ConnWriteEntry entry;
-        entry.count = count;
-        entry.buf = buf;
+    bool ConnClass::writev(const ConnWritePart* parts, int count) {
+        if (!connectionOpen) { return false; }
+        assert(count <= NET_MAX_WRITE_PARTS);
+        std::lock_guard lck(writeMtx);
 
-        // Add entry to queue
+        // Finish sending the buffer the reactor started so that packets don't get mixed up
+        if (_reactor) {
+            if (writeProgress && sendQueued(true) < 0) { return false; }
+            std::lock_guard qlck(writeQueueMtx);
+            if (!writeQueue.empty()) { _reactor->arm(reactorId, REACTOR_EVENT_WRITE); }
+        }
+
+        // Describe the parts to the OS
+#ifdef _WIN32
+        WSABUF vecs[NET_MAX_WRITE_PARTS];
+        for (int i = 0; i < count; i++) {
+            vecs[i].buf = (char*)parts[i].data;
+            vecs[i].len = parts[i].count;
+        }
+#else
+        struct iovec vecs[NET_MAX_WRITE_PARTS];
+        for (int i = 0; i < count; i++) {
+            vecs[i].iov_base = (void*)parts[i].data;
+            vecs[i].iov_len = parts[i].count;
+        }
+#endif
+
+        // Send until all parts are out, skipping what was already sent when a send is partial
+        int first = 0;
+        while (first < count) {
+            int ret;
+#ifdef _WIN32
+            DWORD sent = 0;
+            int err = _udp ? WSASendTo(_sock, &vecs[first], count - first, &sent, 0, (struct sockaddr*)&remoteAddr, sizeof(remoteAddr), NULL, NULL)
+                           : WSASend(_sock, &vecs[first], count - first, &sent, 0, NULL, NULL);
+            ret = err ? -1 : (int)sent;
+#else
+            struct msghdr msg = {};
+            msg.msg_iov = &vecs[first];
+            msg.msg_iovlen = count - first;
+            if (_udp) {
+                msg.msg_name = &remoteAddr;
+                msg.msg_namelen = sizeof(remoteAddr);
+            }
+            ret = sendmsg(_sock, &msg, 0);
+#endif
+            if (ret < 0 && _reactor && wouldBlock() && waitForSocket(_sock, true)) { continue; }
+            if (ret <= 0) {
+                {
+                    std::lock_guard lck(connectionOpenMtx);
+                    connectionOpen = false;
+                }
+                connectionOpenCnd.notify_all();
+                return false;
+            }
+
+            // A datagram is sent whole or not at all
+            if (_udp) { return true; }
+
+            // Skip the parts that were fully sent and the sent start of the next one
+            while (first < count && ret > 0) {
+#ifdef _WIN32
+                int len = vecs[first].len;
+                if (ret < len) {
+                    vecs[first].buf += ret;
+                    vecs[first].len -= ret;
+                    break;
+                }
+#else
+                int len = vecs[first].iov_len;
+                if (ret < len) {
+                    vecs[first].iov_base = (uint8_t*)vecs[first].iov_base + ret;
+                    vecs[first].iov_len -= ret;
+                    break;
+                }
+#endif
+                ret -= len;
+                first++;
+            }
+        }
+
+        return true;
+    }
+
+    ConnWriteBuffer* ConnClass::acquireWriteBuffer(int size, bool wait) {
+        if (!connectionOpen) { return NULL; }
+        std::unique_lock lck(writeQueueMtx);
+
+        // If all buffers are taken, wait for one to be sent or drop the data
+        if (writeBuffersInUse >= writeQueueDepth && !writerStopped && !stopWorkers) {
+            if (!wait) {
+                droppedWrites++;
+                return NULL;
+            }
+            writePoolCnd.wait(lck, [this]() { return (writeBuffersInUse < writeQueueDepth || writerStopped || stopWorkers); });
+        }
+        if (writerStopped || stopWorkers) { return NULL; }
+        writeBuffersInUse++;
+
+        // Reuse a pooled buffer, growing it if it's too small
+        ConnWriteBuffer* wbuf;
+        if (writePool.empty()) {
+            wbuf = new ConnWriteBuffer;
+            wbuf->buf = NULL;
+            wbuf->capacity = 0;
+        }
+        else {
+            wbuf = writePool.back();
+            writePool.pop_back();
+        }
+        if (wbuf->capacity < size) {
+            delete[] wbuf->buf;
+            wbuf->buf = new uint8_t[size];
+            wbuf->capacity = size;
+        }
+        wbuf->count = 0;
+        return wbuf;
+    }
+
+    void ConnClass::releaseWriteBuffer(ConnWriteBuffer* wbuf) {
+        {
+            std::lock_guard lck(writeQueueMtx);
+            writePool.push_back(wbuf);
+            writeBuffersInUse--;
+        }
+        writePoolCnd.notify_all();
+    }
+
+    bool ConnClass::writeAsync(ConnWriteBuffer* wbuf) {
+        // Add buffer to queue unless the writer is gone
         {
             std::lock_guard lck(writeQueueMtx);
-            writeQueue.push_back(entry);
+            if (writerStopped || stopWorkers) {
+                writePool.push_back(wbuf);
+                writeBuffersInUse--;
+                return false;
+            }
+            writeQueue.push_back(wbuf);
         }
 
-        // Notify write worker
+        // Notify write worker or have the reactor send it once the socket can take it
+        if (_reactor) {
+            _reactor->arm(reactorId, REACTOR_EVENT_WRITE);
+            return true;
+        }
         writeQueueCnd.notify_all();
+        return true;
+    }
+
+    bool ConnClass::writeAsync(int count, const uint8_t* buf, bool wait) {
+        ConnWriteBuffer* wbuf = acquireWriteBuffer(count, wait);
+        if (!wbuf) { return false; }
+        memcpy(wbuf->buf, buf, count);
+        wbuf->count = count;
+        return writeAsync(wbuf);
+    }
+
+    void ConnClass::setWriteQueueDepth(int depth) {
+        {
+            std::lock_guard lck(writeQueueMtx);
+            writeQueueDepth = depth;
+        }
+        writePoolCnd.notify_all();
+    }
+
+    uint64_t ConnClass::getDroppedWrites() {
+        std::lock_guard lck(writeQueueMtx);
+        return droppedWrites;
     }
 
     void ConnClass::readWorker() {
@@ -206,29 +428,184 @@ namespace net {
             // Wait for wakeup and exit if it's for terminating the thread
             std::unique_lock lck(writeQueueMtx);
             writeQueueCnd.wait(lck, [this]() { return (writeQueue.size() > 0 || stopWorkers); });
-            if (stopWorkers || !connectionOpen) { return; }
+            if (stopWorkers || !connectionOpen) { break; }
 
             // Pop first element off the list
-            ConnWriteEntry entry = writeQueue[0];
+            ConnWriteBuffer* wbuf = writeQueue[0];
             writeQueue.erase(writeQueue.begin());
             lck.unlock();
 
-            // Write to socket
-            if (!write(entry.count, entry.buf)) {
+            // Write to socket and give the buffer back to the pool
+            bool ok = write(wbuf->count, wbuf->buf);
+            releaseWriteBuffer(wbuf);
+            if (!ok) {
+                {
+                    std::lock_guard lck(connectionOpenMtx);
+                    connectionOpen = false;
+                }
+                connectionOpenCnd.notify_all();
+                break;
+            }
+        }
+
+        stopWriter();
+    }
+
+    void ConnClass::stopWriter() {
+        // Nothing else will be sent, give back the queued buffers and wake up the senders waiting for one
+        {
+            std::lock_guard lck(writeQueueMtx);
+            writeBuffersInUse -= writeQueue.size();
+            writePool.insert(writePool.end(), writeQueue.begin(), writeQueue.end());
+            writeQueue.clear();
+            writerStopped = true;
+            writeProgress = 0;
+        }
+        writePoolCnd.notify_all();
+    }
+
+    void ConnClass::clearWritePool() {
+        std::lock_guard lck(writeQueueMtx);
+        for (auto& wbuf : writePool) {
+            delete[] wbuf->buf;
+            delete wbuf;
+        }
+        writePool.clear();
+    }
+
+
+    void ConnClass::reactorHandler(int events, void* ctx) {
+        ConnClass* _this = (ConnClass*)ctx;
+        if (events & REACTOR_EVENT_READ) { _this->reactorRead(); }
+        if (events & REACTOR_EVENT_WRITE) { _this->reactorWrite(); }
+    }
+
+    void ConnClass::reactorRead() {
+        // Serve the queued reads with what's available, a few at most so that other connections get their turn
+        for (int i = 0; i < NET_REACTOR_MAX_EVENTS; i++) {
+            ConnReadEntry entry;
+            {
+                std::lock_guard lck(readQueueMtx);
+                if (readQueue.empty() || stopWorkers) { return; }
+                entry = readQueue[0];
+            }
+
+            // Read what's available, remembering how much of the entry is done
+            int ret;
+            {
+                std::lock_guard lck(readMtx);
+                if (_udp) {
+                    socklen_t fromLen = sizeof(remoteAddr);
+                    ret = recvfrom(_sock, (char*)entry.buf, entry.count, 0, (struct sockaddr*)&remoteAddr, &fromLen);
+                }
+                else {
+                    ret = recv(_sock, (char*)&entry.buf[readProgress], entry.count - readProgress, 0);
+                }
+            }
+            if (ret < 0 && wouldBlock()) {
+                _reactor->arm(reactorId, REACTOR_EVENT_READ);
+                return;
+            }
+            if (ret <= 0) {
+                {
+                    std::lock_guard lck(connectionOpenMtx);
+                    connectionOpen = false;
+                }
+                connectionOpenCnd.notify_all();
+                return;
+            }
+            readProgress += ret;
+            if (!_udp && entry.enforceSize && readProgress < entry.count) { continue; }
+
+            // The entry is done, pop it and call its handler
+            {
+                std::lock_guard lck(readQueueMtx);
+                readQueue.erase(readQueue.begin());
+            }
+            int len = readProgress;
+            readProgress = 0;
+            entry.handler(len, entry.buf, entry.ctx);
+        }
+
+        // Come back for the rest
+        _reactor->arm(reactorId, REACTOR_EVENT_READ);
+    }
+
+    void ConnClass::reactorWrite() {
+        // A blocking write in progress arms the reactor again once done
+        std::unique_lock lck(writeMtx, std::try_to_lock);
+        if (!lck.owns_lock()) { return; }
+
+        // Send queued buffers until the socket is full
+        while (true) {
+            int ret = sendQueued(false);
+            if (ret < 0) {
                 {
                     std::lock_guard lck(connectionOpenMtx);
                     connectionOpen = false;
                 }
                 connectionOpenCnd.notify_all();
+                stopWriter();
+                return;
+            }
+            if (!ret) {
+                _reactor->arm(reactorId, REACTOR_EVENT_WRITE);
                 return;
             }
+            std::lock_guard qlck(writeQueueMtx);
+            if (writeQueue.empty()) { return; }
         }
     }
 
+    int ConnClass::sendQueued(bool block) {
+        // Must be called with the write mutex held. Returns 1 once the oldest buffer is sent or if there's none,
+        // 0 if the socket is full and -1 on error.
+        ConnWriteBuffer* wbuf;
+        {
+            std::lock_guard lck(writeQueueMtx);
+            if (writeQueue.empty()) { return 1; }
+            wbuf = writeQueue[0];
+        }
+
+        // Send the rest of the buffer
+        while (writeProgress < wbuf->count) {
+            int ret;
+            if (_udp) {
+                ret = sendto(_sock, (char*)wbuf->buf, wbuf->count, 0, (struct sockaddr*)&remoteAddr, sizeof(remoteAddr));
+            }
+            else {
+                ret = send(_sock, (char*)&wbuf->buf[writeProgress], wbuf->count - writeProgress, 0);
+            }
+            if (ret < 0 && wouldBlock()) {
+                if (!block) { return 0; }
+                if (!waitForSocket(_sock, true)) { return -1; }
+                continue;
+            }
+            if (ret <= 0) { return -1; }
+            writeProgress = _udp ? wbuf->count : (writeProgress + ret);
+        }
+        writeProgress = 0;
+
+        // Pop it and give it back to the pool
+        {
+            std::lock_guard lck(writeQueueMtx);
+            writeQueue.erase(writeQueue.begin());
+        }
+        releaseWriteBuffer(wbuf);
+        return 1;
+    }
 
-    ListenerClass::ListenerClass(Socket listenSock) {
+    ListenerClass::ListenerClass(Socket listenSock, Reactor* reactor) {
         sock = listenSock;
+        _reactor = reactor;
         listening = true;
+
+        // Either let the reactor call us when a client is waiting or start our own worker
+        if (_reactor) {
+            setNonBlocking(sock);
+            reactorId = _reactor->add(sock, reactorHandler, this);
+            return;
+        }
         acceptWorkerThread = std::thread(&ListenerClass::worker, this);
     }
 
@@ -242,7 +619,9 @@ namespace net {
         Socket _sock;
 
         // Accept socket
-        _sock = ::accept(sock, NULL, NULL);
+        do {
+            _sock = ::accept(sock, NULL, NULL);
+        } while (_sock < 0 && _reactor && wouldBlock() && waitForSocket(sock, false));
 #ifdef _WIN32
         if (_sock < 0 || _sock == SOCKET_ERROR) {
 #else
@@ -253,7 +632,7 @@ namespace net {
             return NULL;
         }
 
-        return Conn(new ConnClass(_sock));
+        return Conn(new ConnClass(_sock, {}, false, _reactor));
     }
 
     void ListenerClass::acceptAsync(void (*handler)(Conn conn, void* ctx), void* ctx) {
@@ -269,7 +648,11 @@ namespace net {
             acceptQueue.push_back(entry);
         }
 
-        // Notify write worker
+        // Notify accept worker or have the reactor accept once a client is waiting
+        if (_reactor) {
+            _reactor->arm(reactorId, REACTOR_EVENT_READ);
+            return;
+        }
         acceptQueueCnd.notify_all();
     }
 
@@ -280,6 +663,15 @@ namespace net {
         }
         acceptQueueCnd.notify_all();
 
+        // Wait for the reactor to be done with the socket
+        if (reactorId >= 0) {
+#ifndef _WIN32
+            ::shutdown(sock, SHUT_RDWR);
+#endif
+            _reactor->remove(reactorId);
+            reactorId = -1;
+        }
+
         if (listening) {
 #ifdef _WIN32
             closesocket(sock);
@@ -328,7 +720,42 @@ namespace net {
     }
 
 
-    Conn connect(std::string host, uint16_t port) {
+    void ListenerClass::reactorHandler(int events, void* ctx) {
+        ListenerClass* _this = (ListenerClass*)ctx;
+        while (true) {
+            ListenerAcceptEntry entry;
+            {
+                std::lock_guard lck(_this->acceptQueueMtx);
+                if (_this->acceptQueue.empty() || _this->stopWorker) { return; }
+                entry = _this->acceptQueue[0];
+            }
+
+            // Accept the waiting client, if it's gone wait for the next one
+            Socket _sock = ::accept(_this->sock, NULL, NULL);
+            if (_sock < 0 && wouldBlock()) {
+                _this->_reactor->arm(_this->reactorId, REACTOR_EVENT_READ);
+                return;
+            }
+            if (_sock < 0) {
+                _this->listening = false;
+                return;
+            }
+
+            // Pop the entry and hand the connection to its handler
+            {
+                std::lock_guard lck(_this->acceptQueueMtx);
+                _this->acceptQueue.erase(_this->acceptQueue.begin());
+            }
+            try {
+                entry.handler(Conn(new ConnClass(_sock, {}, false, _this->_reactor)), entry.ctx);
+            }
+            catch (const std::exception& e) {
+                flog::error("Could not handle new connection: {0}", e.what());
+            }
+        }
+    }
+
+    Conn connect(std::string host, uint16_t port, Reactor* reactor) {
         Socket sock;
 
 #ifdef _WIN32
@@ -373,10 +800,10 @@ namespace net {
             return NULL;
         }
 
-        return Conn(new ConnClass(sock));
+        return Conn(new ConnClass(sock, {}, false, reactor));
     }
 
-    Listener listen(std::string host, uint16_t port) {
+    Listener listen(std::string host, uint16_t port, Reactor* reactor) {
         Socket listenSock;
 
 #ifdef _WIN32
@@ -439,10 +866,10 @@ namespace net {
             return NULL;
         }
 
-        return Listener(new ListenerClass(listenSock));
+        return Listener(new ListenerClass(listenSock, reactor));
     }
 
-    Conn openUDP(std::string host, uint16_t port, std::string remoteHost, uint16_t remotePort, bool bindSocket) {
+    Conn openUDP(std::string host, uint16_t port, std::string remoteHost, uint16_t remotePort, bool bindSocket, Reactor* reactor) {
         Socket sock;
 
 #ifdef _WIN32
@@ -503,6 +930,6 @@ namespace net {
             }
         }
 
-        return Conn(new ConnClass(sock, raddr, true));
+        return Conn(new ConnClass(sock, raddr, true, reactor));
     }
 }
\ No newline at end of file
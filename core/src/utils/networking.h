@@ -16,11 +16,21 @@
 #include <strings.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
 #endif
 
+// Max number of parts given to a single ConnClass::writev() call
+#define NET_MAX_WRITE_PARTS         16
+
+// Default number of pooled buffers a connection can have waiting to be sent by writeAsync()
+#define NET_WRITE_QUEUE_DEPTH       16
+
 namespace net {
 #ifdef _WIN32
     typedef SOCKET Socket;
@@ -28,6 +38,8 @@ namespace net {
     typedef int Socket;
 #endif
 
+    class Reactor;
+
     struct ConnReadEntry {
         int count;
         uint8_t* buf;
@@ -36,14 +48,24 @@ namespace net {
         bool enforceSize;
     };
 
-    struct ConnWriteEntry {
+    // Part of the data sent by a single ConnClass::writev() call
+    struct ConnWritePart {
+        const void* data;
         int count;
+    };
+
+    // Buffer from the write pool of a connection, filled in place by the sender then queued with writeAsync()
+    struct ConnWriteBuffer {
         uint8_t* buf;
+        int capacity;
+        int count;
     };
 
+    // Connection running its async reads and writes on two threads of its own, or on a reactor's threads if one is given.
+    // With a reactor the socket is non-blocking and the blocking calls wait for it with poll().
     class ConnClass {
     public:
-        ConnClass(Socket sock, struct sockaddr_in raddr = {}, bool udp = false);
+        ConnClass(Socket sock, struct sockaddr_in raddr = {}, bool udp = false, Reactor* reactor = NULL);
         ~ConnClass();
 
         void close();
@@ -53,11 +75,35 @@ namespace net {
         int read(int count, uint8_t* buf, bool enforceSize = true);
         bool write(int count, uint8_t* buf);
         void readAsync(int count, uint8_t* buf, void (*handler)(int count, uint8_t* buf, void* ctx), void* ctx, bool enforceSize = true);
-        void writeAsync(int count, uint8_t* buf);
+
+        // Send several parts as one write without gathering them in a buffer first. On a UDP connection they form one datagram.
+        bool writev(const ConnWritePart* parts, int count);
+
+        // Get a buffer of at least the given size from the write pool. When all of them are waiting to be sent,
+        // either wait for one to be released or return NULL so that the caller can drop its data.
+        ConnWriteBuffer* acquireWriteBuffer(int size, bool wait = true);
+        void releaseWriteBuffer(ConnWriteBuffer* wbuf);
+
+        // Queue an acquired buffer for sending, it's released once sent
+        bool writeAsync(ConnWriteBuffer* wbuf);
+
+        // Copy the data to a pooled buffer and queue it, returns false if it was dropped
+        bool writeAsync(int count, const uint8_t* buf, bool wait = true);
+
+        void setWriteQueueDepth(int depth);
+        uint64_t getDroppedWrites();
 
     private:
         void readWorker();
         void writeWorker();
+        void stopWriter();
+        void clearWritePool();
+
+        // Reactor mode
+        static void reactorHandler(int events, void* ctx);
+        void reactorRead();
+        void reactorWrite();
+        int sendQueued(bool block);
 
         bool stopWorkers = false;
         bool connectionOpen = false;
@@ -70,14 +116,27 @@ namespace net {
         std::mutex closeMtx;
         std::condition_variable readQueueCnd;
         std::condition_variable writeQueueCnd;
+        std::condition_variable writePoolCnd;
         std::condition_variable connectionOpenCnd;
         std::vector<ConnReadEntry> readQueue;
-        std::vector<ConnWriteEntry> writeQueue;
+        std::vector<ConnWriteBuffer*> writeQueue;
+
+        // Write pool, guarded by the write queue mutex
+        std::vector<ConnWriteBuffer*> writePool;
+        int writeQueueDepth = NET_WRITE_QUEUE_DEPTH;
+        int writeBuffersInUse = 0;
+        bool writerStopped = false;
+        uint64_t droppedWrites = 0;
+
         std::thread readWorkerThread;
         std::thread writeWorkerThread;
 
         Socket _sock;
         bool _udp;
+        Reactor* _reactor;
+        int reactorId = -1;
+        int readProgress = 0;
+        int writeProgress = 0;
         struct sockaddr_in remoteAddr;
     };
 
@@ -90,7 +149,7 @@ namespace net {
 
     class ListenerClass {
     public:
-        ListenerClass(Socket listenSock);
+        ListenerClass(Socket listenSock, Reactor* reactor = NULL);
         ~ListenerClass();
 
         Conn accept();
@@ -101,6 +160,7 @@ namespace net {
 
     private:
         void worker();
+        static void reactorHandler(int events, void* ctx);
 
         bool listening = false;
         bool stopWorker = false;
@@ -112,13 +172,15 @@ namespace net {
         std::thread acceptWorkerThread;
 
         Socket sock;
+        Reactor* _reactor;
+        int reactorId = -1;
     };
 
     typedef std::unique_ptr<ListenerClass> Listener;
 
-    Conn connect(std::string host, uint16_t port);
-    Listener listen(std::string host, uint16_t port);
-    Conn openUDP(std::string host, uint16_t port, std::string remoteHost, uint16_t remotePort, bool bindSocket = true);
+    Conn connect(std::string host, uint16_t port, Reactor* reactor = NULL);
+    Listener listen(std::string host, uint16_t port, Reactor* reactor = NULL);
+    Conn openUDP(std::string host, uint16_t port, std::string remoteHost, uint16_t remotePort, bool bindSocket = true, Reactor* reactor = NULL);
 
 #ifdef _WIN32
     extern bool winsock_init;
@@ -0,0 +1,255 @@
+#include <utils/reactor.h>
+#include <utils/flog.h>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#endif
+
+namespace net {
+#ifdef __linux__
+    Reactor::Reactor(int threads) {
+        // Create the epoll instance and the event used to wake up the threads when stopping
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            throw std::runtime_error("Could not create epoll instance");
+        }
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            ::close(epollFd);
+            throw std::runtime_error("Could not create wake-up event");
+        }
+
+        // ID 0 is reserved for the wake-up event, it's level triggered so that it wakes up every thread
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+
+        // Start the threads
+        threads = std::max<int>(threads, 1);
+        for (int i = 0; i < threads; i++) {
+            workerThreads.push_back(std::thread(&Reactor::worker, this));
+        }
+    }
+
+    Reactor::~Reactor() {
+        // Wake up and stop the threads
+        stopWorkers = true;
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            flog::error("Could not wake up the reactor threads");
+        }
+        for (auto& t : workerThreads) {
+            if (t.joinable()) { t.join(); }
+        }
+
+        // Close the timers left behind
+        for (auto& [id, timer] : timers) {
+            ::close(timer->fd);
+        }
+
+        ::close(wakeFd);
+        ::close(epollFd);
+    }
+
+    int Reactor::add(int fd, void (*handler)(int events, void* ctx), void* ctx) {
+        auto reg = std::make_shared<Registration>();
+        reg->fd = fd;
+        reg->handler = handler;
+        reg->ctx = ctx;
+
+        // Register it disarmed, no event is reported until arm() is called
+        int id;
+        {
+            std::lock_guard<std::mutex> lck(regMtx);
+            id = nextId++;
+            reg->id = id;
+            registrations[id] = reg;
+        }
+        struct epoll_event ev = {};
+        ev.events = EPOLLONESHOT;
+        ev.data.u64 = id;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            std::lock_guard<std::mutex> lck(regMtx);
+            registrations.erase(id);
+            throw std::runtime_error("Could not add file descriptor to the reactor");
+        }
+        return id;
+    }
+
+    void Reactor::arm(int id, int events) {
+        std::shared_ptr<Registration> reg;
+        {
+            std::lock_guard<std::mutex> lck(regMtx);
+            auto it = registrations.find(id);
+            if (it == registrations.end()) { return; }
+            reg = it->second;
+        }
+
+        // If the handler is running, it's armed once it returns
+        std::lock_guard<std::mutex> lck(reg->mtx);
+        if (reg->removed) { return; }
+        reg->armed |= events;
+        if (!reg->running) { update(reg.get()); }
+    }
+
+    void Reactor::remove(int id) {
+        std::shared_ptr<Registration> reg;
+        {
+            std::lock_guard<std::mutex> lck(regMtx);
+            auto it = registrations.find(id);
+            if (it == registrations.end()) { return; }
+            reg = it->second;
+            registrations.erase(it);
+        }
+
+        // Events already taken by a thread are ignored since the registration is marked as removed
+        std::unique_lock<std::mutex> lck(reg->mtx);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, reg->fd, NULL);
+        reg->removed = true;
+        reg->runningCnd.wait(lck, [&reg]() { return !reg->running; });
+    }
+
+    int Reactor::addTimer(int intervalMs, void (*handler)(void* ctx), void* ctx) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Could not create timer");
+        }
+
+        // Set the period
+        struct itimerspec spec = {};
+        spec.it_interval.tv_sec = intervalMs / 1000;
+        spec.it_interval.tv_nsec = (long)(intervalMs % 1000) * 1000000L;
+        spec.it_value = spec.it_interval;
+        timerfd_settime(fd, 0, &spec, NULL);
+
+        // A timer is a registration that reads its expirations and calls the handler
+        auto timer = std::make_unique<Timer>();
+        timer->reactor = this;
+        timer->fd = fd;
+        timer->handler = handler;
+        timer->ctx = ctx;
+        int id;
+        try {
+            id = add(fd, timerHandler, timer.get());
+        }
+        catch (const std::exception& e) {
+            ::close(fd);
+            throw;
+        }
+        timer->regId = id;
+        {
+            std::lock_guard<std::mutex> lck(regMtx);
+            timers[id] = std::move(timer);
+        }
+        arm(id, REACTOR_EVENT_READ);
+        return id;
+    }
+
+    void Reactor::removeTimer(int id) {
+        remove(id);
+        std::lock_guard<std::mutex> lck(regMtx);
+        auto it = timers.find(id);
+        if (it == timers.end()) { return; }
+        ::close(it->second->fd);
+        timers.erase(it);
+    }
+
+    int Reactor::getThreadCount() {
+        return workerThreads.size();
+    }
+
+    void Reactor::worker() {
+        struct epoll_event events[NET_REACTOR_MAX_EVENTS];
+        while (!stopWorkers) {
+            int count = epoll_wait(epollFd, events, NET_REACTOR_MAX_EVENTS, -1);
+            if (count < 0) {
+                if (errno == EINTR) { continue; }
+                flog::error("Reactor wait failed: {0}", errno);
+                return;
+            }
+            for (int i = 0; i < count && !stopWorkers; i++) {
+                if (!events[i].data.u64) { continue; }
+                dispatch(events[i].data.u64, events[i].events);
+            }
+        }
+    }
+
+    void Reactor::dispatch(int id, uint32_t events) {
+        std::shared_ptr<Registration> reg;
+        {
+            std::lock_guard<std::mutex> lck(regMtx);
+            auto it = registrations.find(id);
+            if (it == registrations.end()) { return; }
+            reg = it->second;
+        }
+
+        // Take the events it was armed for, an error or hang-up fails any of them
+        int fired = 0;
+        {
+            std::lock_guard<std::mutex> lck(reg->mtx);
+            if (reg->removed || reg->running) { return; }
+            if (events & (EPOLLERR | EPOLLHUP)) { fired = reg->armed; }
+            if (events & EPOLLIN) { fired |= (reg->armed & REACTOR_EVENT_READ); }
+            if (events & EPOLLOUT) { fired |= (reg->armed & REACTOR_EVENT_WRITE); }
+            reg->armed &= ~fired;
+            if (!fired) {
+                update(reg.get());
+                return;
+            }
+            reg->running = true;
+        }
+
+        reg->handler(fired, reg->ctx);
+
+        // Arm it again for what's still wanted, including what the handler asked for
+        {
+            std::lock_guard<std::mutex> lck(reg->mtx);
+            reg->running = false;
+            if (!reg->removed) { update(reg.get()); }
+        }
+        reg->runningCnd.notify_all();
+    }
+
+    void Reactor::update(Registration* reg) {
+        // Must be called with the registration's mutex held
+        if (!reg->armed) { return; }
+        struct epoll_event ev = {};
+        ev.events = EPOLLONESHOT;
+        if (reg->armed & REACTOR_EVENT_READ) { ev.events |= EPOLLIN; }
+        if (reg->armed & REACTOR_EVENT_WRITE) { ev.events |= EPOLLOUT; }
+        ev.data.u64 = reg->id;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, reg->fd, &ev);
+    }
+
+    void Reactor::timerHandler(int events, void* ctx) {
+        Timer* timer = (Timer*)ctx;
+
+        // Acknowledge the expirations and keep the timer armed
+        uint64_t expirations;
+        if (read(timer->fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            timer->handler(timer->ctx);
+        }
+        timer->reactor->arm(timer->regId, REACTOR_EVENT_READ);
+    }
+#else
+    Reactor::Reactor(int threads) {
+        throw std::runtime_error("The reactor is not supported on this platform");
+    }
+
+    Reactor::~Reactor() {}
+
+    int Reactor::add(int fd, void (*handler)(int events, void* ctx), void* ctx) { return -1; }
+    void Reactor::arm(int id, int events) {}
+    void Reactor::remove(int id) {}
+    int Reactor::addTimer(int intervalMs, void (*handler)(void* ctx), void* ctx) { return -1; }
+    void Reactor::removeTimer(int id) {}
+    int Reactor::getThreadCount() { return 0; }
+#endif
+}
\ No newline at end of file
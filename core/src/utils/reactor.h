@@ -0,0 +1,82 @@
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+
+// Max number of events taken by a reactor thread at once
+#define NET_REACTOR_MAX_EVENTS  64
+
+namespace net {
+    enum ReactorEvent {
+        REACTOR_EVENT_READ  = (1 << 0),
+        REACTOR_EVENT_WRITE = (1 << 1)
+    };
+
+    // Event loop calling handlers when file descriptors are ready or timers expire, on a fixed number of threads.
+    // A registration only gets the events it was armed for, once: it's disarmed while its handler runs, so the handler
+    // never runs on two threads at once and has to arm it again to get more events. Errors and hang-ups are reported
+    // as all the armed events so that the handler sees them when it tries to read or write.
+    // Only available on Linux (epoll), the constructor throws elsewhere.
+    class Reactor {
+    public:
+        Reactor(int threads = 1);
+        ~Reactor();
+
+        // Returns the ID of the registration
+        int add(int fd, void (*handler)(int events, void* ctx), void* ctx);
+
+        // Can be called from any thread, including the handler itself
+        void arm(int id, int events);
+
+        // Waits for the handler to return if it's running, so it can't be called from the handler
+        void remove(int id);
+
+        // Periodic timer, returns its ID
+        int addTimer(int intervalMs, void (*handler)(void* ctx), void* ctx);
+        void removeTimer(int id);
+
+        int getThreadCount();
+
+    private:
+        struct Registration {
+            int id;
+            int fd;
+            void (*handler)(int events, void* ctx);
+            void* ctx;
+            int armed = 0;
+            bool running = false;
+            bool removed = false;
+            std::mutex mtx;
+            std::condition_variable runningCnd;
+        };
+
+        struct Timer {
+            Reactor* reactor;
+            int fd;
+            int regId;
+            void (*handler)(void* ctx);
+            void* ctx;
+        };
+
+        void worker();
+        void dispatch(int id, uint32_t events);
+        void update(Registration* reg);
+        static void timerHandler(int events, void* ctx);
+
+        int epollFd = -1;
+        int wakeFd = -1;
+        std::atomic<bool> stopWorkers = false;
+
+        std::mutex regMtx;
+        std::map<int, std::shared_ptr<Registration>> registrations;
+        std::map<int, std::unique_ptr<Timer>> timers;
+        int nextId = 1;
+
+        std::vector<std::thread> workerThreads;
+    };
+}
\ No newline at end of file
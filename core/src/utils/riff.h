@@ -4,6 +4,7 @@
 #include <string>
 #include <stack>
 #include <stdint.h>
+#include "async_file.h"
 
 namespace riff {
 #pragma pack(push, 1)
@@ -15,7 +16,7 @@ namespace riff {
 
     struct ChunkDesc {
         ChunkHeader hdr;
-        std::streampos pos;
+        uint64_t pos;
     };
 
     class Writer {
@@ -24,7 +25,7 @@ namespace riff {
         // Writer(const Writer&& b);
         ~Writer();
 
-        bool open(std::string path, const char form[4]);
+        bool open(std::string path, const char form[4], const utils::AsyncFileOptions& options = utils::AsyncFileOptions());
         bool isOpen();
         void close();
 
@@ -34,14 +35,20 @@ namespace riff {
         void beginChunk(const char id[4]);
         void endChunk();
 
-        void write(const uint8_t* data, size_t len);
+        // Returns false if the data was dropped because the disk couldn't keep up
+        bool write(const uint8_t* data, size_t len);
+
+        uint64_t getOverruns();
+        uint64_t getDroppedBytes();
+        float getBufferUsage();
+        bool hasFailed();
 
     private:
         void beginRIFF(const char form[4]);
         void endRIFF();
 
         std::recursive_mutex mtx;
-        std::ofstream file;
+        utils::AsyncFile file;
         std::stack<ChunkDesc> chunks;
     };
 
@@ -40,6 +40,7 @@ namespace wav {
 
         // Reset work values
         samplesWritten = 0;
+        samplesDropped = 0;
 
         // Fill header
         bytesPerSamp = (SAMP_BITS[_type] / 8) * _channels;
@@ -69,7 +70,7 @@ namespace wav {
         }
 
         // Open file
-        if (!rw.open(path, WAVE_FILE_TYPE)) { return false; }
+        if (!rw.open(path, WAVE_FILE_TYPE, fileOptions)) { return false; }
 
         // Write format chunk
         rw.beginChunk(FORMAT_MARKER);
@@ -147,37 +148,58 @@ namespace wav {
         _type = type;
     }
 
-    void Writer::write(float* samples, int count) {
+    void Writer::setDirectIO(bool enabled) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
-        if (!rw.isOpen()) { return; }
+        // Do not allow settings to change while open
+        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        fileOptions.direct = enabled;
+    }
+
+    void Writer::setPreallocate(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        fileOptions.preallocate = enabled;
+    }
+
+    bool Writer::write(float* samples, int count) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        if (!rw.isOpen()) { return false; }
         
         // Select different writer function depending on the chose depth
         int tcount = count * _channels;
         int tbytes = count * bytesPerSamp;
+        bool written = false;
         switch (_type) {
         case SAMP_TYPE_UINT8:
             // Volk doesn't support unsigned ints yet :/
             for (int i = 0; i < tcount; i++) {
                 bufU8[i] = (samples[i] * 127.0f) + 128.0f;
             }
-            rw.write(bufU8, tbytes);
+            written = rw.write(bufU8, tbytes);
             break;
         case SAMP_TYPE_INT16:
             volk_32f_s32f_convert_16i(bufI16, samples, 32767.0f, tcount);
-            rw.write((uint8_t*)bufI16, tbytes);
+            written = rw.write((uint8_t*)bufI16, tbytes);
             break;
         case SAMP_TYPE_INT32:
             volk_32f_s32f_convert_32i(bufI32, samples, 2147483647.0f, tcount);
-            rw.write((uint8_t*)bufI32, tbytes);
+            written = rw.write((uint8_t*)bufI32, tbytes);
             break;
         case SAMP_TYPE_FLOAT32:
-            rw.write((uint8_t*)samples, tbytes);
+            written = rw.write((uint8_t*)samples, tbytes);
             break;
         default:
             break;
         }
 
-        // Increment sample counter
-        samplesWritten += count;
+        // Increment sample counters
+        if (written) {
+            samplesWritten += count;
+        }
+        else {
+            samplesDropped += count;
+        }
+        return written;
     }
 }
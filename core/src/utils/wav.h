@@ -47,10 +47,20 @@ namespace wav {
         void setSamplerate(uint64_t samplerate);
         void setFormat(Format format);
         void setSampleType(SampleType type);
+        void setDirectIO(bool enabled);
+        void setPreallocate(bool enabled);
 
         size_t getSamplesWritten() { return samplesWritten; }
+        size_t getSamplesDropped() { return samplesDropped; }
+        uint64_t getOverruns() { return rw.getOverruns(); }
+        uint64_t getDroppedBytes() { return rw.getDroppedBytes(); }
+        float getBufferUsage() { return rw.getBufferUsage(); }
 
-        void write(float* samples, int count);
+        // Set once writing to the file failed, nothing more can be written
+        bool hasFailed() { return rw.hasFailed(); }
+
+        // Never waits for the disk, returns false if the samples were dropped
+        bool write(float* samples, int count);
 
     private:
         std::recursive_mutex mtx;
@@ -61,11 +71,13 @@ namespace wav {
         uint64_t _samplerate;
         Format _format;
         SampleType _type;
+        utils::AsyncFileOptions fileOptions;
         size_t bytesPerSamp;
 
         uint8_t* bufU8 = NULL;
         int16_t* bufI16 = NULL;
         int32_t* bufI32 = NULL;
         size_t samplesWritten = 0;
+        size_t samplesDropped = 0;
     };
 }
@@ -9,6 +9,7 @@
 #include <utils/optionlist.h>
 #include "decoder.h"
 #include "pocsag/decoder.h"
+#include "pocsag/farm_decoder.h"
 #include "flex/decoder.h"
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
@@ -156,6 +157,9 @@ MOD_EXPORT void _INIT_() {
     config.setPath(core::args["root"].s() + "/pager_decoder_config.json");
     config.load(def);
     config.enableAutoSave();
+
+    // FLEX isn't offered to the decoder farm until its decoder is implemented
+    sigpath::decoderFarm.registerDecoder("pocsag", { POCSAGFarmDecoder::getChannelParams, POCSAGFarmDecoder::create, NULL });
 }
 
 MOD_EXPORT ModuleManager::Instance* _CREATE_INSTANCE_(std::string name) {
@@ -167,6 +171,7 @@ MOD_EXPORT void _DELETE_INSTANCE_(void* instance) {
 }
 
 MOD_EXPORT void _END_() {
+    sigpath::decoderFarm.unregisterDecoder("pocsag");
     config.disableAutoSave();
     config.save();
 }
@@ -15,11 +15,12 @@ class POCSAGDSP : public dsp::Processor<dsp::complex_t, uint8_t> {
     using base_type = dsp::Processor<dsp::complex_t, uint8_t>;
 public:
     POCSAGDSP() {}
-    POCSAGDSP(dsp::stream<dsp::complex_t>* in, double samplerate, double baudrate) { init(in, samplerate, baudrate); }
+    POCSAGDSP(dsp::stream<dsp::complex_t>* in, double samplerate, double baudrate, bool enableSoft = true) { init(in, samplerate, baudrate, enableSoft); }
 
-    void init(dsp::stream<dsp::complex_t>* in, double samplerate, double baudrate) {
+    void init(dsp::stream<dsp::complex_t>* in, double samplerate, double baudrate, bool enableSoft = true) {
         // Save settings
         _samplerate = samplerate;
+        this->enableSoft = enableSoft;
 
         // Configure blocks
         demod.init(NULL, -4500.0, samplerate);
@@ -60,7 +61,7 @@ public:
 
         base_type::_in->flush();
         if (!base_type::out.swap(count)) { return -1; }
-        if (count) { if (!soft.swap(count)) { return -1; } }
+        if (count && enableSoft) { if (!soft.swap(count)) { return -1; } }
         return count;
     }
 
@@ -73,4 +74,5 @@ private:
     dsp::clock_recovery::MM<float> recov;
 
     double _samplerate;
+    bool enableSoft = true;
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#include <signal_path/decoder_farm.h>
+#include <dsp/sink/handler_sink.h>
+#include "dsp.h"
+#include "pocsag.h"
+
+#define FARM_SAMPLERATE 24000.0
+#define FARM_BANDWIDTH  12500.0
+
+// POCSAG decoder for the decoder farm, the chain of the GUI decoder without the symbol diagram
+class POCSAGFarmDecoder : public DecoderFarm::ChannelDecoder {
+public:
+    POCSAGFarmDecoder(dsp::stream<dsp::complex_t>* in, double baudrate) {
+        dsp.init(in, FARM_SAMPLERATE, baudrate, false);
+        dataHandler.init(&dsp.out, _dataHandler, this);
+        decoder.onMessage.bind(&POCSAGFarmDecoder::messageHandler, this);
+    }
+
+    ~POCSAGFarmDecoder() {
+        stop();
+    }
+
+    void start() {
+        dsp.start();
+        dataHandler.start();
+    }
+
+    void stop() {
+        dsp.stop();
+        dataHandler.stop();
+    }
+
+    std::vector<dsp::block*> getBlocks() {
+        return { &dsp, &dataHandler };
+    }
+
+    static void getChannelParams(const json& params, double& samplerate, double& bandwidth, void* ctx) {
+        samplerate = FARM_SAMPLERATE;
+        bandwidth = FARM_BANDWIDTH;
+    }
+
+    static DecoderFarm::ChannelDecoder* create(dsp::stream<dsp::complex_t>* in, const json& params, void* ctx) {
+        return new POCSAGFarmDecoder(in, params.value("baudrate", 2400.0));
+    }
+
+private:
+    static void _dataHandler(uint8_t* data, int count, void* ctx) {
+        POCSAGFarmDecoder* _this = (POCSAGFarmDecoder*)ctx;
+        _this->symbols += count;
+        _this->decoder.process(data, count);
+    }
+
+    void messageHandler(pocsag::Address addr, pocsag::MessageType type, const std::string& msg) {
+        json fields;
+        fields["address"] = addr;
+        fields["type"] = (type == pocsag::MESSAGE_TYPE_ALPHANUMERIC) ? "alphanumeric" : "numeric";
+        fields["message"] = msg;
+        onMessage(fields);
+    }
+
+    POCSAGDSP dsp;
+    dsp::sink::Handler<uint8_t> dataHandler;
+    pocsag::Decoder decoder;
+};
+
+#undef FARM_SAMPLERATE
+#undef FARM_BANDWIDTH
\ No newline at end of file
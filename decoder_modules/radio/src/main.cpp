@@ -1,4 +1,5 @@
 #include "radio_module.h"
+#include "rds_farm_decoder.h"
 
 SDRPP_MOD_INFO{
     /* Name:            */ "radio",
@@ -13,6 +14,8 @@ MOD_EXPORT void _INIT_() {
     config.setPath(core::args["root"].s() + "/radio_config.json");
     config.load(def);
     config.enableAutoSave();
+
+    sigpath::decoderFarm.registerDecoder("rds", { RDSFarmDecoder::getChannelParams, RDSFarmDecoder::create, NULL });
 }
 
 MOD_EXPORT ModuleManager::Instance* _CREATE_INSTANCE_(std::string name) {
@@ -24,6 +27,7 @@ MOD_EXPORT void _DELETE_INSTANCE_(void* instance) {
 }
 
 MOD_EXPORT void _END_() {
+    sigpath::decoderFarm.unregisterDecoder("rds");
     config.disableAutoSave();
     config.save();
 }
\ No newline at end of file
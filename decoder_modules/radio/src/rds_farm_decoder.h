@@ -0,0 +1,152 @@
+#pragma once
+#include <signal_path/decoder_farm.h>
+#include <dsp/processor.h>
+#include <dsp/demod/quadrature.h>
+#include <dsp/convert/real_to_complex.h>
+#include <dsp/channel/frequency_xlator.h>
+#include <dsp/multirate/rational_resampler.h>
+#include <dsp/sink/handler_sink.h>
+#include "rds_demod.h"
+#include "rds.h"
+
+#define RDS_FARM_SAMPLERATE 250000.0
+#define RDS_FARM_BANDWIDTH  150000.0
+
+// RDS symbols straight from a broadcast FM channel, without demodulating the audio like BroadcastFM does
+class RDSFarmDSP : public dsp::Processor<dsp::complex_t, uint8_t> {
+    using base_type = dsp::Processor<dsp::complex_t, uint8_t>;
+public:
+    RDSFarmDSP() {}
+
+    RDSFarmDSP(dsp::stream<dsp::complex_t>* in) { init(in); }
+
+    void init(dsp::stream<dsp::complex_t>* in) {
+        demod.init(NULL, 75000.0, RDS_FARM_SAMPLERATE);
+        rtoc.init(NULL);
+        xlator.init(NULL, -57000.0, RDS_FARM_SAMPLERATE);
+        resamp.init(NULL, RDS_FARM_SAMPLERATE, 5000.0);
+        rds.init(NULL, false);
+
+        // Free useless buffers
+        xlator.out.free();
+        rds.out.free();
+        rds.soft.free();
+
+        base_type::init(in);
+    }
+
+    inline int process(int count, dsp::complex_t* in, uint8_t* out) {
+        // Extract the RDS subcarrier of the MPX signal, the outputs of the children are used as scratch space
+        demod.process(count, in, demod.out.writeBuf);
+        rtoc.process(count, demod.out.writeBuf, rtoc.out.writeBuf);
+        xlator.process(count, rtoc.out.writeBuf, rtoc.out.writeBuf);
+        count = resamp.process(count, rtoc.out.writeBuf, resamp.out.writeBuf);
+
+        // Demodulate
+        return rds.process(count, resamp.out.writeBuf, (float*)rtoc.out.writeBuf, out);
+    }
+
+    int getOutputSize(int inputSize) { return resamp.getOutputSize(inputSize); }
+
+    int run() {
+        int count = base_type::_in->read();
+        if (count < 0) { return -1; }
+        base_type::updateSizes(count);
+
+        count = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+
+        base_type::_in->flush();
+        if (count) {
+            if (!base_type::out.swap(count)) { return -1; }
+        }
+        return count;
+    }
+
+private:
+    void resizeBuffers(int inputSize) {
+        demod.out.setBufferSize(inputSize);
+        rtoc.setMaxInputSize(inputSize);
+        rtoc.out.setBufferSize(inputSize);
+        resamp.setMaxInputSize(inputSize);
+        resamp.out.setBufferSize(resamp.getOutputSize(inputSize));
+    }
+
+    dsp::demod::Quadrature demod;
+    dsp::convert::RealToComplex rtoc;
+    dsp::channel::FrequencyXlator xlator;
+    dsp::multirate::RationalResampler<dsp::complex_t> resamp;
+    RDSDemod rds;
+};
+
+// RDS decoder for the decoder farm, a message is sent each time the decoded station info changes
+class RDSFarmDecoder : public DecoderFarm::ChannelDecoder {
+public:
+    RDSFarmDecoder(dsp::stream<dsp::complex_t>* in, bool northAmerica) {
+        this->northAmerica = northAmerica;
+        dsp.init(in);
+        dataHandler.init(&dsp.out, _dataHandler, this);
+    }
+
+    ~RDSFarmDecoder() {
+        stop();
+    }
+
+    void start() {
+        dsp.start();
+        dataHandler.start();
+    }
+
+    void stop() {
+        dsp.stop();
+        dataHandler.stop();
+    }
+
+    std::vector<dsp::block*> getBlocks() {
+        return { &dsp, &dataHandler };
+    }
+
+    static void getChannelParams(const json& params, double& samplerate, double& bandwidth, void* ctx) {
+        samplerate = RDS_FARM_SAMPLERATE;
+        bandwidth = RDS_FARM_BANDWIDTH;
+    }
+
+    static DecoderFarm::ChannelDecoder* create(dsp::stream<dsp::complex_t>* in, const json& params, void* ctx) {
+        return new RDSFarmDecoder(in, params.value("region", std::string("eu")) == "na");
+    }
+
+private:
+    static void _dataHandler(uint8_t* data, int count, void* ctx) {
+        RDSFarmDecoder* _this = (RDSFarmDecoder*)ctx;
+        _this->symbols += count;
+        _this->decoder.process(data, count);
+        _this->update();
+    }
+
+    void update() {
+        // Only the valid fields are sent
+        json fields = json::object();
+        if (decoder.piCodeValid()) {
+            fields["pi"] = decoder.getPICode();
+            if (northAmerica) { fields["callsign"] = decoder.getCallsign(); }
+        }
+        if (decoder.programTypeValid()) {
+            rds::ProgramType pty = decoder.getProgramType();
+            fields["programType"] = northAmerica ? rds::PROGRAM_TYPE_US_TO_STR[pty] : rds::PROGRAM_TYPE_EU_TO_STR[pty];
+        }
+        if (decoder.PSNameValid()) { fields["ps"] = decoder.getPSName(); }
+        if (decoder.radioTextValid()) { fields["radioText"] = decoder.getRadioText(); }
+
+        if (fields.empty() || fields == lastFields) { return; }
+        lastFields = fields;
+        onMessage(fields);
+    }
+
+    RDSFarmDSP dsp;
+    dsp::sink::Handler<uint8_t> dataHandler;
+    rds::Decoder decoder;
+    bool northAmerica;
+    json lastFields;
+};
+
+#undef RDS_FARM_SAMPLERATE
+#undef RDS_FARM_BANDWIDTH
\ No newline at end of file
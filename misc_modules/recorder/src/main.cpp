@@ -82,6 +82,12 @@ public:
         if (config.conf[name].contains("ignoreSilence")) {
             ignoreSilence = config.conf[name]["ignoreSilence"];
         }
+        if (config.conf[name].contains("directIO")) {
+            directIO = config.conf[name]["directIO"];
+        }
+        if (config.conf[name].contains("preallocate")) {
+            preallocate = config.conf[name]["preallocate"];
+        }
         if (config.conf[name].contains("nameTemplate")) {
             std::string _nameTemplate = config.conf[name]["nameTemplate"];
             if (_nameTemplate.length() > sizeof(nameTemplate)-1) {
@@ -166,6 +172,8 @@ public:
         writer.setChannels((recMode == RECORDER_MODE_AUDIO && !stereo) ? 1 : 2);
         writer.setSampleType(sampleTypes[sampleTypeId]);
         writer.setSamplerate(samplerate);
+        writer.setDirectIO(directIO);
+        writer.setPreallocate(preallocate);
 
         // Open file
         std::string vfoName = (recMode == RECORDER_MODE_AUDIO) ? selectedStreamName : "";
@@ -175,6 +183,7 @@ public:
             flog::error("Failed to open file for recording: {0}", expandedPath);
             return;
         }
+        writeFailed = false;
 
         // Open audio stream or baseband
         if (recMode == RECORDER_MODE_AUDIO) {
@@ -218,8 +227,12 @@ public:
             delete basebandStream;
         }
 
-        // Close file
+        // Close file, the bytes dropped by a write error are only known once the last buffer has been handled
         writer.close();
+        if (writer.hasFailed()) {
+            writeFailed = true;
+            failedDroppedBytes = writer.getDroppedBytes();
+        }
         
         recording = false;
     }
@@ -282,6 +295,17 @@ private:
             config.release(true);
         }
 
+        if (ImGui::Checkbox(CONCAT("Direct I/O##_recorder_direct_", _this->name), &_this->directIO)) {
+            config.acquire();
+            config.conf[_this->name]["directIO"] = _this->directIO;
+            config.release(true);
+        }
+        if (ImGui::Checkbox(CONCAT("Preallocate##_recorder_prealloc_", _this->name), &_this->preallocate)) {
+            config.acquire();
+            config.conf[_this->name]["preallocate"] = _this->preallocate;
+            config.release(true);
+        }
+
         if (_this->recording) { style::endDisabled(); }
 
         // Show additional audio options
@@ -329,11 +353,19 @@ private:
         // Record button
         bool canRecord = _this->folderSelect.pathIsValid();
         if (_this->recMode == RECORDER_MODE_AUDIO) { canRecord &= !_this->selectedStreamName.empty(); }
+        // Nothing more can be written once the file failed, so stop right away
+        if (_this->recording && _this->writer.hasFailed()) {
+            flog::error("Recording stopped after a write error");
+            _this->stop();
+        }
         if (!_this->recording) {
             if (ImGui::Button(CONCAT("Record##_recorder_rec_", _this->name), ImVec2(menuWidth, 0))) {
                 _this->start();
             }
             ImGui::TextColored(ImGui::GetStyleColorVec4(ImGuiCol_Text), "Idle --:--:--");
+            if (_this->writeFailed) {
+                ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Write error, %.1lfMB dropped", (double)_this->failedDroppedBytes / (1024.0 * 1024.0));
+            }
         }
         else {
             if (ImGui::Button(CONCAT("Stop##_recorder_rec_", _this->name), ImVec2(menuWidth, 0))) {
@@ -349,6 +381,14 @@ private:
             else {
                 ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Recording %02d:%02d:%02d", dtm->tm_hour, dtm->tm_min, dtm->tm_sec);
             }
+
+            // Share of the disk buffers waiting to be written, and samples dropped because the disk couldn't keep up
+            ImGui::Text("Disk buffer: %d%%", (int)(_this->writer.getBufferUsage() * 100.0f));
+            uint64_t overruns = _this->writer.getOverruns();
+            if (overruns) {
+                double lost = (double)_this->writer.getSamplesDropped() / (double)_this->samplerate;
+                ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Overruns: %d (%.3lfs lost)", (int)overruns, lost);
+            }
         }
     }
 
@@ -575,10 +615,14 @@ private:
     std::string selectedStreamName = "";
     float audioVolume = 1.0f;
     bool ignoreSilence = false;
+    bool directIO = false;
+    bool preallocate = false;
     dsp::stereo_t audioLvl = { -100.0f, -100.0f };
 
     bool recording = false;
     bool ignoringSilence = false;
+    bool writeFailed = false;
+    uint64_t failedDroppedBytes = 0;
     wav::Writer writer;
     std::recursive_mutex recMtx;
     dsp::stream<dsp::complex_t>* basebandStream;
@@ -56,8 +56,6 @@ public:
         bool startNow = config.conf[_streamName]["listening"];
         config.release(true);
 
-        netBuf = new int16_t[STREAM_BUFFER_SIZE];
-
         packer.init(_stream->sinkOut, 512);
         s2m.init(&packer.out);
         monoSink.init(&s2m.out, monoHandler, this);
@@ -103,7 +101,6 @@ public:
 
     ~NetworkSink() {
         stopServer();
-        delete[] netBuf;
     }
 
     void start() {
@@ -243,9 +240,12 @@ private:
         std::lock_guard lck(_this->connMtx);
         if (!_this->conn || !_this->conn->isOpen()) { return; }
 
-        volk_32f_s32f_convert_16i(_this->netBuf, (float*)samples, 32768.0f, count);
-
-        _this->conn->write(count * sizeof(int16_t), (uint8_t*)_this->netBuf);
+        // Convert straight into a buffer of the connection, dropping the audio if the client can't keep up
+        net::ConnWriteBuffer* wbuf = _this->conn->acquireWriteBuffer(count * sizeof(int16_t), false);
+        if (!wbuf) { return; }
+        volk_32f_s32f_convert_16i((int16_t*)wbuf->buf, (float*)samples, 32768.0f, count);
+        wbuf->count = count * sizeof(int16_t);
+        _this->conn->writeAsync(wbuf);
     }
 
     static void stereoHandler(dsp::stereo_t* samples, int count, void* ctx) {
@@ -253,9 +253,11 @@ private:
         std::lock_guard lck(_this->connMtx);
         if (!_this->conn || !_this->conn->isOpen()) { return; }
 
-        volk_32f_s32f_convert_16i(_this->netBuf, (float*)samples, 32768.0f, count * 2);
-
-        _this->conn->write(count * 2 * sizeof(int16_t), (uint8_t*)_this->netBuf);
+        net::ConnWriteBuffer* wbuf = _this->conn->acquireWriteBuffer(count * 2 * sizeof(int16_t), false);
+        if (!wbuf) { return; }
+        volk_32f_s32f_convert_16i((int16_t*)wbuf->buf, (float*)samples, 32768.0f, count * 2);
+        wbuf->count = count * 2 * sizeof(int16_t);
+        _this->conn->writeAsync(wbuf);
     }
 
     static void clientHandler(net::Conn client, void* ctx) {
@@ -297,8 +299,6 @@ private:
     unsigned int sampleRate = 48000;
     bool stereo = false;
 
-    int16_t* netBuf;
-
     net::Listener listener;
     net::Conn conn;
     std::mutex connMtx;
@@ -3,6 +3,7 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <dsp/convert/samples.h>
 #include <core.h>
 #include <gui/style.h>
 #include <config.h>
@@ -601,7 +602,7 @@ private:
             if (ret != 0) { break; }
 
             // Convert to complex float and swap buffers
-            volk_16i_s32f_convert_32f((float*)stream.writeBuf, buffer, 32768.0f, bufferSize * 2);
+            dsp::convert::i16ToComplex(stream.writeBuf, buffer, bufferSize, 1.0f / 32768.0f);
             if (!stream.swap(bufferSize)) { break; }
         }
 
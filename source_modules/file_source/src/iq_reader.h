@@ -0,0 +1,324 @@
+#pragma once
+#include <utils/riff.h>
+#include <utils/wav.h>
+#include <dsp/types.h>
+#include <dsp/convert/samples.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Amount of data the OS is asked to load ahead of the playback position
+#define IQ_READER_PREFETCH_SIZE     (16 * 1024 * 1024)
+
+// Size field of RF64 chunks whose real size is in the ds64 chunk
+#define IQ_READER_RF64_SIZE         0xFFFFFFFF
+
+enum IQFormat {
+    IQ_FORMAT_UINT8,
+    IQ_FORMAT_INT8,
+    IQ_FORMAT_INT16,
+    IQ_FORMAT_FLOAT32
+};
+
+// Maps a whole IQ recording in memory and converts the samples straight from the mapping, so reading or seeking
+// never goes through an intermediate buffer. Reads WAV and RF64 files with unsigned 8-bit, 16-bit or float32 samples,
+// and raw files whose format is given by their extension, which need the samplerate to be given.
+class IQReader {
+public:
+    IQReader(std::string path, uint32_t rawSampleRate = 0) {
+        map(path);
+
+        // WAV files start with a RIFF or RF64 header, anything else is read as raw samples
+        bool riff = (size >= 12) && (!memcmp(data, "RIFF", 4) || !memcmp(data, "RF64", 4)) && !memcmp(&data[8], "WAVE", 4);
+        try {
+            if (riff) {
+                parseWav();
+            }
+            else {
+                parseRaw(path, rawSampleRate);
+            }
+        }
+        catch (const std::exception& e) {
+            unmap();
+            throw;
+        }
+
+        sampleCount = dataSize / bytesPerSample;
+        samples = &data[dataOffset];
+        position = 0;
+        prefetchedUntil = 0;
+        prefetch();
+    }
+
+    ~IQReader() {
+        unmap();
+    }
+
+    // Returns true if the file is read as raw samples given its extension
+    static bool isRaw(std::string path) {
+        IQFormat format;
+        return rawFormat(path, format);
+    }
+
+    uint32_t getSampleRate() {
+        return sampleRate;
+    }
+
+    IQFormat getFormat() {
+        return format;
+    }
+
+    int64_t getSampleCount() {
+        return sampleCount;
+    }
+
+    // Can be called from any thread
+    int64_t getPosition() {
+        return position;
+    }
+
+    void seek(int64_t sample) {
+        position = std::clamp<int64_t>(sample, 0, sampleCount);
+        prefetchedUntil = 0;
+        prefetch();
+    }
+
+    // Returns the number of samples read, 0 at the end of the file
+    int read(dsp::complex_t* out, int count) {
+        int64_t pos = position;
+        count = (int)std::min<int64_t>(count, sampleCount - pos);
+        if (count <= 0) { return 0; }
+
+#ifndef _WIN32
+        // Touching a page of the mapping that's past the end of the file raises SIGBUS, which happens if the file
+        // is truncated while it's played. Its size is checked before every read and the end moved back to it, since
+        // a signal handler would be process wide. A truncation between the check and the copy can still crash.
+        // Windows doesn't let a mapped file be truncated.
+        struct stat st;
+        if (!fstat(fd, &st) && (uint64_t)st.st_size < size) {
+            uint64_t avail = ((uint64_t)st.st_size > dataOffset) ? ((uint64_t)st.st_size - dataOffset) / bytesPerSample : 0;
+            if ((int64_t)avail < sampleCount) { sampleCount = avail; }
+            count = (int)std::clamp<int64_t>((int64_t)avail - pos, 0, count);
+            if (!count) { return 0; }
+        }
+#endif
+
+        // Convert from the mapping
+        const uint8_t* in = &samples[pos * bytesPerSample];
+        switch (format) {
+        case IQ_FORMAT_UINT8:
+            dsp::convert::u8ToComplex(out, in, count, 127.5f, 1.0f / 128.0f);
+            break;
+        case IQ_FORMAT_INT8:
+            dsp::convert::i8ToComplex(out, (const int8_t*)in, count, 1.0f / 128.0f);
+            break;
+        case IQ_FORMAT_INT16:
+            dsp::convert::i16ToComplex(out, (const int16_t*)in, count, 1.0f / 32768.0f);
+            break;
+        case IQ_FORMAT_FLOAT32:
+            memcpy(out, in, count * sizeof(dsp::complex_t));
+            break;
+        }
+
+        position = pos + count;
+        prefetch();
+        return count;
+    }
+
+private:
+    void parseWav() {
+        // Walk the chunks until the samples
+        uint64_t ds64DataSize = 0;
+        bool rf64 = !memcmp(data, "RF64", 4);
+        bool fmtFound = false;
+        wav::FormatHeader fmt;
+        uint64_t pos = 12;
+        while (pos + sizeof(riff::ChunkHeader) <= size) {
+            riff::ChunkHeader hdr;
+            memcpy(&hdr, &data[pos], sizeof(riff::ChunkHeader));
+            uint64_t chunkStart = pos + sizeof(riff::ChunkHeader);
+            uint64_t chunkSize = hdr.size;
+
+            if (!memcmp(hdr.id, "ds64", 4) && chunkSize >= 16 && chunkStart + 16 <= size) {
+                // RIFF size then data size, both 64 bit
+                memcpy(&ds64DataSize, &data[chunkStart + 8], sizeof(uint64_t));
+            }
+            else if (!memcmp(hdr.id, "fmt ", 4) && chunkSize >= sizeof(wav::FormatHeader) && chunkStart + chunkSize <= size) {
+                memcpy(&fmt, &data[chunkStart], sizeof(wav::FormatHeader));
+
+                // WAVE_FORMAT_EXTENSIBLE keeps the real codec at the start of its sub-format GUID
+                if (fmt.codec == 0xFFFE && chunkSize >= 26) {
+                    memcpy(&fmt.codec, &data[chunkStart + 24], sizeof(uint16_t));
+                }
+                fmtFound = true;
+            }
+            else if (!memcmp(hdr.id, "data", 4)) {
+                dataOffset = chunkStart;
+                if (rf64 && chunkSize == IQ_READER_RF64_SIZE) { chunkSize = ds64DataSize; }
+
+                // Files from recordings that didn't end properly have a wrong size, use what's actually there
+                dataSize = size - dataOffset;
+                if (chunkSize && chunkSize < dataSize) { dataSize = chunkSize; }
+                break;
+            }
+
+            // Chunks are padded to an even size
+            pos = chunkStart + chunkSize + (chunkSize & 1);
+        }
+        if (!fmtFound || !dataOffset) {
+            throw std::runtime_error("Invalid WAV file");
+        }
+
+        // Only IQ data is supported
+        if (fmt.channelCount != 2) {
+            throw std::runtime_error("WAV file must have two channels");
+        }
+        if (fmt.codec == wav::CODEC_PCM && fmt.bitDepth == 8) {
+            format = IQ_FORMAT_UINT8;
+        }
+        else if (fmt.codec == wav::CODEC_PCM && fmt.bitDepth == 16) {
+            format = IQ_FORMAT_INT16;
+        }
+        else if (fmt.codec == wav::CODEC_FLOAT && fmt.bitDepth == 32) {
+            format = IQ_FORMAT_FLOAT32;
+        }
+        else {
+            throw std::runtime_error("Unsupported WAV sample format");
+        }
+        bytesPerSample = formatSize(format) * 2;
+        sampleRate = fmt.sampleRate;
+    }
+
+    void parseRaw(std::string path, uint32_t rawSampleRate) {
+        if (!rawFormat(path, format)) {
+            throw std::runtime_error("Unknown file type");
+        }
+        if (!rawSampleRate) {
+            throw std::runtime_error("Raw files need a samplerate");
+        }
+        bytesPerSample = formatSize(format) * 2;
+        sampleRate = rawSampleRate;
+        dataOffset = 0;
+        dataSize = size;
+    }
+
+    static bool rawFormat(std::string path, IQFormat& format) {
+        std::string ext = std::filesystem::path(path).extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == ".cu8" || ext == ".u8") { format = IQ_FORMAT_UINT8; }
+        else if (ext == ".cs8" || ext == ".s8") { format = IQ_FORMAT_INT8; }
+        else if (ext == ".cs16" || ext == ".s16") { format = IQ_FORMAT_INT16; }
+        else if (ext == ".cf32" || ext == ".fc32" || ext == ".cfile") { format = IQ_FORMAT_FLOAT32; }
+        else { return false; }
+        return true;
+    }
+
+    static int formatSize(IQFormat format) {
+        switch (format) {
+        case IQ_FORMAT_UINT8:
+        case IQ_FORMAT_INT8:
+            return 1;
+        case IQ_FORMAT_INT16:
+            return 2;
+        case IQ_FORMAT_FLOAT32:
+            return 4;
+        }
+        return 1;
+    }
+
+    void prefetch() {
+        // Ask for the next part of the file once half of what was requested has been played
+        uint64_t offset = dataOffset + (uint64_t)position * bytesPerSample;
+        if (offset + (IQ_READER_PREFETCH_SIZE / 2) < prefetchedUntil) { return; }
+#ifndef _WIN32
+        uint64_t start = offset & ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+        uint64_t len = std::min<uint64_t>(IQ_READER_PREFETCH_SIZE, size - start);
+        madvise((void*)&data[start], len, MADV_WILLNEED);
+#endif
+        // On Windows the file is opened for sequential access, which lets the OS read ahead on its own
+        prefetchedUntil = offset + IQ_READER_PREFETCH_SIZE;
+    }
+
+    void map(std::string path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not open file");
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        size = fileSize.QuadPart;
+        mapping = size ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        data = mapping ? (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (!data) {
+            if (mapping) { CloseHandle(mapping); }
+            CloseHandle(file);
+            throw std::runtime_error("Could not map file");
+        }
+#else
+        // The file is kept open to watch its size
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open file");
+        }
+        struct stat st;
+        fstat(fd, &st);
+        size = st.st_size;
+        void* ptr = size ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        if (ptr == MAP_FAILED) {
+            ::close(fd);
+            fd = -1;
+            throw std::runtime_error("Could not map file");
+        }
+        data = (const uint8_t*)ptr;
+        madvise(ptr, size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    void unmap() {
+        if (!data) { return; }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        CloseHandle(file);
+#else
+        munmap((void*)data, size);
+        ::close(fd);
+        fd = -1;
+#endif
+        data = NULL;
+    }
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+    const uint8_t* data = NULL;
+    uint64_t size = 0;
+
+    uint64_t dataOffset = 0;
+    uint64_t dataSize = 0;
+    const uint8_t* samples = NULL;
+
+    IQFormat format;
+    int bytesPerSample = 4;
+    uint32_t sampleRate = 0;
+    std::atomic<int64_t> sampleCount = 0;
+    std::atomic<int64_t> position = 0;
+    uint64_t prefetchedUntil = 0;
+};
\ No newline at end of file
@@ -4,20 +4,23 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
-#include <wavreader.h>
+#include <iq_reader.h>
 #include <core.h>
 #include <gui/widgets/file_select.h>
 #include <filesystem>
 #include <regex>
 #include <gui/tuner.h>
+#include <gui/style.h>
 #include <algorithm>
 #include <stdexcept>
+#include <atomic>
+#include <chrono>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
 SDRPP_MOD_INFO{
     /* Name:            */ "file_source",
-    /* Description:     */ "Wav file source module for SDR++",
+    /* Description:     */ "IQ file source module for SDR++",
     /* Author:          */ "Ryzerth",
     /* Version:         */ 0, 1, 1,
     /* Max instances    */ 1
@@ -27,13 +30,16 @@ ConfigManager config;
 
 class FileSourceModule : public ModuleManager::Instance {
 public:
-    FileSourceModule(std::string name) : fileSelect("", { "Wav IQ Files (*.wav)", "*.wav", "All Files", "*" }) {
+    FileSourceModule(std::string name) : fileSelect("", { "IQ Files (*.wav *.cu8 *.cs8 *.cs16 *.cf32)", "*.wav *.cu8 *.cs8 *.cs16 *.cf32", "All Files", "*" }) {
         this->name = name;
 
         if (core::args["server"].b()) { return; }
 
         config.acquire();
         fileSelect.setPath(config.conf["path"], true);
+        if (config.conf.contains("realTime")) { realTime = config.conf["realTime"]; }
+        if (config.conf.contains("loop")) { loop = config.conf["loop"]; }
+        if (config.conf.contains("rawSampleRate")) { rawSampleRate = config.conf["rawSampleRate"]; }
         config.release();
 
         handler.ctx = this;
@@ -92,8 +98,9 @@ private:
         FileSourceModule* _this = (FileSourceModule*)ctx;
         if (_this->running) { return; }
         if (_this->reader == NULL) { return; }
+        _this->endOfFile = false;
         _this->running = true;
-        _this->workerThread = _this->float32Mode ? std::thread(floatWorker, _this) : std::thread(worker, _this);
+        _this->workerThread = std::thread(worker, _this);
         flog::info("FileSourceModule '{0}': Start!", _this->name);
     }
 
@@ -105,7 +112,6 @@ private:
         _this->workerThread.join();
         _this->stream.clearWriteStop();
         _this->running = false;
-        _this->reader->rewind();
         flog::info("FileSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -117,34 +123,16 @@ private:
     static void menuHandler(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
 
+        // The worker has reached the end of the file, stop like the play button would so that the source and the UI
+        // don't stay in the running state
+        if (_this->endOfFile.exchange(false) && _this->running) {
+            gui::mainWindow.setPlayState(false);
+        }
+
         if (_this->fileSelect.render("##file_source_" + _this->name)) {
             if (_this->fileSelect.pathIsValid()) {
                 gui::mainWindow.playButtonLocked = false;
-
-                if (_this->reader != NULL) {
-                    _this->reader->close();
-                    delete _this->reader;
-                }
-                try {
-                    _this->reader = new WavReader(_this->fileSelect.path);
-                    if (_this->reader->getSampleRate() == 0) {
-                        _this->reader->close();
-                        delete _this->reader;
-                        _this->reader = NULL;
-                        throw std::runtime_error("Sample rate may not be zero");
-                    }
-                    _this->sampleRate = _this->reader->getSampleRate();
-                    core::setInputSampleRate(_this->sampleRate);
-                    std::string filename = std::filesystem::path(_this->fileSelect.path).filename().string();
-                    _this->centerFreq = _this->getFrequency(filename);
-                    tuner::tune(tuner::TUNER_MODE_IQ_ONLY, "", _this->centerFreq);
-                    //gui::freqSelect.minFreq = _this->centerFreq - (_this->sampleRate/2);
-                    //gui::freqSelect.maxFreq = _this->centerFreq + (_this->sampleRate/2);
-                    //gui::freqSelect.limitFreq = true;
-                }
-                catch (const std::exception& e) {
-                    flog::error("Error: {}", e.what());
-                }
+                _this->openFile();
                 config.acquire();
                 config.conf["path"] = _this->fileSelect.path;
                 config.release(true);
@@ -154,36 +142,115 @@ private:
             }
         }
 
-        ImGui::Checkbox("Float32 Mode##_file_source", &_this->float32Mode);
-    }
+        // Raw files don't say their samplerate
+        if (_this->fileSelect.pathIsValid() && IQReader::isRaw(_this->fileSelect.path)) {
+            ImGui::LeftLabel("Raw samplerate");
+            ImGui::FillWidth();
+            if (ImGui::InputInt("##file_source_raw_sr", &_this->rawSampleRate, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue)) {
+                _this->rawSampleRate = std::max<int>(_this->rawSampleRate, 1);
+                if (!_this->running) { _this->openFile(); }
+                config.acquire();
+                config.conf["rawSampleRate"] = _this->rawSampleRate;
+                config.release(true);
+            }
+        }
 
-    static void worker(void* ctx) {
-        FileSourceModule* _this = (FileSourceModule*)ctx;
-        double sampleRate = std::max(_this->reader->getSampleRate(), (uint32_t)1);
-        int blockSize = std::min((int)(sampleRate / 200.0f), (int)STREAM_BUFFER_SIZE);
-        int16_t* inBuf = new int16_t[blockSize * 2];
+        // Scrub bar, the worker picks up the new position
+        if (_this->reader) {
+            double duration = (double)_this->reader->getSampleCount() / _this->sampleRate;
+            float progress = _this->reader->getSampleCount() ? (float)_this->reader->getPosition() / (float)_this->reader->getSampleCount() : 0.0f;
+            char timeStr[64];
+            int pos = progress * duration;
+            int dur = duration;
+            sprintf(timeStr, "%02d:%02d:%02d / %02d:%02d:%02d", pos / 3600, (pos / 60) % 60, pos % 60, dur / 3600, (dur / 60) % 60, dur % 60);
+            ImGui::FillWidth();
+            if (ImGui::SliderFloat(CONCAT("##_file_source_pos_", _this->name), &progress, 0.0f, 1.0f, timeStr)) {
+                _this->seekRequest = (int64_t)(progress * (double)_this->reader->getSampleCount());
+                if (!_this->running) { _this->reader->seek(_this->seekRequest.exchange(-1)); }
+            }
+        }
 
-        while (true) {
-            _this->reader->readSamples(inBuf, blockSize * 2 * sizeof(int16_t));
-            volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, inBuf, 32768.0f, blockSize * 2);
-            if (!_this->stream.swap(blockSize)) { break; };
+        if (ImGui::Checkbox(CONCAT("Real-time##_file_source_rt_", _this->name), &_this->realTime)) {
+            config.acquire();
+            config.conf["realTime"] = _this->realTime;
+            config.release(true);
+        }
+        ImGui::SameLine();
+        if (ImGui::Checkbox(CONCAT("Loop##_file_source_loop_", _this->name), &_this->loop)) {
+            config.acquire();
+            config.conf["loop"] = _this->loop;
+            config.release(true);
         }
+    }
 
-        delete[] inBuf;
+    void openFile() {
+        // The worker can't be using the reader while it's replaced
+        bool wasRunning = running;
+        if (running) { stop(this); }
+        if (reader != NULL) {
+            delete reader;
+            reader = NULL;
+        }
+        try {
+            reader = new IQReader(fileSelect.path, rawSampleRate);
+            if (reader->getSampleRate() == 0) {
+                delete reader;
+                reader = NULL;
+                throw std::runtime_error("Sample rate may not be zero");
+            }
+            sampleRate = reader->getSampleRate();
+            core::setInputSampleRate(sampleRate);
+            std::string filename = std::filesystem::path(fileSelect.path).filename().string();
+            centerFreq = getFrequency(filename);
+            tuner::tune(tuner::TUNER_MODE_IQ_ONLY, "", centerFreq);
+            //gui::freqSelect.minFreq = centerFreq - (sampleRate/2);
+            //gui::freqSelect.maxFreq = centerFreq + (sampleRate/2);
+            //gui::freqSelect.limitFreq = true;
+        }
+        catch (const std::exception& e) {
+            flog::error("Error: {}", e.what());
+        }
+        if (wasRunning) { start(this); }
     }
 
-    static void floatWorker(void* ctx) {
+    static void worker(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
         double sampleRate = std::max(_this->reader->getSampleRate(), (uint32_t)1);
         int blockSize = std::min((int)(sampleRate / 200.0f), (int)STREAM_BUFFER_SIZE);
-        dsp::complex_t* inBuf = new dsp::complex_t[blockSize];
+        blockSize = std::max<int>(blockSize, 1);
+        _this->stream.setBufferSize(blockSize);
+        auto next = std::chrono::steady_clock::now();
 
         while (true) {
-            _this->reader->readSamples(_this->stream.writeBuf, blockSize * sizeof(dsp::complex_t));
-            if (!_this->stream.swap(blockSize)) { break; };
+            // Apply a seek from the scrub bar
+            int64_t seekTo = _this->seekRequest.exchange(-1);
+            if (seekTo >= 0) { _this->reader->seek(seekTo); }
+
+            // Convert straight from the file to the stream, starting over or stopping at the end
+            int count = _this->reader->read(_this->stream.writeBuf, blockSize);
+            if (!count) {
+                if (!_this->loop || !_this->reader->getSampleCount()) {
+                    // The playback is stopped from the GUI thread
+                    _this->endOfFile = true;
+                    break;
+                }
+                _this->reader->seek(0);
+                continue;
+            }
+            if (!_this->stream.swap(count)) { break; };
+
+            // In real-time mode, wait until the samples are due, otherwise go as fast as the DSP allows
+            if (!_this->realTime) { continue; }
+            next += std::chrono::nanoseconds((int64_t)(1e9 * (double)count / sampleRate));
+            auto now = std::chrono::steady_clock::now();
+            if (next > now) {
+                std::this_thread::sleep_until(next);
+            }
+            else if (now - next > std::chrono::milliseconds(500)) {
+                // Too far behind (stalled or just switched to real-time), don't try to catch up
+                next = now;
+            }
         }
-
-        delete[] inBuf;
     }
 
     double getFrequency(std::string filename) {
@@ -199,15 +266,19 @@ private:
     std::string name;
     dsp::stream<dsp::complex_t> stream;
     SourceManager::SourceHandler handler;
-    WavReader* reader = NULL;
-    bool running = false;
+    IQReader* reader = NULL;
+    std::atomic<bool> running = false;
+    std::atomic<bool> endOfFile = false;
     bool enabled = true;
     float sampleRate = 1000000;
     std::thread workerThread;
 
     double centerFreq = 100000000;
 
-    bool float32Mode = false;
+    bool realTime = true;
+    bool loop = true;
+    int rawSampleRate = 1000000;
+    std::atomic<int64_t> seekRequest = -1;
 };
 
 MOD_EXPORT void _INIT_() {
@@ -2,6 +2,7 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <dsp/convert/samples.h>
 #include <core.h>
 #include <gui/style.h>
 #include <config.h>
@@ -387,7 +388,7 @@ private:
 
     static int callback(hackrf_transfer* transfer) {
         HackRFSourceModule* _this = (HackRFSourceModule*)transfer->rx_ctx;
-        volk_8i_s32f_convert_32f((float*)_this->stream.writeBuf, (int8_t*)transfer->buffer, 128.0f, transfer->valid_length);
+        dsp::convert::i8ToComplex(_this->stream.writeBuf, (int8_t*)transfer->buffer, transfer->valid_length / 2, 1.0f / 128.0f);
         if (!_this->stream.swap(transfer->valid_length / 2)) { return -1; }
         return 0;
     }
@@ -3,6 +3,7 @@
 #include <gui/gui.h>
 #include <gui/smgui.h>
 #include <signal_path/signal_path.h>
+#include <dsp/convert/samples.h>
 #include <core.h>
 #include <utils/optionlist.h>
 #include <htra_api.h>
@@ -445,10 +446,10 @@ private:
 
             // Convert them to floating point
             if (sampsInt8) {
-                volk_8i_s32f_convert_32f((float*)&stream.writeBuf[(count++)*bufferSize], (int8_t*)iqs.AlternIQStream, 128.0f, realSamps);
+                dsp::convert::i8ToComplex(&stream.writeBuf[(count++)*bufferSize], (int8_t*)iqs.AlternIQStream, bufferSize, 1.0f / 128.0f);
             }
             else {
-                volk_16i_s32f_convert_32f((float*)&stream.writeBuf[(count++)*bufferSize], (int16_t*)iqs.AlternIQStream, 32768.0f, realSamps);
+                dsp::convert::i16ToComplex(&stream.writeBuf[(count++)*bufferSize], (int16_t*)iqs.AlternIQStream, bufferSize, 1.0f / 32768.0f);
             }
 
             // Send them off if we have enough
@@ -483,7 +483,8 @@ private:
     }
 
     void worker() {
-        int sampCount = sampleRate / 200;
+        int sampCount = std::max<int>(sampleRate / 200, 1);
+        stream.setBufferSize(sampCount);
         lms_stream_meta_t meta;
         while (streamRunning) {
             int ret = LMS_RecvStream(&devStream, stream.writeBuf, sampCount, &meta, 1000);
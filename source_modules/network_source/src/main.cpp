@@ -3,6 +3,7 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <dsp/convert/samples.h>
 #include <core.h>
 #include <gui/style.h>
 #include <config.h>
@@ -91,6 +92,10 @@ public:
             port = config.conf[name]["port"];
             port = std::clamp<int>(port, 1, 65535);
         }
+        if (config.conf[name].contains("jitterBuffer")) {
+            jitterBuffer = config.conf[name]["jitterBuffer"];
+            jitterBuffer = std::clamp<int>(jitterBuffer, 0, 2000);
+        }
         config.release();
 
         // Set menu IDs
@@ -137,12 +142,14 @@ private:
     static void menuSelected(void* ctx) {
         NetworkSourceModule* _this = (NetworkSourceModule*)ctx;
         core::setInputSampleRate(_this->samplerate);
+        sigpath::iqFrontEnd.setBufferTargetLatency(_this->jitterBuffer);
         flog::info("NetworkSourceModule '{0}': Menu Select!", _this->name);
     }
 
     static void menuDeselected(void* ctx) {
         NetworkSourceModule* _this = (NetworkSourceModule*)ctx;
         gui::mainWindow.playButtonLocked = false;
+        sigpath::iqFrontEnd.setBufferTargetLatency(0);
         flog::info("NetworkSourceModule '{0}': Menu Deselect!", _this->name);
     }
 
@@ -272,22 +279,36 @@ private:
         }
 
         if (_this->running) { SmGui::EndDisabled(); }
+
+        // Amount of signal kept buffered to smooth out the network jitter, 0 to disable
+        SmGui::LeftLabel("Jitter buffer (ms)");
+        SmGui::FillWidth();
+        if (SmGui::InputInt(("##network_source_jitter_" + _this->name).c_str(), &_this->jitterBuffer, 10, 100)) {
+            _this->jitterBuffer = std::clamp<int>(_this->jitterBuffer, 0, 2000);
+            sigpath::iqFrontEnd.setBufferTargetLatency(_this->jitterBuffer);
+            config.acquire();
+            config.conf[_this->name]["jitterBuffer"] = _this->jitterBuffer;
+            config.release(true);
+        }
     }
 
     void worker() {
-        // Compute sizes
-        int blockSize = samplerate / 200;
+        // Compute sizes, the raw samples and the converted ones have to fit in the stream's buffer together
         int sampleSize = SAMPLE_TYPE_SIZE[sampType];
+        int blockSize = std::min<int>(samplerate / 200, STREAM_BUFFER_SIZE / 2);
 
-        // Chose amount of bytes to attempt to read
+        // Chose amount of bytes to attempt to read, a UDP datagram is never larger than 64KB
         bool forceSize = (proto != PROTOCOL_UDP);
-        int frameSize = sampleSize * (forceSize ? blockSize : STREAM_BUFFER_SIZE);
+        int frameSize = sampleSize * (forceSize ? blockSize : (65536 / sampleSize));
 
-        // Allocate receive buffer
-        uint8_t* buffer = dsp::buffer::alloc<uint8_t>(frameSize);
+        // Declare the block size, leaving room for a frame of raw samples behind the converted ones
+        stream.setBufferSize((frameSize / sampleSize) + ((frameSize + sizeof(dsp::complex_t) - 1) / sizeof(dsp::complex_t)));
 
         while (true) {
-            // Read samples from socket
+            // Read samples from socket straight into the stream's buffer. Those that need converting are received
+            // at the end of it and converted in place to its start
+            bool convert = (sampType != SAMPLE_TYPE_FLOAT32);
+            uint8_t* buffer = convert ? (uint8_t*)stream.rawWriteBuf(frameSize) : (uint8_t*)stream.writeBuf;
             int bytes = sock->recv(buffer, frameSize, forceSize);
             if (bytes <= 0) { break; }
 
@@ -295,16 +316,16 @@ private:
             int count = bytes / sampleSize;
             switch (sampType) {
             case SAMPLE_TYPE_INT8:
-                volk_8i_s32f_convert_32f((float*)stream.writeBuf, (int8_t*)buffer, 128.0f, count*2);
+                dsp::convert::i8ToComplex(stream.writeBuf, (int8_t*)buffer, count, 1.0f / 128.0f);
                 break;
             case SAMPLE_TYPE_INT16:
-                volk_16i_s32f_convert_32f((float*)stream.writeBuf, (int16_t*)buffer, 32768.0f, count*2);
+                dsp::convert::i16ToComplex(stream.writeBuf, (int16_t*)buffer, count, 1.0f / 32768.0f);
                 break;
             case SAMPLE_TYPE_INT32:
                 volk_32i_s32f_convert_32f((float*)stream.writeBuf, (int32_t*)buffer, 2147483647.0f, count*2);
                 break;
             case SAMPLE_TYPE_FLOAT32:
-                memcpy(stream.writeBuf, buffer, bytes);
+                // Already in place
                 break;
             default:
                 break;
@@ -313,9 +334,6 @@ private:
             // Send out converted samples
             if (!stream.swap(count)) { break; }
         }
-
-        // Free receive buffer
-        dsp::buffer::free(buffer);
     }
 
     std::string name;
@@ -333,6 +351,7 @@ private:
     int sampTypeId;
     char hostname[1024] = "localhost";
     int port = 1234;
+    int jitterBuffer = 0;
 
     OptionList<std::string, Protocol> protocols;
     OptionList<std::string, SampleType> sampleTypes;
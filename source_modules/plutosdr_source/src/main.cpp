@@ -2,6 +2,7 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <dsp/convert/samples.h>
 #include <core.h>
 #include <gui/style.h>
 #include <gui/smgui.h>
@@ -446,7 +447,8 @@ private:
 
     static void worker(void* ctx) {
         PlutoSDRSourceModule* _this = (PlutoSDRSourceModule*)ctx;
-        int blockSize = _this->samplerate / 200.0f;
+        int blockSize = std::max<int>(_this->samplerate / 200.0f, 1);
+        _this->stream.setBufferSize(blockSize);
 
         // Acquire channels
         iio_channel* rx0_i = iio_device_find_channel(_this->dev, "voltage0", 0);
@@ -477,7 +479,7 @@ private:
             if (!buf) { break; }
 
             // Convert samples to CF32
-            volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, buf, 32768.0f, blockSize * 2);
+            dsp::convert::i16ToComplex(_this->stream.writeBuf, buf, blockSize, 1.0f / 32768.0f);
 
             // Send out the samples
             if (!_this->stream.swap(blockSize)) { break; };
@@ -1,4 +1,5 @@
 #include "rtl_tcp_client.h"
+#include <dsp/convert/samples.h>
 
 namespace rtltcp {
     Client::Client(std::shared_ptr<net::Socket> sock, dsp::stream<dsp::complex_t>* stream) {
@@ -73,25 +74,19 @@ namespace rtltcp {
     }
 
     void Client::worker() {
-        uint8_t* buffer = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE*2);
-
         while (true) {
-            // Read data
+            // Read data straight into the end of the stream's buffer
+            uint8_t* buffer = (uint8_t*)stream->rawWriteBuf(bufferSize * 2);
             int count = sock->recv(buffer, bufferSize * 2, true);
             if (count <= 0) { break; }
 
-            // Convert to complex float
+            // Convert to complex float in place, to the start of the buffer
             int scount = count/2;
-            for (int i = 0; i < scount; i++) {
-                stream->writeBuf[i].re = ((double)buffer[i * 2] - 128.0) / 128.0;
-                stream->writeBuf[i].im = ((double)buffer[(i * 2) + 1] - 128.0) / 128.0;
-            }
+            dsp::convert::u8ToComplex(stream->writeBuf, buffer, scount, 128.0f, 1.0f / 128.0f);
 
             // Swap buffer
             if (!stream->swap(scount)) { break; }
         }
-
-        dsp::buffer::free(buffer);
     }
 
     std::shared_ptr<Client> connect(dsp::stream<dsp::complex_t>* stream, std::string host, int port) {
@@ -3,12 +3,14 @@
 #include <module.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <dsp/convert/samples.h>
 #include <core.h>
 #include <gui/style.h>
 #include <config.h>
 #include <sdrplay_api.h>
 #include <gui/smgui.h>
 #include <utils/optionlist.h>
+#include <algorithm>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
@@ -1095,12 +1097,15 @@ private:
     static void streamCB(short* xi, short* xq, sdrplay_api_StreamCbParamsT* params,
                          unsigned int numSamples, unsigned int reset, void* cbContext) {
         SDRPlaySourceModule* _this = (SDRPlaySourceModule*)cbContext;
-        // TODO: Optimise using volk and math
         if (!_this->running) { return; }
-        for (int i = 0; i < numSamples; i++) {
-            int id = _this->bufferIndex++;
-            _this->stream.writeBuf[id].re = (float)xi[i] / 32768.0f;
-            _this->stream.writeBuf[id].im = (float)xq[i] / 32768.0f;
+
+        // Convert as much as fits in the buffer at once, sending it out whenever it's full
+        unsigned int i = 0;
+        while (i < numSamples) {
+            int toConvert = std::min<int>(numSamples - i, _this->bufferSize - _this->bufferIndex);
+            dsp::convert::i16PlanarToComplex(&_this->stream.writeBuf[_this->bufferIndex], &xi[i], &xq[i], toConvert, 1.0f / 32768.0f);
+            _this->bufferIndex += toConvert;
+            i += toConvert;
 
             if (_this->bufferIndex >= _this->bufferSize) {
                 _this->stream.swap(_this->bufferSize);
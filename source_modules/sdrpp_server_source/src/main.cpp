@@ -33,9 +33,19 @@ public:
 
         // Initialize lists
         sampleTypeList.define("Int8", dsp::compression::PCM_TYPE_I8);
+        sampleTypeList.define("Int12", dsp::compression::PCM_TYPE_I12);
         sampleTypeList.define("Int16", dsp::compression::PCM_TYPE_I16);
         sampleTypeList.define("Float32", dsp::compression::PCM_TYPE_F32);
+        sampleTypeList.define("BFP4 (lossy)", dsp::compression::PCM_TYPE_BFP4);
+        sampleTypeList.define("BFP8 (lossy)", dsp::compression::PCM_TYPE_BFP8);
         sampleTypeId = sampleTypeList.valueId(dsp::compression::PCM_TYPE_I16);
+        ddcRates.define(25e3, "25KHz", 25e3);
+        ddcRates.define(50e3, "50KHz", 50e3);
+        ddcRates.define(100e3, "100KHz", 100e3);
+        ddcRates.define(250e3, "250KHz", 250e3);
+        ddcRates.define(500e3, "500KHz", 500e3);
+        ddcRates.define(1e6, "1MHz", 1e6);
+        ddcRateId = ddcRates.valueId(250e3);
 
         handler.ctx = this;
         handler.selectHandler = menuSelected;
@@ -95,12 +105,16 @@ private:
         if (_this->client) {
             core::setInputSampleRate(_this->client->getSampleRate());
         }
+        _this->selected = true;
+        _this->updateFFT();
         gui::mainWindow.playButtonLocked = !(_this->client && _this->client->isOpen());
         flog::info("SDRPPServerSourceModule '{0}': Menu Select!", _this->name);
     }
 
     static void menuDeselected(void* ctx) {
         SDRPPServerSourceModule* _this = (SDRPPServerSourceModule*)ctx;
+        _this->selected = false;
+        _this->updateFFT();
         gui::mainWindow.playButtonLocked = false;
         flog::info("SDRPPServerSourceModule '{0}': Menu Deselect!", _this->name);
     }
@@ -148,6 +162,7 @@ private:
 
         bool connected = _this->connected();
         gui::mainWindow.playButtonLocked = !connected;
+        _this->updateFFT();
 
         ImGui::GenericDialog("##sdrpp_srv_src_err_dialog", _this->serverBusy, GENERIC_DIALOG_BUTTONS_OK, [=](){
             ImGui::TextUnformatted("This server is already in use.");
@@ -199,10 +214,27 @@ private:
                 config.release(true);
             }
 
-            bool dummy = true;
-            style::beginDisabled();
-            ImGui::Checkbox("Full IQ", &dummy);
-            style::endDisabled();
+            // Without full IQ the server only sends a narrower band around the tuned frequency
+            if (ImGui::Checkbox("Full IQ", &_this->fullIQ)) {
+                _this->applyDDC();
+
+                // Save config
+                config.acquire();
+                config.conf["servers"][_this->devConfName]["fullIQ"] = _this->fullIQ;
+                config.release(true);
+            }
+            if (!_this->fullIQ) {
+                ImGui::LeftLabel("DDC samplerate");
+                ImGui::FillWidth();
+                if (ImGui::Combo("##sdrpp_srv_source_ddc_sr", &_this->ddcRateId, _this->ddcRates.txt)) {
+                    _this->applyDDC();
+
+                    // Save config
+                    config.acquire();
+                    config.conf["servers"][_this->devConfName]["ddcSampleRate"] = _this->ddcRates.key(_this->ddcRateId);
+                    config.release(true);
+                }
+            }
 
             // Calculate datarate
             _this->frametimeCounter += ImGui::GetIO().DeltaTime;
@@ -258,10 +290,63 @@ private:
         if (config.conf["servers"][devConfName].contains("compression")) {
             compression = config.conf["servers"][devConfName]["compression"];
         }
+        fullIQ = true;
+        if (config.conf["servers"][devConfName].contains("fullIQ")) {
+            fullIQ = config.conf["servers"][devConfName]["fullIQ"];
+        }
+        ddcRateId = ddcRates.valueId(250e3);
+        if (config.conf["servers"][devConfName].contains("ddcSampleRate")) {
+            double sr = config.conf["servers"][devConfName]["ddcSampleRate"];
+            if (ddcRates.keyExists(sr)) { ddcRateId = ddcRates.keyId(sr); }
+        }
+
+        // The new client has no FFT yet
+        fftSize = 0;
+        fftRate = 0.0;
 
         // Set settings
         client->setSampleType(sampleTypeList[sampleTypeId]);
         client->setCompression(compression);
+        if (!fullIQ) { applyDDC(); }
+    }
+
+    void applyDDC() {
+        // Fall back to the full IQ if the server can't make the DDC, e.g. when it's wider than the source
+        if (!client->setDDC(fullIQ ? 0.0 : ddcRates[ddcRateId])) { fullIQ = true; }
+        updateFFT();
+    }
+
+    // While the DDC is active, the waterfall shows the whole baseband from the server's FFT instead of the narrow
+    // band of the DDC. Only the band of the DDC can be demodulated.
+    void updateFFT() {
+        bool remote = selected && connected() && client->isDDCActive();
+        int size = remote ? sigpath::iqFrontEnd.getFFTSize() : 0;
+        double rate = remote ? sigpath::iqFrontEnd.getFFTRate() : 0.0;
+
+        // Only ask again when the settings change so that a refused FFT isn't asked for on every frame
+        if (connected() && (size != fftSize || rate != fftRate)) {
+            client->setFFT(size, rate);
+        }
+        fftSize = size;
+        fftRate = rate;
+        remote = remote && (client->getFFTSize() == size);
+
+        // The local FFT only sees the DDC
+        sigpath::iqFrontEnd.setFFTEnabled(!remote);
+        if (remote) {
+            double bw = client->getBasebandSampleRate();
+            if (bw != gui::waterfall.getBandwidth()) {
+                gui::waterfall.setBandwidth(bw);
+                gui::waterfall.setViewOffset(0);
+                gui::waterfall.setViewBandwidth(bw);
+                gui::mainWindow.setViewBandwidthSlider(1.0);
+            }
+        }
+        else if (remoteFFT && selected && connected()) {
+            // Back to the band of the DDC
+            core::setInputSampleRate(client->getSampleRate());
+        }
+        remoteFFT = remote;
     }
 
     std::string name;
@@ -285,6 +370,16 @@ private:
     int sampleTypeId;
     bool compression = false;
 
+    OptionList<double, double> ddcRates;
+    int ddcRateId;
+    bool fullIQ = true;
+
+    // Server FFT shown on the waterfall, and the parameters last asked for
+    bool selected = false;
+    bool remoteFFT = false;
+    int fftSize = 0;
+    double fftRate = 0.0;
+
     std::shared_ptr<server::Client> client;
 };
 
@@ -3,6 +3,7 @@
 #include <cstring>
 #include <utils/flog.h>
 #include <core.h>
+#include <gui/gui.h>
 
 using namespace std::chrono_literals;
 
@@ -26,8 +27,9 @@ namespace server {
         s_cmd_hdr = (CommandHeader*)s_pkt_data;
         s_cmd_data = &sbuffer[sizeof(PacketHeader) + sizeof(CommandHeader)];
 
-        // Initialize decompressor
+        // Initialize decompressors, each VFO packet is a zstd frame of its own
         dctx = ZSTD_createDCtx();
+        vfoDctx = ZSTD_createDCtx();
 
         // Initialize DSP
         decompIn.setBufferSize(STREAM_BUFFER_SIZE*sizeof(dsp::complex_t) + 8);
@@ -61,6 +63,7 @@ namespace server {
     Client::~Client() {
         close();
         ZSTD_freeDCtx(dctx);
+        ZSTD_freeDCtx(vfoDctx);
         delete[] rbuffer;
         delete[] sbuffer;
     }
@@ -118,7 +121,74 @@ namespace server {
     }
 
     double Client::getSampleRate() {
-        return currentSampleRate;
+        double ddcRate = ddcSampleRate;
+        return ddcRate ? ddcRate : (double)currentSampleRate;
+    }
+
+    bool Client::setDDC(double sampleRate) {
+        if (!isOpen()) { return false; }
+        VFOParams params;
+        params.id = 0;
+
+        if (sampleRate > 0.0) {
+            // Stop the baseband first so that its samples don't get mixed with the VFO's
+            s_cmd_data[0] = false;
+            auto waiter = awaitCommandAck(COMMAND_SET_BASEBAND);
+            sendCommand(COMMAND_SET_BASEBAND, 1);
+            waiter->await(PROTOCOL_TIMEOUT_MS);
+            waiter->handled();
+
+            // Open the VFO on the server
+            params.sampleRate = sampleRate;
+            params.bandwidth = sampleRate;
+            params.offset = 0.0;
+            memcpy(s_cmd_data, &params, sizeof(VFOParams));
+            waiter = awaitCommandAck(COMMAND_ADD_VFO);
+            sendCommand(COMMAND_ADD_VFO, sizeof(VFOParams));
+            // The VFO's samples can follow the ack right away, they're only used once this is set
+            bool ok = waiter->await(PROTOCOL_TIMEOUT_MS);
+            if (ok) { ddcSampleRate = sampleRate; }
+            waiter->handled();
+            if (ok) {
+                core::setInputSampleRate(sampleRate);
+                return true;
+            }
+            flog::error("Server refused a {0} S/s DDC", sampleRate);
+        }
+        else if (ddcSampleRate) {
+            // Close the VFO before the baseband comes back
+            memcpy(s_cmd_data, &params.id, sizeof(uint32_t));
+            auto waiter = awaitCommandAck(COMMAND_REMOVE_VFO);
+            sendCommand(COMMAND_REMOVE_VFO, sizeof(uint32_t));
+            waiter->await(PROTOCOL_TIMEOUT_MS);
+            waiter->handled();
+        }
+
+        // Full baseband
+        ddcSampleRate = 0.0;
+        s_cmd_data[0] = true;
+        auto waiter = awaitCommandAck(COMMAND_SET_BASEBAND);
+        sendCommand(COMMAND_SET_BASEBAND, 1);
+        waiter->await(PROTOCOL_TIMEOUT_MS);
+        waiter->handled();
+        core::setInputSampleRate(currentSampleRate);
+        return sampleRate <= 0.0;
+    }
+
+    bool Client::setFFT(int size, double rate) {
+        if (!isOpen()) { return false; }
+        FFTParams params;
+        params.size = size;
+        params.rate = rate;
+        memcpy(s_cmd_data, &params, sizeof(FFTParams));
+        auto waiter = awaitCommandAck(COMMAND_SET_FFT);
+        sendCommand(COMMAND_SET_FFT, sizeof(FFTParams));
+        bool ok = waiter->await(PROTOCOL_TIMEOUT_MS);
+        remoteFFTSize = ok ? size : 0;
+        remoteFFTRate = ok ? rate : 0.0;
+        waiter->handled();
+        if (!ok) { flog::error("Server refused a {0} bins FFT at {1} FPS", size, rate); }
+        return ok;
     }
 
     void Client::setSampleType(dsp::compression::PCMType type) {
@@ -129,8 +199,11 @@ namespace server {
 
     void Client::setCompression(bool enabled) {
         if (!isOpen()) { return; }
-         s_cmd_data[0] = enabled;
-        sendCommand(COMMAND_SET_COMPRESSION, 1);
+        // Stream mode with the level tuned by the server
+        s_cmd_data[0] = enabled ? COMPRESSION_STREAM : COMPRESSION_NONE;
+        s_cmd_data[1] = 0;
+        resetDecompressor = true;
+        sendCommand(COMMAND_SET_COMPRESSION, 2);
     }
 
     void Client::start() {
@@ -180,25 +253,14 @@ namespace server {
             if (r_pkt_hdr->type == PACKET_TYPE_COMMAND) {
                 // TODO: Move to command handler
                 if (r_cmd_hdr->cmd == COMMAND_SET_SAMPLERATE && r_pkt_hdr->size == sizeof(PacketHeader) + sizeof(CommandHeader) + sizeof(double)) {
+                    // The DDC keeps its own samplerate whatever the source does
                     currentSampleRate = *(double*)r_cmd_data;
-                    core::setInputSampleRate(currentSampleRate);
+                    if (!ddcSampleRate) { core::setInputSampleRate(currentSampleRate); }
                 }
                 else if (r_cmd_hdr->cmd == COMMAND_DISCONNECT) {
                     flog::error("Asked to disconnect by the server");
                     serverBusy = true;
-
-                    // Cancel waiters
-                    std::vector<PacketWaiter*> toBeRemoved;
-                    for (auto& [waiter, cmd] : commandAckWaiters) {
-                        waiter->cancel();
-                        toBeRemoved.push_back(waiter);
-                    }
-
-                    // Remove handled waiters
-                    for (auto& waiter : toBeRemoved) {
-                        commandAckWaiters.erase(waiter);
-                        delete waiter;
-                    }
+                    cancelWaiters();
                 }
             }
             else if (r_pkt_hdr->type == PACKET_TYPE_COMMAND_ACK) {
@@ -221,13 +283,58 @@ namespace server {
                 if (!decompIn.swap(r_pkt_hdr->size - sizeof(PacketHeader))) { break; }
             }
             else if (r_pkt_hdr->type == PACKET_TYPE_BASEBAND_COMPRESSED) {
-                size_t outCount = ZSTD_decompressDCtx(dctx, decompIn.writeBuf, STREAM_BUFFER_SIZE*sizeof(dsp::complex_t)+8, r_pkt_data, r_pkt_hdr->size - sizeof(PacketHeader));
-                if (outCount) {
-                    if (!decompIn.swap(outCount)) { break; }
-                };
+                // The server starts a new zstd stream when the compression changes
+                if (resetDecompressor.exchange(false)) {
+                    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+                }
+
+                // Each packet is flushed by the server so it decompresses to whole samples
+                ZSTD_inBuffer input = { r_pkt_data, r_pkt_hdr->size - sizeof(PacketHeader), 0 };
+                ZSTD_outBuffer output = { decompIn.writeBuf, STREAM_BUFFER_SIZE*sizeof(dsp::complex_t)+8, 0 };
+                size_t err = 0;
+                while (input.pos < input.size && output.pos < output.size) {
+                    err = ZSTD_decompressStream(dctx, &output, &input);
+                    if (ZSTD_isError(err)) { break; }
+                }
+                if (ZSTD_isError(err)) {
+                    // Packets from before the reset can't be decoded, drop them until a new frame starts
+                    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+                    continue;
+                }
+                if (output.pos) {
+                    if (!decompIn.swap(output.pos)) { break; }
+                }
+            }
+            else if (r_pkt_hdr->type == PACKET_TYPE_VFO) {
+                // Only the DDC's VFO is used, it takes the place of the baseband
+                if (r_pkt_hdr->size < sizeof(PacketHeader) + sizeof(VFOHeader)) { continue; }
+                VFOHeader* vhdr = (VFOHeader*)r_pkt_data;
+                if (vhdr->id != 0 || !ddcSampleRate) { continue; }
+                uint8_t* vdata = &r_pkt_data[sizeof(VFOHeader)];
+                int vlen = r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(VFOHeader);
+                if (vhdr->compressed) {
+                    size_t ret = ZSTD_decompressDCtx(vfoDctx, decompIn.writeBuf, STREAM_BUFFER_SIZE*sizeof(dsp::complex_t)+8, vdata, vlen);
+                    if (ZSTD_isError(ret)) { continue; }
+                    vlen = ret;
+                }
+                else {
+                    memcpy(decompIn.writeBuf, vdata, vlen);
+                }
+                if (!decompIn.swap(vlen)) { break; }
+            }
+            else if (r_pkt_hdr->type == PACKET_TYPE_FFT) {
+                // Drawn in place of the DDC's spectrum, frames of another size than the waterfall's are from before a change
+                int count = (r_pkt_hdr->size - sizeof(PacketHeader)) / sizeof(float);
+                if (!ddcSampleRate || count != remoteFFTSize || count != gui::waterfall.getRawFFTSize()) { continue; }
+                float* buf = gui::waterfall.getFFTBuffer();
+                if (!buf) { continue; }
+                memcpy(buf, r_pkt_data, std::min<int>(count, gui::waterfall.getRawFFTSize()) * sizeof(float));
+                gui::waterfall.pushFFT();
             }
             else if (r_pkt_hdr->type == PACKET_TYPE_ERROR) {
+                // Errors replace the ack of the failed command, don't leave its caller waiting for it
                 flog::error("SDR++ Server Error: {0}", rbuffer[sizeof(PacketHeader)]);
+                cancelWaiters();
             }
             else {
                 flog::error("Invalid packet type: {0}", r_pkt_hdr->type);
@@ -274,6 +381,21 @@ namespace server {
         return waiter;
     }
 
+    void Client::cancelWaiters() {
+        // Cancel waiters
+        std::vector<PacketWaiter*> toBeRemoved;
+        for (auto& [waiter, cmd] : commandAckWaiters) {
+            waiter->cancel();
+            toBeRemoved.push_back(waiter);
+        }
+
+        // Remove handled waiters
+        for (auto& waiter : toBeRemoved) {
+            commandAckWaiters.erase(waiter);
+            delete waiter;
+        }
+    }
+
     void Client::dHandler(dsp::complex_t *data, int count, void *ctx) {
         Client* _this = (Client*)ctx;
         memcpy(_this->output->writeBuf, data, count * sizeof(dsp::complex_t));
@@ -85,6 +85,20 @@ namespace server {
 
         void setFrequency(double freq);
         double getSampleRate();
+
+        // Have the server compute a VFO of the given samplerate centered on the tuned frequency and stream it
+        // instead of the full baseband, 0 goes back to the full baseband. Returns false if the server refused it.
+        bool setDDC(double sampleRate);
+        inline bool isDDCActive() { return ddcSampleRate != 0.0; }
+
+        // Samplerate of the server's source, whether the DDC is active or not
+        inline double getBasebandSampleRate() { return currentSampleRate; }
+
+        // Have the server compute a spectrum of its whole baseband, its frames are drawn on the waterfall while
+        // the DDC is active. A size of 0 stops it. Returns false if the server refused it.
+        bool setFFT(int size, double rate);
+        inline int getFFTSize() { return remoteFFTSize; }
+        inline double getFFTRate() { return remoteFFTRate; }
         
         void setSampleType(dsp::compression::PCMType type);
         void setCompression(bool enabled);
@@ -109,6 +123,7 @@ namespace server {
 
         PacketWaiter* awaitCommandAck(Command cmd);
         void commandAckHandled(PacketWaiter* waiter);
+        void cancelWaiters();
         std::map<PacketWaiter*, Command> commandAckWaiters;
 
         static void dHandler(dsp::complex_t *data, int count, void *ctx);
@@ -137,10 +152,15 @@ namespace server {
         std::mutex dlMtx;
 
         ZSTD_DCtx* dctx;
+        ZSTD_DCtx* vfoDctx;
+        std::atomic<bool> resetDecompressor = false;
 
         std::thread workerThread;
 
-        double currentSampleRate = 1000000.0;
+        std::atomic<double> currentSampleRate = 1000000.0;
+        std::atomic<double> ddcSampleRate = 0.0;
+        std::atomic<int> remoteFFTSize = 0;
+        double remoteFFTRate = 0.0;
     };
 
     std::shared_ptr<Client> connect(std::string host, uint16_t port, dsp::stream<dsp::complex_t>* out);
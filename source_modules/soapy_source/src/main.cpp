@@ -501,7 +501,8 @@ private:
     }
 
     static void _worker(SoapyModule* _this) {
-        int blockSize = _this->sampleRate / 200.0f;
+        int blockSize = std::max<int>(_this->sampleRate / 200.0f, 1);
+        _this->stream.setBufferSize(blockSize);
         int flags = 0;
         long long timeMs = 0;
 
@@ -1,5 +1,6 @@
 #include <spyserver_client.h>
 #include <volk/volk.h>
+#include <dsp/convert/samples.h>
 #include <cstring>
 #include <utils/flog.h>
 #include <chrono>
@@ -114,9 +115,8 @@ namespace spyserver {
             _this->readSize(sizeof(SpyServerMessageHeader) - count, &buf[count]);
         }
 
-        int size = _this->readSize(_this->receivedHeader.BodySize, _this->readBuf);
-        if (size <= 0) {
-            flog::error("ERROR: Disconnected\n");
+        if (_this->receivedHeader.BodySize > SPYSERVER_MAX_MESSAGE_BODY_SIZE) {
+            flog::error("ERROR: Message too large\n");
             return;
         }
 
@@ -125,6 +125,22 @@ namespace spyserver {
         int mtype = _this->receivedHeader.MessageType & 0xFFFF;
         int mflags = (_this->receivedHeader.MessageType & 0xFFFF0000) >> 16;
 
+        // IQ samples are received straight into the output stream, at the end of its buffer if they have to be
+        // converted to its start
+        uint8_t* body = _this->readBuf;
+        if (mtype == SPYSERVER_MSG_TYPE_UINT8_IQ || mtype == SPYSERVER_MSG_TYPE_INT16_IQ) {
+            body = (uint8_t*)_this->output->rawWriteBuf(_this->receivedHeader.BodySize);
+        }
+        else if (mtype == SPYSERVER_MSG_TYPE_FLOAT_IQ) {
+            body = (uint8_t*)_this->output->writeBuf;
+        }
+
+        int size = _this->readSize(_this->receivedHeader.BodySize, body);
+        if (size <= 0) {
+            flog::error("ERROR: Disconnected\n");
+            return;
+        }
+
         if (mtype == SPYSERVER_MSG_TYPE_DEVICE_INFO) {
             {
                 std::lock_guard lck(_this->deviceInfoMtx);
@@ -138,16 +154,13 @@ namespace spyserver {
             int sampCount = _this->receivedHeader.BodySize / (sizeof(uint8_t) * 2);
             float gain = pow(10, (double)mflags / 20.0);
             float scale = 1.0f / (gain * 128.0f);
-            for (int i = 0; i < sampCount; i++) {
-                _this->output->writeBuf[i].re = ((float)_this->readBuf[(2 * i)] - 128.0f) * scale;
-                _this->output->writeBuf[i].im = ((float)_this->readBuf[(2 * i) + 1] - 128.0f) * scale;
-            }
+            dsp::convert::u8ToComplex(_this->output->writeBuf, body, sampCount, 128.0f, scale);
             _this->output->swap(sampCount);
         }
         else if (mtype == SPYSERVER_MSG_TYPE_INT16_IQ) {
             int sampCount = _this->receivedHeader.BodySize / (sizeof(int16_t) * 2);
             float gain = pow(10, (double)mflags / 20.0);
-            volk_16i_s32f_convert_32f((float*)_this->output->writeBuf, (int16_t*)_this->readBuf, 32768.0 * gain, sampCount * 2);
+            dsp::convert::i16ToComplex(_this->output->writeBuf, (int16_t*)body, sampCount, 1.0f / (32768.0f * gain));
             _this->output->swap(sampCount);
         }
         else if (mtype == SPYSERVER_MSG_TYPE_INT24_IQ) {
@@ -157,7 +170,7 @@ namespace spyserver {
         else if (mtype == SPYSERVER_MSG_TYPE_FLOAT_IQ) {
             int sampCount = _this->receivedHeader.BodySize / sizeof(dsp::complex_t);
             float gain = pow(10, (double)mflags / 20.0);
-            volk_32f_s32f_multiply_32f((float*)_this->output->writeBuf, (float*)_this->readBuf, gain, sampCount * 2);
+            volk_32f_s32f_multiply_32f((float*)_this->output->writeBuf, (float*)body, gain, sampCount * 2);
             _this->output->swap(sampCount);
         }
 
@@ -437,7 +437,8 @@ private:
 
     void worker() {
         // TODO: Select a better buffer size that will avoid bad timing
-        int bufferSize = sampleRate / 200;
+        int bufferSize = std::max<int>(sampleRate / 200, 1);
+        stream.setBufferSize(bufferSize);
         try {
             while (true) {
                 uhd::rx_metadata_t meta;